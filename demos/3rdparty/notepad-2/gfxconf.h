@@ -50,6 +50,8 @@
 #define GDISP_NEED_IMAGE_BMP		FALSE
 #define GDISP_NEED_IMAGE_JPG		FALSE
 #define GDISP_NEED_IMAGE_PNG		FALSE
+#define GDISP_NEED_IMAGE_ALPHA		TRUE
+#define GDISP_NEED_IMAGE_ATLAS		TRUE
 
 /* Features for the GWIN sub-system. */
 #define GWIN_NEED_BUTTON		TRUE
@@ -60,8 +60,9 @@ static GButtonObject btnPencil, btnFill, btnEraser;
 static GButtonObject btnClose;
 /* static GButtonObject btnYes, btnNo; // Reserved for future use */
 
-// Image object
+// Image object and the icons decoded from it
 static gdispImage toolbarImageFilmstrip;
+static gdispAtlas toolbarAtlas;
 
 static color_t myColors[] = { Black, Red, Green, Blue, Cyan, Magenta, Yellow, White };
 
@@ -195,18 +196,13 @@ static void nbtnColorBarSelDraw(GHandle gh, bool_t enabled, bool_t isdown, const
 				  NPAD_TOOLBAR_BTN_HEIGHT,
 				  ca);
 
-  	gdispImageSetBgColor(&toolbarImageFilmstrip, ca);
   	gdispDrawBox(gh->x + NPAD_TOOLBAR_BTN_WIDTH * i, gh->y,
   	             NPAD_TOOLBAR_BTN_WIDTH, NPAD_TOOLBAR_BTN_HEIGHT, cb);
 
   	/* Draw both the icons */
-  	gwinImageDraw(gh, &toolbarImageFilmstrip,
-  	              2 + NPAD_TOOLBAR_BTN_WIDTH * i,
-  	              2,
-  	              NPAD_ICON_WIDTH,
-  	              NPAD_ICON_HEIGHT,
-  	              NPAD_ICON_START(3 + i),
-  	              0);
+  	gdispAtlasDraw(&toolbarAtlas, 3 + i,
+  	               gh->x + 2 + NPAD_TOOLBAR_BTN_WIDTH * i,
+  	               gh->y + 2);
   }
 
   if (j)
@@ -220,9 +216,8 @@ static void nToolbarImageButtonDraw(GHandle gh, bool_t isenabled, bool_t isdown,
 
   color_t cl = isdown ? nCurColorScheme.toolbarBgActive : nCurColorScheme.toolbarBgUnsel;
 
-  gdispImageSetBgColor(&toolbarImageFilmstrip, cl);
   gdispFillArea(gh->x, gh->y, gh->width, gh->height, cl);
-  gwinImageDraw(gh, &toolbarImageFilmstrip, 2, 2, NPAD_ICON_WIDTH, NPAD_ICON_HEIGHT, NPAD_ICON_START((int) param), 0);
+  gdispAtlasDraw(&toolbarAtlas, (int) param, gh->x + 2, gh->y + 2);
 
   if (isdown || ((int)param - 5) == ncoreGetMode())
 	gdispDrawBox(gh->x, gh->y, gh->width, gh->height, nCurColorScheme.toolbarSeparator);
@@ -234,7 +229,7 @@ static void nCloseButtonDraw(GHandle gh, bool_t isenabled, bool_t isdown, const
   (void) txt;
   (void) pstyle;
   (void) param;
-  gwinImageDraw(gh, &toolbarImageFilmstrip, 0, 0, NPAD_ICON_WIDTH, NPAD_ICON_HEIGHT, NPAD_ICON_START(8), 0);
+  gdispAtlasDraw(&toolbarAtlas, 8, gh->x, gh->y);
 }
 
 static void initButtons(void) {
@@ -332,9 +327,11 @@ static DECLARE_THREAD_FUNCTION(notepadThread, param) {
 
   initButtons();
 
-  /* Configure the GIF decoder with the toolbar Icon images */
+  /* Decode the toolbar Icon images once - the icons are then drawn without decoding */
   gdispImageSetMemoryReader(&toolbarImageFilmstrip, toolbarIcons);
   gdispImageOpen(&toolbarImageFilmstrip);
+  gdispAtlasOpenGrid(&toolbarAtlas, &toolbarImageFilmstrip, NPAD_ICON_WIDTH, NPAD_ICON_HEIGHT);
+  gdispImageClose(&toolbarImageFilmstrip);
 
   /* Set clip to the entire screen */
   gdispSetClip(0, 0, swidth, sheight);
@@ -374,13 +371,9 @@ static DECLARE_THREAD_FUNCTION(notepadThread, param) {
                           NPAD_STATUSBAR_HEIGHT,
                           font);
 
-  gdispImageDraw(&toolbarImageFilmstrip,
+  gdispAtlasDraw(&toolbarAtlas, 12,
                  NPAD_STATUSBAR_ICON_START_X,
-                 NPAD_STATUSBAR_ICON_START_Y,
-                 NPAD_ICON_WIDTH,
-                 NPAD_ICON_HEIGHT,
-                 NPAD_ICON_START(12),
-                 0);
+                 NPAD_STATUSBAR_ICON_START_Y);
 
   gwinSetBgColor(ghc, nCurColorScheme.winBgColor);
   gwinSetColor(ghc, Black);
@@ -455,7 +448,7 @@ static DECLARE_THREAD_FUNCTION(notepadThread, param) {
   // No need to destroy the buttons as they are statically allocated
   gdispCloseFont(font);
   ncoreTerminateDrawThread();
-  gdispImageClose(&toolbarImageFilmstrip);
+  gdispAtlasClose(&toolbarAtlas);
 
   return 0;
 }
@@ -41,6 +41,10 @@
 #define GDISP_NEED_ELLIPSE			TRUE
 #define GDISP_NEED_ARC				FALSE
 #define GDISP_NEED_CONVEX_POLYGON	FALSE
+#define GDISP_NEED_GRADIENT			FALSE
+#define GDISP_NEED_CLIPREGION		FALSE
+#define GDISP_NEED_STATISTICS		FALSE
+#define GDISP_NEED_TRACE			FALSE
 #define GDISP_NEED_SCROLL			FALSE
 #define GDISP_NEED_PIXELREAD		FALSE
 #define GDISP_NEED_CONTROL			FALSE
@@ -52,6 +56,7 @@
 #define GDISP_NEED_ANTIALIAS		FALSE
 #define GDISP_NEED_UTF8				FALSE
 #define GDISP_NEED_TEXT_KERNING		FALSE
+#define GDISP_NEED_TEXT_LOADFONT	FALSE
 
 /* GDISP - fonts to include */
 #define GDISP_INCLUDE_FONT_DEJAVUSANS10			FALSE
@@ -81,6 +86,12 @@
 #define GDISP_NEED_IMAGE_JPG		FALSE
 #define GDISP_NEED_IMAGE_PNG		FALSE
 #define GDISP_NEED_IMAGE_ACCOUNTING	FALSE
+#define GDISP_NEED_IMAGE_GLOBAL_CACHE	FALSE
+#define GDISP_NEED_IMAGE_SCALING	FALSE
+#define GDISP_NEED_IMAGE_ALPHA		FALSE
+#define GDISP_NEED_IMAGE_ATLAS		FALSE
+#define GDISP_NEED_IMAGE_ASYNC		FALSE
+#define GDISP_NEED_IMAGE_PRELOAD	FALSE
 
 /* Optional image support that can be turned off */
 /*
@@ -94,6 +105,11 @@
 	#define GDISP_NEED_IMAGE_BMP_32		TRUE
 */
 
+/* Optional image support that can be turned on */
+/*
+	#define GDISP_NEED_IMAGE_GIF_PREDECODE	TRUE
+*/
+
 /* Features for the TDISP subsystem. */
 #define TDISP_NEED_MULTITHREAD	FALSE
 
@@ -153,6 +169,7 @@
 	#define GWIN_CONSOLE_USE_BASESTREAM		FALSE
 	#define GWIN_CONSOLE_USE_FLOAT			FALSE
 	#define GWIN_NEED_IMAGE_ANIMATION		FALSE
+	#define GWIN_NEED_IMAGE_ASYNC			FALSE
 */
 
 /* Optional Low Level Driver Definitions */
@@ -62,6 +62,12 @@ typedef enum fontmetric {fontHeight, fontDescendersHeight, fontLineSpacing, font
  * @brief   The type of a font.
  */
 typedef const struct mf_font_s* font_t;
+/**
+ * @brief   A range of characters to load from a font file.
+ */
+typedef struct gdispFontRange {
+	uint16_t	first, last;
+	} gdispFontRange;
 /**
  * @brief   Type for the screen orientation.
  */
@@ -70,6 +76,67 @@ typedef enum orientation {GDISP_ROTATE_0, GDISP_ROTATE_90, GDISP_ROTATE_180, GDI
  * @brief   Type for the available power modes for the screen.
  */
 typedef enum powermode {powerOff, powerSleep, powerDeepSleep, powerOn} gdisp_powermode_t;
+/**
+ * @brief   Type for the shape drawn where two thick line segments meet.
+ */
+typedef enum linejoin {joinMiter, joinRound, joinBevel} linejoin_t;
+/**
+ * @brief   Type for the shape drawn at the ends of a thick line.
+ */
+typedef enum linecap {capButt, capRound, capSquare} linecap_t;
+/**
+ * @brief   Type for the shape of a gradient fill.
+ */
+typedef enum gradient {gradientLinear, gradientRadial} gradient_t;
+/**
+ * @brief   Type for a rectangle in a clip region.
+ */
+typedef struct gdispRect {
+	coord_t		x0, y0;
+	coord_t		x1, y1;		/* not inclusive */
+	} gdispRect;
+/**
+ * @brief   Type for a clip region.
+ * @details	A set of non-overlapping rectangles sorted top to bottom then left to right.
+ */
+typedef struct gdispRegion {
+	unsigned	cnt;
+	gdispRect	rect[GDISP_CLIPREGION_RECTS];
+	} gdispRegion;
+/**
+ * @brief   The operations counted by the GDISP statistics.
+ */
+typedef enum gdispStatOp {
+	GDISP_STAT_CLEAR, GDISP_STAT_DRAWPIXEL, GDISP_STAT_DRAWLINE, GDISP_STAT_FILLAREA, GDISP_STAT_BLITAREA,
+	GDISP_STAT_DRAWCIRCLE, GDISP_STAT_FILLCIRCLE, GDISP_STAT_DRAWELLIPSE, GDISP_STAT_FILLELLIPSE,
+	GDISP_STAT_DRAWARC, GDISP_STAT_FILLARC, GDISP_STAT_SCROLL, GDISP_STAT_SETCLIP, GDISP_STAT_TEXT,
+	GDISP_STAT_COUNT
+	} gdispStatOp;
+/**
+ * @brief   The GDISP statistics for one operation.
+ */
+typedef struct gdispStat {
+	uint32_t		calls;			/* The number of API calls */
+	uint32_t		pixels;			/* The (approximate) number of pixels drawn */
+	uint32_t		emulated;		/* The number of software emulation calls, including those made by other emulated operations */
+	uint32_t		time;			/* The total GDISP_STATISTICS_COUNTER counts spent in the call (0 if it is not defined) */
+	} gdispStat;
+/**
+ * @brief   The function used to write GDISP trace data.
+ */
+typedef void (*gdispTraceWriteFn)(void *param, const void *buf, size_t len);
+/**
+ * @brief   The function used to read GDISP trace data. It returns the number of bytes read.
+ */
+typedef size_t (*gdispTraceReadFn)(void *param, void *buf, size_t len);
+/**
+ * @brief   The result of replaying a GDISP trace.
+ */
+typedef struct gdispTraceResult {
+	uint32_t		records;		/* The number of drawing records replayed */
+	uint32_t		captureMs;		/* The elapsed time when the trace was captured */
+	uint32_t		replayMs;		/* The elapsed time for the replay */
+	} gdispTraceResult;
 
 /*
  * This is not documented in Doxygen as it is meant to be a black-box.
@@ -544,23 +611,46 @@ extern "C" {
 
 	/* The same as above but use the low level driver directly if no multi-thread support is needed */
 	#define gdispIsBusy()										FALSE
-	#define gdispClear(color)									gdisp_lld_clear(color)
-	#define gdispDrawPixel(x, y, color)							gdisp_lld_draw_pixel(x, y, color)
-	#define gdispDrawLine(x0, y0, x1, y1, color)				gdisp_lld_draw_line(x0, y0, x1, y1, color)
-	#define gdispFillArea(x, y, cx, cy, color)					gdisp_lld_fill_area(x, y, cx, cy, color)
-	#define gdispBlitAreaEx(x, y, cx, cy, sx, sy, scx, buf)		gdisp_lld_blit_area_ex(x, y, cx, cy, sx, sy, scx, buf)
-	#define gdispSetClip(x, y, cx, cy)							gdisp_lld_set_clip(x, y, cx, cy)
-	#define gdispDrawCircle(x, y, radius, color)				gdisp_lld_draw_circle(x, y, radius, color)
-	#define gdispFillCircle(x, y, radius, color)				gdisp_lld_fill_circle(x, y, radius, color)
-	#define gdispDrawArc(x, y, radius, sangle, eangle, color)	gdisp_lld_draw_arc(x, y, radius, sangle, eangle, color)
-	#define gdispFillArc(x, y, radius, sangle, eangle, color)	gdisp_lld_fill_arc(x, y, radius, sangle, eangle, color)
-	#define gdispDrawEllipse(x, y, a, b, color)					gdisp_lld_draw_ellipse(x, y, a, b, color)
-	#define gdispFillEllipse(x, y, a, b, color)					gdisp_lld_fill_ellipse(x, y, a, b, color)
 	#define gdispGetPixelColor(x, y)							gdisp_lld_get_pixel_color(x, y)
-	#define gdispVerticalScroll(x, y, cx, cy, lines, bgcolor)	gdisp_lld_vertical_scroll(x, y, cx, cy, lines, bgcolor)
-	#define gdispControl(what, value)							gdisp_lld_control(what, value)
 	#define gdispQuery(what)									gdisp_lld_query(what)
 
+	#if GDISP_NEED_CONTROL && GDISP_NEED_TRACE
+		void gdispControl(unsigned what, void *value);
+	#else
+		#define gdispControl(what, value)						gdisp_lld_control(what, value)
+	#endif
+
+	#if GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE
+		/* These are clipped against the clip region, counted and/or traced before being passed to the low level driver */
+		void gdispClear(color_t color);
+		void gdispDrawPixel(coord_t x, coord_t y, color_t color);
+		void gdispDrawLine(coord_t x0, coord_t y0, coord_t x1, coord_t y1, color_t color);
+		void gdispFillArea(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color);
+		void gdispBlitAreaEx(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t srcx, coord_t srcy, coord_t srccx, const pixel_t *buffer);
+		void gdispSetClip(coord_t x, coord_t y, coord_t cx, coord_t cy);
+		void gdispDrawCircle(coord_t x, coord_t y, coord_t radius, color_t color);
+		void gdispFillCircle(coord_t x, coord_t y, coord_t radius, color_t color);
+		void gdispDrawArc(coord_t x, coord_t y, coord_t radius, coord_t startangle, coord_t endangle, color_t color);
+		void gdispFillArc(coord_t x, coord_t y, coord_t radius, coord_t startangle, coord_t endangle, color_t color);
+		void gdispDrawEllipse(coord_t x, coord_t y, coord_t a, coord_t b, color_t color);
+		void gdispFillEllipse(coord_t x, coord_t y, coord_t a, coord_t b, color_t color);
+		void gdispVerticalScroll(coord_t x, coord_t y, coord_t cx, coord_t cy, int lines, color_t bgcolor);
+	#else
+		#define gdispClear(color)									gdisp_lld_clear(color)
+		#define gdispDrawPixel(x, y, color)							gdisp_lld_draw_pixel(x, y, color)
+		#define gdispDrawLine(x0, y0, x1, y1, color)				gdisp_lld_draw_line(x0, y0, x1, y1, color)
+		#define gdispFillArea(x, y, cx, cy, color)					gdisp_lld_fill_area(x, y, cx, cy, color)
+		#define gdispBlitAreaEx(x, y, cx, cy, sx, sy, scx, buf)		gdisp_lld_blit_area_ex(x, y, cx, cy, sx, sy, scx, buf)
+		#define gdispSetClip(x, y, cx, cy)							gdisp_lld_set_clip(x, y, cx, cy)
+		#define gdispDrawCircle(x, y, radius, color)				gdisp_lld_draw_circle(x, y, radius, color)
+		#define gdispFillCircle(x, y, radius, color)				gdisp_lld_fill_circle(x, y, radius, color)
+		#define gdispDrawArc(x, y, radius, sangle, eangle, color)	gdisp_lld_draw_arc(x, y, radius, sangle, eangle, color)
+		#define gdispFillArc(x, y, radius, sangle, eangle, color)	gdisp_lld_fill_arc(x, y, radius, sangle, eangle, color)
+		#define gdispDrawEllipse(x, y, a, b, color)					gdisp_lld_draw_ellipse(x, y, a, b, color)
+		#define gdispFillEllipse(x, y, a, b, color)					gdisp_lld_fill_ellipse(x, y, a, b, color)
+		#define gdispVerticalScroll(x, y, cx, cy, lines, bgcolor)	gdisp_lld_vertical_scroll(x, y, cx, cy, lines, bgcolor)
+	#endif
+
 #endif
 
 /* These routines are not hardware accelerated
@@ -613,6 +703,303 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color);
 	 * @api
 	 */
 	void gdispFillConvexPoly(coord_t tx, coord_t ty, const point *pntarray, unsigned cnt, color_t color);
+
+	/**
+	 * @brief   Draw a line with a thickness
+	 * @details The line and any square caps are drawn as a single filled polygon. Round caps
+	 * 			are filled circles drawn over the ends of the line.
+	 *
+	 * @param[in] x0,y0		The start position
+	 * @param[in] x1,y1 	The end position
+	 * @param[in] color		The color to use
+	 * @param[in] width		The width of the line in pixels
+	 * @param[in] cap		The shape to draw at the two ends of the line
+	 *
+	 * @note	A width of 1 or less draws a normal (thin) line.
+	 * @note	capRound requires GDISP_NEED_CIRCLE. Without it capSquare is used instead.
+	 *
+	 * @api
+	 */
+	void gdispDrawThickLine(coord_t x0, coord_t y0, coord_t x1, coord_t y1, color_t color, coord_t width, linecap_t cap);
+
+	/**
+	 * @brief   Draw a series of connected lines with a thickness
+	 * @details Each segment is drawn as a filled polygon and the gap on the outside of each
+	 * 			corner is filled using the specified join. The line is not closed.
+	 *
+	 * @param[in] tx, ty	Transform all points in pntarray by tx, ty
+	 * @param[in] pntarray	An array of points
+	 * @param[in] cnt		The number of points in the array
+	 * @param[in] color		The color to use
+	 * @param[in] width		The width of the line in pixels
+	 * @param[in] join		The shape to draw where two segments meet
+	 * @param[in] cap		The shape to draw at the two ends of the line
+	 *
+	 * @note	joinMiter falls back to joinBevel for corners sharper than about 29 degrees.
+	 * @note	Pixels where segments, joins and round caps overlap are written more than once.
+	 * @note	joinRound and capRound require GDISP_NEED_CIRCLE. Without it joinMiter and
+	 * 			capSquare are used instead.
+	 *
+	 * @api
+	 */
+	void gdispDrawThickPolyline(coord_t tx, coord_t ty, const point *pntarray, unsigned cnt, color_t color, coord_t width, linejoin_t join, linecap_t cap);
+#endif
+
+/* Gradient Functions */
+
+#if GDISP_NEED_GRADIENT || defined(__DOXYGEN__)
+	/**
+	 * @brief   Fill an area with a color gradient.
+	 * @details For gradientLinear the color changes from start to end in the direction
+	 * 			of the angle. An angle of 0 goes from left to right and an angle of 90 goes
+	 * 			from bottom to top. For gradientRadial the color changes from start at the
+	 * 			center of the area to end at the corners and the angle is ignored.
+	 *
+	 * @param[in] x, y		The start position
+	 * @param[in] cx, cy	The size of the filled area
+	 * @param[in] start		The color at the start of the gradient
+	 * @param[in] end		The color at the end of the gradient
+	 * @param[in] type		The shape of the gradient
+	 * @param[in] angle		The direction of a linear gradient in degrees
+	 * @param[in] dither	Use an ordered dither to hide the color banding of low color depth displays
+	 *
+	 * @note	Undithered linear gradients at 0, 90, 180 or 270 degrees are drawn with
+	 * 			at most one area fill per column or row.
+	 * @note	Requires the maths library to be included in the link. ie  -lm
+	 *
+	 * @api
+	 */
+	void gdispFillGradient(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t start, color_t end, gradient_t type, coord_t angle, bool_t dither);
+#endif
+
+/* Clip Region Functions */
+
+#if GDISP_NEED_CLIPREGION || defined(__DOXYGEN__)
+	/**
+	 * @brief   Set a region to a single rectangle.
+	 *
+	 * @param[out] rgn		The region
+	 * @param[in] x, y		The start position
+	 * @param[in] cx, cy	The size of the rectangle. If either is zero the region is empty.
+	 *
+	 * @api
+	 */
+	void gdispRegionSet(gdispRegion *rgn, coord_t x, coord_t y, coord_t cx, coord_t cy);
+
+	/**
+	 * @brief   Intersect a region with a rectangle.
+	 *
+	 * @param[in,out] rgn	The region
+	 * @param[in] x, y		The start position
+	 * @param[in] cx, cy	The size of the rectangle
+	 *
+	 * @api
+	 */
+	void gdispRegionIntersect(gdispRegion *rgn, coord_t x, coord_t y, coord_t cx, coord_t cy);
+
+	/**
+	 * @brief   Intersect a region with another region.
+	 *
+	 * @param[in,out] rgn	The region
+	 * @param[in] other		The region to intersect with
+	 *
+	 * @return	FALSE if the result needs more than GDISP_CLIPREGION_RECTS rectangles.
+	 * 			In that case the region is left unchanged.
+	 *
+	 * @api
+	 */
+	bool_t gdispRegionIntersectRegion(gdispRegion *rgn, const gdispRegion *other);
+
+	/**
+	 * @brief   Remove a rectangle from a region.
+	 *
+	 * @param[in,out] rgn	The region
+	 * @param[in] x, y		The start position
+	 * @param[in] cx, cy	The size of the rectangle
+	 *
+	 * @return	FALSE if the result needs more than GDISP_CLIPREGION_RECTS rectangles.
+	 * 			In that case the region is left unchanged.
+	 *
+	 * @api
+	 */
+	bool_t gdispRegionSubtract(gdispRegion *rgn, coord_t x, coord_t y, coord_t cx, coord_t cy);
+
+	/**
+	 * @brief   Restrict all following drawing to a region.
+	 * @details	The region is intersected with the current top of the clip stack (if any)
+	 * 			and the result is pushed on the stack. Drawing is also still clipped by
+	 * 			gdispSetClip().
+	 *
+	 * @param[in] rgn		The region
+	 *
+	 * @return	FALSE if the clip stack is full or the intersection is too complex.
+	 * 			In that case nothing is pushed and gdispPopClip() must not be called.
+	 *
+	 * @note	The clip stack is shared by all threads.
+	 * @note	gdispClear(), gdispVerticalScroll() and gdispGetPixelColor() ignore the clip region.
+	 *
+	 * @api
+	 */
+	bool_t gdispPushClip(const gdispRegion *rgn);
+
+	/**
+	 * @brief   Remove the clip region added by the last successful gdispPushClip().
+	 *
+	 * @api
+	 */
+	void gdispPopClip(void);
+#endif
+
+/* Statistics Functions */
+
+#if GDISP_NEED_STATISTICS || defined(__DOXYGEN__)
+	/**
+	 * @brief   Get the statistics for an operation.
+	 *
+	 * @param[in] op		The operation
+	 * @param[out] pstat	The statistics are returned here
+	 *
+	 * @note	Times are only measured if GDISP_STATISTICS_COUNTER is defined and are inclusive. For example the time spent filling the background
+	 * 			of a string is counted both for GDISP_STAT_TEXT and GDISP_STAT_FILLAREA.
+	 * @note	The emulated count is incremented every time the low level driver
+	 * 			falls back to software emulation for the operation, including when it
+	 * 			is called from the emulation of another operation.
+	 *
+	 * @api
+	 */
+	void gdispGetStats(gdispStatOp op, gdispStat *pstat);
+
+	/**
+	 * @brief   Reset all the statistics to zero.
+	 *
+	 * @api
+	 */
+	void gdispResetStats(void);
+
+	/**
+	 * @brief   Get a printable name for an operation.
+	 *
+	 * @param[in] op		The operation
+	 *
+	 * @api
+	 */
+	const char *gdispGetStatName(gdispStatOp op);
+
+	#if GFX_USE_OS_WIN32 || GFX_USE_OS_LINUX || GFX_USE_OS_OSX || defined(__DOXYGEN__)
+		/**
+		 * @brief   Print the statistics to stderr.
+		 *
+		 * @api
+		 */
+		void gdispDumpStats(void);
+	#endif
+#endif
+
+/* Trace Functions */
+
+#if GDISP_NEED_TRACE || defined(__DOXYGEN__)
+	/**
+	 * @brief   Start recording all drawing calls to a trace.
+	 * @details	Each call is written as a record whose type is the matching GDISP_LLD_MSG_xxx
+	 * 			action value, followed by its arguments. Coordinates are 16 bit little endian
+	 * 			and colors are 24 bit RGB so a trace can be replayed on a display with a
+	 * 			different color format.
+	 * @note	Blit buffers are recorded once by content hash and then referred to by that hash.
+	 * 			Text is recorded as the drawing calls it produces so fonts are not needed to replay it.
+	 *
+	 * @param[in] fn		The function to write the trace data
+	 * @param[in] param		A parameter passed to the write function
+	 *
+	 * @api
+	 */
+	void gdispTraceStart(gdispTraceWriteFn fn, void *param);
+
+	/**
+	 * @brief   Stop recording the trace.
+	 *
+	 * @api
+	 */
+	void gdispTraceStop(void);
+
+	/**
+	 * @brief   Replay a trace on the current display.
+	 * @return	FALSE if the trace is invalid or uses an operation this build does not support.
+	 *
+	 * @param[in] fn		The function to read the trace data
+	 * @param[in] param		A parameter passed to the read function
+	 * @param[out] pres		The record count and timing are returned here. It can be NULL.
+	 *
+	 * @note	The replay runs as fast as possible. Combine it with GDISP_NEED_STATISTICS to
+	 * 			get the time spent in each operation.
+	 *
+	 * @api
+	 */
+	bool_t gdispTraceReplay(gdispTraceReadFn fn, void *param, gdispTraceResult *pres);
+#endif
+
+/* Anti-aliased Drawing Functions */
+
+#if GDISP_NEED_ANTIALIAS || defined(__DOXYGEN__)
+	/**
+	 * @brief   Draw an anti-aliased line.
+	 * @details The edge pixels are blended against the specified background color.
+	 * 			Nothing is read back from the display.
+	 *
+	 * @param[in] x0, y0	The start position
+	 * @param[in] x1, y1	The end position
+	 * @param[in] color		The color to use
+	 * @param[in] bgcolor	The background color to blend with
+	 *
+	 * @api
+	 */
+	void gdispDrawLineAA(coord_t x0, coord_t y0, coord_t x1, coord_t y1, color_t color, color_t bgcolor);
+
+	#if GDISP_NEED_CIRCLE || defined(__DOXYGEN__)
+		/**
+		 * @brief   Draw an anti-aliased circle.
+		 * @details The edge pixels are blended against the specified background color.
+		 *
+		 * @param[in] x, y		The center of the circle
+		 * @param[in] radius	The radius of the circle
+		 * @param[in] color		The color to use
+		 * @param[in] bgcolor	The background color to blend with
+		 *
+		 * @api
+		 */
+		void gdispDrawCircleAA(coord_t x, coord_t y, coord_t radius, color_t color, color_t bgcolor);
+	#endif
+
+	#if GDISP_NEED_ELLIPSE || defined(__DOXYGEN__)
+		/**
+		 * @brief   Draw an anti-aliased ellipse.
+		 * @details The edge pixels are blended against the specified background color.
+		 *
+		 * @param[in] x, y		The center of the ellipse
+		 * @param[in] a, b		The dimensions of the ellipse
+		 * @param[in] color		The color to use
+		 * @param[in] bgcolor	The background color to blend with
+		 *
+		 * @api
+		 */
+		void gdispDrawEllipseAA(coord_t x, coord_t y, coord_t a, coord_t b, color_t color, color_t bgcolor);
+	#endif
+
+	#if GDISP_NEED_ARC || defined(__DOXYGEN__)
+		/**
+		 * @brief   Draw an anti-aliased arc.
+		 * @details The edge pixels are blended against the specified background color.
+		 *
+		 * @param[in] x, y			The center point
+		 * @param[in] radius		The radius of the arc
+		 * @param[in] startangle	The start angle (0 to 360)
+		 * @param[in] endangle		The end angle (0 to 360)
+		 * @param[in] color			The color to use
+		 * @param[in] bgcolor		The background color to blend with
+		 *
+		 * @api
+		 */
+		void gdispDrawArcAA(coord_t x, coord_t y, coord_t radius, coord_t startangle, coord_t endangle, color_t color, color_t bgcolor);
+	#endif
 #endif
 
 /* Text Functions */
@@ -789,6 +1176,41 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color);
 	 * @api
 	 */
 	const char *gdispGetFontName(font_t font);
+
+	#if GDISP_NEED_TEXT_LOADFONT || defined(__DOXYGEN__)
+		/**
+		 * @brief	Load a BDF font from a file.
+		 * @details	The font is converted into a mcufont black and white font in RAM.
+		 * @return	The font or NULL if the file could not be read or has no wanted characters.
+		 *
+		 * @param[in] filename	The BDF file to load.
+		 * @param[in] ranges	The characters to load or NULL to load every character.
+		 * @param[in] count		The number of ranges.
+		 *
+		 * @note	Use gdispCloseFont() to free the font.
+		 * @note	The short font name is the file name without its path or extension.
+		 * @note	Only available on operating systems with a file system (Win32, Linux and OSX).
+		 *
+		 * @api
+		 */
+		font_t gdispLoadFont(const char *filename, const gdispFontRange *ranges, unsigned count);
+
+		/**
+		 * @brief	Load a BDF font from memory.
+		 * @details	The font is converted into a mcufont black and white font in RAM.
+		 * @return	The font or NULL if the data could not be read or has no wanted characters.
+		 *
+		 * @param[in] data		The BDF text.
+		 * @param[in] size		The length of the BDF text.
+		 * @param[in] ranges	The characters to load or NULL to load every character.
+		 * @param[in] count		The number of ranges.
+		 *
+		 * @note	Use gdispCloseFont() to free the font. The BDF text is not needed after loading.
+		 *
+		 * @api
+		 */
+		font_t gdispLoadFontFromMemory(const void *data, size_t size, const gdispFontRange *ranges, unsigned count);
+	#endif
 #endif
 
 /* Extra Arc Functions */
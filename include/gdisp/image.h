@@ -48,6 +48,14 @@ typedef uint16_t	gdispImageFlags;
 	#define GDISP_IMAGE_FLG_TRANSPARENT			0x0001	/* The image has transparency */
 	#define GDISP_IMAGE_FLG_ANIMATED			0x0002	/* The image has animation */
 	#define GDISP_IMAGE_FLG_MULTIPAGE			0x0004	/* The image has multiple pages */
+	#define GDISP_IMAGE_FLG_CACHED				0x0008	/* gdispImageCache() has cached the image */
+
+/**
+ * @brief	Image scaling filters
+ */
+typedef uint8_t	gdispImageFilter;
+	#define GDISP_IMAGE_FILTER_NEAREST			0		/* Use the nearest source pixel */
+	#define GDISP_IMAGE_FILTER_BILINEAR			1		/* Interpolate between the 4 nearest source pixels */
 
 struct gdispImageIO;
 
@@ -80,10 +88,25 @@ typedef size_t (*gdispImageIOReadFn)(struct gdispImageIO *pio, void *buf, size_t
  */
 typedef void (*gdispImageIOSeekFn)(struct gdispImageIO *pio, size_t pos);
 
+/**
+ * @brief	An image IO get pointer function
+ * @returns	A pointer to the bytes or NULL if they can't be accessed directly
+ *
+ * @param[in] pio	Pointer to the io structure
+ * @param[in] pos	Which byte to start at relative to the start of the "file".
+ * @param[in] len	The number of bytes that must be accessible through the pointer
+ *
+ * @note	This doesn't change the current "file" position.
+ * @note	This function is optional. Decoders use it to draw directly from
+ * 			images that are in memory (RAM, Flash or memory mapped files).
+ */
+typedef const void *(*gdispImageIOGetPtrFn)(struct gdispImageIO *pio, size_t pos, size_t len);
+
 typedef struct gdispImageIOFunctions {
 	gdispImageIOReadFn			read;				/* @< The function to read input */
 	gdispImageIOSeekFn			seek;				/* @< The function to seek input */
 	gdispImageIOCloseFn			close;				/* @< The function to close input */
+	gdispImageIOGetPtrFn		getptr;				/* @< The function to get a pointer to the input (optional - can be NULL) */
 	} gdispImageIOFunctions;
 
 /**
@@ -95,6 +118,74 @@ typedef struct gdispImageIO {
 	const gdispImageIOFunctions	*fns;				/* @< The current "file" functions */
 } gdispImageIO;
 
+/**
+ * @brief	Where a decoder sends whole rows of the image when drawing scaled
+ * @note	The decoder calls row() for each needed row in increasing order and may stop
+ * 			after the row @p last. Rows that aren't needed may be skipped or only
+ * 			partially decoded. If row() returns FALSE the decoder stops and returns
+ * 			GDISP_IMAGE_ERR_OK.
+ */
+typedef struct gdispImageRowSink {
+	bool_t			(*row)(struct gdispImageRowSink *sink, coord_t y, const pixel_t *pixels);	/* @< Receives row y (the full image width) */
+	const uint8_t	*need;			/* @< One bit per image row (LSB first) set if the row is needed */
+	coord_t			last;			/* @< The last row needed */
+	pixel_t			*buf;			/* @< A buffer of the image width the decoder may use for the row */
+} gdispImageRowSink;
+
+#define gdispImageRowNeeded(sink, y)	((sink)->need[(y)>>3] & (1<<((y)&7)))
+
+/**
+ * @brief	Is the image drawn using its alpha channel
+ * @note	When TRUE a decoded image is followed by width*height alpha values (0 to 255)
+ * 			and its pixels are not blended with the background color.
+ */
+#if GDISP_NEED_IMAGE_ALPHA || defined(__DOXYGEN__)
+	#define gdispImageHasAlpha(img)		(((img)->flags & GDISP_IMAGE_FLG_TRANSPARENT) != 0)
+#else
+	#define gdispImageHasAlpha(img)		FALSE
+#endif
+
+#if GDISP_NEED_IMAGE_GLOBAL_CACHE || defined(__DOXYGEN__)
+	/**
+	 * @brief	The statistics for the global image cache
+	 */
+	typedef struct gdispImageCacheStats {
+		uint32_t	hits;				/* @< Draws that were done from the cache */
+		uint32_t	misses;				/* @< Draws that didn't find the image in the cache */
+		uint32_t	evictions;			/* @< Images thrown away to make room or by a flush */
+		uint32_t	entries;			/* @< The number of images currently in the cache */
+		size_t		used;				/* @< The number of bytes currently used */
+		size_t		budget;				/* @< The maximum number of bytes to use */
+	} gdispImageCacheStats;
+#endif
+
+#if GDISP_NEED_IMAGE_ATLAS || defined(__DOXYGEN__)
+	/**
+	 * @brief	An area of an atlas image
+	 */
+	typedef struct gdispAtlasRect {
+		const char *		name;				/* @< The name of the area (can be NULL) */
+		coord_t				x, y;				/* @< The position of the area in the image */
+		coord_t				width, height;		/* @< The size of the area */
+	} gdispAtlasRect;
+
+	/**
+	 * @brief	An image decoded once so that areas of it can be drawn without decoding
+	 */
+	typedef struct gdispAtlas {
+		coord_t					width, height;			/* @< The image dimensions */
+		const gdispAtlasRect *	rects;					/* @< The areas (or NULL for a grid) */
+		unsigned				count;					/* @< The number of areas */
+		coord_t					cellwidth, cellheight;	/* @< The grid cell size (if rects is NULL) */
+		color_t					bgcolor;				/* @< The image background color when decoded */
+		pixel_t *				pixels;					/* @< The decoded image */
+		#if GDISP_NEED_IMAGE_ALPHA
+			const uint8_t *		alpha;					/* @< The alpha values (if any) */
+		#endif
+		size_t					size;					/* @< The size of the decoded image */
+	} gdispAtlas;
+#endif
+
 /**
  * @brief	The structure for an image
  */
@@ -111,6 +202,45 @@ typedef struct gdispImage {
 	const struct gdispImageHandlers *	fns;				/* @< Don't mess with this! */
 	struct gdispImagePrivate *			priv;				/* @< Don't mess with this! */
 } gdispImage;
+
+#if GDISP_NEED_IMAGE_ASYNC || defined(__DOXYGEN__)
+	/**
+	 * @brief	Flags for gdispImageDrawAsync()
+	 */
+	#define GDISP_IMAGE_ASYNC_PROGRESSIVE		0x01	/* @< Draw every few rows first and then fill in the rest */
+
+	/**
+	 * @brief	An image being drawn by a background thread
+	 */
+	typedef struct gdispImageAsync {
+		gdispImage *					img;		/* @< The image being drawn */
+		gdispImageError					result;		/* @< The result of the draw once it has finished */
+		struct gdispImageAsyncPrivate *	priv;		/* @< Don't mess with this! */
+	} gdispImageAsync;
+#endif
+
+#if GDISP_NEED_IMAGE_PRELOAD || defined(__DOXYGEN__)
+	/**
+	 * @brief	An image or font to load with gdispImagePreload()
+	 */
+	typedef struct gdispPreloadAsset {
+		gdispImage *		img;			/* @< The image to open and cache (its reader must be set) or NULL for a font */
+		const char *		fontname;		/* @< The name of the font to open if img is NULL */
+		font_t				font;			/* @< The font once it has been opened */
+		gdispImageError		result;			/* @< The result of loading the asset */
+		size_t				memory;			/* @< The RAM used by the asset once loaded */
+	} gdispPreloadAsset;
+
+	/**
+	 * @brief	The progress callback for gdispImagePreload()
+	 *
+	 * @param[in] param		The parameter passed to gdispImagePreload()
+	 * @param[in] done		The number of assets loaded so far
+	 * @param[in] count		The total number of assets
+	 * @param[in] memory	The RAM used by the assets loaded so far
+	 */
+	typedef void (*gdispPreloadCallback)(void *param, unsigned done, unsigned count, size_t memory);
+#endif
 	
 #ifdef __cplusplus
 extern "C" {
@@ -155,11 +285,35 @@ extern "C" {
 		 * @param[in] img   	The image structure
 		 * @param[in] filename	The filename to open
 		 *
+		 * @note	On Linux and OSX the file is memory mapped if possible so that decoders
+		 * 			can read the image without copying it. If the file can't be mapped
+		 * 			normal file reads are used instead.
 		 */
 		bool_t gdispImageSetFileReader(gdispImage *img, const char *filename);
 		/* Old definition */
 		#define gdispImageSetSimulFileReader(img, fname)	gdispImageSetFileReader(img, fname)
 	#endif
+
+	/**
+	 * @brief	Adds a read-ahead buffer to the io routines already set in the image structure.
+	 *
+	 * @return	TRUE if the buffer could be allocated
+	 *
+	 * @param[in] img   	The image structure
+	 * @param[in] bufsize	The size of the read-ahead buffer in bytes. Use 0 for the default
+	 * 						(GDISP_IMAGE_IO_BUFFER_SIZE).
+	 *
+	 * @pre		One of the gdispImageSetXxxReader() functions must have been called successfully first.
+	 * @note	Reads smaller than the buffer are satisfied from the buffer and seeks are only
+	 * 			passed to the underlying reader when a read falls outside the buffer. This makes
+	 * 			the many small reads and seeks the decoders do much cheaper on slow file systems.
+	 * @note	Readers that already have direct access to the image data, such as the memory
+	 * 			reader and mapped files, are left unbuffered as a buffer would only add copying.
+	 * @note	If this returns FALSE the original io routines are left in place so the image can
+	 * 			still be used unbuffered.
+	 * @note	The buffer is freed when the image is closed.
+	 */
+	bool_t gdispImageSetBufferedReader(gdispImage *img, size_t bufsize);
 	
 	/**
 	 * @brief	Open an image ready for drawing
@@ -218,6 +372,8 @@ extern "C" {
 	 *
 	 * @note	This color is only used when an image has to restore part of the background before
 	 * 			continuing with drawing that includes transparency eg some GIF animations.
+	 * @note	Transparent pixels in PNG images are also blended with this color unless
+	 * 			GDISP_NEED_IMAGE_ALPHA is TRUE.
 	 */
 	void gdispImageSetBgColor(gdispImage *img, color_t bgcolor);
 	
@@ -256,9 +412,214 @@ extern "C" {
 	 * 			fast blit from the cached frame. If not, it reads the input and decodes it as it
 	 * 			is drawing. This may be significantly slower than if the image has been cached (but
 	 * 			uses a lot less RAM)
+	 * @note	If GDISP_NEED_IMAGE_GLOBAL_CACHE is TRUE, still images from memory or a file reader are
+	 * 			decoded into the global image cache (if it has room) and drawn from there. Images
+	 * 			already cached with @p gdispImageCache() don't use the global cache.
+	 * @note	Images in memory are found in the global cache by their address. If a RAM buffer is
+	 * 			reused for a different image call @p gdispImageGlobalCacheFlush() first.
 	 */
 	gdispImageError gdispImageDraw(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy);
 
+	#if GDISP_NEED_IMAGE_SCALING || defined(__DOXYGEN__)
+		/**
+		 * @brief	Draw the whole image scaled to fit an area
+		 * @return	GDISP_IMAGE_ERR_OK (0) on success or an error code.
+		 *
+		 * @param[in] img		The image structure
+		 * @param[in] x,y		The screen location to draw the image
+		 * @param[in] cx,cy		The size to draw the image at
+		 * @param[in] filter	GDISP_IMAGE_FILTER_NEAREST or GDISP_IMAGE_FILTER_BILINEAR
+		 *
+		 * @pre		gdispImageOpen() must have returned successfully.
+		 *
+		 * @note	The image is decoded one row at a time and only the source rows the output
+		 * 			needs are converted. When shrinking an image, rows that aren't needed
+		 * 			are skipped where the image format allows it.
+		 * @note	Decoders that can't produce single rows (eg interlaced PNG or RLE BMP) decode
+		 * 			the whole image into a temporary buffer first. Animated images aren't supported
+		 * 			and return GDISP_IMAGE_ERR_UNSUPPORTED.
+		 * @note	Bilinear filtering only looks at the 4 nearest source pixels so shrinking by
+		 * 			more than half still drops detail.
+		 * @note	Scaled images are always drawn opaque. Transparent pixels are blended with
+		 * 			the image background color.
+		 */
+		gdispImageError gdispImageDrawScaled(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, gdispImageFilter filter);
+	#endif
+
+	#if GDISP_NEED_IMAGE_GLOBAL_CACHE || defined(__DOXYGEN__)
+		/**
+		 * @brief	Set the memory budget of the global image cache.
+		 *
+		 * @param[in] bytes		The maximum number of bytes of decoded images to keep. 0 turns the cache off.
+		 *
+		 * @note	Images are thrown away (least recently drawn first) until the cache fits.
+		 */
+		void gdispImageGlobalCacheSetBudget(size_t bytes);
+
+		/**
+		 * @brief	Throw away all the images in the global image cache.
+		 *
+		 * @note	Images in memory are identified by their address. Call this if you change
+		 * 			the contents of an image in RAM. Files are identified by their device, inode,
+		 * 			size and modification time.
+		 */
+		void gdispImageGlobalCacheFlush(void);
+
+		/**
+		 * @brief	Get the global image cache statistics.
+		 *
+		 * @param[out] pstats	Where to put the statistics
+		 */
+		void gdispImageGlobalCacheGetStats(gdispImageCacheStats *pstats);
+
+		/**
+		 * @brief	Reset the hit, miss and eviction counts of the global image cache.
+		 */
+		void gdispImageGlobalCacheResetStats(void);
+	#endif
+
+	#if GDISP_NEED_IMAGE_ASYNC || defined(__DOXYGEN__)
+		/**
+		 * @brief	Start drawing an image on a background thread.
+		 * @return	GDISP_IMAGE_ERR_OK (0) if the draw has started or an error code.
+		 *
+		 * @param[out] pa		The structure to keep track of the draw
+		 * @param[in] img		The image structure
+		 * @param[in] x,y		The screen location to draw the image
+		 * @param[in] cx,cy		The area on the screen to draw
+		 * @param[in] sx,sy		The image position to start drawing at
+		 * @param[in] flags		0 or GDISP_IMAGE_ASYNC_PROGRESSIVE
+		 *
+		 * @pre		gdispImageOpen() must have returned successfully.
+		 *
+		 * @note	The image is decoded by a low priority thread a band of rows at a time. Each band is
+		 * 			drawn by the next call to gdispImageAsyncPoll() so the calling thread can keep
+		 * 			handling input and only it draws on the display.
+		 * @note	With GDISP_IMAGE_ASYNC_PROGRESSIVE a coarse version of the area (every 8th row
+		 * 			repeated) is drawn first. It is quick for images that can skip rows (native and BMP)
+		 * 			but PNG images must still decompress every row.
+		 * @note	The image must not be used in any other way until gdispImageAsyncPoll() returns TRUE
+		 * 			or gdispImageAsyncCancel() is called.
+		 * @note	Transparent pixels are blended with the image background color.
+		 */
+		gdispImageError gdispImageDrawAsync(gdispImageAsync *pa, gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy, uint8_t flags);
+
+		/**
+		 * @brief	Draw any rows of a background image draw that are ready.
+		 * @return	TRUE once the draw has finished. The result is then in pa->result.
+		 *
+		 * @param[in] pa		The structure passed to gdispImageDrawAsync()
+		 * @param[in] ms		How long to wait for the first band of rows. Use TIME_IMMEDIATE to not wait.
+		 *
+		 * @note	Call this regularly, eg from a timer or the event loop, until it returns TRUE.
+		 */
+		bool_t gdispImageAsyncPoll(gdispImageAsync *pa, delaytime_t ms);
+
+		/**
+		 * @brief	Stop a background image draw.
+		 *
+		 * @param[in] pa		The structure passed to gdispImageDrawAsync()
+		 *
+		 * @note	This waits for the decoder to stop. Rows that have not been drawn are thrown away.
+		 * @note	It is safe to call this after the draw has finished.
+		 */
+		void gdispImageAsyncCancel(gdispImageAsync *pa);
+	#endif
+
+	#if GDISP_NEED_IMAGE_ATLAS || defined(__DOXYGEN__)
+		/**
+		 * @brief	Decode an image into an atlas of named areas.
+		 * @return	GDISP_IMAGE_ERR_OK (0) on success or an error code.
+		 *
+		 * @param[out] atlas	The atlas structure
+		 * @param[in] img		The image structure
+		 * @param[in] rects		The areas of the image. This array must stay valid until the atlas is closed.
+		 * @param[in] count		The number of areas
+		 *
+		 * @pre		gdispImageOpen() must have returned successfully.
+		 *
+		 * @note	The current frame is decoded once into RAM in the display pixel format. The image
+		 * 			can be closed afterwards.
+		 * @note	If GDISP_NEED_IMAGE_GLOBAL_CACHE is TRUE the decoded image counts against the global
+		 * 			image cache budget and older cached images are thrown away to make room.
+		 * @note	Transparent pixels are blended with the image background color unless
+		 * 			GDISP_NEED_IMAGE_ALPHA is TRUE.
+		 * @note	Images whose decoder can't decode a whole frame (eg native images) return
+		 * 			GDISP_IMAGE_ERR_UNSUPPORTED.
+		 */
+		gdispImageError gdispAtlasOpen(gdispAtlas *atlas, gdispImage *img, const gdispAtlasRect *rects, unsigned count);
+
+		/**
+		 * @brief	Decode an image into an atlas of equally sized areas.
+		 * @return	GDISP_IMAGE_ERR_OK (0) on success or an error code.
+		 *
+		 * @param[out] atlas		The atlas structure
+		 * @param[in] img			The image structure
+		 * @param[in] cellwidth		The width of each area
+		 * @param[in] cellheight	The height of each area
+		 *
+		 * @pre		gdispImageOpen() must have returned successfully.
+		 *
+		 * @note	The areas are numbered left to right and then top to bottom. A filmstrip of
+		 * 			16x16 icons is gdispAtlasOpenGrid(&atlas, &img, 16, 16).
+		 * @note	See gdispAtlasOpen() for how the image is decoded.
+		 */
+		gdispImageError gdispAtlasOpenGrid(gdispAtlas *atlas, gdispImage *img, coord_t cellwidth, coord_t cellheight);
+
+		/**
+		 * @brief	Free the decoded image of an atlas.
+		 *
+		 * @param[in] atlas		The atlas structure
+		 */
+		void gdispAtlasClose(gdispAtlas *atlas);
+
+		/**
+		 * @brief	Find an area of an atlas by name.
+		 * @return	The area id or -1 if there is no area with that name.
+		 *
+		 * @param[in] atlas		The atlas structure
+		 * @param[in] name		The area name
+		 *
+		 * @note	Look up the ids once rather than before every draw.
+		 */
+		int gdispAtlasFind(gdispAtlas *atlas, const char *name);
+
+		/**
+		 * @brief	Draw an area of an atlas.
+		 * @return	GDISP_IMAGE_ERR_OK (0) on success or an error code.
+		 *
+		 * @param[in] atlas		The atlas structure
+		 * @param[in] id		The area id (its index in the areas or grid)
+		 * @param[in] x,y		The screen location to draw the area
+		 *
+		 * @note	This is a straight blit from the decoded image.
+		 * @note	An id that isn't in the atlas returns GDISP_IMAGE_ERR_BADDATA.
+		 */
+		gdispImageError gdispAtlasDraw(gdispAtlas *atlas, unsigned id, coord_t x, coord_t y);
+	#endif
+
+	#if GDISP_NEED_IMAGE_PRELOAD || defined(__DOXYGEN__)
+		/**
+		 * @brief	Load a list of images and fonts using a pool of worker threads.
+		 * @return	The RAM used by all the loaded assets.
+		 *
+		 * @param[in] assets	The assets to load. The result of each is put in its structure.
+		 * @param[in] count		The number of assets
+		 * @param[in] fn		A function to call as each asset is loaded (or NULL)
+		 * @param[in] param		A parameter for the function
+		 *
+		 * @note	Each image is opened and then decoded into the global image cache if
+		 * 			GDISP_NEED_IMAGE_GLOBAL_CACHE is TRUE and it fits, otherwise with gdispImageCache().
+		 * 			An image that fails to open or decode has the error in its result and is left closed.
+		 * 			Not having the RAM to cache an image is not an error.
+		 * @note	Fonts are looked up with gdispOpenFont(). As with that, an unknown name gets the default font.
+		 * @note	This waits until everything is loaded. The function is called on this thread
+		 * 			so it can draw a progress bar on a splash screen.
+		 * @note	GDISP_IMAGE_PRELOAD_THREADS sets how many assets are loaded at once.
+		 */
+		size_t gdispImagePreload(gdispPreloadAsset *assets, unsigned count, gdispPreloadCallback fn, void *param);
+	#endif
+
 	/**
 	 * @brief	Prepare for the next frame/page in the image file.
 	 * @return	A time in milliseconds to keep displaying the current frame before trying to draw
@@ -294,6 +655,16 @@ extern "C" {
 		 * @note	The 8 byte header:
 		 *  			{ 'N', 'I', width.hi, width.lo, height.hi, height.lo, format.hi, format.lo }
 		 *  			The format word = GDISP_PIXELFORMAT
+		 * @note	A compressed (version 2) NATIVE image has a 12 byte header:
+		 *  			{ 'N', 'Z', width.hi, width.lo, height.hi, height.lo, format.hi, format.lo, sizeof(pixel_t), order, 0, 0 }
+		 * 			where order is 0 if the pixels are stored little endian or 1 if they are big endian,
+		 * 			followed by a row index of height+1 little endian 32 bit entries and then the row data.
+		 * 			Each entry is the offset of the row from the start of the row data with the row
+		 * 			compression in the top 2 bits (0 = raw, 1 = run length, 2 = LZ). The last entry is the
+		 * 			length of the row data. Pixels are stored already converted to the display format
+		 * 			so any area can be drawn by decompressing just the rows it needs. Pixels in the other
+		 * 			byte order to the CPU are swapped as they are decoded. The file2c tool (-i option)
+		 * 			converts a BMP into this format.
 		 * @{
 		 */
 		gdispImageError gdispImageOpen_NATIVE(gdispImage *img);
@@ -301,6 +672,9 @@ extern "C" {
 		gdispImageError gdispImageCache_NATIVE(gdispImage *img);
 		gdispImageError gdispImageDraw_NATIVE(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy);
 		delaytime_t gdispImageNext_NATIVE(gdispImage *img);
+		#if GDISP_NEED_IMAGE_SCALING
+			gdispImageError gdispImageRows_NATIVE(gdispImage *img, gdispImageRowSink *sink);
+		#endif
 		/* @} */
 	#endif
 
@@ -310,11 +684,17 @@ extern "C" {
 		 * @note	Only use these functions if you absolutely know the format
 		 * 			of the image you are decoding. Generally you should use the
 		 * 			generic functions and it will auto-detect the format.
+		 * @note	If GDISP_NEED_IMAGE_GIF_PREDECODE is TRUE in your gfxconf.h, the first call to
+		 * 			gdispImageNext() starts a thread that prepares each following frame of an animation
+		 * 			while the current one is displayed. It needs two buffers the size of the full image.
+		 * 			Transparent areas are then drawn in the image background color, and the first draw
+		 * 			of each frame only draws the area that has changed.
 		 * @{
 		 */
 		gdispImageError gdispImageOpen_GIF(gdispImage *img);
 		void gdispImageClose_GIF(gdispImage *img);
 		gdispImageError gdispImageCache_GIF(gdispImage *img);
+		gdispImageError gdispImageDecode_GIF(gdispImage *img, pixel_t *buf);
 		gdispImageError gdispImageDraw_GIF(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy);
 		delaytime_t gdispImageNext_GIF(gdispImage *img);
 		/* @} */
@@ -331,8 +711,12 @@ extern "C" {
 		gdispImageError gdispImageOpen_BMP(gdispImage *img);
 		void gdispImageClose_BMP(gdispImage *img);
 		gdispImageError gdispImageCache_BMP(gdispImage *img);
+		gdispImageError gdispImageDecode_BMP(gdispImage *img, pixel_t *buf);
 		gdispImageError gdispImageDraw_BMP(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy);
 		delaytime_t gdispImageNext_BMP(gdispImage *img);
+		#if GDISP_NEED_IMAGE_SCALING
+			gdispImageError gdispImageRows_BMP(gdispImage *img, gdispImageRowSink *sink);
+		#endif
 		/* @} */
 	#endif
 	
@@ -347,8 +731,28 @@ extern "C" {
 		gdispImageError gdispImageOpen_JPG(gdispImage *img);
 		void gdispImageClose_JPG(gdispImage *img);
 		gdispImageError gdispImageCache_JPG(gdispImage *img);
+		gdispImageError gdispImageDecode_JPG(gdispImage *img, pixel_t *buf);
 		gdispImageError gdispImageDraw_JPG(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy);
 		delaytime_t gdispImageNext_JPG(gdispImage *img);
+		#if GDISP_NEED_IMAGE_SCALING
+			gdispImageError gdispImageRows_JPG(gdispImage *img, gdispImageRowSink *sink);
+		#endif
+
+		/**
+		 * @brief	Decode a JPG image at a reduced size.
+		 * @return	GDISP_IMAGE_ERR_OK (0) on success or an error code.
+		 *
+		 * @param[in] img	The image structure
+		 * @param[in] denom	The scale denominator. It must be 1, 2, 4 or 8.
+		 *
+		 * @pre		gdispImageOpen() must have returned successfully.
+		 *
+		 * @note	The image width and height are changed to the scaled size (rounded up).
+		 * 			Any cached image is thrown away.
+		 * @note	Scaling is done as part of the IDCT so a scaled image decodes faster than
+		 * 			a full size one. At 1/8 only the DC value of each block is used.
+		 */
+		gdispImageError gdispImageSetScale_JPG(gdispImage *img, uint8_t denom);
 		/* @} */
 	#endif
 
@@ -363,8 +767,12 @@ extern "C" {
 		gdispImageError gdispImageOpen_PNG(gdispImage *img);
 		void gdispImageClose_PNG(gdispImage *img);
 		gdispImageError gdispImageCache_PNG(gdispImage *img);
+		gdispImageError gdispImageDecode_PNG(gdispImage *img, pixel_t *buf);
 		gdispImageError gdispImageDraw_PNG(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy);
 		delaytime_t gdispImageNext_PNG(gdispImage *img);
+		#if GDISP_NEED_IMAGE_SCALING
+			gdispImageError gdispImageRows_PNG(gdispImage *img, gdispImageRowSink *sink);
+		#endif
 		/* @} */
 	#endif
 
@@ -31,33 +31,116 @@ GDISPDriver	GDISP;
 
 #if !GDISP_HARDWARE_CLEARS 
 	void gdisp_lld_clear(color_t color) {
+		GDISP_STAT_EMULATED(GDISP_STAT_CLEAR);
 		gdisp_lld_fill_area(0, 0, GDISP.Width, GDISP.Height, color);
 	}
 #endif
 
-#if !GDISP_HARDWARE_LINES 
+#if !GDISP_HARDWARE_LINES && (GDISP_HARDWARE_FILLS || GDISP_HARDWARE_SCROLL)
+	/*
+	 * Run-slice line drawing.
+	 * Instead of stepping one pixel at a time we calculate the length of each horizontal
+	 * (or vertical) run of pixels in the line and draw each run with a single area fill.
+	 * A shallow line then needs one fill per row instead of one pixel write per column.
+	 */
 	void gdisp_lld_draw_line(coord_t x0, coord_t y0, coord_t x1, coord_t y1, color_t color) {
-		int16_t dy, dx;
-		int16_t addx, addy;
-		int16_t P, diff, i;
+		coord_t	dx, dy, addx, t;
+		coord_t	whole, first, last, run, i;
+		int32_t	adjup, adjdown, err;
 
-		#if GDISP_HARDWARE_FILLS || GDISP_HARDWARE_SCROLL
-		// speed improvement if vertical or horizontal
-		if (x0 == x1) {
-			if (y1 > y0)
-				gdisp_lld_fill_area(x0, y0, 1, y1-y0+1, color);
-			else
-				gdisp_lld_fill_area(x0, y1, 1, y0-y1+1, color);
+		GDISP_STAT_EMULATED(GDISP_STAT_DRAWLINE);
+
+		// Always draw from top to bottom
+		if (y0 > y1) {
+			t = x0; x0 = x1; x1 = t;
+			t = y0; y0 = y1; y1 = t;
+		}
+		dy = y1 - y0;
+		if (x1 >= x0) {
+			dx = x1 - x0;
+			addx = 1;
+		} else {
+			dx = x0 - x1;
+			addx = -1;
+		}
+
+		// Vertical and horizontal lines are a single run
+		if (!dx) {
+			gdisp_lld_fill_area(x0, y0, 1, dy+1, color);
 			return;
 		}
-		if (y0 == y1) {
-			if (x1 > x0)
-				gdisp_lld_fill_area(x0, y0, x1-x0+1, 1, color);
-			else
-				gdisp_lld_fill_area(x1, y0, x0-x1+1, 1, color);
+		if (!dy) {
+			gdisp_lld_fill_area(addx > 0 ? x0 : x1, y0, dx+1, 1, color);
 			return;
 		}
-		#endif
+
+		if (dx >= dy) {
+			// X major - there is one horizontal run per row
+			whole = dx / dy;
+			adjup = (dx % dy) * 2;
+			adjdown = dy * 2;
+			err = (dx % dy) - adjdown;
+
+			// The first and last runs share a whole run between them
+			first = last = whole/2 + 1;
+			if (!adjup && !(whole & 1))
+				first--;
+			if ((whole & 1))
+				err += dy;
+
+			for(i = 0; i <= dy; i++, y0++) {
+				if (!i)
+					run = first;
+				else if (i == dy)
+					run = last;
+				else {
+					run = whole;
+					if ((err += adjup) > 0) {
+						run++;
+						err -= adjdown;
+					}
+				}
+				gdisp_lld_fill_area(addx > 0 ? x0 : x0-run+1, y0, run, 1, color);
+				x0 += addx > 0 ? run : -run;
+			}
+		} else {
+			// Y major - there is one vertical run per column
+			whole = dy / dx;
+			adjup = (dy % dx) * 2;
+			adjdown = dx * 2;
+			err = (dy % dx) - adjdown;
+
+			// The first and last runs share a whole run between them
+			first = last = whole/2 + 1;
+			if (!adjup && !(whole & 1))
+				first--;
+			if ((whole & 1))
+				err += dx;
+
+			for(i = 0; i <= dx; i++, x0 += addx) {
+				if (!i)
+					run = first;
+				else if (i == dx)
+					run = last;
+				else {
+					run = whole;
+					if ((err += adjup) > 0) {
+						run++;
+						err -= adjdown;
+					}
+				}
+				gdisp_lld_fill_area(x0, y0, 1, run, color);
+				y0 += run;
+			}
+		}
+	}
+#elif !GDISP_HARDWARE_LINES
+	void gdisp_lld_draw_line(coord_t x0, coord_t y0, coord_t x1, coord_t y1, color_t color) {
+		int16_t dy, dx;
+		int16_t addx, addy;
+		int16_t P, diff, i;
+
+		GDISP_STAT_EMULATED(GDISP_STAT_DRAWLINE);
 
 		if (x1 >= x0) {
 			dx = x1 - x0;
@@ -113,10 +196,12 @@ GDISPDriver	GDISP;
 #if !GDISP_HARDWARE_FILLS
 	void gdisp_lld_fill_area(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 		#if GDISP_HARDWARE_SCROLL
+			GDISP_STAT_EMULATED(GDISP_STAT_FILLAREA);
 			gdisp_lld_vertical_scroll(x, y, cx, cy, cy, color);
 		#elif GDISP_HARDWARE_LINES
 			coord_t x1, y1;
 			
+			GDISP_STAT_EMULATED(GDISP_STAT_FILLAREA);
 			x1 = x + cx - 1;
 			y1 = y + cy;
 			for(; y < y1; y++)
@@ -124,6 +209,7 @@ GDISPDriver	GDISP;
 		#else
 			coord_t x0, x1, y1;
 			
+			GDISP_STAT_EMULATED(GDISP_STAT_FILLAREA);
 			x0 = x;
 			x1 = x + cx;
 			y1 = y + cy;
@@ -138,6 +224,7 @@ GDISPDriver	GDISP;
 	void gdisp_lld_blit_area_ex(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t srcx, coord_t srcy, coord_t srccx, const pixel_t *buffer) {
 			coord_t x0, x1, y1;
 			
+			GDISP_STAT_EMULATED(GDISP_STAT_BLITAREA);
 			x0 = x;
 			x1 = x + cx;
 			y1 = y + cy;
@@ -170,6 +257,7 @@ GDISPDriver	GDISP;
 	void gdisp_lld_draw_circle(coord_t x, coord_t y, coord_t radius, color_t color) {
 		coord_t a, b, P;
 
+		GDISP_STAT_EMULATED(GDISP_STAT_DRAWCIRCLE);
 		a = 0;
 		b = radius;
 		P = 1 - radius;
@@ -195,6 +283,7 @@ GDISPDriver	GDISP;
 	void gdisp_lld_fill_circle(coord_t x, coord_t y, coord_t radius, color_t color) {
 		coord_t a, b, P;
 		
+		GDISP_STAT_EMULATED(GDISP_STAT_FILLCIRCLE);
 		a = 0;
 		b = radius;
 		P = 1 - radius;
@@ -218,6 +307,7 @@ GDISPDriver	GDISP;
 		long a2 = a*a, b2 = b*b;
 		long err = b2-(2*b-1)*a2, e2; /* Fehler im 1. Schritt */
 
+		GDISP_STAT_EMULATED(GDISP_STAT_DRAWELLIPSE);
 		do {
 			gdisp_lld_draw_pixel(x+dx, y+dy, color); /* I. Quadrant */
 			gdisp_lld_draw_pixel(x-dx, y+dy, color); /* II. Quadrant */
@@ -248,6 +338,7 @@ GDISPDriver	GDISP;
 		long a2 = a*a, b2 = b*b;
 		long err = b2-(2*b-1)*a2, e2; /* Fehler im 1. Schritt */
 
+		GDISP_STAT_EMULATED(GDISP_STAT_FILLELLIPSE);
 		do {
 			gdisp_lld_draw_line(x-dx,y+dy,x+dx,y+dy, color);
 			gdisp_lld_draw_line(x-dx,y-dy,x+dx,y-dy, color);
@@ -358,6 +449,7 @@ GDISPDriver	GDISP;
 	}
 
 	void gdisp_lld_draw_arc(coord_t x, coord_t y, coord_t radius, coord_t startangle, coord_t endangle, color_t color) {
+		GDISP_STAT_EMULATED(GDISP_STAT_DRAWARC);
 		if(endangle < startangle) {
 	        _draw_arc(x, y, startangle, 360, radius, color);
 	        _draw_arc(x, y, 0, endangle, radius, color);
@@ -452,6 +544,7 @@ GDISPDriver	GDISP;
 	}
 
 	void gdisp_lld_fill_arc(coord_t x, coord_t y, coord_t radius, coord_t startangle, coord_t endangle, color_t color) {
+		GDISP_STAT_EMULATED(GDISP_STAT_FILLARC);
 		if(endangle < startangle) {
 	        _fill_arc(x, y, startangle, 360, radius, color);
 	        _fill_arc(x, y, 0, endangle, radius, color);
@@ -548,6 +641,8 @@ void *gdisp_lld_query(unsigned what) {
 				msg->query.result = gdisp_lld_query(msg->query.what);
 				break;
 		#endif
+		default:
+			break;
 		}
 	}
 #endif
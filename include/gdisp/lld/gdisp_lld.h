@@ -275,11 +275,21 @@ extern "C" {
 	#endif
 
 	/* Messaging API */
-	#if GDISP_NEED_MSGAPI
+	#if GDISP_NEED_MSGAPI || GDISP_NEED_TRACE
 	#include "gdisp_lld_msgs.h"
+	#endif
+	#if GDISP_NEED_MSGAPI
 	extern void gdisp_lld_msg_dispatch(gdisp_lld_msg_t *msg);
 	#endif
 
+	/* Statistics - counts the use of software emulation */
+	#if GDISP_NEED_STATISTICS
+	extern gdispStat _gdispStats[GDISP_STAT_COUNT];
+	#define GDISP_STAT_EMULATED(op)		(_gdispStats[op].emulated++)
+	#else
+	#define GDISP_STAT_EMULATED(op)
+	#endif
+
 #ifdef __cplusplus
 }
 #endif
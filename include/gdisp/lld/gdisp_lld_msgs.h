@@ -17,7 +17,9 @@
 #define _GDISP_LLD_MSGS_H
 
 /* This file describes the message API for gdisp_lld */
-#if GFX_USE_GDISP && GDISP_NEED_MSGAPI
+#if GFX_USE_GDISP && (GDISP_NEED_MSGAPI || GDISP_NEED_TRACE)
+
+/* The action values are also used as the record types in GDISP trace files - only ever add to the end */
 
 typedef enum gdisp_msgaction {
 	GDISP_LLD_MSG_NOP,
@@ -27,33 +29,21 @@ typedef enum gdisp_msgaction {
 	GDISP_LLD_MSG_FILLAREA,
 	GDISP_LLD_MSG_BLITAREA,
 	GDISP_LLD_MSG_DRAWLINE,
-	#if GDISP_NEED_CLIP
-		GDISP_LLD_MSG_SETCLIP,
-	#endif
-	#if GDISP_NEED_CIRCLE
-		GDISP_LLD_MSG_DRAWCIRCLE,
-		GDISP_LLD_MSG_FILLCIRCLE,
-	#endif
-	#if GDISP_NEED_ELLIPSE
-		GDISP_LLD_MSG_DRAWELLIPSE,
-		GDISP_LLD_MSG_FILLELLIPSE,
-	#endif
-	#if GDISP_NEED_ARC
-		GDISP_LLD_MSG_DRAWARC,
-		GDISP_LLD_MSG_FILLARC,
-	#endif
-	#if GDISP_NEED_PIXELREAD
-		GDISP_LLD_MSG_GETPIXELCOLOR,
-	#endif
-	#if GDISP_NEED_SCROLL
-		GDISP_LLD_MSG_VERTICALSCROLL,
-	#endif
-	#if GDISP_NEED_CONTROL
-		GDISP_LLD_MSG_CONTROL,
-	#endif
+	GDISP_LLD_MSG_SETCLIP,
+	GDISP_LLD_MSG_DRAWCIRCLE,
+	GDISP_LLD_MSG_FILLCIRCLE,
+	GDISP_LLD_MSG_DRAWELLIPSE,
+	GDISP_LLD_MSG_FILLELLIPSE,
+	GDISP_LLD_MSG_DRAWARC,
+	GDISP_LLD_MSG_FILLARC,
+	GDISP_LLD_MSG_GETPIXELCOLOR,
+	GDISP_LLD_MSG_VERTICALSCROLL,
+	GDISP_LLD_MSG_CONTROL,
 	GDISP_LLD_MSG_QUERY,
 } gdisp_msgaction_t;
 
+#if GDISP_NEED_MSGAPI
+
 typedef union gdisp_lld_msg {
 	struct {
 		gfxQueueItem		qi;
@@ -174,8 +164,9 @@ typedef union gdisp_lld_msg {
 		void *				result;
 	} query;
 } gdisp_lld_msg_t;
+#endif
 
-#endif	/* GFX_USE_GDISP && GDISP_NEED_MSGAPI */
+#endif	/* GFX_USE_GDISP && (GDISP_NEED_MSGAPI || GDISP_NEED_TRACE) */
 #endif	/* _GDISP_LLD_MSGS_H */
 /** @} */
 
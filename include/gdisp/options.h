@@ -80,6 +80,48 @@
 	#ifndef GDISP_NEED_CONVEX_POLYGON
 		#define GDISP_NEED_CONVEX_POLYGON		FALSE
 	#endif
+	/**
+	 * @brief   Are gradient fill functions needed.
+	 * @details	Defaults to FALSE
+	 * @note	Requires the maths library to be included in the link. ie  -lm
+	 */
+	#ifndef GDISP_NEED_GRADIENT
+		#define GDISP_NEED_GRADIENT		FALSE
+	#endif
+	/**
+	 * @brief   Are clip regions and the clip stack needed.
+	 * @details	Defaults to FALSE
+	 * @note	Requires GDISP_NEED_CLIP. It can not be used with GDISP_NEED_ASYNC.
+	 */
+	#ifndef GDISP_NEED_CLIPREGION
+		#define GDISP_NEED_CLIPREGION	FALSE
+	#endif
+	/**
+	 * @brief   Are drawing performance statistics needed.
+	 * @details	Defaults to FALSE
+	 * @details	Counts calls, pixels, time and software emulation for each drawing operation.
+	 * @note	It can not be used with GDISP_NEED_ASYNC.
+	 */
+	#ifndef GDISP_NEED_STATISTICS
+		#define GDISP_NEED_STATISTICS	FALSE
+	#endif
+	/**
+	 * @brief   A free running high resolution counter used to time the statistics.
+	 * @details	Not defined by default, in which case calls and pixels are counted but not timed.
+	 * @note	It must return a uint32_t that may wrap, for example a CPU cycle counter.
+	 * 			The system tick is too coarse to time single drawing calls.
+	 */
+	/* #define GDISP_STATISTICS_COUNTER()	DWT->CYCCNT */
+	/**
+	 * @brief   Are trace capture and replay functions needed.
+	 * @details	Defaults to FALSE
+	 * @details	Records every drawing call to a compact binary trace that can be
+	 * 			replayed later against any driver.
+	 * @note	It can not be used with GDISP_NEED_ASYNC.
+	 */
+	#ifndef GDISP_NEED_TRACE
+		#define GDISP_NEED_TRACE		FALSE
+	#endif
 	/**
 	 * @brief   Are scrolling functions needed.
 	 * @details	Defaults to FALSE
@@ -180,6 +222,59 @@
 	#ifndef GDISP_NEED_IMAGE_ACCOUNTING
 		#define GDISP_NEED_IMAGE_ACCOUNTING	FALSE
 	#endif
+	/**
+	 * @brief   Are decoded images kept in a global cache.
+	 * @details	Defaults to FALSE
+	 * @note	Still images drawn by a decoder that supports it are decoded once and then drawn
+	 * 			from the cache, even after the image has been closed and opened again.
+	 * @note	The cache uses at most GDISP_IMAGE_GLOBAL_CACHE_SIZE bytes. The least recently
+	 * 			drawn images are thrown away to make room.
+	 */
+	#ifndef GDISP_NEED_IMAGE_GLOBAL_CACHE
+		#define GDISP_NEED_IMAGE_GLOBAL_CACHE	FALSE
+	#endif
+	/**
+	 * @brief   Is scaled image drawing (gdispImageDrawScaled) required.
+	 * @details	Defaults to FALSE
+	 */
+	#ifndef GDISP_NEED_IMAGE_SCALING
+		#define GDISP_NEED_IMAGE_SCALING		FALSE
+	#endif
+	/**
+	 * @brief   Are images with transparency drawn over what is already on the display.
+	 * @details	Defaults to FALSE
+	 * @details	If FALSE transparent pixels are blended with the image background color.
+	 * @note	Fully transparent pixels are not drawn. Partially transparent pixels
+	 * 			need GDISP_NEED_PIXELREAD to blend with the display, otherwise they
+	 * 			are blended with the image background color.
+	 */
+	#ifndef GDISP_NEED_IMAGE_ALPHA
+		#define GDISP_NEED_IMAGE_ALPHA			FALSE
+	#endif
+	/**
+	 * @brief   Are image atlases (sprite sheets) required.
+	 * @details	Defaults to FALSE
+	 * @note	An atlas decodes an image once and then draws named areas of it without decoding.
+	 */
+	#ifndef GDISP_NEED_IMAGE_ATLAS
+		#define GDISP_NEED_IMAGE_ATLAS			FALSE
+	#endif
+	/**
+	 * @brief   Can images be drawn by a background thread (gdispImageDrawAsync).
+	 * @details	Defaults to FALSE
+	 * @note	This needs GDISP_NEED_IMAGE_SCALING for the decoders to produce single rows.
+	 */
+	#ifndef GDISP_NEED_IMAGE_ASYNC
+		#define GDISP_NEED_IMAGE_ASYNC			FALSE
+	#endif
+	/**
+	 * @brief   Can images and fonts be loaded by a pool of threads (gdispImagePreload).
+	 * @details	Defaults to FALSE
+	 * @note	This needs GDISP_NEED_IMAGE_ACCOUNTING to report the memory used.
+	 */
+	#ifndef GDISP_NEED_IMAGE_PRELOAD
+		#define GDISP_NEED_IMAGE_PRELOAD		FALSE
+	#endif
 /**
  * @}
  * 
@@ -203,9 +298,18 @@
 	#endif
 	
 	/**
-	 * @brief	Enable antialiased font support
+	 * @brief	Enable loading BDF fonts at run time (gdispLoadFont).
 	 * @details	Defaults to FALSE
 	 */
+	#ifndef GDISP_NEED_TEXT_LOADFONT
+		#define GDISP_NEED_TEXT_LOADFONT	FALSE
+	#endif
+	
+	/**
+	 * @brief	Enable antialiased font and drawing support
+	 * @details	Defaults to FALSE
+	 * @details	Adds gdispDrawLineAA(), gdispDrawCircleAA(), gdispDrawEllipseAA() and gdispDrawArcAA().
+	 */
 	#ifndef GDISP_NEED_ANTIALIAS
 		#define GDISP_NEED_ANTIALIAS	FALSE
 	#endif
@@ -257,6 +361,63 @@
  * @name    GDISP Optional Sizing Parameters
  * @{
  */
+	/**
+	 * @brief   The maximum number of rectangles in a clip region.
+	 * @details	Defaults to 8
+	 */
+	#ifndef GDISP_CLIPREGION_RECTS
+		#define GDISP_CLIPREGION_RECTS	8
+	#endif
+	/**
+	 * @brief   The maximum depth of the clip region stack.
+	 * @details	Defaults to 4
+	 */
+	#ifndef GDISP_CLIPSTACK_DEPTH
+		#define GDISP_CLIPSTACK_DEPTH	4
+	#endif
+	/**
+	 * @brief   The default size of the read-ahead buffer for gdispImageSetBufferedReader().
+	 * @details	Defaults to 512
+	 */
+	#ifndef GDISP_IMAGE_IO_BUFFER_SIZE
+		#define GDISP_IMAGE_IO_BUFFER_SIZE	512
+	#endif
+	/**
+	 * @brief   The initial memory budget in bytes of the global image cache.
+	 * @details	Defaults to 65536
+	 * @note	Only used if GDISP_NEED_IMAGE_GLOBAL_CACHE is TRUE.
+	 */
+	#ifndef GDISP_IMAGE_GLOBAL_CACHE_SIZE
+		#define GDISP_IMAGE_GLOBAL_CACHE_SIZE	65536
+	#endif
+	/**
+	 * @brief   The number of threads gdispImagePreload() uses.
+	 * @details	Defaults to 2
+	 * @note	Only used if GDISP_NEED_IMAGE_PRELOAD is TRUE.
+	 */
+	#ifndef GDISP_IMAGE_PRELOAD_THREADS
+		#define GDISP_IMAGE_PRELOAD_THREADS		2
+	#endif
+	/**
+	 * @brief   The stack size in bytes of the GIF frame predecode thread.
+	 * @details	Defaults to 1024
+	 * @note	Only used if GDISP_NEED_IMAGE_GIF_PREDECODE is TRUE.
+	 * @note	The thread reads the image through its I/O functions (including any file
+	 * 			system reader) and decodes the frame, so allow for the deepest of these.
+	 */
+	#ifndef GDISP_IMAGE_GIF_PREDECODE_STACK_SIZE
+		#define GDISP_IMAGE_GIF_PREDECODE_STACK_SIZE	1024
+	#endif
+	/**
+	 * @brief   The number of glyph edge profiles kept for kerning.
+	 * @details	Defaults to 32
+	 * @note	Only used if GDISP_NEED_TEXT_KERNING is TRUE.
+	 * @note	Each profile takes about 40 bytes of RAM. Setting this to 0 measures
+	 * 			the glyph edges again for every character pair drawn.
+	 */
+	#ifndef GDISP_TEXT_KERNING_CACHE_SIZE
+		#define GDISP_TEXT_KERNING_CACHE_SIZE	32
+	#endif
 /**
  * @}
  *
@@ -50,6 +50,30 @@
 		#if !GDISP_NEED_IMAGE
 			#error "GWIN: GDISP_NEED_IMAGE is required when GWIN_NEED_IMAGE is TRUE."
 		#endif
+		#if GWIN_NEED_IMAGE_ASYNC
+			#if !GDISP_NEED_IMAGE_ASYNC
+				#if GFX_DISPLAY_RULE_WARNINGS
+					#warning "GWIN: GDISP_NEED_IMAGE_ASYNC is required if GWIN_NEED_IMAGE_ASYNC is TRUE. It has been turned on for you."
+				#endif
+				#undef GDISP_NEED_IMAGE_ASYNC
+				#define GDISP_NEED_IMAGE_ASYNC	TRUE
+			#endif
+			#if !GFX_USE_GTIMER
+				#if GFX_DISPLAY_RULE_WARNINGS
+					#warning "GWIN: GFX_USE_GTIMER is required if GWIN_NEED_IMAGE_ASYNC is TRUE. It has been turned on for you."
+				#endif
+				#undef GFX_USE_GTIMER
+				#define GFX_USE_GTIMER	TRUE
+			#endif
+			#if !GDISP_NEED_MULTITHREAD && !GDISP_NEED_ASYNC
+				#if GFX_DISPLAY_RULE_WARNINGS
+					#warning "GWIN: Either GDISP_NEED_MULTITHREAD or GDISP_NEED_ASYNC is required if GWIN_NEED_IMAGE_ASYNC is TRUE."
+					#warning "GWIN: GDISP_NEED_MULTITHREAD has been turned on for you."
+				#endif
+				#undef GDISP_NEED_MULTITHREAD
+				#define GDISP_NEED_MULTITHREAD	TRUE
+			#endif
+		#endif
 	#endif
 	#if GWIN_NEED_RADIO
 		#if !GDISP_NEED_CIRCLE
@@ -159,6 +183,48 @@
 			#endif
 		#endif
 	#endif
+	#if GDISP_NEED_CLIPREGION && GDISP_NEED_ASYNC
+		#if GFX_DISPLAY_RULE_WARNINGS
+			#warning "GDISP: GDISP_NEED_CLIPREGION can not be used with GDISP_NEED_ASYNC. It has been turned off for you."
+		#endif
+		#undef GDISP_NEED_CLIPREGION
+		#define GDISP_NEED_CLIPREGION	FALSE
+	#endif
+	#if GDISP_NEED_STATISTICS && GDISP_NEED_ASYNC
+		#if GFX_DISPLAY_RULE_WARNINGS
+			#warning "GDISP: GDISP_NEED_STATISTICS can not be used with GDISP_NEED_ASYNC. It has been turned off for you."
+		#endif
+		#undef GDISP_NEED_STATISTICS
+		#define GDISP_NEED_STATISTICS	FALSE
+	#endif
+	#if GDISP_NEED_TRACE && GDISP_NEED_ASYNC
+		#if GFX_DISPLAY_RULE_WARNINGS
+			#warning "GDISP: GDISP_NEED_TRACE can not be used with GDISP_NEED_ASYNC. It has been turned off for you."
+		#endif
+		#undef GDISP_NEED_TRACE
+		#define GDISP_NEED_TRACE		FALSE
+	#endif
+	#if GDISP_NEED_IMAGE_ASYNC && !GDISP_NEED_IMAGE_SCALING
+		#if GFX_DISPLAY_RULE_WARNINGS
+			#warning "GDISP: GDISP_NEED_IMAGE_ASYNC requires GDISP_NEED_IMAGE_SCALING. It has been turned on for you."
+		#endif
+		#undef GDISP_NEED_IMAGE_SCALING
+		#define GDISP_NEED_IMAGE_SCALING	TRUE
+	#endif
+	#if GDISP_NEED_IMAGE_PRELOAD && !GDISP_NEED_IMAGE_ACCOUNTING
+		#if GFX_DISPLAY_RULE_WARNINGS
+			#warning "GDISP: GDISP_NEED_IMAGE_PRELOAD requires GDISP_NEED_IMAGE_ACCOUNTING. It has been turned on for you."
+		#endif
+		#undef GDISP_NEED_IMAGE_ACCOUNTING
+		#define GDISP_NEED_IMAGE_ACCOUNTING	TRUE
+	#endif
+	#if GDISP_NEED_CLIPREGION && !GDISP_NEED_CLIP
+		#if GFX_DISPLAY_RULE_WARNINGS
+			#warning "GDISP: GDISP_NEED_CLIPREGION requires GDISP_NEED_CLIP. It has been turned on for you."
+		#endif
+		#undef GDISP_NEED_CLIP
+		#define GDISP_NEED_CLIP		TRUE
+	#endif
 	#if (defined(GDISP_INCLUDE_FONT_SMALL) && GDISP_INCLUDE_FONT_SMALL) || (defined(GDISP_INCLUDE_FONT_LARGER) && GDISP_INCLUDE_FONT_LARGER)
 		#if GFX_DISPLAY_RULE_WARNINGS
 			#warning "GDISP: An old font (Small or Larger) has been defined. A single default font of DEJAVUSANS12 has been added instead."
@@ -194,6 +194,20 @@ GHandle _gwindowCreate(GWindowObject *pgw, const GWindowInit *pInit, const gwinV
 	void _gwidgetRedraw(GHandle gh);
 #endif
 
+#if (GWIN_NEED_WINDOWMANAGER && GDISP_NEED_CLIPREGION) || defined(__DOXYGEN__)
+	/**
+	 * @brief	Push a clip region of the parts of a window that are not covered by other windows
+	 *
+	 * @param[in]	gh		The window
+	 *
+	 * @return	TRUE if the region was pushed and must later be popped with gdispPopClip().
+	 * 			FALSE if the visible parts can't be worked out (eg another window manager is in use).
+	 *
+	 * @notapi
+	 */
+	bool_t _gwmPushVisible(GHandle gh);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
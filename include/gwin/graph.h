@@ -34,8 +34,12 @@ typedef struct GGraphPointStyle_t {
 	color_t				color;
 	} GGraphPointStyle;
 
+/**
+ * @note	GGRAPH_LINE_THICK draws a solid line that is size pixels wide with round ends and
+ * 			corners. It requires GDISP_NEED_CONVEX_POLYGON, without which a normal solid line is drawn.
+ */
 typedef enum GGraphLineType_e {
-	GGRAPH_LINE_NONE, GGRAPH_LINE_SOLID, GGRAPH_LINE_DOT, GGRAPH_LINE_DASH
+	GGRAPH_LINE_NONE, GGRAPH_LINE_SOLID, GGRAPH_LINE_DOT, GGRAPH_LINE_DASH, GGRAPH_LINE_THICK
 	} GGraphLineType;
 
 typedef struct GGraphLineStyle_t {
@@ -36,6 +36,10 @@ typedef struct GImageObject {
 	#if GWIN_NEED_IMAGE_ANIMATION
 		GTimer			timer;		// Timer used for animated images
 	#endif
+	#if GWIN_NEED_IMAGE_ASYNC
+		gdispImageAsync			async;		// The background draw of a still image
+		struct GImageObject		*asyncNext;	// The next image window with a background draw in progress
+	#endif
 } GImageObject;
 
 #ifdef __cplusplus
@@ -103,6 +107,9 @@ bool_t gwinImageOpenMemory(GHandle gh, const void* memory);
  *
  * @return				GDISP_IMAGE_ERR_OK (0) on success or an error code.
  *
+ * @note				With GWIN_NEED_IMAGE_ASYNC a background draw in progress is cancelled and
+ * 						the image is then drawn from the cache.
+ *
  * @api
  */
 gdispImageError gwinImageCache(GHandle gh);
@@ -132,6 +132,18 @@
 	#ifndef GWIN_NEED_IMAGE_ANIMATION
 		#define GWIN_NEED_IMAGE_ANIMATION		FALSE
 	#endif
+	/**
+	 * @brief   Image windows can optionally decode still images in the background
+	 * @details	Defaults to FALSE
+	 * @details	The image is drawn progressively with gdispImageDrawAsync() so large images
+	 * 			don't hold up the application. The draw is cancelled if the window is destroyed,
+	 * 			a new image is opened or the window is redrawn.
+	 * @note	This needs GDISP_NEED_IMAGE_ASYNC and GFX_USE_GTIMER. As the image is drawn from the
+	 * 			GTIMER thread it also needs GDISP_NEED_MULTITHREAD (or GDISP_NEED_ASYNC).
+	 */
+	#ifndef GWIN_NEED_IMAGE_ASYNC
+		#define GWIN_NEED_IMAGE_ASYNC			FALSE
+	#endif
 /** @} */
 
 #endif /* _GWIN_OPTIONS_H */
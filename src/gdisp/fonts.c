@@ -19,6 +19,16 @@
 
 #include "mcufont.h"
 
+#if GDISP_NEED_TEXT_LOADFONT
+	#define MF_BWFONT_INTERNALS
+	#include "mf_bwfont.h"
+	#include <string.h>
+	#if defined(WIN32) || GFX_USE_OS_WIN32 || GFX_USE_OS_LINUX || GFX_USE_OS_OSX
+		#include <stdio.h>
+		#define FONT_FILE_READER	TRUE
+	#endif
+#endif
+
 /* Custom flag to indicate dynamically allocated font */
 #define FONT_FLAG_DYNAMIC 0x80
 
@@ -76,6 +86,9 @@ void gdispCloseFont(font_t font) {
 		/* Make sure that no-one can successfully use font after closing */
 		dfont->render_character = NULL;
 		
+		/* Forget any kerning edges measured for it */
+		mf_kerning_flush(dfont);
+		
 		/* Release the allocated memory */
 		gfxFree(dfont);
 	}
@@ -92,5 +105,548 @@ const char *gdispGetFontName(font_t font) {
 	return font->short_name;
 }
 
+#if GDISP_NEED_TEXT_LOADFONT
+	/**
+	 * The longest BDF line we need to read. Longer lines (eg copyright notices) are cut short.
+	 * Gaps of up to FONT_MAX_GAP missing characters are stored in a range rather than starting a new one.
+	 */
+	#define FONT_LINE_SIZE		128
+	#define FONT_MAX_GAP		8
+
+	typedef struct FontReader {
+		const char *		mem;				// The BDF text if reading from memory
+		size_t				size, pos;
+		#if FONT_FILE_READER
+			FILE *			f;					// The BDF file if reading from a file
+		#endif
+		char				line[FONT_LINE_SIZE];
+	} FontReader;
+
+	typedef struct FontGlyph {
+		uint16_t			code;
+		uint8_t				advance;			// The x advance (DWIDTH)
+		uint8_t				w, h;				// The bitmap size (BBX)
+		int16_t				x, y;				// The bitmap top left in the font bounding box
+		int16_t				l, t, r, b;			// The pixels that are set in the font bounding box (r == l if none)
+		uint8_t				range;				// The range the glyph is stored in
+		uint16_t			column;				// The first column of the glyph in the range data
+		bool_t				done;				// The bitmap has been read
+	} FontGlyph;
+
+	typedef struct FontInfo {
+		char				name[FONT_LINE_SIZE];
+		int					w, h, bx, by;		// The font bounding box and the baseline within it
+		int					ascent, descent;
+		int					defchar;
+		FontGlyph *			glyphs;
+		unsigned			count, max;
+	} FontInfo;
+
+	/* Read the next line. Returns FALSE at the end of the font. */
+	static bool_t FontReadLine(FontReader *pr) {
+		unsigned	i;
+		int			c;
+
+		i = 0;
+		while(1) {
+			#if FONT_FILE_READER
+				if (pr->f)
+					c = fgetc(pr->f);
+				else
+			#endif
+				c = pr->pos < pr->size ? (uint8_t)pr->mem[pr->pos++] : EOF;
+			if (c == EOF) {
+				if (!i)
+					return FALSE;
+				break;
+			}
+			if (c == '\n')
+				break;
+			if (c != '\r' && i < FONT_LINE_SIZE-1)
+				pr->line[i++] = (char)c;
+		}
+		pr->line[i] = 0;
+		return TRUE;
+	}
+
+	static void FontRewind(FontReader *pr) {
+		#if FONT_FILE_READER
+			if (pr->f)
+				rewind(pr->f);
+		#endif
+		pr->pos = 0;
+	}
+
+	/* Returns the text after a keyword or 0 if the line doesn't start with it */
+	static const char *FontKeyword(const char *line, const char *kw) {
+		while(*kw) {
+			if (*line++ != *kw++)
+				return 0;
+		}
+		if (*line && *line != ' ' && *line != '\t')
+			return 0;
+		while(*line == ' ' || *line == '\t')
+			line++;
+		return line;
+	}
+
+	/* Read a number from a line. Returns 0 if there isn't one. */
+	static const char *FontNumber(const char *p, int *pv) {
+		bool_t	neg;
+		int		v;
+
+		if (!p) return 0;
+		while(*p == ' ' || *p == '\t')
+			p++;
+		if ((neg = (*p == '-')))
+			p++;
+		if (*p < '0' || *p > '9')
+			return 0;
+		for(v = 0; *p >= '0' && *p <= '9'; p++)
+			v = v * 10 + (*p - '0');
+		*pv = neg ? -v : v;
+		return p;
+	}
+
+	static int FontHex(char c) {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		return -1;
+	}
+
+	static bool_t FontWanted(int code, const gdispFontRange *ranges, unsigned count) {
+		if (code < 0 || code > 0xFFFF)
+			return FALSE;
+		if (!ranges)
+			return TRUE;
+		for(; count; count--, ranges++) {
+			if (code >= ranges->first && code <= ranges->last)
+				return TRUE;
+		}
+		return FALSE;
+	}
+
+	static FontGlyph *FontFindGlyph(FontInfo *pi, int code) {
+		unsigned	lo, hi, mid;
+
+		lo = 0;
+		hi = pi->count;
+		while(lo < hi) {
+			mid = (lo + hi) / 2;
+			if (pi->glyphs[mid].code < code)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo < pi->count && pi->glyphs[lo].code == code ? &pi->glyphs[lo] : 0;
+	}
+
+	/**
+	 * Read the font header and the size of each wanted glyph.
+	 */
+	static bool_t FontScan(FontReader *pr, FontInfo *pi, const gdispFontRange *ranges, unsigned count) {
+		const char	*p;
+		FontGlyph	*pg, g;
+		int			code, adv, w, h, x, y, n, c, v;
+		unsigned	i;
+		bool_t		box, wanted;
+
+		box = FALSE;
+		code = -1;
+		adv = w = h = x = y = 0;
+		while(FontReadLine(pr)) {
+			if ((p = FontKeyword(pr->line, "FONT"))) {
+				strcpy(pi->name, p);
+			} else if ((p = FontKeyword(pr->line, "FONTBOUNDINGBOX"))) {
+				if (!(p = FontNumber(p, &pi->w)) || !(p = FontNumber(p, &pi->h)) || !(p = FontNumber(p, &pi->bx)) || !FontNumber(p, &pi->by))
+					return FALSE;
+				if (pi->w <= 0 || pi->w > 255 || pi->h <= 0 || pi->h > 255)
+					return FALSE;
+				// Convert the offsets into the baseline position within the box
+				pi->bx = pi->bx < 0 ? -pi->bx : 0;
+				pi->by = pi->h + pi->by;
+				box = TRUE;
+			} else if ((p = FontKeyword(pr->line, "FONT_ASCENT"))) {
+				FontNumber(p, &pi->ascent);
+			} else if ((p = FontKeyword(pr->line, "FONT_DESCENT"))) {
+				FontNumber(p, &pi->descent);
+			} else if ((p = FontKeyword(pr->line, "DEFAULT_CHAR"))) {
+				FontNumber(p, &pi->defchar);
+			} else if ((p = FontKeyword(pr->line, "CHARS"))) {
+				if (!pi->glyphs && FontNumber(p, &n) && n > 0) {
+					if (!(pi->glyphs = (FontGlyph *)gfxAlloc(n * sizeof(FontGlyph))))
+						return FALSE;
+					pi->max = n;
+				}
+			} else if (FontKeyword(pr->line, "STARTCHAR")) {
+				code = -1;
+				adv = w = h = x = y = 0;
+			} else if ((p = FontKeyword(pr->line, "ENCODING"))) {
+				FontNumber(p, &code);
+			} else if ((p = FontKeyword(pr->line, "DWIDTH"))) {
+				FontNumber(p, &adv);
+			} else if ((p = FontKeyword(pr->line, "BBX"))) {
+				if (!(p = FontNumber(p, &w)) || !(p = FontNumber(p, &h)) || !(p = FontNumber(p, &x)) || !FontNumber(p, &y))
+					return FALSE;
+			} else if (FontKeyword(pr->line, "BITMAP")) {
+				if (!box || w < 0 || w > 255 || h < 0 || h > 255 || adv < 0)
+					return FALSE;
+				g.x = pi->bx + x;
+				g.y = pi->by - (y + h);
+
+				// Find the pixels that are set
+				wanted = FontWanted(code, ranges, count);
+				g.l = g.t = 0x7FFF;
+				g.r = g.b = -0x7FFF;
+				for(n = 0; n < h; n++) {
+					if (!FontReadLine(pr))
+						return FALSE;
+					for(c = 0; wanted && c < w && pr->line[c>>2]; c++) {
+						if ((v = FontHex(pr->line[c>>2])) < 0)
+							return FALSE;
+						if (!(v & (8 >> (c & 3))))
+							continue;
+						if (g.x + c < g.l) g.l = g.x + c;
+						if (g.x + c >= g.r) g.r = g.x + c + 1;
+						if (g.y + n < g.t) g.t = g.y + n;
+						g.b = g.y + n + 1;
+					}
+				}
+				if (!wanted)
+					continue;
+				if (g.r < g.l)
+					g.l = g.r = g.t = g.b = 0;
+
+				// Remember the glyph
+				if (pi->count >= pi->max) {
+					n = pi->max ? pi->max * 2 : 128;
+					if (!(pg = (FontGlyph *)gfxRealloc(pi->glyphs, pi->max * sizeof(FontGlyph), n * sizeof(FontGlyph))))
+						return FALSE;
+					pi->glyphs = pg;
+					pi->max = n;
+				}
+				g.code = code;
+				g.advance = adv > 255 ? 255 : adv;
+				g.w = w;
+				g.h = h;
+				g.done = FALSE;
+
+				// Keep them sorted by character. Fonts are nearly always in order already.
+				for(i = pi->count; i && pi->glyphs[i-1].code >= code; i--);
+				if (i < pi->count && pi->glyphs[i].code == code)
+					continue;
+				memmove(pi->glyphs + i + 1, pi->glyphs + i, (pi->count - i) * sizeof(FontGlyph));
+				pi->glyphs[i] = g;
+				pi->count++;
+			} else if (FontKeyword(pr->line, "ENDFONT")) {
+				break;
+			}
+		}
+		return box && pi->count;
+	}
+
+	/* The columns a glyph needs in a range of variable width glyphs */
+	static int FontColumns(FontInfo *pi, FontGlyph *pg) {
+		if (pg->r <= 0) return 0;
+		return pg->r > pi->w ? pi->w : pg->r;
+	}
+
+	/**
+	 * Crop the font bounding box to the pixels used by the wanted glyphs as the mcufont encoder does.
+	 */
+	static bool_t FontCrop(FontInfo *pi) {
+		FontGlyph	*pg, *pe;
+		int			l, t, r, b;
+
+		l = t = 0x7FFF;
+		r = b = -0x7FFF;
+		for(pg = pi->glyphs, pe = pi->glyphs + pi->count; pg < pe; pg++) {
+			if (pg->r == pg->l) continue;
+			if (pg->l < l) l = pg->l;
+			if (pg->t < t) t = pg->t;
+			if (pg->r > r) r = pg->r;
+			if (pg->b > b) b = pg->b;
+		}
+		if (r < l)
+			return TRUE;
+
+		// The baseline must stay within the box
+		if (l > pi->bx) l = pi->bx;
+		if (t > pi->by) t = pi->by;
+		if (r - l > 255 || b - t > 255)
+			return FALSE;
+		for(pg = pi->glyphs; pg < pe; pg++) {
+			pg->x -= l;
+			pg->y -= t;
+			if (pg->r != pg->l) {
+				pg->l -= l; pg->r -= l;
+				pg->t -= t; pg->b -= t;
+			}
+		}
+		pi->w = r - l;
+		pi->h = b - t;
+		pi->bx -= l;
+		pi->by -= t;
+		return TRUE;
+	}
+
+	/**
+	 * Read the glyph bitmaps into the font.
+	 */
+	static bool_t FontRead(FontReader *pr, FontInfo *pi, struct mf_bwfont_s *font) {
+		const struct mf_bwfont_char_range_s	*prg;
+		FontGlyph	*pg;
+		uint8_t		*data;
+		const char	*p;
+		int			code, r, c, x, y, cols, v;
+
+		code = -1;
+		while(FontReadLine(pr)) {
+			if (FontKeyword(pr->line, "STARTCHAR"))
+				code = -1;
+			else if ((p = FontKeyword(pr->line, "ENCODING")))
+				FontNumber(p, &code);
+			else if (FontKeyword(pr->line, "BITMAP")) {
+				// Only the first glyph for each wanted character is used
+				if (!(pg = FontFindGlyph(pi, code)) || pg->done)
+					continue;
+				pg->done = TRUE;
+				prg = &font->char_ranges[pg->range];
+				cols = prg->width ? prg->width : prg->glyph_offsets[pg->code - prg->first_char + 1] - pg->column;
+
+				for(r = 0; r < pg->h; r++) {
+					if (!FontReadLine(pr))
+						return FALSE;
+					y = pg->y + r - prg->offset_y;
+					if (y < 0 || y >= prg->height_pixels)
+						continue;
+					data = (uint8_t *)prg->glyph_data + pg->column * prg->height_bytes + (y >> 3);
+					for(p = pr->line, c = 0; c < pg->w && p[c>>2]; c++) {
+						if ((v = FontHex(p[c>>2])) < 0)
+							return FALSE;
+						x = pg->x + c;
+						if ((v & (8 >> (c & 3))) && x >= 0 && x < cols)
+							data[x * prg->height_bytes] |= 1 << (y & 7);
+					}
+				}
+			} else if (FontKeyword(pr->line, "ENDFONT"))
+				break;
+		}
+		return TRUE;
+	}
+
+	/**
+	 * Measure the next range of glyphs. Returns the number of glyphs in it.
+	 */
+	static unsigned FontMeasureRange(FontInfo *pi, FontGlyph *pg, FontGlyph *pe, struct mf_bwfont_char_range_s *prg, unsigned *pcols) {
+		unsigned	n, i;
+		int			top, bottom, fixed;
+
+		// Bridge small gaps and find the rows used
+		top = pi->h;
+		bottom = 0;
+		for(n = 0; pg+n < pe && (!n || pg[n].code - pg[n-1].code <= FONT_MAX_GAP + 1); n++) {
+			if (pg[n].r == pg[n].l) continue;
+			if (pg[n].t < top) top = pg[n].t;
+			if (pg[n].b > bottom) bottom = pg[n].b;
+		}
+		if (top < 0) top = 0;
+		if (bottom > pi->h) bottom = pi->h;
+		if (bottom < top) bottom = top;
+
+		// A range of equal width glyphs without gaps doesn't need the width and offset tables
+		fixed = pg[n-1].code - pg->code + 1 == (int)n ? pg->advance : 0;
+		for(i = 0; fixed && i < n; i++) {
+			if (pg[i].advance != fixed || (pg[i].r != pg[i].l && (pg[i].l < 0 || pg[i].r > fixed)))
+				fixed = 0;
+		}
+
+		prg->first_char = pg->code;
+		prg->char_count = pg[n-1].code - pg->code + 1;
+		prg->offset_x = 0;
+		prg->offset_y = top;
+		prg->height_pixels = bottom - top;
+		prg->height_bytes = (bottom - top + 7) / 8;
+		prg->width = fixed;
+		if (fixed)
+			*pcols = fixed * n;
+		else {
+			for(*pcols = 0, i = 0; i < n; i++)
+				*pcols += FontColumns(pi, pg + i);
+		}
+		return n;
+	}
+
+	/**
+	 * Lay out the wanted glyphs as bwfont character ranges in one allocation and then read them.
+	 */
+	static font_t FontLoad(FontReader *pr, const char *shortname, const gdispFontRange *ranges, unsigned count) {
+		FontInfo							*pi;
+		struct mf_bwfont_s					*font;
+		struct mf_font_s					mf;
+		struct mf_bwfont_char_range_s		rg, *prg;
+		FontGlyph							*pg, *pe;
+		uint8_t								*pd, *pw;
+		uint16_t							*poff;
+		char								*pname;
+		unsigned							nranges, n, i, cols;
+		size_t								sz;
+
+		font = 0;
+		if (!(pi = (FontInfo *)gfxAlloc(sizeof(FontInfo))))
+			return 0;
+		memset(pi, 0, sizeof(FontInfo));
+		pi->defchar = -1;
+		if (!FontScan(pr, pi, ranges, count) || !FontCrop(pi))
+			goto cleanup;
+		if (!shortname)
+			shortname = pi->name;
+
+		// Work out how much memory we need
+		sz = strlen(pi->name) + strlen(shortname) + 2;
+		nranges = 0;
+		for(pg = pi->glyphs, pe = pi->glyphs + pi->count; pg < pe; pg += n, nranges++) {
+			n = FontMeasureRange(pi, pg, pe, &rg, &cols);
+			if (cols > 0xFFFF)
+				goto cleanup;
+			if (!rg.width)
+				sz += rg.char_count * (sizeof(uint16_t) + sizeof(uint8_t)) + sizeof(uint16_t) + 1;
+			sz += cols * rg.height_bytes;
+		}
+		if (nranges > 255)
+			goto cleanup;
+		sz += sizeof(struct mf_bwfont_s) + nranges * sizeof(struct mf_bwfont_char_range_s);
+		if (!(font = (struct mf_bwfont_s *)gfxAlloc(sz)))
+			goto cleanup;
+		memset(font, 0, sz);
+
+		// Lay out each range. The offsets go first to keep them aligned.
+		prg = (struct mf_bwfont_char_range_s *)(font+1);
+		pd = (uint8_t *)(prg + nranges);
+		for(pg = pi->glyphs; pg < pe; pg += n, prg++) {
+			n = FontMeasureRange(pi, pg, pe, prg, &cols);
+			if (!prg->width) {
+				if (((size_t)pd & 1))
+					pd++;
+				prg->glyph_offsets = poff = (uint16_t *)pd;
+				prg->glyph_widths = pw = (uint8_t *)(poff + prg->char_count + 1);
+				pd = pw + prg->char_count;
+
+				// Missing characters in a gap have no columns and no width
+				for(cols = 0, i = 0; i < n; i++) {
+					while(poff < prg->glyph_offsets + (pg[i].code - prg->first_char))
+						*poff++ = cols;
+					*poff++ = cols;
+					pw[pg[i].code - prg->first_char] = pg[i].advance;
+					pg[i].column = cols;
+					cols += FontColumns(pi, pg + i);
+				}
+				*poff = cols;
+			} else {
+				for(i = 0; i < n; i++)
+					pg[i].column = i * prg->width;
+			}
+			for(i = 0; i < n; i++)
+				pg[i].range = prg - (struct mf_bwfont_char_range_s *)(font+1);
+			prg->glyph_data = pd;
+			pd += cols * prg->height_bytes;
+		}
+
+		// The font description
+		pname = (char *)pd;
+		mf.full_name = strcpy(pname, pi->name);
+		mf.short_name = strcpy(pname + strlen(pi->name) + 1, shortname);
+		mf.width = pi->w;
+		mf.height = pi->h;
+		mf.min_x_advance = 255;
+		mf.max_x_advance = 0;
+		for(pg = pi->glyphs; pg < pe; pg++) {
+			if (pg->advance < mf.min_x_advance) mf.min_x_advance = pg->advance;
+			if (pg->advance > mf.max_x_advance) mf.max_x_advance = pg->advance;
+		}
+		mf.baseline_x = pi->bx;
+		mf.baseline_y = pi->by;
+		mf.line_height = pi->ascent + pi->descent > 0 && pi->ascent + pi->descent < 256 ? pi->ascent + pi->descent : pi->h;
+		mf.flags = FONT_FLAG_DYNAMIC|MF_FONT_FLAG_BW;
+		if (mf.min_x_advance == mf.max_x_advance)
+			mf.flags |= MF_FONT_FLAG_MONOSPACE;
+		if (FontFindGlyph(pi, pi->defchar))
+			mf.fallback_character = pi->defchar;
+		else if (FontFindGlyph(pi, '?'))
+			mf.fallback_character = '?';
+		else
+			mf.fallback_character = pi->glyphs[0].code;
+		mf.character_width = mf_bwfont_character_width;
+		mf.render_character = mf_bwfont_render_character;
+		{
+			struct mf_bwfont_s	bw = { mf, 4, nranges, (const struct mf_bwfont_char_range_s *)(font+1) };
+
+			memcpy(font, &bw, sizeof(bw));
+		}
+
+		// Now fill in the bitmaps
+		FontRewind(pr);
+		if (!FontRead(pr, pi, font)) {
+			gfxFree(font);
+			font = 0;
+		}
+
+	cleanup:
+		if (pi->glyphs)
+			gfxFree(pi->glyphs);
+		gfxFree(pi);
+		return (font_t)font;
+	}
+
+	font_t gdispLoadFontFromMemory(const void *data, size_t size, const gdispFontRange *ranges, unsigned count) {
+		FontReader	*pr;
+		font_t		font;
+
+		if (!(pr = (FontReader *)gfxAlloc(sizeof(FontReader))))
+			return 0;
+		pr->mem = (const char *)data;
+		pr->size = size;
+		pr->pos = 0;
+		#if FONT_FILE_READER
+			pr->f = 0;
+		#endif
+		font = FontLoad(pr, 0, ranges, count);
+		gfxFree(pr);
+		return font;
+	}
+
+	#if FONT_FILE_READER
+		font_t gdispLoadFont(const char *filename, const gdispFontRange *ranges, unsigned count) {
+			FontReader	*pr;
+			font_t		font;
+			const char	*p, *q;
+			char		shortname[32];
+			unsigned	i;
+
+			// The short name is the file name without the path or extension
+			for(p = q = filename; *q; q++) {
+				if (*q == '/' || *q == '\\')
+					p = q + 1;
+			}
+			for(i = 0; p[i] && p[i] != '.' && i < sizeof(shortname)-1; i++)
+				shortname[i] = p[i];
+			shortname[i] = 0;
+
+			if (!(pr = (FontReader *)gfxAlloc(sizeof(FontReader))))
+				return 0;
+			pr->mem = 0;
+			pr->size = pr->pos = 0;
+			font = 0;
+			if ((pr->f = fopen(filename, "rb"))) {
+				font = FontLoad(pr, shortname, ranges, count);
+				fclose(pr->f);
+			}
+			gfxFree(pr);
+			return font;
+		}
+	#endif
+#endif
+
 #endif /* GFX_USE_GDISP && GDISP_NEED_TEXT */
 /** @} */
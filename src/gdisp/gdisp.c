@@ -19,6 +19,10 @@
 /* Include the low level driver information */
 #include "gdisp/lld/gdisp_lld.h"
 
+#if (GDISP_NEED_ANTIALIAS && GDISP_NEED_ARC) || GDISP_NEED_GRADIENT
+	#include <math.h>
+#endif
+
 /*===========================================================================*/
 /* Driver local variables.                                                   */
 /*===========================================================================*/
@@ -90,6 +94,456 @@
 	}
 #endif
 
+#if GDISP_NEED_STATISTICS
+	gdispStat	_gdispStats[GDISP_STAT_COUNT];
+
+	#ifdef GDISP_STATISTICS_COUNTER
+		#define STAT_DECL		uint32_t	statStart
+		#define STAT_BEGIN()	statStart = GDISP_STATISTICS_COUNTER()
+		#define STAT_TIME()		(GDISP_STATISTICS_COUNTER() - statStart)
+	#else
+		/* Without a high resolution counter calls are counted but not timed */
+		#define STAT_DECL		(void)0
+		#define STAT_BEGIN()
+		#define STAT_TIME()		0
+	#endif
+	#define STAT_END(op, px)			stat_add(op, px, STAT_TIME())
+	#define STAT_TEXT_BEGIN(ch)			do { STAT_BEGIN(); (ch).pixels = 0; } while(0)
+	#define STAT_TEXT_PIXELS(ch, px)	((ch)->pixels += (px))
+	#define STAT_TEXT_END(ch)			stat_add_locked(GDISP_STAT_TEXT, (ch).pixels, STAT_TIME())
+
+	/* The caller must hold the GDISP mutex */
+	static void stat_add(gdispStatOp op, uint32_t pixels, uint32_t time) {
+		_gdispStats[op].calls++;
+		_gdispStats[op].pixels += pixels;
+		_gdispStats[op].time += time;
+	}
+
+	#if GDISP_NEED_TEXT
+		/* For the text functions which don't otherwise hold the GDISP mutex */
+		static void stat_add_locked(gdispStatOp op, uint32_t pixels, uint32_t time) {
+			#if GDISP_NEED_MULTITHREAD
+				gfxMutexEnter(&gdispMutex);
+			#endif
+			stat_add(op, pixels, time);
+			#if GDISP_NEED_MULTITHREAD
+				gfxMutexExit(&gdispMutex);
+			#endif
+		}
+	#endif
+
+	static uint32_t stat_line(coord_t x0, coord_t y0, coord_t x1, coord_t y1) {
+		coord_t	dx, dy;
+
+		dx = x1 > x0 ? x1 - x0 : x0 - x1;
+		dy = y1 > y0 ? y1 - y0 : y0 - y1;
+		return (dx > dy ? dx : dy) + 1;
+	}
+
+	#if GDISP_NEED_ARC
+		static uint32_t stat_sweep(coord_t startangle, coord_t endangle) {
+			return endangle < startangle ? 360 + endangle - startangle : endangle - startangle;
+		}
+	#endif
+#else
+	#define STAT_DECL			(void)0
+	#define STAT_BEGIN()
+	#define STAT_END(op, px)
+	#define STAT_TEXT_BEGIN(ch)
+	#define STAT_TEXT_PIXELS(ch, px)
+	#define STAT_TEXT_END(ch)
+#endif
+
+#if GDISP_NEED_CLIPREGION
+	static gdispRegion	clipStack[GDISP_CLIPSTACK_DEPTH];
+	static unsigned		clipDepth;
+
+	/* Iterate over the region rectangles that overlap a bounding box, setting the driver clip to each */
+	typedef struct clipiter {
+		const gdispRect	*r, *e;
+		coord_t			x0, y0, x1, y1;			/* The bounding box of what is being drawn */
+		coord_t			cx0, cy0, cx1, cy1;		/* The saved driver clip */
+		bool_t			changed;
+	} clipiter;
+
+	static void clip_start(clipiter *it, coord_t x0, coord_t y0, coord_t x1, coord_t y1) {
+		it->r = clipStack[clipDepth-1].rect;
+		it->e = it->r + clipStack[clipDepth-1].cnt;
+		it->x0 = x0; it->y0 = y0;
+		it->x1 = x1; it->y1 = y1;
+		it->cx0 = GDISP.clipx0; it->cy0 = GDISP.clipy0;
+		it->cx1 = GDISP.clipx1; it->cy1 = GDISP.clipy1;
+		it->changed = FALSE;
+	}
+
+	static bool_t clip_next(clipiter *it) {
+		const gdispRect	*r;
+		coord_t			x0, y0, x1, y1;
+
+		/* The rectangles are sorted by y so we can stop once we are past the bounding box */
+		while (it->r < it->e && it->r->y0 < it->y1) {
+			r = it->r++;
+			if (r->x0 >= it->x1 || r->x1 <= it->x0 || r->y1 <= it->y0)
+				continue;
+			x0 = r->x0 > it->cx0 ? r->x0 : it->cx0;
+			y0 = r->y0 > it->cy0 ? r->y0 : it->cy0;
+			x1 = r->x1 < it->cx1 ? r->x1 : it->cx1;
+			y1 = r->y1 < it->cy1 ? r->y1 : it->cy1;
+			if (x0 < x1 && y0 < y1) {
+				gdisp_lld_set_clip(x0, y0, x1-x0, y1-y0);
+				it->changed = TRUE;
+				return TRUE;
+			}
+		}
+
+		/* Restore the driver clip */
+		if (it->changed)
+			gdisp_lld_set_clip(it->cx0, it->cy0, it->cx1-it->cx0, it->cy1-it->cy0);
+		return FALSE;
+	}
+
+	static void clip_draw_pixel(coord_t x, coord_t y, color_t color) {
+		const gdispRect	*r, *e;
+
+		if (!clipDepth) {
+			gdisp_lld_draw_pixel(x, y, color);
+			return;
+		}
+		for(r = clipStack[clipDepth-1].rect, e = r + clipStack[clipDepth-1].cnt; r < e && r->y0 <= y; r++) {
+			if (y < r->y1 && x >= r->x0 && x < r->x1) {
+				gdisp_lld_draw_pixel(x, y, color);
+				return;
+			}
+		}
+	}
+
+	static void clip_fill_area(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
+		const gdispRect	*r, *e;
+		coord_t			x0, y0, x1, y1;
+
+		if (!clipDepth) {
+			gdisp_lld_fill_area(x, y, cx, cy, color);
+			return;
+		}
+		for(r = clipStack[clipDepth-1].rect, e = r + clipStack[clipDepth-1].cnt; r < e && r->y0 < y+cy; r++) {
+			x0 = x > r->x0 ? x : r->x0;
+			y0 = y > r->y0 ? y : r->y0;
+			x1 = x+cx < r->x1 ? x+cx : r->x1;
+			y1 = y+cy < r->y1 ? y+cy : r->y1;
+			if (x0 < x1 && y0 < y1)
+				gdisp_lld_fill_area(x0, y0, x1-x0, y1-y0, color);
+		}
+	}
+
+	static void clip_blit_area_ex(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t srcx, coord_t srcy, coord_t srccx, const pixel_t *buffer) {
+		const gdispRect	*r, *e;
+		coord_t			x0, y0, x1, y1;
+
+		if (!clipDepth) {
+			gdisp_lld_blit_area_ex(x, y, cx, cy, srcx, srcy, srccx, buffer);
+			return;
+		}
+		for(r = clipStack[clipDepth-1].rect, e = r + clipStack[clipDepth-1].cnt; r < e && r->y0 < y+cy; r++) {
+			x0 = x > r->x0 ? x : r->x0;
+			y0 = y > r->y0 ? y : r->y0;
+			x1 = x+cx < r->x1 ? x+cx : r->x1;
+			y1 = y+cy < r->y1 ? y+cy : r->y1;
+			if (x0 < x1 && y0 < y1)
+				gdisp_lld_blit_area_ex(x0, y0, x1-x0, y1-y0, srcx+x0-x, srcy+y0-y, srccx, buffer);
+		}
+	}
+
+	static void clip_draw_line(coord_t x0, coord_t y0, coord_t x1, coord_t y1, color_t color) {
+		clipiter	it;
+
+		if (!clipDepth) {
+			gdisp_lld_draw_line(x0, y0, x1, y1, color);
+			return;
+		}
+		clip_start(&it, x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, (x0 > x1 ? x0 : x1)+1, (y0 > y1 ? y0 : y1)+1);
+		while(clip_next(&it))
+			gdisp_lld_draw_line(x0, y0, x1, y1, color);
+	}
+
+	#if GDISP_NEED_CIRCLE
+		static void clip_draw_circle(coord_t x, coord_t y, coord_t radius, color_t color) {
+			clipiter	it;
+
+			if (!clipDepth) {
+				gdisp_lld_draw_circle(x, y, radius, color);
+				return;
+			}
+			clip_start(&it, x-radius, y-radius, x+radius+1, y+radius+1);
+			while(clip_next(&it))
+				gdisp_lld_draw_circle(x, y, radius, color);
+		}
+
+		static void clip_fill_circle(coord_t x, coord_t y, coord_t radius, color_t color) {
+			clipiter	it;
+
+			if (!clipDepth) {
+				gdisp_lld_fill_circle(x, y, radius, color);
+				return;
+			}
+			clip_start(&it, x-radius, y-radius, x+radius+1, y+radius+1);
+			while(clip_next(&it))
+				gdisp_lld_fill_circle(x, y, radius, color);
+		}
+	#endif
+
+	#if GDISP_NEED_ELLIPSE
+		static void clip_draw_ellipse(coord_t x, coord_t y, coord_t a, coord_t b, color_t color) {
+			clipiter	it;
+
+			if (!clipDepth) {
+				gdisp_lld_draw_ellipse(x, y, a, b, color);
+				return;
+			}
+			clip_start(&it, x-a, y-b, x+a+1, y+b+1);
+			while(clip_next(&it))
+				gdisp_lld_draw_ellipse(x, y, a, b, color);
+		}
+
+		static void clip_fill_ellipse(coord_t x, coord_t y, coord_t a, coord_t b, color_t color) {
+			clipiter	it;
+
+			if (!clipDepth) {
+				gdisp_lld_fill_ellipse(x, y, a, b, color);
+				return;
+			}
+			clip_start(&it, x-a, y-b, x+a+1, y+b+1);
+			while(clip_next(&it))
+				gdisp_lld_fill_ellipse(x, y, a, b, color);
+		}
+	#endif
+
+	#if GDISP_NEED_ARC
+		static void clip_draw_arc(coord_t x, coord_t y, coord_t radius, coord_t start, coord_t end, color_t color) {
+			clipiter	it;
+
+			if (!clipDepth) {
+				gdisp_lld_draw_arc(x, y, radius, start, end, color);
+				return;
+			}
+			clip_start(&it, x-radius, y-radius, x+radius+1, y+radius+1);
+			while(clip_next(&it))
+				gdisp_lld_draw_arc(x, y, radius, start, end, color);
+		}
+
+		static void clip_fill_arc(coord_t x, coord_t y, coord_t radius, coord_t start, coord_t end, color_t color) {
+			clipiter	it;
+
+			if (!clipDepth) {
+				gdisp_lld_fill_arc(x, y, radius, start, end, color);
+				return;
+			}
+			clip_start(&it, x-radius, y-radius, x+radius+1, y+radius+1);
+			while(clip_next(&it))
+				gdisp_lld_fill_arc(x, y, radius, start, end, color);
+		}
+	#endif
+#else
+	#define clip_draw_pixel		gdisp_lld_draw_pixel
+	#define clip_draw_line		gdisp_lld_draw_line
+	#define clip_fill_area		gdisp_lld_fill_area
+	#define clip_blit_area_ex	gdisp_lld_blit_area_ex
+	#define clip_draw_circle	gdisp_lld_draw_circle
+	#define clip_fill_circle	gdisp_lld_fill_circle
+	#define clip_draw_ellipse	gdisp_lld_draw_ellipse
+	#define clip_fill_ellipse	gdisp_lld_fill_ellipse
+	#define clip_draw_arc		gdisp_lld_draw_arc
+	#define clip_fill_arc		gdisp_lld_fill_arc
+#endif
+
+#if GDISP_NEED_TRACE
+	/* Trace records that are not drawing calls use values past the GDISP_LLD_MSG_xxx actions */
+	#define TRACE_REC_DATA		0x80		/* Blit pixels: hash, cx, cy, cx*cy RGB pixels */
+	#define TRACE_REC_TIME		0x81		/* Ticks elapsed since the previous time record */
+	#define TRACE_REC_PUSHCLIP	0x82		/* Clip region: count, rectangles */
+	#define TRACE_REC_POPCLIP	0x83
+	#define TRACE_VERSION		2
+	#define TRACE_HASHES		16			/* The number of recent blit buffers that are remembered */
+	#define TRACE_CHUNK			16			/* Pixels converted at a time */
+
+	/* The record format for each GDISP_LLD_MSG_xxx action - coordinates are in the order of the message structure */
+	#define TF_COORDS			0x07
+	#define TF_COLOR			0x08
+	#define TF_VALID			0x10
+	static const uint8_t traceFormat[] = {
+		0,								/* NOP */
+		0,								/* INIT */
+		TF_VALID|TF_COLOR|0,			/* CLEAR */
+		TF_VALID|TF_COLOR|2,			/* DRAWPIXEL */
+		TF_VALID|TF_COLOR|4,			/* FILLAREA */
+		TF_VALID|4,						/* BLITAREA - followed by the buffer hash */
+		TF_VALID|TF_COLOR|4,			/* DRAWLINE */
+		TF_VALID|4,						/* SETCLIP */
+		TF_VALID|TF_COLOR|3,			/* DRAWCIRCLE */
+		TF_VALID|TF_COLOR|3,			/* FILLCIRCLE */
+		TF_VALID|TF_COLOR|4,			/* DRAWELLIPSE */
+		TF_VALID|TF_COLOR|4,			/* FILLELLIPSE */
+		TF_VALID|TF_COLOR|5,			/* DRAWARC */
+		TF_VALID|TF_COLOR|5,			/* FILLARC */
+		0,								/* GETPIXELCOLOR */
+		TF_VALID|TF_COLOR|5,			/* VERTICALSCROLL */
+		TF_VALID|1,						/* CONTROL - what, followed by the value as 64 bits */
+		0,								/* QUERY */
+	};
+
+	static gdispTraceWriteFn	traceWrite;
+	static void *				traceParam;
+	static systemticks_t		traceTime;
+	static uint32_t				traceHashes[TRACE_HASHES];
+	static unsigned				traceNextHash;
+
+	#define TRACE(action, a, b, c, d, e, color)		{ if (traceWrite) trace_put(action, a, b, c, d, e, color); }
+	#define TRACE_BLIT(x, y, cx, cy, sx, sy, scx, buf)	{ if (traceWrite) trace_blit(x, y, cx, cy, sx, sy, scx, buf); }
+	#define TRACE_CONTROL(what, value)					{ if (traceWrite) trace_control(what, value); }
+
+	static uint8_t *trace_put16(uint8_t *p, coord_t v) {
+		*p++ = (uint8_t)v;
+		*p++ = (uint8_t)(v >> 8);
+		return p;
+	}
+
+	static uint8_t *trace_put32(uint8_t *p, uint32_t v) {
+		*p++ = (uint8_t)v;
+		*p++ = (uint8_t)(v >> 8);
+		*p++ = (uint8_t)(v >> 16);
+		*p++ = (uint8_t)(v >> 24);
+		return p;
+	}
+
+	static uint8_t *trace_putcolor(uint8_t *p, color_t c) {
+		*p++ = RED_OF(c);
+		*p++ = GREEN_OF(c);
+		*p++ = BLUE_OF(c);
+		return p;
+	}
+
+	/* Only write a time record when the clock has moved on since the last one */
+	static void trace_time(void) {
+		uint8_t			buf[5];
+		systemticks_t	now;
+
+		now = gfxSystemTicks();
+		if (now == traceTime)
+			return;
+		buf[0] = TRACE_REC_TIME;
+		trace_put32(buf+1, now - traceTime);
+		traceTime = now;
+		traceWrite(traceParam, buf, 5);
+	}
+
+	static void trace_put(gdisp_msgaction_t action, coord_t a, coord_t b, coord_t c, coord_t d, coord_t e, color_t color) {
+		uint8_t		buf[1+5*2+3], *p;
+		coord_t		v[5];
+		unsigned	i, n;
+
+		trace_time();
+		v[0] = a; v[1] = b; v[2] = c; v[3] = d; v[4] = e;
+		p = buf;
+		*p++ = action;
+		for(n = traceFormat[action] & TF_COORDS, i = 0; i < n; i++)
+			p = trace_put16(p, v[i]);
+		if ((traceFormat[action] & TF_COLOR))
+			p = trace_putcolor(p, color);
+		traceWrite(traceParam, buf, p - buf);
+	}
+
+	static void trace_blit(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t srcx, coord_t srcy, coord_t srccx, const pixel_t *buffer) {
+		uint8_t			buf[3*TRACE_CHUNK], *p;
+		const pixel_t	*row;
+		uint32_t		hash;
+		coord_t			i, j, k, n;
+
+		if (cx <= 0 || cy <= 0)
+			return;
+		trace_time();
+
+		/* Hash the pixels that are actually used (FNV-1a) */
+		hash = 2166136261UL;
+		for(row = buffer + srcy*srccx + srcx, j = 0; j < cy; j++, row += srccx) {
+			for(i = 0; i < cx; i++) {
+				trace_putcolor(buf, row[i]);
+				hash = (hash ^ buf[0]) * 16777619UL;
+				hash = (hash ^ buf[1]) * 16777619UL;
+				hash = (hash ^ buf[2]) * 16777619UL;
+			}
+		}
+		hash = (hash ^ cx) * 16777619UL;
+		if (!hash)
+			hash = 1;
+
+		/* Write the pixels only if they are not one of the recently seen buffers */
+		for(i = 0; i < TRACE_HASHES && traceHashes[i] != hash; i++);
+		if (i == TRACE_HASHES) {
+			traceHashes[traceNextHash] = hash;
+			traceNextHash = (traceNextHash + 1) % TRACE_HASHES;
+			buf[0] = TRACE_REC_DATA;
+			p = trace_put32(buf+1, hash);
+			p = trace_put16(p, cx);
+			p = trace_put16(p, cy);
+			traceWrite(traceParam, buf, p - buf);
+			for(row = buffer + srcy*srccx + srcx, j = 0; j < cy; j++, row += srccx) {
+				for(i = 0; i < cx; i += n) {
+					n = cx - i > TRACE_CHUNK ? TRACE_CHUNK : cx - i;
+					for(p = buf, k = 0; k < n; k++)
+						p = trace_putcolor(p, row[i+k]);
+					traceWrite(traceParam, buf, 3*n);
+				}
+			}
+		}
+
+		buf[0] = GDISP_LLD_MSG_BLITAREA;
+		p = trace_put16(buf+1, x);
+		p = trace_put16(p, y);
+		p = trace_put16(p, cx);
+		p = trace_put16(p, cy);
+		p = trace_put32(p, hash);
+		traceWrite(traceParam, buf, p - buf);
+	}
+
+	#if GDISP_NEED_CONTROL
+		/* The value is recorded at full width as it may be a pointer or a 32 bit number */
+		static void trace_control(unsigned what, void *value) {
+			uint8_t		buf[1+2+8], *p;
+			uint64_t	v;
+
+			trace_time();
+			v = (size_t)value;
+			buf[0] = GDISP_LLD_MSG_CONTROL;
+			p = trace_put16(buf+1, (coord_t)what);
+			p = trace_put32(p, (uint32_t)v);
+			p = trace_put32(p, (uint32_t)(v >> 32));
+			traceWrite(traceParam, buf, p - buf);
+		}
+	#endif
+
+	#if GDISP_NEED_CLIPREGION
+		static void trace_region(const gdispRegion *rgn) {
+			uint8_t		buf[2+4*2], *p;
+			unsigned	i;
+
+			trace_time();
+			buf[0] = TRACE_REC_PUSHCLIP;
+			buf[1] = rgn->cnt;
+			traceWrite(traceParam, buf, 2);
+			for(i = 0; i < rgn->cnt; i++) {
+				p = trace_put16(buf, rgn->rect[i].x0);
+				p = trace_put16(p, rgn->rect[i].y0);
+				p = trace_put16(p, rgn->rect[i].x1);
+				p = trace_put16(p, rgn->rect[i].y1);
+				traceWrite(traceParam, buf, p - buf);
+			}
+		}
+	#endif
+#else
+	#define TRACE(action, a, b, c, d, e, color)
+	#define TRACE_BLIT(x, y, cx, cy, sx, sy, scx, buf)
+	#define TRACE_CONTROL(what, value)
+#endif
+
 /*===========================================================================*/
 /* Driver exported functions.                                                */
 /*===========================================================================*/
@@ -149,8 +603,13 @@
 
 #if GDISP_NEED_MULTITHREAD
 	void gdispClear(color_t color) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
+		TRACE(GDISP_LLD_MSG_CLEAR, 0, 0, 0, 0, 0, color);
+		STAT_BEGIN();
 		gdisp_lld_clear(color);
+		STAT_END(GDISP_STAT_CLEAR, (uint32_t)GDISP.Width * GDISP.Height);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_ASYNC
@@ -159,12 +618,26 @@
 		p->clear.color = color;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispClear(color_t color) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_CLEAR, 0, 0, 0, 0, 0, color);
+		STAT_BEGIN();
+		gdisp_lld_clear(color);
+		STAT_END(GDISP_STAT_CLEAR, (uint32_t)GDISP.Width * GDISP.Height);
+	}
 #endif
 
 #if GDISP_NEED_MULTITHREAD
 	void gdispDrawPixel(coord_t x, coord_t y, color_t color) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
-		gdisp_lld_draw_pixel(x, y, color);
+		TRACE(GDISP_LLD_MSG_DRAWPIXEL, x, y, 0, 0, 0, color);
+		STAT_BEGIN();
+		clip_draw_pixel(x, y, color);
+		STAT_END(GDISP_STAT_DRAWPIXEL, 1);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_ASYNC
@@ -175,12 +648,26 @@
 		p->drawpixel.color = color;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispDrawPixel(coord_t x, coord_t y, color_t color) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_DRAWPIXEL, x, y, 0, 0, 0, color);
+		STAT_BEGIN();
+		clip_draw_pixel(x, y, color);
+		STAT_END(GDISP_STAT_DRAWPIXEL, 1);
+	}
 #endif
 	
 #if GDISP_NEED_MULTITHREAD
 	void gdispDrawLine(coord_t x0, coord_t y0, coord_t x1, coord_t y1, color_t color) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
-		gdisp_lld_draw_line(x0, y0, x1, y1, color);
+		TRACE(GDISP_LLD_MSG_DRAWLINE, x0, y0, x1, y1, 0, color);
+		STAT_BEGIN();
+		clip_draw_line(x0, y0, x1, y1, color);
+		STAT_END(GDISP_STAT_DRAWLINE, stat_line(x0, y0, x1, y1));
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_ASYNC
@@ -193,12 +680,26 @@
 		p->drawline.color = color;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispDrawLine(coord_t x0, coord_t y0, coord_t x1, coord_t y1, color_t color) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_DRAWLINE, x0, y0, x1, y1, 0, color);
+		STAT_BEGIN();
+		clip_draw_line(x0, y0, x1, y1, color);
+		STAT_END(GDISP_STAT_DRAWLINE, stat_line(x0, y0, x1, y1));
+	}
 #endif
 
 #if GDISP_NEED_MULTITHREAD
 	void gdispFillArea(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
-		gdisp_lld_fill_area(x, y, cx, cy, color);
+		TRACE(GDISP_LLD_MSG_FILLAREA, x, y, cx, cy, 0, color);
+		STAT_BEGIN();
+		clip_fill_area(x, y, cx, cy, color);
+		STAT_END(GDISP_STAT_FILLAREA, (uint32_t)cx * cy);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_ASYNC
@@ -211,12 +712,26 @@
 		p->fillarea.color = color;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispFillArea(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_FILLAREA, x, y, cx, cy, 0, color);
+		STAT_BEGIN();
+		clip_fill_area(x, y, cx, cy, color);
+		STAT_END(GDISP_STAT_FILLAREA, (uint32_t)cx * cy);
+	}
 #endif
 	
 #if GDISP_NEED_MULTITHREAD
 	void gdispBlitAreaEx(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t srcx, coord_t srcy, coord_t srccx, const pixel_t *buffer) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
-		gdisp_lld_blit_area_ex(x, y, cx, cy, srcx, srcy, srccx, buffer);
+		TRACE_BLIT(x, y, cx, cy, srcx, srcy, srccx, buffer);
+		STAT_BEGIN();
+		clip_blit_area_ex(x, y, cx, cy, srcx, srcy, srccx, buffer);
+		STAT_END(GDISP_STAT_BLITAREA, (uint32_t)cx * cy);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_ASYNC
@@ -232,12 +747,26 @@
 		p->blitarea.buffer = buffer;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispBlitAreaEx(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t srcx, coord_t srcy, coord_t srccx, const pixel_t *buffer) {
+		STAT_DECL;
+
+		TRACE_BLIT(x, y, cx, cy, srcx, srcy, srccx, buffer);
+		STAT_BEGIN();
+		clip_blit_area_ex(x, y, cx, cy, srcx, srcy, srccx, buffer);
+		STAT_END(GDISP_STAT_BLITAREA, (uint32_t)cx * cy);
+	}
 #endif
 	
 #if (GDISP_NEED_CLIP && GDISP_NEED_MULTITHREAD)
 	void gdispSetClip(coord_t x, coord_t y, coord_t cx, coord_t cy) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
+		TRACE(GDISP_LLD_MSG_SETCLIP, x, y, cx, cy, 0, 0);
+		STAT_BEGIN();
 		gdisp_lld_set_clip(x, y, cx, cy);
+		STAT_END(GDISP_STAT_SETCLIP, 0);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_CLIP && GDISP_NEED_ASYNC
@@ -249,12 +778,184 @@
 		p->setclip.cy = cy;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif GDISP_NEED_CLIP && (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispSetClip(coord_t x, coord_t y, coord_t cx, coord_t cy) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_SETCLIP, x, y, cx, cy, 0, 0);
+		STAT_BEGIN();
+		gdisp_lld_set_clip(x, y, cx, cy);
+		STAT_END(GDISP_STAT_SETCLIP, 0);
+	}
+#endif
+
+#if GDISP_NEED_CLIPREGION
+	/* Keep the rectangles sorted top to bottom then left to right */
+	static void region_sort(gdispRegion *rgn) {
+		gdispRect	t;
+		unsigned	i, j;
+
+		for(i = 1; i < rgn->cnt; i++) {
+			t = rgn->rect[i];
+			for(j = i; j && (rgn->rect[j-1].y0 > t.y0 || (rgn->rect[j-1].y0 == t.y0 && rgn->rect[j-1].x0 > t.x0)); j--)
+				rgn->rect[j] = rgn->rect[j-1];
+			rgn->rect[j] = t;
+		}
+	}
+
+	void gdispRegionSet(gdispRegion *rgn, coord_t x, coord_t y, coord_t cx, coord_t cy) {
+		if (cx <= 0 || cy <= 0) {
+			rgn->cnt = 0;
+			return;
+		}
+		rgn->cnt = 1;
+		rgn->rect[0].x0 = x;
+		rgn->rect[0].y0 = y;
+		rgn->rect[0].x1 = x + cx;
+		rgn->rect[0].y1 = y + cy;
+	}
+
+	void gdispRegionIntersect(gdispRegion *rgn, coord_t x, coord_t y, coord_t cx, coord_t cy) {
+		gdispRect	*r, *d, *e;
+
+		/* Clip each rectangle and drop any that become empty */
+		for(r = d = rgn->rect, e = r + rgn->cnt; r < e; r++) {
+			if (r->x0 < x)		r->x0 = x;
+			if (r->y0 < y)		r->y0 = y;
+			if (r->x1 > x+cx)	r->x1 = x+cx;
+			if (r->y1 > y+cy)	r->y1 = y+cy;
+			if (r->x0 < r->x1 && r->y0 < r->y1)
+				*d++ = *r;
+		}
+		rgn->cnt = d - rgn->rect;
+
+		/*
+		 * The top to bottom order is kept but rectangles that started in different rows can now
+		 * share the same top edge, so the left to right order within a row may need fixing.
+		 */
+		region_sort(rgn);
+	}
+
+	bool_t gdispRegionIntersectRegion(gdispRegion *rgn, const gdispRegion *other) {
+		gdispRegion		res;
+		const gdispRect	*a, *b;
+		gdispRect		*d;
+
+		res.cnt = 0;
+		for(a = rgn->rect; a < rgn->rect + rgn->cnt; a++) {
+			for(b = other->rect; b < other->rect + other->cnt; b++) {
+				if (b->x0 >= a->x1 || b->x1 <= a->x0 || b->y0 >= a->y1 || b->y1 <= a->y0)
+					continue;
+				if (res.cnt >= GDISP_CLIPREGION_RECTS)
+					return FALSE;
+				d = &res.rect[res.cnt++];
+				d->x0 = a->x0 > b->x0 ? a->x0 : b->x0;
+				d->y0 = a->y0 > b->y0 ? a->y0 : b->y0;
+				d->x1 = a->x1 < b->x1 ? a->x1 : b->x1;
+				d->y1 = a->y1 < b->y1 ? a->y1 : b->y1;
+			}
+		}
+		region_sort(&res);
+		*rgn = res;
+		return TRUE;
+	}
+
+	bool_t gdispRegionSubtract(gdispRegion *rgn, coord_t x, coord_t y, coord_t cx, coord_t cy) {
+		gdispRegion		res;
+		const gdispRect	*r;
+		gdispRect		*d;
+		coord_t			x1, y1, ty0, ty1;
+
+		if (cx <= 0 || cy <= 0)
+			return TRUE;
+		x1 = x + cx;
+		y1 = y + cy;
+
+		/* Each rectangle is split into at most four pieces - above, left, right and below the hole */
+		#define ADDRECT(ax0, ay0, ax1, ay1)	{										\
+					if (res.cnt >= GDISP_CLIPREGION_RECTS) return FALSE;			\
+					d = &res.rect[res.cnt++];										\
+					d->x0 = (ax0); d->y0 = (ay0); d->x1 = (ax1); d->y1 = (ay1);		\
+				}
+		res.cnt = 0;
+		for(r = rgn->rect; r < rgn->rect + rgn->cnt; r++) {
+			if (x >= r->x1 || x1 <= r->x0 || y >= r->y1 || y1 <= r->y0) {
+				ADDRECT(r->x0, r->y0, r->x1, r->y1);
+				continue;
+			}
+			ty0 = y > r->y0 ? y : r->y0;
+			ty1 = y1 < r->y1 ? y1 : r->y1;
+			if (r->y0 < ty0)
+				ADDRECT(r->x0, r->y0, r->x1, ty0);
+			if (r->x0 < x)
+				ADDRECT(r->x0, ty0, x, ty1);
+			if (x1 < r->x1)
+				ADDRECT(x1, ty0, r->x1, ty1);
+			if (ty1 < r->y1)
+				ADDRECT(r->x0, ty1, r->x1, r->y1);
+		}
+		#undef ADDRECT
+		region_sort(&res);
+		*rgn = res;
+		return TRUE;
+	}
+
+	bool_t gdispPushClip(const gdispRegion *rgn) {
+		bool_t	ok;
+
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexEnter(&gdispMutex);
+		#endif
+		ok = FALSE;
+		if (clipDepth < GDISP_CLIPSTACK_DEPTH) {
+			clipStack[clipDepth] = *rgn;
+			if (!clipDepth)
+				region_sort(&clipStack[0]);			/* A region built by hand may not be sorted */
+			if (!clipDepth || gdispRegionIntersectRegion(&clipStack[clipDepth], &clipStack[clipDepth-1])) {
+				clipDepth++;
+				ok = TRUE;
+				#if GDISP_NEED_TRACE
+					if (traceWrite)
+						trace_region(rgn);
+				#endif
+			}
+		}
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexExit(&gdispMutex);
+		#endif
+		return ok;
+	}
+
+	void gdispPopClip(void) {
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexEnter(&gdispMutex);
+		#endif
+		if (clipDepth) {
+			clipDepth--;
+			#if GDISP_NEED_TRACE
+				if (traceWrite) {
+					uint8_t	rec = TRACE_REC_POPCLIP;
+
+					trace_time();
+					traceWrite(traceParam, &rec, 1);
+				}
+			#endif
+		}
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexExit(&gdispMutex);
+		#endif
+	}
 #endif
 
 #if (GDISP_NEED_CIRCLE && GDISP_NEED_MULTITHREAD)
 	void gdispDrawCircle(coord_t x, coord_t y, coord_t radius, color_t color) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
-		gdisp_lld_draw_circle(x, y, radius, color);
+		TRACE(GDISP_LLD_MSG_DRAWCIRCLE, x, y, radius, 0, 0, color);
+		STAT_BEGIN();
+		clip_draw_circle(x, y, radius, color);
+		STAT_END(GDISP_STAT_DRAWCIRCLE, 44 * (uint32_t)radius / 7);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_CIRCLE && GDISP_NEED_ASYNC
@@ -266,12 +967,26 @@
 		p->drawcircle.color = color;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif GDISP_NEED_CIRCLE && (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispDrawCircle(coord_t x, coord_t y, coord_t radius, color_t color) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_DRAWCIRCLE, x, y, radius, 0, 0, color);
+		STAT_BEGIN();
+		clip_draw_circle(x, y, radius, color);
+		STAT_END(GDISP_STAT_DRAWCIRCLE, 44 * (uint32_t)radius / 7);
+	}
 #endif
 	
 #if (GDISP_NEED_CIRCLE && GDISP_NEED_MULTITHREAD)
 	void gdispFillCircle(coord_t x, coord_t y, coord_t radius, color_t color) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
-		gdisp_lld_fill_circle(x, y, radius, color);
+		TRACE(GDISP_LLD_MSG_FILLCIRCLE, x, y, radius, 0, 0, color);
+		STAT_BEGIN();
+		clip_fill_circle(x, y, radius, color);
+		STAT_END(GDISP_STAT_FILLCIRCLE, 22 * (uint32_t)radius * radius / 7);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_CIRCLE && GDISP_NEED_ASYNC
@@ -283,12 +998,26 @@
 		p->fillcircle.color = color;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif GDISP_NEED_CIRCLE && (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispFillCircle(coord_t x, coord_t y, coord_t radius, color_t color) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_FILLCIRCLE, x, y, radius, 0, 0, color);
+		STAT_BEGIN();
+		clip_fill_circle(x, y, radius, color);
+		STAT_END(GDISP_STAT_FILLCIRCLE, 22 * (uint32_t)radius * radius / 7);
+	}
 #endif
 
 #if (GDISP_NEED_ELLIPSE && GDISP_NEED_MULTITHREAD)
 	void gdispDrawEllipse(coord_t x, coord_t y, coord_t a, coord_t b, color_t color) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
-		gdisp_lld_draw_ellipse(x, y, a, b, color);
+		TRACE(GDISP_LLD_MSG_DRAWELLIPSE, x, y, a, b, 0, color);
+		STAT_BEGIN();
+		clip_draw_ellipse(x, y, a, b, color);
+		STAT_END(GDISP_STAT_DRAWELLIPSE, 22 * (uint32_t)(a + b) / 7);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_ELLIPSE && GDISP_NEED_ASYNC
@@ -301,12 +1030,26 @@
 		p->drawellipse.color = color;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif GDISP_NEED_ELLIPSE && (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispDrawEllipse(coord_t x, coord_t y, coord_t a, coord_t b, color_t color) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_DRAWELLIPSE, x, y, a, b, 0, color);
+		STAT_BEGIN();
+		clip_draw_ellipse(x, y, a, b, color);
+		STAT_END(GDISP_STAT_DRAWELLIPSE, 22 * (uint32_t)(a + b) / 7);
+	}
 #endif
 	
 #if (GDISP_NEED_ELLIPSE && GDISP_NEED_MULTITHREAD)
 	void gdispFillEllipse(coord_t x, coord_t y, coord_t a, coord_t b, color_t color) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
-		gdisp_lld_fill_ellipse(x, y, a, b, color);
+		TRACE(GDISP_LLD_MSG_FILLELLIPSE, x, y, a, b, 0, color);
+		STAT_BEGIN();
+		clip_fill_ellipse(x, y, a, b, color);
+		STAT_END(GDISP_STAT_FILLELLIPSE, 22 * (uint32_t)a * b / 7);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_ELLIPSE && GDISP_NEED_ASYNC
@@ -319,12 +1062,26 @@
 		p->fillellipse.color = color;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif GDISP_NEED_ELLIPSE && (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispFillEllipse(coord_t x, coord_t y, coord_t a, coord_t b, color_t color) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_FILLELLIPSE, x, y, a, b, 0, color);
+		STAT_BEGIN();
+		clip_fill_ellipse(x, y, a, b, color);
+		STAT_END(GDISP_STAT_FILLELLIPSE, 22 * (uint32_t)a * b / 7);
+	}
 #endif
 
 #if (GDISP_NEED_ARC && GDISP_NEED_MULTITHREAD)
 	void gdispDrawArc(coord_t x, coord_t y, coord_t radius, coord_t start, coord_t end, color_t color) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
-		gdisp_lld_draw_arc(x, y, radius, start, end, color);
+		TRACE(GDISP_LLD_MSG_DRAWARC, x, y, radius, start, end, color);
+		STAT_BEGIN();
+		clip_draw_arc(x, y, radius, start, end, color);
+		STAT_END(GDISP_STAT_DRAWARC, 44 * (uint32_t)radius / 7 * stat_sweep(start, end) / 360);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_ARC && GDISP_NEED_ASYNC
@@ -338,12 +1095,26 @@
 		p->drawarc.color = color;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif GDISP_NEED_ARC && (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispDrawArc(coord_t x, coord_t y, coord_t radius, coord_t start, coord_t end, color_t color) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_DRAWARC, x, y, radius, start, end, color);
+		STAT_BEGIN();
+		clip_draw_arc(x, y, radius, start, end, color);
+		STAT_END(GDISP_STAT_DRAWARC, 44 * (uint32_t)radius / 7 * stat_sweep(start, end) / 360);
+	}
 #endif
 
 #if (GDISP_NEED_ARC && GDISP_NEED_MULTITHREAD)
 	void gdispFillArc(coord_t x, coord_t y, coord_t radius, coord_t start, coord_t end, color_t color) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
-		gdisp_lld_fill_arc(x, y, radius, start, end, color);
+		TRACE(GDISP_LLD_MSG_FILLARC, x, y, radius, start, end, color);
+		STAT_BEGIN();
+		clip_fill_arc(x, y, radius, start, end, color);
+		STAT_END(GDISP_STAT_FILLARC, 22 * (uint32_t)radius * radius / 7 * stat_sweep(start, end) / 360);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_ARC && GDISP_NEED_ASYNC
@@ -357,6 +1128,15 @@
 		p->fillarc.color = color;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif GDISP_NEED_ARC && (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispFillArc(coord_t x, coord_t y, coord_t radius, coord_t start, coord_t end, color_t color) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_FILLARC, x, y, radius, start, end, color);
+		STAT_BEGIN();
+		clip_fill_arc(x, y, radius, start, end, color);
+		STAT_END(GDISP_STAT_FILLARC, 22 * (uint32_t)radius * radius / 7 * stat_sweep(start, end) / 360);
+	}
 #endif
 
 #if GDISP_NEED_ARC
@@ -410,8 +1190,13 @@ void gdispFillRoundedBox(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t r
 
 #if (GDISP_NEED_SCROLL && GDISP_NEED_MULTITHREAD)
 	void gdispVerticalScroll(coord_t x, coord_t y, coord_t cx, coord_t cy, int lines, color_t bgcolor) {
+		STAT_DECL;
+
 		gfxMutexEnter(&gdispMutex);
+		TRACE(GDISP_LLD_MSG_VERTICALSCROLL, x, y, cx, cy, lines, bgcolor);
+		STAT_BEGIN();
 		gdisp_lld_vertical_scroll(x, y, cx, cy, lines, bgcolor);
+		STAT_END(GDISP_STAT_SCROLL, (uint32_t)cx * cy);
 		gfxMutexExit(&gdispMutex);
 	}
 #elif GDISP_NEED_SCROLL && GDISP_NEED_ASYNC
@@ -425,11 +1210,21 @@ void gdispFillRoundedBox(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t r
 		p->verticalscroll.bgcolor = bgcolor;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif GDISP_NEED_SCROLL && (GDISP_NEED_CLIPREGION || GDISP_NEED_STATISTICS || GDISP_NEED_TRACE)
+	void gdispVerticalScroll(coord_t x, coord_t y, coord_t cx, coord_t cy, int lines, color_t bgcolor) {
+		STAT_DECL;
+
+		TRACE(GDISP_LLD_MSG_VERTICALSCROLL, x, y, cx, cy, lines, bgcolor);
+		STAT_BEGIN();
+		gdisp_lld_vertical_scroll(x, y, cx, cy, lines, bgcolor);
+		STAT_END(GDISP_STAT_SCROLL, (uint32_t)cx * cy);
+	}
 #endif
 
 #if (GDISP_NEED_CONTROL && GDISP_NEED_MULTITHREAD)
 	void gdispControl(unsigned what, void *value) {
 		gfxMutexEnter(&gdispMutex);
+		TRACE_CONTROL(what, value);
 		gdisp_lld_control(what, value);
 		gfxMutexExit(&gdispMutex);
 	}
@@ -440,6 +1235,11 @@ void gdispFillRoundedBox(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t r
 		p->control.value = value;
 		gfxQueuePut(&gdispQueue, &p->qi, TIME_IMMEDIATE);
 	}
+#elif GDISP_NEED_CONTROL && GDISP_NEED_TRACE
+	void gdispControl(unsigned what, void *value) {
+		TRACE_CONTROL(what, value);
+		gdisp_lld_control(what, value);
+	}
 #endif
 
 #if (GDISP_NEED_MULTITHREAD || GDISP_NEED_ASYNC) && GDISP_NEED_QUERY
@@ -483,6 +1283,24 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 	}
 }
 
+#if GDISP_NEED_CONVEX_POLYGON || GDISP_NEED_ANTIALIAS || GDISP_NEED_GRADIENT
+	/* Integer square root */
+	static uint32_t isqrt(uint32_t n) {
+		uint32_t	r, b;
+
+		r = 0;
+		for(b = 1UL<<30; b > n; b >>= 2);
+		for(; b; b >>= 2) {
+			if (n >= r + b) {
+				n -= r + b;
+				r = (r >> 1) + b;
+			} else
+				r >>= 1;
+		}
+		return r;
+	}
+#endif
+
 #if GDISP_NEED_CONVEX_POLYGON
 	void gdispDrawPoly(coord_t tx, coord_t ty, const point *pntarray, unsigned cnt, color_t color) {
 		const point	*epnt, *p;
@@ -576,51 +1394,778 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 			}
 		}
 	}
+
+	/* Returns n/(2*len) rounded up to the next integer */
+	static coord_t stroke_ceil(int32_t n, int32_t len) {
+		len <<= 1;
+		return n >= 0 ? (n + len - 1) / len : -(-n / len);
+	}
+
+	typedef struct strokeseg {
+		point	d;				// The direction of the segment
+		point	pa, pb;			// The offsets to the two edges of the stroke
+		point	e;				// The offset to extend the segment by half the stroke width
+	} strokeseg;
+
+	/*
+	 * Calculate the edge offsets for a thick line segment.
+	 * The edges are half the width either side of the line through the pixel centres. The
+	 * offsets are rounded up as the polygon fill includes the left edge but excludes the right
+	 * edge so this covers exactly width pixels across an axis aligned line.
+	 */
+	static bool_t stroke_seg(strokeseg *s, const point *p0, const point *p1, coord_t width) {
+		uint32_t	len2;
+		int32_t		len, w;
+		unsigned	shift;
+
+		s->d.x = p1->x - p0->x;
+		s->d.y = p1->y - p0->y;
+		if (!s->d.x && !s->d.y)
+			return FALSE;
+
+		/* Scale up short lines to keep the precision */
+		len2 = (uint32_t)((int32_t)s->d.x*s->d.x) + (uint32_t)((int32_t)s->d.y*s->d.y);
+		for(shift = 0; shift < 8 && !(len2 & 0xC0000000); shift++)
+			len2 <<= 2;
+		len = isqrt(len2);
+		w = (int32_t)width << shift;
+
+		s->pa.x = stroke_ceil(-s->d.y * w, len);
+		s->pa.y = stroke_ceil(s->d.x * w, len);
+		s->pb.x = stroke_ceil(s->d.y * w, len);
+		s->pb.y = stroke_ceil(-s->d.x * w, len);
+		s->e.x = s->pa.y;
+		s->e.y = s->pb.x;
+		return TRUE;
+	}
+
+	/* Fill the gap on the outside of the corner between two thick line segments */
+	static void stroke_join(coord_t x, coord_t y, const strokeseg *s1, const strokeseg *s2, coord_t width, linejoin_t join, color_t color) {
+		const point	*o1, *o2;
+		point		pts[4];
+		int32_t		cross, h2, d;
+
+		/* Which side is the outside of the corner? */
+		cross = (int32_t)s1->d.x * s2->d.y - (int32_t)s1->d.y * s2->d.x;
+		if (!cross)
+			return;
+		if (cross > 0) {
+			o1 = &s1->pb;
+			o2 = &s2->pb;
+		} else {
+			o1 = &s1->pa;
+			o2 = &s2->pa;
+		}
+
+		#if GDISP_NEED_CIRCLE
+			if (join == joinRound) {
+				gdispFillCircle(x, y, (width-1)/2, color);
+				return;
+			}
+		#else
+			(void) width;
+		#endif
+
+		pts[0].x = x;
+		pts[0].y = y;
+		pts[1].x = x + o1->x;
+		pts[1].y = y + o1->y;
+
+		if (join != joinBevel) {
+			/*
+			 * The miter tip is along o1+o2 where it projects onto each edge normal by half the width.
+			 * Use a miter limit of 4 (as per SVG) ie. the angle between the normals has cos >= -7/8
+			 */
+			h2 = (int32_t)o1->x*o1->x + (int32_t)o1->y*o1->y;
+			d = (int32_t)o1->x*o2->x + (int32_t)o1->y*o2->y;
+			if (h2 && 8*d >= -7*h2) {
+				pts[2].x = x + (o1->x + o2->x) * h2 / (h2 + d);
+				pts[2].y = y + (o1->y + o2->y) * h2 / (h2 + d);
+				pts[3].x = x + o2->x;
+				pts[3].y = y + o2->y;
+				gdispFillConvexPoly(0, 0, pts, 4, color);
+				return;
+			}
+		}
+
+		pts[2].x = x + o2->x;
+		pts[2].y = y + o2->y;
+		gdispFillConvexPoly(0, 0, pts, 3, color);
+	}
+
+	void gdispDrawThickPolyline(coord_t tx, coord_t ty, const point *pntarray, unsigned cnt, color_t color, coord_t width, linejoin_t join, linecap_t cap) {
+		const point	*p, *epnt;
+		strokeseg	segs[2], *s, *ps;
+		point		p0, p1, pts[4];
+
+		if (cnt < 2)
+			return;
+		epnt = &pntarray[cnt-1];
+
+		if (width <= 1) {
+			for(p = pntarray; p < epnt; p++)
+				gdispDrawLine(tx+p->x, ty+p->y, tx+p[1].x, ty+p[1].y, color);
+			return;
+		}
+
+		#if !GDISP_NEED_CIRCLE
+			if (cap == capRound)
+				cap = capSquare;
+		#endif
+
+		/* Ignore any zero length segments at the end so we know where to put the end cap */
+		while(epnt > pntarray && epnt->x == epnt[-1].x && epnt->y == epnt[-1].y)
+			epnt--;
+
+		ps = 0;
+		for(p = pntarray; p < epnt; p++) {
+			s = ps == segs ? segs+1 : segs;
+			if (!stroke_seg(s, p, p+1, width))
+				continue;
+
+			p0.x = tx + p->x;
+			p0.y = ty + p->y;
+			p1.x = tx + p[1].x;
+			p1.y = ty + p[1].y;
+
+			/* The start of the segment is either a join or the start cap */
+			if (ps)
+				stroke_join(p0.x, p0.y, ps, s, width, join, color);
+			else if (cap == capSquare) {
+				p0.x -= s->e.x;
+				p0.y -= s->e.y;
+			}
+			#if GDISP_NEED_CIRCLE
+				else if (cap == capRound)
+					gdispFillCircle(p0.x, p0.y, (width-1)/2, color);
+			#endif
+
+			/* The end cap */
+			if (p+1 == epnt) {
+				if (cap == capSquare) {
+					p1.x += s->e.x;
+					p1.y += s->e.y;
+				}
+				#if GDISP_NEED_CIRCLE
+					else if (cap == capRound)
+						gdispFillCircle(p1.x, p1.y, (width-1)/2, color);
+				#endif
+			}
+
+			/* The segment itself */
+			pts[0].x = p0.x + s->pa.x;
+			pts[0].y = p0.y + s->pa.y;
+			pts[1].x = p1.x + s->pa.x;
+			pts[1].y = p1.y + s->pa.y;
+			pts[2].x = p1.x + s->pb.x;
+			pts[2].y = p1.y + s->pb.y;
+			pts[3].x = p0.x + s->pb.x;
+			pts[3].y = p0.y + s->pb.y;
+			gdispFillConvexPoly(0, 0, pts, 4, color);
+
+			ps = s;
+		}
+	}
+
+	void gdispDrawThickLine(coord_t x0, coord_t y0, coord_t x1, coord_t y1, color_t color, coord_t width, linecap_t cap) {
+		point	pts[2];
+
+		pts[0].x = x0;
+		pts[0].y = y0;
+		pts[1].x = x1;
+		pts[1].y = y1;
+		gdispDrawThickPolyline(0, 0, pts, 2, color, width, joinBevel, cap);
+	}
+#endif
+
+#if GDISP_NEED_ANTIALIAS
+	/*
+	 * Anti-aliased drawing.
+	 * Each pixel's coverage is quantised to 16 levels and consecutive pixels with the same coverage
+	 * are gathered into a run. Each run is blended once against the background color and drawn
+	 * with a single fill. Nothing is read back from the display.
+	 */
+	#define AA_RUNS		8
+
+	typedef struct aarun {
+		coord_t		x, y;
+		coord_t		cnt;
+		uint8_t		alpha;
+		bool_t		vert;
+	} aarun;
+
+	typedef struct aactx {
+		color_t		color, bgcolor;
+		aarun		runs[AA_RUNS];
+		#if GDISP_NEED_ARC
+			coord_t		cx, cy;
+			int32_t		sx, sy, ex, ey;
+			bool_t		arc, major;
+		#endif
+	} aactx;
+
+	static void aa_flush(aactx *ctx, aarun *r) {
+		color_t	c;
+
+		if (!r->cnt)
+			return;
+		c = r->alpha == 255 ? ctx->color : gdispBlendColor(ctx->color, ctx->bgcolor, r->alpha);
+		if (r->cnt == 1)
+			gdispDrawPixel(r->x, r->y, c);
+		else if (r->vert)
+			gdispFillArea(r->x, r->y, 1, r->cnt, c);
+		else
+			gdispFillArea(r->x, r->y, r->cnt, 1, c);
+		r->cnt = 0;
+	}
+
+	static void aa_start(aactx *ctx, bool_t vert) {
+		aarun	*r;
+
+		for(r = ctx->runs; r < &ctx->runs[AA_RUNS]; r++) {
+			aa_flush(ctx, r);
+			r->vert = vert;
+		}
+	}
+
+	static void aa_end(aactx *ctx) {
+		aarun	*r;
+
+		for(r = ctx->runs; r < &ctx->runs[AA_RUNS]; r++)
+			aa_flush(ctx, r);
+	}
+
+	#if GDISP_NEED_ARC
+		/* Is the point (relative to the center) inside the arc. The y axis is upwards for the angles. */
+		static bool_t aa_inarc(aactx *ctx, coord_t x, coord_t y) {
+			int32_t		sp, pe;
+
+			sp = ctx->sx * -y - ctx->sy * x;
+			pe = ctx->ey * x + ctx->ex * y;
+			return ctx->major ? (sp >= 0 || pe >= 0) : (sp >= 0 && pe >= 0);
+		}
+	#endif
+
+	/* Add a pixel to a run (extending it at either end if possible) */
+	static void aa_plot(aactx *ctx, aarun *r, coord_t x, coord_t y, uint8_t alpha) {
+		alpha &= 0xF0;
+		alpha |= alpha >> 4;
+		if (!alpha)
+			return;
+
+		#if GDISP_NEED_ARC
+			if (ctx->arc && !aa_inarc(ctx, x - ctx->cx, y - ctx->cy))
+				return;
+		#endif
+
+		if (r->cnt && r->alpha == alpha) {
+			if (r->vert ? x == r->x : y == r->y) {
+				if (r->vert ? y == r->y + r->cnt : x == r->x + r->cnt) {
+					r->cnt++;
+					return;
+				}
+				if (r->vert ? y == r->y - 1 : x == r->x - 1) {
+					r->x = x;
+					r->y = y;
+					r->cnt++;
+					return;
+				}
+			}
+		}
+		aa_flush(ctx, r);
+		r->x = x;
+		r->y = y;
+		r->cnt = 1;
+		r->alpha = alpha;
+	}
+
+	/* Returns sqrt(v) as a 24.8 fixed point value */
+	static uint32_t aa_sqrt8(uint32_t v) {
+		unsigned	s;
+
+		for(s = 8; s && v >= (1UL << (32 - 2*s)); s--);
+		return isqrt(v << (2*s)) << (8 - s);
+	}
+
+	void gdispDrawLineAA(coord_t x0, coord_t y0, coord_t x1, coord_t y1, color_t color, color_t bgcolor) {
+		aactx		ctx;
+		fixed		v, k;
+		coord_t		dx, dy, t, i;
+		uint8_t		f;
+
+		dx = x1 > x0 ? x1 - x0 : x0 - x1;
+		dy = y1 > y0 ? y1 - y0 : y0 - y1;
+
+		/* Horizontal and vertical lines have nothing to anti-alias */
+		if (!dx || !dy) {
+			gdispDrawLine(x0, y0, x1, y1, color);
+			return;
+		}
+
+		ctx.color = color;
+		ctx.bgcolor = bgcolor;
+		#if GDISP_NEED_ARC
+			ctx.arc = FALSE;
+		#endif
+		ctx.runs[0].cnt = ctx.runs[1].cnt = 0;
+
+		if (dx >= dy) {
+			/* X major - the line falls between two pixels in each column */
+			if (x0 > x1) {
+				t = x0; x0 = x1; x1 = t;
+				t = y0; y0 = y1; y1 = t;
+			}
+			ctx.runs[0].vert = ctx.runs[1].vert = FALSE;
+			k = FIXED(y1 - y0) / dx;
+			for(i = x0, v = FIXED(y0); i <= x1; i++, v += k) {
+				f = (v >> 8) & 0xFF;
+				aa_plot(&ctx, &ctx.runs[0], i, NONFIXED(v), 255 - f);
+				aa_plot(&ctx, &ctx.runs[1], i, NONFIXED(v) + 1, f);
+			}
+		} else {
+			/* Y major - the line falls between two pixels in each row */
+			if (y0 > y1) {
+				t = x0; x0 = x1; x1 = t;
+				t = y0; y0 = y1; y1 = t;
+			}
+			ctx.runs[0].vert = ctx.runs[1].vert = TRUE;
+			k = FIXED(x1 - x0) / dy;
+			for(i = y0, v = FIXED(x0); i <= y1; i++, v += k) {
+				f = (v >> 8) & 0xFF;
+				aa_plot(&ctx, &ctx.runs[0], NONFIXED(v), i, 255 - f);
+				aa_plot(&ctx, &ctx.runs[1], NONFIXED(v) + 1, i, f);
+			}
+		}
+		aa_flush(&ctx, &ctx.runs[0]);
+		aa_flush(&ctx, &ctx.runs[1]);
+	}
+
+	#if GDISP_NEED_CIRCLE || GDISP_NEED_ELLIPSE || GDISP_NEED_ARC
+		/*
+		 * Draw an anti-aliased ellipse outline.
+		 * Where the curve is flatter than 45 degrees it falls between two pixels in each column,
+		 * otherwise between two pixels in each row. Each part is mirrored into all four quadrants.
+		 * The parts are split where the slope is -1 so that no pixel is blended twice.
+		 */
+		static uint32_t aa_ellipse_scale(uint32_t v, coord_t mul, coord_t div) {
+			/* v * mul / div without overflowing 32 bits for large radii */
+			return (v / div) * mul + (v % div) * mul / div;
+		}
+
+		static void aa_ellipse(aactx *ctx, coord_t x, coord_t y, coord_t a, coord_t b) {
+			int32_t		a2, b2;
+			uint32_t	v;
+			coord_t		i, vi, lim, top;
+			uint8_t		f;
+
+			a2 = (int32_t)a*a;
+			b2 = (int32_t)b*b;
+
+			/* The x major part - the columns up to where the slope is -1 */
+			aa_start(ctx, FALSE);
+			v = isqrt(a2 + b2);
+			if (v*v != (uint32_t)(a2 + b2))
+				v++;						/* Round up so lim never passes the -1 slope */
+			lim = a2 / v;
+			vi = b;							/* The top of the ellipse (column 0 is always drawn) */
+			for(i = 0; i <= lim; i++) {
+				v = aa_ellipse_scale(aa_sqrt8(a2 - (int32_t)i*i), b, a);
+				vi = v >> 8;
+				f = v & 0xFF;
+				aa_plot(ctx, &ctx->runs[0], x+i, y-vi, 255 - f);
+				aa_plot(ctx, &ctx->runs[1], x+i, y-vi-1, f);
+				if (vi)
+					aa_plot(ctx, &ctx->runs[2], x+i, y+vi, 255 - f);
+				aa_plot(ctx, &ctx->runs[3], x+i, y+vi+1, f);
+				if (i) {
+					aa_plot(ctx, &ctx->runs[4], x-i, y-vi, 255 - f);
+					aa_plot(ctx, &ctx->runs[5], x-i, y-vi-1, f);
+					if (vi)
+						aa_plot(ctx, &ctx->runs[6], x-i, y+vi, 255 - f);
+					aa_plot(ctx, &ctx->runs[7], x-i, y+vi+1, f);
+				}
+			}
+
+			/*
+			 * The y major part. The x major part covered the rows from top down and only the
+			 * columns up to lim, so below top both pixels are drawn and above it only the
+			 * pixels to the right of lim.
+			 */
+			top = vi;
+			aa_start(ctx, TRUE);
+			for(i = 0; i <= b; i++) {
+				v = aa_ellipse_scale(aa_sqrt8(b2 - (int32_t)i*i), a, b);
+				vi = v >> 8;
+				f = v & 0xFF;
+				if (i >= top && vi < lim)
+					break;
+				if (i < top || vi > lim) {
+					aa_plot(ctx, &ctx->runs[0], x+vi, y-i, 255 - f);
+					if (vi)
+						aa_plot(ctx, &ctx->runs[2], x-vi, y-i, 255 - f);
+					if (i) {
+						aa_plot(ctx, &ctx->runs[4], x+vi, y+i, 255 - f);
+						if (vi)
+							aa_plot(ctx, &ctx->runs[6], x-vi, y+i, 255 - f);
+					}
+				}
+				aa_plot(ctx, &ctx->runs[1], x+vi+1, y-i, f);
+				aa_plot(ctx, &ctx->runs[3], x-vi-1, y-i, f);
+				if (i) {
+					aa_plot(ctx, &ctx->runs[5], x+vi+1, y+i, f);
+					aa_plot(ctx, &ctx->runs[7], x-vi-1, y+i, f);
+				}
+			}
+			aa_end(ctx);
+		}
+
+		static void aa_init(aactx *ctx, color_t color, color_t bgcolor) {
+			aarun	*r;
+
+			ctx->color = color;
+			ctx->bgcolor = bgcolor;
+			#if GDISP_NEED_ARC
+				ctx->arc = FALSE;
+			#endif
+			for(r = ctx->runs; r < &ctx->runs[AA_RUNS]; r++)
+				r->cnt = 0;
+		}
+	#endif
+
+	#if GDISP_NEED_CIRCLE
+		void gdispDrawCircleAA(coord_t x, coord_t y, coord_t radius, color_t color, color_t bgcolor) {
+			aactx	ctx;
+
+			if (radius <= 0) {
+				gdispDrawPixel(x, y, color);
+				return;
+			}
+			aa_init(&ctx, color, bgcolor);
+			aa_ellipse(&ctx, x, y, radius, radius);
+		}
+	#endif
+
+	#if GDISP_NEED_ELLIPSE
+		void gdispDrawEllipseAA(coord_t x, coord_t y, coord_t a, coord_t b, color_t color, color_t bgcolor) {
+			aactx	ctx;
+
+			if (a <= 0 || b <= 0) {
+				gdispDrawLine(x-a, y-b, x+a, y+b, color);
+				return;
+			}
+			aa_init(&ctx, color, bgcolor);
+			aa_ellipse(&ctx, x, y, a, b);
+		}
+	#endif
+
+	#if GDISP_NEED_ARC
+		void gdispDrawArcAA(coord_t x, coord_t y, coord_t radius, coord_t startangle, coord_t endangle, color_t color, color_t bgcolor) {
+			aactx	ctx;
+			int		sweep;
+
+			if (radius <= 0) {
+				gdispDrawPixel(x, y, color);
+				return;
+			}
+			aa_init(&ctx, color, bgcolor);
+
+			sweep = endangle - startangle;
+			if (sweep < 0)
+				sweep += 360;
+			if (sweep < 360) {
+				ctx.arc = TRUE;
+				ctx.major = sweep > 180;
+				ctx.cx = x;
+				ctx.cy = y;
+				ctx.sx = 4096 * cos(startangle*M_PI/180);
+				ctx.sy = 4096 * sin(startangle*M_PI/180);
+				ctx.ex = 4096 * cos(endangle*M_PI/180);
+				ctx.ey = 4096 * sin(endangle*M_PI/180);
+			}
+			aa_ellipse(&ctx, x, y, radius, radius);
+		}
+	#endif
+#endif
+
+#if GDISP_NEED_GRADIENT
+	typedef struct gradctx {
+		int32_t		c[3];			/* The start color components (16.16) */
+		int32_t		d[3];			/* The difference between the end and start components */
+		uint8_t		step[3];		/* The component quantisation steps if dithering */
+		bool_t		dither;
+		coord_t		x, y, cnt;		/* The current horizontal run */
+		color_t		color;
+	} gradctx;
+
+	/* A 4x4 ordered dither matrix */
+	static const uint8_t gradBayer[4][4] = {
+		{ 0,  8,  2, 10},
+		{12,  4, 14,  6},
+		{ 3, 11,  1,  9},
+		{15,  7, 13,  5}
+	};
+
+	static void grad_init(gradctx *ctx, color_t start, color_t end, bool_t dither) {
+		ctx->c[0] = (int32_t)RED_OF(start) << 16;
+		ctx->c[1] = (int32_t)GREEN_OF(start) << 16;
+		ctx->c[2] = (int32_t)BLUE_OF(start) << 16;
+		ctx->d[0] = (int32_t)RED_OF(end) - (int32_t)RED_OF(start);
+		ctx->d[1] = (int32_t)GREEN_OF(end) - (int32_t)GREEN_OF(start);
+		ctx->d[2] = (int32_t)BLUE_OF(end) - (int32_t)BLUE_OF(start);
+
+		/* The lowest bit kept by the pixel format is the size of each quantisation step */
+		ctx->step[0] = RED_OF(White) & -RED_OF(White);
+		ctx->step[1] = GREEN_OF(White) & -GREEN_OF(White);
+		ctx->step[2] = BLUE_OF(White) & -BLUE_OF(White);
+		ctx->dither = dither && (ctx->step[0] > 1 || ctx->step[1] > 1 || ctx->step[2] > 1);
+		ctx->cnt = 0;
+	}
+
+	/* Convert 16.16 color components to a color, dithering if required */
+	static color_t grad_color(gradctx *ctx, coord_t x, coord_t y, const int32_t *v) {
+		int32_t		c[3];
+		unsigned	i, b;
+
+		if (!ctx->dither)
+			return RGB2COLOR(v[0] >> 16, v[1] >> 16, v[2] >> 16);
+
+		b = gradBayer[y & 3][x & 3] * 2 + 1;
+		for(i = 0; i < 3; i++) {
+			c[i] = (v[i] - 0x8000 + (((int32_t)ctx->step[i] * b) << 11)) >> 16;
+			if (c[i] > 255)	c[i] = 255;
+		}
+		return RGB2COLOR(c[0], c[1], c[2]);
+	}
+
+	static void grad_flush(gradctx *ctx) {
+		if (ctx->cnt == 1)
+			gdispDrawPixel(ctx->x, ctx->y, ctx->color);
+		else if (ctx->cnt)
+			gdispFillArea(ctx->x, ctx->y, ctx->cnt, 1, ctx->color);
+		ctx->cnt = 0;
+	}
+
+	/* Add a pixel to the current horizontal run. Pixels must be added left to right. */
+	static void grad_plot(gradctx *ctx, coord_t x, coord_t y, color_t color) {
+		if (ctx->cnt && ctx->color == color && ctx->y == y && ctx->x + ctx->cnt == x) {
+			ctx->cnt++;
+			return;
+		}
+		grad_flush(ctx);
+		ctx->x = x;
+		ctx->y = y;
+		ctx->cnt = 1;
+		ctx->color = color;
+	}
+
+	/* A gradient that changes along only one axis - one fill per row or column */
+	static void grad_axis(gradctx *ctx, coord_t x, coord_t y, coord_t cx, coord_t cy, bool_t vert) {
+		int32_t		v[3], k[3];
+		coord_t		i, n, last;
+		color_t		c, lc;
+		unsigned	j;
+
+		n = vert ? cy : cx;
+		for(j = 0; j < 3; j++) {
+			v[j] = ctx->c[j] + 0x8000;
+			k[j] = n > 1 ? (ctx->d[j] << 16) / (n - 1) : 0;
+		}
+
+		/* Adjacent rows or columns that end up the same color are combined */
+		lc = 0;
+		for(i = 0, last = 0; i < n; i++) {
+			c = RGB2COLOR(v[0] >> 16, v[1] >> 16, v[2] >> 16);
+			if (i && c != lc) {
+				if (vert)
+					gdispFillArea(x, y+last, cx, i-last, lc);
+				else
+					gdispFillArea(x+last, y, i-last, cy, lc);
+				last = i;
+			}
+			lc = c;
+			for(j = 0; j < 3; j++)
+				v[j] += k[j];
+		}
+		if (vert)
+			gdispFillArea(x, y+last, cx, n-last, lc);
+		else
+			gdispFillArea(x+last, y, n-last, cy, lc);
+	}
+
+	/* A linear gradient in any direction (or dithered) - one pass per row */
+	static void grad_linear(gradctx *ctx, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t angle) {
+		double		ux, uy, tmin, span;
+		int32_t		v[3], row[3], kx[3], ky[3];
+		coord_t		i, j;
+		unsigned	n;
+
+		/* The direction of the gradient (y is up for the angle) */
+		ux = cos(angle*M_PI/180);
+		uy = -sin(angle*M_PI/180);
+
+		/* The projection of the box onto the gradient direction */
+		tmin = (ux < 0 ? ux*(cx-1) : 0) + (uy < 0 ? uy*(cy-1) : 0);
+		span = fabs(ux)*(cx-1) + fabs(uy)*(cy-1);
+		if (span < 1)
+			span = 1;
+
+		for(n = 0; n < 3; n++) {
+			kx[n] = ctx->d[n] * ux * 65536 / span;
+			ky[n] = ctx->d[n] * uy * 65536 / span;
+			row[n] = ctx->c[n] + 0x8000 - (int32_t)(ctx->d[n] * tmin * 65536 / span);
+		}
+
+		for(j = 0; j < cy; j++) {
+			for(n = 0; n < 3; n++)
+				v[n] = row[n];
+			for(i = 0; i < cx; i++) {
+				grad_plot(ctx, x+i, y+j, grad_color(ctx, x+i, y+j, v));
+				for(n = 0; n < 3; n++)
+					v[n] += kx[n];
+			}
+			for(n = 0; n < 3; n++)
+				row[n] += ky[n];
+		}
+		grad_flush(ctx);
+	}
+
+	/*
+	 * A radial gradient from the center of the box out to its corners.
+	 * Each pixel's distance to the center starts from the previous pixel's and is corrected
+	 * with a single Newton step, rather than calculating a full square root for every pixel.
+	 */
+	static void grad_radial(gradctx *ctx, coord_t x, coord_t y, coord_t cx, coord_t cy) {
+		int32_t		v[3], dx, dy;
+		uint32_t	d2, m, r, s, s0;
+		coord_t		i, j;
+		unsigned	n, sh;
+
+		/*
+		 * Work in half pixels so that the center can fall between pixels. The squared distances
+		 * are scaled up for precision as far as 30 bits allow, so s and r always fit in 16 bits.
+		 */
+		dx = cx-1;
+		dy = cy-1;
+		m = (uint32_t)(dx*dx) + (uint32_t)(dy*dy);
+		for(sh = 6; sh && (m >> (30 - sh)); sh--);
+		r = isqrt(m << sh);
+		if (!r)
+			r = 1;
+
+		s0 = isqrt(m << sh);
+		for(j = 0; j < cy; j++) {
+			dy = 2*j - (cy-1);
+			s = s0;
+			for(i = 0; i < cx; i++) {
+				dx = 2*i - (cx-1);
+				d2 = ((uint32_t)(dx*dx) + (uint32_t)(dy*dy)) << sh;
+				s = s ? (s + d2/s) / 2 : isqrt(d2);
+				while (s*s > d2)
+					s--;
+				while ((s+1)*(s+1) <= d2)
+					s++;
+				if (!i)
+					s0 = s;				/* The next row starts from here */
+				for(n = 0; n < 3; n++)
+					v[n] = ctx->c[n] + 0x8000 + (ctx->d[n] << 16) / (int32_t)r * (int32_t)s;
+				grad_plot(ctx, x+i, y+j, grad_color(ctx, x+i, y+j, v));
+			}
+		}
+		grad_flush(ctx);
+	}
+
+	void gdispFillGradient(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t start, color_t end, gradient_t type, coord_t angle, bool_t dither) {
+		gradctx		ctx;
+
+		if (cx <= 0 || cy <= 0)
+			return;
+
+		grad_init(&ctx, start, end, dither);
+
+		if (type == gradientRadial) {
+			grad_radial(&ctx, x, y, cx, cy);
+			return;
+		}
+
+		angle %= 360;
+		if (angle < 0)
+			angle += 360;
+
+		if (!ctx.dither) {
+			switch(angle) {
+			case 0:		grad_axis(&ctx, x, y, cx, cy, FALSE);	return;
+			case 90:	grad_init(&ctx, end, start, FALSE);
+						grad_axis(&ctx, x, y, cx, cy, TRUE);	return;
+			case 180:	grad_init(&ctx, end, start, FALSE);
+						grad_axis(&ctx, x, y, cx, cy, FALSE);	return;
+			case 270:	grad_axis(&ctx, x, y, cx, cy, TRUE);	return;
+			}
+		}
+		grad_linear(&ctx, x, y, cx, cy, angle);
+	}
 #endif
 
 #if GDISP_NEED_TEXT
 	#include "mcufont.h"
 
+	/* The state passed to the character rendering callbacks */
+	typedef struct
+	{
+		color_t color[2];			/* The foreground and (for filled text) background colors */
+		#if GDISP_NEED_STATISTICS
+			uint32_t pixels;		/* The glyph pixels drawn, added to the statistics once the call completes */
+		#endif
+	} gdispChar_state_t;
+
 	#if GDISP_NEED_ANTIALIAS && GDISP_NEED_PIXELREAD
 		static void text_draw_char_callback(int16_t x, int16_t y, uint8_t count, uint8_t alpha, void *state) {
+			STAT_TEXT_PIXELS((gdispChar_state_t *)state, count);
 			if (alpha == 255) {
 				if (count == 1)
-					gdispDrawPixel(x, y, ((color_t *)state)[0]);
+					gdispDrawPixel(x, y, ((gdispChar_state_t *)state)->color[0]);
 				else
-					gdispFillArea(x, y, count, 1, ((color_t *)state)[0]);
+					gdispFillArea(x, y, count, 1, ((gdispChar_state_t *)state)->color[0]);
 			} else {
 				while (count--) {
-					gdispDrawPixel(x, y, gdispBlendColor(((color_t *)state)[0], gdispGetPixelColor(x, y), alpha));
+					gdispDrawPixel(x, y, gdispBlendColor(((gdispChar_state_t *)state)->color[0], gdispGetPixelColor(x, y), alpha));
 					x++;
 				}
 			}
 		}
 	#else
 		static void text_draw_char_callback(int16_t x, int16_t y, uint8_t count, uint8_t alpha, void *state) {
+			STAT_TEXT_PIXELS((gdispChar_state_t *)state, count);
 			if (alpha > 0x80) {			// A best approximation when using anti-aliased fonts but we can't actually draw them anti-aliased
 				if (count == 1)
-					gdispDrawPixel(x, y, ((color_t *)state)[0]);
+					gdispDrawPixel(x, y, ((gdispChar_state_t *)state)->color[0]);
 				else
-					gdispFillArea(x, y, count, 1, ((color_t *)state)[0]);
+					gdispFillArea(x, y, count, 1, ((gdispChar_state_t *)state)->color[0]);
 			}
 		}
 	#endif
 
 	void gdispDrawChar(coord_t x, coord_t y, uint16_t c, font_t font, color_t color) {
 		/* No mutex required as we only call high level functions which have their own mutex */
-		mf_render_character(font, x, y, c, text_draw_char_callback, &color);
+		gdispChar_state_t	state;
+		STAT_DECL;
+
+		STAT_TEXT_BEGIN(state);
+		state.color[0] = color;
+		mf_render_character(font, x, y, c, text_draw_char_callback, &state);
+		STAT_TEXT_END(state);
 	}
 
 	#if GDISP_NEED_ANTIALIAS
 		static void text_fill_char_callback(int16_t x, int16_t y, uint8_t count, uint8_t alpha, void *state) {
+			STAT_TEXT_PIXELS((gdispChar_state_t *)state, count);
 			if (alpha == 255) {
 				if (count == 1)
-					gdispDrawPixel(x, y, ((color_t *)state)[0]);
+					gdispDrawPixel(x, y, ((gdispChar_state_t *)state)->color[0]);
 				else
-					gdispFillArea(x, y, count, 1, ((color_t *)state)[0]);
+					gdispFillArea(x, y, count, 1, ((gdispChar_state_t *)state)->color[0]);
 			} else {
 				while (count--) {
-					gdispDrawPixel(x, y, gdispBlendColor(((color_t *)state)[0], ((color_t *)state)[1], alpha));
+					gdispDrawPixel(x, y, gdispBlendColor(((gdispChar_state_t *)state)->color[0], ((gdispChar_state_t *)state)->color[1], alpha));
 					x++;
 				}
 			}
@@ -631,19 +2176,22 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 
 	void gdispFillChar(coord_t x, coord_t y, uint16_t c, font_t font, color_t color, color_t bgcolor) {
 		/* No mutex required as we only call high level functions which have their own mutex */
-		color_t		state[2];
+		gdispChar_state_t	state;
+		STAT_DECL;
 
-		state[0] = color;
-		state[1] = bgcolor;
+		STAT_TEXT_BEGIN(state);
+		state.color[0] = color;
+		state.color[1] = bgcolor;
 
 		gdispFillArea(x, y, mf_character_width(font, c) + font->baseline_x, font->height, bgcolor);
-		mf_render_character(font, x, y, c, text_fill_char_callback, state);
+		mf_render_character(font, x, y, c, text_fill_char_callback, &state);
+		STAT_TEXT_END(state);
 	}
 
 	typedef struct
 	{
 		font_t font;
-		color_t color;
+		gdispChar_state_t ch;
 		coord_t	x, y;
 		coord_t	cx, cy;
 	} gdispDrawString_state_t;
@@ -656,16 +2204,18 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 		
 		w = mf_character_width(s->font, character);
 		if (x >= s->x && x+w < s->x + s->cx && y >= s->y && y+s->font->height <= s->y + s->cy)
-			mf_render_character(s->font, x, y, character, text_draw_char_callback, &s->color);
+			mf_render_character(s->font, x, y, character, text_draw_char_callback, &s->ch);
 		return w;
 	}
 
 	void gdispDrawString(coord_t x, coord_t y, const char *str, font_t font, color_t color) {
 		/* No mutex required as we only call high level functions which have their own mutex */
 		gdispDrawString_state_t state;
-		
+		STAT_DECL;
+
+		STAT_TEXT_BEGIN(state.ch);
 		state.font = font;
-		state.color = color;
+		state.ch.color[0] = color;
 		state.x = x;
 		state.y = y;
 		state.cx = GDISP.Width - x;
@@ -673,12 +2223,13 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 		
 		x += font->baseline_x;
 		mf_render_aligned(font, x, y, MF_ALIGN_LEFT, str, 0, gdispDrawString_callback, &state);
+		STAT_TEXT_END(state.ch);
 	}
 
 	typedef struct
 	{
 		font_t font;
-		color_t color[2];
+		gdispChar_state_t ch;
 		coord_t	x, y;
 		coord_t	cx, cy;
 		coord_t x_offset;
@@ -692,17 +2243,19 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 
 		w = mf_character_width(s->font, character);
 		if (x >= s->x && x+w < s->x + s->cx && y >= s->y && y+s->font->height <= s->y + s->cy)
-			mf_render_character(s->font, x, y, character, text_fill_char_callback, s->color);
+			mf_render_character(s->font, x, y, character, text_fill_char_callback, &s->ch);
 		return w;
 	}
 
 	void gdispFillString(coord_t x, coord_t y, const char *str, font_t font, color_t color, color_t bgcolor) {
 		/* No mutex required as we only call high level functions which have their own mutex */
 		gdispFillString_state_t state;
-		
+		STAT_DECL;
+
+		STAT_TEXT_BEGIN(state.ch);
 		state.font = font;
-		state.color[0] = color;
-		state.color[1] = bgcolor;
+		state.ch.color[0] = color;
+		state.ch.color[1] = bgcolor;
 		state.x = x;
 		state.y = y;
 		state.cx = mf_get_string_width(font, str, 0, 0);
@@ -710,14 +2263,17 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 		
 		gdispFillArea(x, y, state.cx, state.cy, bgcolor);
 		mf_render_aligned(font, x+font->baseline_x, y, MF_ALIGN_LEFT, str, 0, gdispFillString_callback, &state);
+		STAT_TEXT_END(state.ch);
 	}
 
 	void gdispDrawStringBox(coord_t x, coord_t y, coord_t cx, coord_t cy, const char* str, font_t font, color_t color, justify_t justify) {
 		/* No mutex required as we only call high level functions which have their own mutex */
 		gdispDrawString_state_t state;
-		
+		STAT_DECL;
+
+		STAT_TEXT_BEGIN(state.ch);
 		state.font = font;
-		state.color = color;
+		state.ch.color[0] = color;
 		state.x = x;
 		state.y = y;
 		state.cx = cx;
@@ -738,15 +2294,18 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 		y += (cy+1 - font->height)/2;
 
 		mf_render_aligned(font, x, y, justify, str, 0, gdispDrawString_callback, &state);
+		STAT_TEXT_END(state.ch);
 	}
 
 	void gdispFillStringBox(coord_t x, coord_t y, coord_t cx, coord_t cy, const char* str, font_t font, color_t color, color_t bgcolor, justify_t justify) {
 		/* No mutex required as we only call high level functions which have their own mutex */
 		gdispFillString_state_t state;
+		STAT_DECL;
 
+		STAT_TEXT_BEGIN(state.ch);
 		state.font = font;
-		state.color[0] = color;
-		state.color[1] = bgcolor;
+		state.ch.color[0] = color;
+		state.ch.color[1] = bgcolor;
 		state.x = x;
 		state.y = y;
 		state.cx = cx;
@@ -770,15 +2329,18 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 		
 		/* Render */
 		mf_render_aligned(font, x, y, justify, str, 0, gdispFillString_callback, &state);
+		STAT_TEXT_END(state.ch);
 	}
 
   void gdispFillStringBoxWithOffset(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t x_offset, const char* str, font_t font, color_t color, color_t bgcolor) {
     /* No mutex required as we only call high level functions which have their own mutex */
     gdispFillString_state_t state;
+    STAT_DECL;
 
+    STAT_TEXT_BEGIN(state.ch);
     state.font = font;
-    state.color[0] = color;
-    state.color[1] = bgcolor;
+    state.ch.color[0] = color;
+    state.ch.color[1] = bgcolor;
     state.x = x;
     state.y = y;
     state.cx = cx;
@@ -792,6 +2354,7 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 
     /* Render */
     mf_render_aligned(font, x, y, justifyLeft, str, 0, gdispFillString_callback, &state);
+    STAT_TEXT_END(state.ch);
   }
 
 	coord_t gdispGetFontMetric(font_t font, fontmetric_t metric) {
@@ -818,6 +2381,303 @@ void gdispDrawBox(coord_t x, coord_t y, coord_t cx, coord_t cy, color_t color) {
 	}
 #endif
 
+#if GDISP_NEED_STATISTICS
+	static const char *const statNames[GDISP_STAT_COUNT] = {
+		"Clear", "DrawPixel", "DrawLine", "FillArea", "BlitArea",
+		"DrawCircle", "FillCircle", "DrawEllipse", "FillEllipse",
+		"DrawArc", "FillArc", "Scroll", "SetClip", "Text"
+	};
+
+	void gdispGetStats(gdispStatOp op, gdispStat *pstat) {
+		if ((unsigned)op >= GDISP_STAT_COUNT)
+			return;
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexEnter(&gdispMutex);
+		#endif
+		*pstat = _gdispStats[op];
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexExit(&gdispMutex);
+		#endif
+	}
+
+	void gdispResetStats(void) {
+		unsigned	i;
+
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexEnter(&gdispMutex);
+		#endif
+		for(i = 0; i < GDISP_STAT_COUNT; i++) {
+			_gdispStats[i].calls = 0;
+			_gdispStats[i].pixels = 0;
+			_gdispStats[i].emulated = 0;
+			_gdispStats[i].time = 0;
+		}
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexExit(&gdispMutex);
+		#endif
+	}
+
+	const char *gdispGetStatName(gdispStatOp op) {
+		return (unsigned)op < GDISP_STAT_COUNT ? statNames[op] : "";
+	}
+
+	#if GFX_USE_OS_WIN32 || GFX_USE_OS_LINUX || GFX_USE_OS_OSX
+		#include <stdio.h>
+
+		void gdispDumpStats(void) {
+			gdispStat	st;
+			unsigned	i;
+
+			fprintf(stderr, "%-12s %10s %10s %10s %10s\n", "Operation", "Calls", "Pixels", "Emulated", "Time");
+			for(i = 0; i < GDISP_STAT_COUNT; i++) {
+				gdispGetStats((gdispStatOp)i, &st);
+				if (st.calls || st.emulated)
+					fprintf(stderr, "%-12s %10lu %10lu %10lu %10lu\n", statNames[i],
+						(unsigned long)st.calls, (unsigned long)st.pixels, (unsigned long)st.emulated, (unsigned long)st.time);
+			}
+		}
+	#endif
+#endif
+
+#if GDISP_NEED_TRACE
+	void gdispTraceStart(gdispTraceWriteFn fn, void *param) {
+		uint8_t		buf[12], *p;
+		unsigned	i;
+
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexEnter(&gdispMutex);
+		#endif
+		traceWrite = fn;
+		traceParam = param;
+		traceTime = gfxSystemTicks();
+		for(i = 0; i < TRACE_HASHES; i++)
+			traceHashes[i] = 0;
+		traceNextHash = 0;
+
+		/* The header - magic, version, display size and clock rate */
+		buf[0] = 'G'; buf[1] = 'D'; buf[2] = 'T'; buf[3] = TRACE_VERSION;
+		p = trace_put16(buf+4, GDISP.Width);
+		p = trace_put16(p, GDISP.Height);
+		p = trace_put32(p, gfxMillisecondsToTicks(1000));
+		fn(param, buf, p - buf);
+
+		/* Start the replay with the same clipping */
+		#if GDISP_NEED_CLIP
+			trace_put(GDISP_LLD_MSG_SETCLIP, GDISP.clipx0, GDISP.clipy0, GDISP.clipx1-GDISP.clipx0, GDISP.clipy1-GDISP.clipy0, 0, 0);
+		#endif
+		#if GDISP_NEED_CLIPREGION
+			for(i = 0; i < clipDepth; i++)
+				trace_region(&clipStack[i]);
+		#endif
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexExit(&gdispMutex);
+		#endif
+	}
+
+	void gdispTraceStop(void) {
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexEnter(&gdispMutex);
+		#endif
+		traceWrite = 0;
+		#if GDISP_NEED_MULTITHREAD
+			gfxMutexExit(&gdispMutex);
+		#endif
+	}
+
+	#define trace_get16(p)		((coord_t)(int16_t)((p)[0] | ((p)[1] << 8)))
+	#define trace_getcolor(p)	RGB2COLOR((p)[0], (p)[1], (p)[2])
+
+	static uint32_t trace_get32(const uint8_t *p) {
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	static uint32_t trace_ms(uint32_t ticks, uint32_t tps) {
+		if (tps >= 1000)
+			return ticks / (tps / 1000);
+		return ticks * 1000 / tps;
+	}
+
+	bool_t gdispTraceReplay(gdispTraceReadFn fn, void *param, gdispTraceResult *pres) {
+		uint8_t			buf[3*TRACE_CHUNK];
+		coord_t			v[5];
+		color_t			color;
+		pixel_t			*bufs[TRACE_HASHES], *pp;
+		uint32_t		hashes[TRACE_HASHES];
+		coord_t			bufcx[TRACE_HASHES];
+		uint32_t		tps, captured, records, hash;
+		systemticks_t	start;
+		unsigned		i, k, n, next;
+		bool_t			ok;
+		#if GDISP_NEED_CLIPREGION
+			gdispRegion	rgn;
+			unsigned	pushed;
+		#endif
+
+		if (pres) {
+			pres->records = 0;
+			pres->captureMs = 0;
+			pres->replayMs = 0;
+		}
+		if (fn(param, buf, 12) != 12 || buf[0] != 'G' || buf[1] != 'D' || buf[2] != 'T' || buf[3] != TRACE_VERSION)
+			return FALSE;
+		tps = trace_get32(buf+8);
+		if (!tps)
+			return FALSE;
+
+		for(i = 0; i < TRACE_HASHES; i++) {
+			bufs[i] = 0;
+			hashes[i] = 0;
+		}
+		next = 0;
+		captured = records = 0;
+		#if GDISP_NEED_CLIPREGION
+			pushed = 0;
+		#endif
+		ok = TRUE;
+		start = gfxSystemTicks();
+
+		while(ok && fn(param, buf, 1) == 1) {
+			switch(buf[0]) {
+			case TRACE_REC_TIME:
+				if (!(ok = fn(param, buf, 4) == 4))
+					break;
+				captured += trace_get32(buf);
+				continue;
+
+			case TRACE_REC_DATA:
+				/* Mirror the capture side cache so the hashes resolve to the same buffers */
+				if (!(ok = fn(param, buf, 8) == 8))
+					break;
+				if (bufs[next])
+					gfxFree(bufs[next]);
+				hashes[next] = trace_get32(buf);
+				bufcx[next] = trace_get16(buf+4);
+				n = (unsigned)bufcx[next] * (unsigned)trace_get16(buf+6);
+				if (!(bufs[next] = pp = gfxAlloc(n * sizeof(pixel_t)))) {
+					ok = FALSE;
+					break;
+				}
+				next = (next + 1) % TRACE_HASHES;
+				for(; n; n -= i) {
+					i = n > TRACE_CHUNK ? TRACE_CHUNK : n;
+					if (!(ok = fn(param, buf, 3*i) == 3*i))
+						break;
+					for(k = 0; k < i; k++)
+						*pp++ = trace_getcolor(buf + 3*k);
+				}
+				continue;
+
+			#if GDISP_NEED_CLIPREGION
+				case TRACE_REC_PUSHCLIP:
+					if (!(ok = fn(param, buf, 1) == 1 && buf[0] <= GDISP_CLIPREGION_RECTS))
+						break;
+					rgn.cnt = buf[0];
+					for(i = 0; i < rgn.cnt; i++) {
+						if (!(ok = fn(param, buf, 8) == 8))
+							break;
+						rgn.rect[i].x0 = trace_get16(buf);
+						rgn.rect[i].y0 = trace_get16(buf+2);
+						rgn.rect[i].x1 = trace_get16(buf+4);
+						rgn.rect[i].y1 = trace_get16(buf+6);
+					}
+					/* Only pushes that worked were recorded so a failure here would unbalance the pops */
+					if (ok && (ok = gdispPushClip(&rgn)))
+						pushed++;
+					continue;
+
+				case TRACE_REC_POPCLIP:
+					if (!(ok = pushed != 0))
+						break;
+					gdispPopClip();
+					pushed--;
+					continue;
+			#endif
+
+			case GDISP_LLD_MSG_BLITAREA:
+				if (!(ok = fn(param, buf, 12) == 12))
+					break;
+				hash = trace_get32(buf+8);
+				for(i = 0; i < TRACE_HASHES && hashes[i] != hash; i++);
+				if (!(ok = i < TRACE_HASHES))
+					break;
+				gdispBlitAreaEx(trace_get16(buf), trace_get16(buf+2), trace_get16(buf+4), trace_get16(buf+6), 0, 0, bufcx[i], bufs[i]);
+				records++;
+				continue;
+
+			#if GDISP_NEED_CONTROL
+				case GDISP_LLD_MSG_CONTROL:
+					if (!(ok = fn(param, buf, 10) == 10))
+						break;
+					gdispControl((uint16_t)trace_get16(buf), (void *)(size_t)(trace_get32(buf+2) | ((uint64_t)trace_get32(buf+6) << 32)));
+					records++;
+					continue;
+			#endif
+
+			default:
+				if (buf[0] >= sizeof(traceFormat) || !(traceFormat[buf[0]] & TF_VALID)) {
+					ok = FALSE;
+					break;
+				}
+				break;
+			}
+			if (!ok)
+				break;
+
+			/* A drawing call - read the arguments */
+			i = buf[0];
+			n = (traceFormat[i] & TF_COORDS) * 2 + ((traceFormat[i] & TF_COLOR) ? 3 : 0);
+			if (!(ok = fn(param, buf+1, n) == n))
+				break;
+			for(n = 0; n < (traceFormat[i] & TF_COORDS); n++)
+				v[n] = trace_get16(buf+1+2*n);
+			color = (traceFormat[i] & TF_COLOR) ? trace_getcolor(buf+1+2*n) : 0;
+			records++;
+
+			switch(i) {
+			case GDISP_LLD_MSG_CLEAR:			gdispClear(color);										break;
+			case GDISP_LLD_MSG_DRAWPIXEL:		gdispDrawPixel(v[0], v[1], color);						break;
+			case GDISP_LLD_MSG_FILLAREA:		gdispFillArea(v[0], v[1], v[2], v[3], color);			break;
+			case GDISP_LLD_MSG_DRAWLINE:		gdispDrawLine(v[0], v[1], v[2], v[3], color);			break;
+			#if GDISP_NEED_CLIP
+				case GDISP_LLD_MSG_SETCLIP:		gdispSetClip(v[0], v[1], v[2], v[3]);					break;
+			#endif
+			#if GDISP_NEED_CIRCLE
+				case GDISP_LLD_MSG_DRAWCIRCLE:	gdispDrawCircle(v[0], v[1], v[2], color);				break;
+				case GDISP_LLD_MSG_FILLCIRCLE:	gdispFillCircle(v[0], v[1], v[2], color);				break;
+			#endif
+			#if GDISP_NEED_ELLIPSE
+				case GDISP_LLD_MSG_DRAWELLIPSE:	gdispDrawEllipse(v[0], v[1], v[2], v[3], color);		break;
+				case GDISP_LLD_MSG_FILLELLIPSE:	gdispFillEllipse(v[0], v[1], v[2], v[3], color);		break;
+			#endif
+			#if GDISP_NEED_ARC
+				case GDISP_LLD_MSG_DRAWARC:		gdispDrawArc(v[0], v[1], v[2], v[3], v[4], color);		break;
+				case GDISP_LLD_MSG_FILLARC:		gdispFillArc(v[0], v[1], v[2], v[3], v[4], color);		break;
+			#endif
+			#if GDISP_NEED_SCROLL
+				case GDISP_LLD_MSG_VERTICALSCROLL: gdispVerticalScroll(v[0], v[1], v[2], v[3], v[4], color); break;
+			#endif
+			default:							ok = FALSE;												break;
+			}
+		}
+
+		for(i = 0; i < TRACE_HASHES; i++) {
+			if (bufs[i])
+				gfxFree(bufs[i]);
+		}
+		#if GDISP_NEED_CLIPREGION
+			/* Leave the clip stack as we found it */
+			for(; pushed; pushed--)
+				gdispPopClip();
+		#endif
+		if (pres) {
+			pres->records = records;
+			pres->captureMs = trace_ms(captured, tps);
+			pres->replayMs = trace_ms(gfxSystemTicks() - start, gfxMillisecondsToTicks(1000));
+		}
+		return ok;
+	}
+#endif
+
 color_t gdispBlendColor(color_t fg, color_t bg, uint8_t alpha)
 {
 	uint16_t fg_ratio = alpha + 1;
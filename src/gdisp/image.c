@@ -16,6 +16,14 @@
 
 #if GFX_USE_GDISP && GDISP_NEED_IMAGE
 
+#include <string.h>
+
+void *gdispImageAlloc(gdispImage *img, size_t sz);
+void gdispImageFree(gdispImage *img, void *ptr, size_t sz);
+#if GDISP_NEED_IMAGE_ALPHA
+	void gdispImageBlitAlpha(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t srcx, coord_t srcy, coord_t srccx, const pixel_t *buffer, const uint8_t *alpha, color_t bgcolor);
+#endif
+
 /* The structure defining the routines for image drawing */
 typedef struct gdispImageHandlers {
 	gdispImageError	(*open)(gdispImage *img);			/* The open function */
@@ -26,32 +34,58 @@ typedef struct gdispImageHandlers {
 							coord_t cx, coord_t cy,
 							coord_t sx, coord_t sy);	/* The draw function */
 	delaytime_t		(*next)(gdispImage *img);			/* The next frame function */
+	gdispImageError	(*decode)(gdispImage *img,
+							pixel_t *buf);				/* Decode the whole frame into buf (optional). See gdispImageHasAlpha() */
+	#if GDISP_NEED_IMAGE_SCALING
+		gdispImageError	(*rows)(gdispImage *img,
+							gdispImageRowSink *sink);	/* Pass the needed rows to a sink (optional) */
+	#endif
 } gdispImageHandlers;
 
 static gdispImageHandlers ImageHandlers[] = {
 	#if GDISP_NEED_IMAGE_NATIVE
 		{	gdispImageOpen_NATIVE,	gdispImageClose_NATIVE,
 			gdispImageCache_NATIVE,	gdispImageDraw_NATIVE,	gdispImageNext_NATIVE,
+			0,
+			#if GDISP_NEED_IMAGE_SCALING
+				gdispImageRows_NATIVE,
+			#endif
 		},
 	#endif
 	#if GDISP_NEED_IMAGE_GIF
 		{	gdispImageOpen_GIF,		gdispImageClose_GIF,
 			gdispImageCache_GIF,	gdispImageDraw_GIF,		gdispImageNext_GIF,
+			gdispImageDecode_GIF,
+			#if GDISP_NEED_IMAGE_SCALING
+				0,
+			#endif
 		},
 	#endif
 	#if GDISP_NEED_IMAGE_BMP
 		{	gdispImageOpen_BMP,		gdispImageClose_BMP,
 			gdispImageCache_BMP,	gdispImageDraw_BMP,		gdispImageNext_BMP,
+			gdispImageDecode_BMP,
+			#if GDISP_NEED_IMAGE_SCALING
+				gdispImageRows_BMP,
+			#endif
 		},
 	#endif
 	#if GDISP_NEED_IMAGE_JPG
 		{	gdispImageOpen_JPG,		gdispImageClose_JPG,
 			gdispImageCache_JPG,	gdispImageDraw_JPG,		gdispImageNext_JPG,
+			gdispImageDecode_JPG,
+			#if GDISP_NEED_IMAGE_SCALING
+				gdispImageRows_JPG,
+			#endif
 		},
 	#endif
 	#if GDISP_NEED_IMAGE_PNG
 		{	gdispImageOpen_PNG,		gdispImageClose_PNG,
 			gdispImageCache_PNG,	gdispImageDraw_PNG,		gdispImageNext_PNG,
+			gdispImageDecode_PNG,
+			#if GDISP_NEED_IMAGE_SCALING
+				gdispImageRows_PNG,
+			#endif
 		},
 	#endif
 };
@@ -73,8 +107,15 @@ static void ImageMemoryClose(struct gdispImageIO *pio) {
 	pio->pos = 0;
 }
 
+static const void *ImageMemoryGetPtr(struct gdispImageIO *pio, size_t pos, size_t len) {
+	(void) len;
+
+	if (pio->fd == (void *)-1) return 0;
+	return ((const char *)pio->fd)+pos;
+}
+
 static const gdispImageIOFunctions ImageMemoryFunctions =
-	{ ImageMemoryRead, ImageMemorySeek, ImageMemoryClose };
+	{ ImageMemoryRead, ImageMemorySeek, ImageMemoryClose, ImageMemoryGetPtr };
 
 bool_t gdispImageSetMemoryReader(gdispImage *img, const void *memimage) {
 	img->io.fns = &ImageMemoryFunctions;
@@ -107,7 +148,7 @@ bool_t gdispImageSetMemoryReader(gdispImage *img, const void *memimage) {
 	}
 
 	static const gdispImageIOFunctions ImageBaseFileStreamFunctions =
-		{ ImageBaseFileStreamRead, ImageBaseFileStreamSeek, ImageBaseFileStreamClose };
+		{ ImageBaseFileStreamRead, ImageBaseFileStreamSeek, ImageBaseFileStreamClose, 0 };
 
 	bool_t gdispImageSetBaseFileStreamReader(gdispImage *img, void *BaseFileStreamPtr) {
 		img->io.fns = &ImageBaseFileStreamFunctions;
@@ -144,9 +185,102 @@ bool_t gdispImageSetMemoryReader(gdispImage *img, const void *memimage) {
 	}
 
 	static const gdispImageIOFunctions ImageFileFunctions =
-		{ ImageFileRead, ImageFileSeek, ImageFileClose };
+		{ ImageFileRead, ImageFileSeek, ImageFileClose, 0 };
+
+	#if GFX_USE_OS_LINUX || GFX_USE_OS_OSX
+		#include <sys/types.h>
+		#include <sys/stat.h>
+		#include <sys/mman.h>
+		#include <fcntl.h>
+		#include <unistd.h>
+
+		typedef struct ImageMapping {
+			const uint8_t	*base;
+			size_t			size;
+			dev_t			dev;			// The file identity (for the global image cache)
+			ino_t			ino;
+			time_t			mtime;
+		} ImageMapping;
+
+		static size_t ImageMapRead(struct gdispImageIO *pio, void *buf, size_t len) {
+			const ImageMapping	*pm;
+
+			if (!pio->fd) return 0;
+			pm = (const ImageMapping *)pio->fd;
+			if (pio->pos >= pm->size) return 0;
+			if (len > pm->size - pio->pos) len = pm->size - pio->pos;
+			memcpy(buf, pm->base+pio->pos, len);
+			pio->pos += len;
+			return len;
+		}
+
+		static void ImageMapSeek(struct gdispImageIO *pio, size_t pos) {
+			if (!pio->fd) return;
+			pio->pos = pos;
+		}
+
+		static void ImageMapClose(struct gdispImageIO *pio) {
+			const ImageMapping	*pm;
+
+			if (!pio->fd) return;
+			pm = (const ImageMapping *)pio->fd;
+			munmap((void *)pm->base, pm->size);
+			gfxFree((void *)pm);
+			pio->fd = 0;
+			pio->pos = 0;
+		}
+
+		static const void *ImageMapGetPtr(struct gdispImageIO *pio, size_t pos, size_t len) {
+			const ImageMapping	*pm;
+
+			if (!pio->fd) return 0;
+			pm = (const ImageMapping *)pio->fd;
+			if (pos > pm->size || len > pm->size - pos) return 0;
+			return pm->base+pos;
+		}
+
+		static const gdispImageIOFunctions ImageMapFunctions =
+			{ ImageMapRead, ImageMapSeek, ImageMapClose, ImageMapGetPtr };
+
+		/**
+		 * Map the file into memory so the decoders can draw from it directly.
+		 * Returns FALSE (with nothing allocated) if the file can't be mapped.
+		 */
+		static bool_t ImageMapFile(gdispImage *img, const char *filename) {
+			ImageMapping	*pm;
+			struct stat		st;
+			void			*base;
+			int				fd;
+
+			if ((fd = open(filename, O_RDONLY)) < 0)
+				return FALSE;
+			base = MAP_FAILED;
+			if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0 && (off_t)(size_t)st.st_size == st.st_size)
+				base = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);							// The mapping stays valid after the close
+			if (base == MAP_FAILED)
+				return FALSE;
+			if (!(pm = (ImageMapping *)gfxAlloc(sizeof(ImageMapping)))) {
+				munmap(base, (size_t)st.st_size);
+				return FALSE;
+			}
+			pm->base = (const uint8_t *)base;
+			pm->size = (size_t)st.st_size;
+			pm->dev = st.st_dev;
+			pm->ino = st.st_ino;
+			pm->mtime = st.st_mtime;
+			img->io.fns = &ImageMapFunctions;
+			img->io.pos = 0;
+			img->io.fd = pm;
+			return TRUE;
+		}
+	#endif
 
 	bool_t gdispImageSetFileReader(gdispImage *img, const char *filename) {
+		#if GFX_USE_OS_LINUX || GFX_USE_OS_OSX
+			if (ImageMapFile(img, filename))
+				return TRUE;
+		#endif
 		img->io.fns = &ImageFileFunctions;
 		img->io.pos = 0;
 		#if defined(WIN32) || GFX_USE_OS_WIN32
@@ -159,6 +293,371 @@ bool_t gdispImageSetMemoryReader(gdispImage *img, const void *memimage) {
 	}
 #endif
 
+typedef struct ImageBuffer {
+	gdispImageIO	io;				// The io we are buffering
+	size_t			bufpos;			// The file position of buf[0]
+	size_t			buflen;			// The number of valid bytes in buf
+	size_t			bufsize;		// The size of buf
+	uint8_t			buf[1];			// The buffer (actually bufsize bytes)
+} ImageBuffer;
+
+static size_t ImageBufferedRead(struct gdispImageIO *pio, void *buf, size_t len) {
+	ImageBuffer	*pb;
+	size_t		n, total;
+
+	if (!pio->fd) return 0;
+	pb = (ImageBuffer *)pio->fd;
+
+	for(total = 0; len; total += n, len -= n, buf = (uint8_t *)buf + n) {
+		// Take what we can from the buffer
+		if (pio->pos >= pb->bufpos && pio->pos < pb->bufpos + pb->buflen) {
+			n = pb->bufpos + pb->buflen - pio->pos;
+			if (n > len) n = len;
+			memcpy(buf, pb->buf + (pio->pos - pb->bufpos), n);
+			pio->pos += n;
+			continue;
+		}
+
+		// We only seek the real io when we have to
+		if (pb->io.pos != pio->pos)
+			pb->io.fns->seek(&pb->io, pio->pos);
+
+		// Big reads go straight to the destination
+		if (len >= pb->bufsize) {
+			if (!(n = pb->io.fns->read(&pb->io, buf, len)))
+				break;
+			pio->pos += n;
+			continue;
+		}
+
+		// Refill the buffer
+		pb->bufpos = pio->pos;
+		if (!(pb->buflen = pb->io.fns->read(&pb->io, pb->buf, pb->bufsize)))
+			break;
+		n = 0;
+	}
+	return total;
+}
+
+static void ImageBufferedSeek(struct gdispImageIO *pio, size_t pos) {
+	if (!pio->fd) return;
+	pio->pos = pos;
+}
+
+static void ImageBufferedClose(struct gdispImageIO *pio) {
+	ImageBuffer	*pb;
+
+	if (!pio->fd) return;
+	pb = (ImageBuffer *)pio->fd;
+	pb->io.fns->close(&pb->io);
+	gfxFree(pb);
+	pio->fd = 0;
+	pio->pos = 0;
+}
+
+static const gdispImageIOFunctions ImageBufferedFunctions =
+	{ ImageBufferedRead, ImageBufferedSeek, ImageBufferedClose, 0 };
+
+bool_t gdispImageSetBufferedReader(gdispImage *img, size_t bufsize) {
+	ImageBuffer	*pb;
+
+	// Readers with direct access to the image (memory and mapped files) gain nothing from a buffer
+	if (img->io.fns->getptr)
+		return TRUE;
+
+	if (!bufsize)
+		bufsize = GDISP_IMAGE_IO_BUFFER_SIZE;
+	if (!(pb = (ImageBuffer *)gfxAlloc(sizeof(ImageBuffer) - 1 + bufsize)))
+		return FALSE;
+	pb->io = img->io;
+	pb->bufpos = 0;
+	pb->buflen = 0;
+	pb->bufsize = bufsize;
+	img->io.fns = &ImageBufferedFunctions;
+	img->io.fd = pb;
+	return TRUE;
+}
+
+#if GDISP_NEED_IMAGE_GLOBAL_CACHE
+	/* What identifies a decoded image. The whole structure is compared so it must be zeroed before filling. */
+	typedef struct ImageCacheKey {
+		const void *		ptr;				// The memory image (or 0 for a file)
+		#if GFX_USE_OS_LINUX || GFX_USE_OS_OSX
+			dev_t			dev;				// The file identity
+			ino_t			ino;
+			off_t			size;
+			time_t			mtime;
+		#endif
+		gdispImageType		type;
+		coord_t				width, height;		// The (possibly scaled) image size
+		color_t				bgcolor;			// Only for images blended with it when decoded
+	} ImageCacheKey;
+
+	typedef struct ImageCacheEntry {
+		struct ImageCacheEntry	*prev;			// Towards the most recently used
+		struct ImageCacheEntry	*next;			// Towards the least recently used
+		ImageCacheKey			key;
+		size_t					size;			// The size of the pixels (and alpha)
+		unsigned				pins;			// The number of draws using the entry outside the mutex
+		bool_t					evicted;		// Evicted while pinned - freed when the last pin is released
+		#if GDISP_NEED_IMAGE_ALPHA
+			const uint8_t		*alpha;			// The alpha values (if any) after the pixels
+		#endif
+		// The pixels follow
+	} ImageCacheEntry;
+
+	static gfxMutex				ImageCacheMutex;
+	static ImageCacheEntry *	ImageCacheHead;	// The most recently used
+	static ImageCacheEntry *	ImageCacheTail;	// The least recently used
+	static gdispImageCacheStats	ImageCacheStats;
+
+	void _gdispImageInit(void) {
+		gfxMutexInit(&ImageCacheMutex);
+		ImageCacheStats.budget = GDISP_IMAGE_GLOBAL_CACHE_SIZE;
+	}
+
+	/**
+	 * Work out what the image is decoded from. Returns FALSE if the source can't be identified.
+	 */
+	static bool_t ImageCacheMakeKey(gdispImage *img, ImageCacheKey *pk) {
+		const gdispImageIO	*pio;
+
+		memset(pk, 0, sizeof(ImageCacheKey));
+		pio = &img->io;
+		if (pio->fns == &ImageBufferedFunctions)
+			pio = &((const ImageBuffer *)pio->fd)->io;
+
+		if (pio->fns == &ImageMemoryFunctions) {
+			if (pio->fd == (void *)-1) return FALSE;
+			pk->ptr = pio->fd;
+		#if GFX_USE_OS_LINUX || GFX_USE_OS_OSX
+			} else if (pio->fns == &ImageMapFunctions) {
+				const ImageMapping	*pm;
+
+				if (!pio->fd) return FALSE;
+				pm = (const ImageMapping *)pio->fd;
+				pk->dev = pm->dev;
+				pk->ino = pm->ino;
+				pk->size = (off_t)pm->size;
+				pk->mtime = pm->mtime;
+			} else if (pio->fns == &ImageFileFunctions) {
+				struct stat		st;
+
+				if (!pio->fd || fstat(fileno((FILE *)pio->fd), &st))
+					return FALSE;
+				pk->dev = st.st_dev;
+				pk->ino = st.st_ino;
+				pk->size = st.st_size;
+				pk->mtime = st.st_mtime;
+		#endif
+		} else
+			return FALSE;
+
+		pk->type = img->type;
+		pk->width = img->width;
+		pk->height = img->height;
+		if ((img->flags & GDISP_IMAGE_FLG_TRANSPARENT) && !gdispImageHasAlpha(img))
+			pk->bgcolor = img->bgcolor;
+		return TRUE;
+	}
+
+	/* These must be called with the mutex held */
+	static void ImageCacheUnlink(ImageCacheEntry *pe) {
+		if (pe->prev) pe->prev->next = pe->next;
+		else ImageCacheHead = pe->next;
+		if (pe->next) pe->next->prev = pe->prev;
+		else ImageCacheTail = pe->prev;
+	}
+
+	static void ImageCacheLinkHead(ImageCacheEntry *pe) {
+		pe->prev = 0;
+		pe->next = ImageCacheHead;
+		if (ImageCacheHead) ImageCacheHead->prev = pe;
+		else ImageCacheTail = pe;
+		ImageCacheHead = pe;
+	}
+
+	static void ImageCacheEvict(size_t limit) {
+		ImageCacheEntry	*pe;
+
+		while(ImageCacheStats.used > limit && (pe = ImageCacheTail)) {
+			ImageCacheUnlink(pe);
+			ImageCacheStats.used -= pe->size;
+			ImageCacheStats.entries--;
+			ImageCacheStats.evictions++;
+			if (pe->pins)
+				pe->evicted = TRUE;
+			else
+				gfxFree(pe);
+		}
+	}
+
+	/**
+	 * Reserve space in the budget, throwing away old images to make room.
+	 */
+	static bool_t ImageCacheReserve(size_t sz) {
+		if (sz > ImageCacheStats.budget)
+			return FALSE;
+		ImageCacheEvict(ImageCacheStats.budget - sz);
+		if (ImageCacheStats.used > ImageCacheStats.budget - sz)
+			return FALSE;
+		ImageCacheStats.used += sz;
+		return TRUE;
+	}
+
+	static void ImageCacheBlit(gdispImage *img, ImageCacheEntry *pe, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy) {
+		if (sx >= pe->key.width || sy >= pe->key.height) return;
+		if (sx + cx > pe->key.width) cx = pe->key.width - sx;
+		if (sy + cy > pe->key.height) cy = pe->key.height - sy;
+		#if GDISP_NEED_IMAGE_ALPHA
+			if (pe->alpha) {
+				gdispImageBlitAlpha(x, y, cx, cy, sx, sy, pe->key.width, (const pixel_t *)(pe+1), pe->alpha, img->bgcolor);
+				return;
+			}
+		#else
+			(void) img;
+		#endif
+		gdispBlitAreaEx(x, y, cx, cy, sx, sy, pe->key.width, (const pixel_t *)(pe+1));
+	}
+
+	/**
+	 * Find the image in the global cache, decoding it into the cache first if needed.
+	 * Returns the entry pinned so it can be used without the mutex, or 0 if the image can't be cached.
+	 * The pin must be released with ImageCacheRelease().
+	 */
+	static ImageCacheEntry *ImageCacheGet(gdispImage *img) {
+		ImageCacheKey		key;
+		ImageCacheEntry		*pe, *pn;
+		size_t				sz;
+
+		if (!img->fns->decode || (img->flags & GDISP_IMAGE_FLG_ANIMATED) || !ImageCacheMakeKey(img, &key))
+			return 0;
+
+		// GIF images leave their transparent pixels alone so they can only be cached with their alpha
+		#if !GDISP_NEED_IMAGE_ALPHA
+			if (img->type == GDISP_IMAGE_TYPE_GIF && (img->flags & GDISP_IMAGE_FLG_TRANSPARENT))
+				return 0;
+		#endif
+
+		gfxMutexEnter(&ImageCacheMutex);
+		for(pe = ImageCacheHead; pe; pe = pe->next) {
+			if (!memcmp(&pe->key, &key, sizeof(key))) {
+				ImageCacheStats.hits++;
+				if (pe != ImageCacheHead) {
+					ImageCacheUnlink(pe);
+					ImageCacheLinkHead(pe);
+				}
+				pe->pins++;
+				gfxMutexExit(&ImageCacheMutex);
+				return pe;
+			}
+		}
+		ImageCacheStats.misses++;
+
+		// Make room for the new image. The space is reserved while we decode without the mutex.
+		sz = (size_t)img->width * img->height * sizeof(pixel_t);
+		if (gdispImageHasAlpha(img))
+			sz += (size_t)img->width * img->height;
+		if (!ImageCacheReserve(sz)) {
+			gfxMutexExit(&ImageCacheMutex);
+			return 0;
+		}
+		gfxMutexExit(&ImageCacheMutex);
+
+		// Decode the image
+		if ((pn = (ImageCacheEntry *)gfxAlloc(sizeof(ImageCacheEntry) + sz))) {
+			pn->key = key;
+			pn->size = sz;
+			pn->pins = 0;
+			pn->evicted = FALSE;
+			#if GDISP_NEED_IMAGE_ALPHA
+				pn->alpha = gdispImageHasAlpha(img) ? (const uint8_t *)((pixel_t *)(pn+1) + (size_t)img->width * img->height) : 0;
+			#endif
+			if (img->fns->decode(img, (pixel_t *)(pn+1)) != GDISP_IMAGE_ERR_OK) {
+				gfxFree(pn);
+				pn = 0;
+			}
+		}
+
+		gfxMutexEnter(&ImageCacheMutex);
+		if (!pn) {
+			ImageCacheStats.used -= sz;
+			gfxMutexExit(&ImageCacheMutex);
+			return 0;
+		}
+
+		// Another thread may have decoded the same image while we were
+		for(pe = ImageCacheHead; pe; pe = pe->next) {
+			if (!memcmp(&pe->key, &key, sizeof(key)))
+				break;
+		}
+		if (pe) {
+			ImageCacheStats.used -= sz;
+			gfxFree(pn);
+		} else {
+			ImageCacheLinkHead(pn);
+			ImageCacheStats.entries++;
+			pe = pn;
+		}
+		pe->pins++;
+		gfxMutexExit(&ImageCacheMutex);
+		return pe;
+	}
+
+	static void ImageCacheRelease(ImageCacheEntry *pe) {
+		gfxMutexEnter(&ImageCacheMutex);
+		if (!--pe->pins && pe->evicted)
+			gfxFree(pe);
+		gfxMutexExit(&ImageCacheMutex);
+	}
+
+	/**
+	 * Draw the image from the global cache, decoding it into the cache first if needed.
+	 * Returns FALSE if the image should be drawn by the decoder instead.
+	 */
+	static bool_t ImageCacheDraw(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy) {
+		ImageCacheEntry		*pe;
+
+		// An image cached by gdispImageCache() is already as fast to draw
+		if ((img->flags & GDISP_IMAGE_FLG_CACHED))
+			return FALSE;
+
+		// The entry is pinned so the (possibly slow) display is not written with the mutex held
+		if (!(pe = ImageCacheGet(img)))
+			return FALSE;
+		ImageCacheBlit(img, pe, x, y, cx, cy, sx, sy);
+		ImageCacheRelease(pe);
+		return TRUE;
+	}
+
+	void gdispImageGlobalCacheSetBudget(size_t bytes) {
+		gfxMutexEnter(&ImageCacheMutex);
+		ImageCacheStats.budget = bytes;
+		ImageCacheEvict(bytes);
+		gfxMutexExit(&ImageCacheMutex);
+	}
+
+	void gdispImageGlobalCacheFlush(void) {
+		gfxMutexEnter(&ImageCacheMutex);
+		ImageCacheEvict(0);
+		gfxMutexExit(&ImageCacheMutex);
+	}
+
+	void gdispImageGlobalCacheGetStats(gdispImageCacheStats *pstats) {
+		gfxMutexEnter(&ImageCacheMutex);
+		*pstats = ImageCacheStats;
+		gfxMutexExit(&ImageCacheMutex);
+	}
+
+	void gdispImageGlobalCacheResetStats(void) {
+		gfxMutexEnter(&ImageCacheMutex);
+		ImageCacheStats.hits = 0;
+		ImageCacheStats.misses = 0;
+		ImageCacheStats.evictions = 0;
+		gfxMutexExit(&ImageCacheMutex);
+	}
+#endif
+
 gdispImageError gdispImageOpen(gdispImage *img) {
 	gdispImageError err;
 
@@ -199,21 +698,734 @@ void gdispImageSetBgColor(gdispImage *img, color_t bgcolor) {
 }
 
 gdispImageError gdispImageCache(gdispImage *img) {
+	gdispImageError err;
+
 	if (!img->fns) return GDISP_IMAGE_ERR_BADFORMAT;
-	return img->fns->cache(img);
+	if (!(err = img->fns->cache(img)))
+		img->flags |= GDISP_IMAGE_FLG_CACHED;
+	return err;
 }
 
 gdispImageError gdispImageDraw(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy) {
 	if (!img->fns) return GDISP_IMAGE_ERR_BADFORMAT;
+	#if GDISP_NEED_IMAGE_GLOBAL_CACHE
+		if (ImageCacheDraw(img, x, y, cx, cy, sx, sy))
+			return GDISP_IMAGE_ERR_OK;
+	#endif
 	return img->fns->draw(img, x, y, cx, cy, sx, sy);
 }
 
+#if GDISP_NEED_IMAGE_SCALING
+	typedef struct ImageScale {
+		gdispImageRowSink	sink;				// Must be first
+		gdispImageFilter	filter;
+		coord_t				x, y, cx, cy;		// Where to draw
+		coord_t				sw, sh;				// The image size
+		coord_t				dy;					// The next output row
+		pixel_t				*out;				// The output row
+		pixel_t				*prev;				// The previous source row (bilinear only)
+		coord_t				*mapx;				// The source column for each output column
+		uint8_t				*wx;				// The weight of the next source column (bilinear only)
+	} ImageScale;
+
+	/**
+	 * Pass the needed rows of an image to a sink. If the decoder can't produce single rows
+	 * the whole image is decoded first. The rows are always opaque.
+	 */
+	static gdispImageError ImageGetRows(gdispImage *img, gdispImageRowSink *sink) {
+		gdispImageError	err;
+		pixel_t			*full;
+		size_t			sz;
+		coord_t			y;
+
+		/* Ask the decoder for the rows */
+		err = GDISP_IMAGE_ERR_UNSUPPORTED;
+		if (img->fns->rows)
+			err = img->fns->rows(img, sink);
+		if (err != GDISP_IMAGE_ERR_UNSUPPORTED || !img->fns->decode)
+			return err;
+
+		/* Otherwise decode the whole image and take the rows from that */
+		sz = img->width * img->height * sizeof(pixel_t);
+		if (gdispImageHasAlpha(img))
+			sz += img->width * img->height;
+		if (!(full = (pixel_t *)gdispImageAlloc(img, sz)))
+			return GDISP_IMAGE_ERR_NOMEMORY;
+		if (!(err = img->fns->decode(img, full))) {
+			for(y = 0; y <= sink->last; y++) {
+				if (!gdispImageRowNeeded(sink, y))
+					continue;
+				#if GDISP_NEED_IMAGE_ALPHA
+					if (gdispImageHasAlpha(img)) {
+						const uint8_t	*pa;
+						pixel_t			*pc;
+						coord_t			x;
+
+						pc = full + y * img->width;
+						pa = (const uint8_t *)(full + img->width * img->height) + y * img->width;
+						for(x = 0; x < img->width; x++)
+							pc[x] = gdispBlendColor(pc[x], img->bgcolor, pa[x]);
+					}
+				#endif
+				if (!sink->row(sink, y, full + y * img->width))
+					break;
+			}
+		}
+		gdispImageFree(img, full, sz);
+		return err;
+	}
+
+	/**
+	 * Get the source position for output pixel d when scaling max source pixels to n output pixels.
+	 * Nearest samples at the centre of the output pixel. Bilinear is offset by half a source pixel
+	 * and also returns the weight of the next source pixel.
+	 */
+	static coord_t ImageScalePos(ImageScale *ps, coord_t d, coord_t n, coord_t max, uint8_t *pw) {
+		uint32_t	pos;
+
+		pos = (2*(uint32_t)d+1) * (uint32_t)max;
+		*pw = 0;
+		if (ps->filter != GDISP_IMAGE_FILTER_BILINEAR)
+			return (coord_t)(pos / (2*(uint32_t)n));
+		if (pos < (uint32_t)n)
+			return 0;
+		pos -= n;
+		if (pos / (2*(uint32_t)n) >= (uint32_t)max-1)
+			return max-1;
+		*pw = (uint8_t)(((pos % (2*(uint32_t)n)) << 8) / (2*(uint32_t)n));
+		return (coord_t)(pos / (2*(uint32_t)n));
+	}
+
+	static color_t ImageScaleMix(color_t c00, color_t c01, color_t c10, color_t c11, unsigned wx, unsigned wy) {
+		uint32_t	w00, w01, w10, w11;
+
+		w00 = (256-wx)*(256-wy);
+		w01 = wx*(256-wy);
+		w10 = (256-wx)*wy;
+		w11 = wx*wy;
+		return RGB2COLOR(
+			(RED_OF(c00)*w00 + RED_OF(c01)*w01 + RED_OF(c10)*w10 + RED_OF(c11)*w11) >> 16,
+			(GREEN_OF(c00)*w00 + GREEN_OF(c01)*w01 + GREEN_OF(c10)*w10 + GREEN_OF(c11)*w11) >> 16,
+			(BLUE_OF(c00)*w00 + BLUE_OF(c01)*w01 + BLUE_OF(c10)*w10 + BLUE_OF(c11)*w11) >> 16);
+	}
+
+	/* Produce all the output rows that can be made once source row y has arrived */
+	static bool_t ImageScaleRow(gdispImageRowSink *sink, coord_t y, const pixel_t *pixels) {
+		ImageScale		*ps;
+		const pixel_t	*p0;
+		coord_t			sy, dx, sx;
+		uint8_t			wy;
+		bool_t			built;
+
+		ps = (ImageScale *)sink;
+		for(built = FALSE; ps->dy < ps->cy; ps->dy++) {
+			sy = ImageScalePos(ps, ps->dy, ps->cy, ps->sh, &wy);
+
+			if (ps->filter == GDISP_IMAGE_FILTER_BILINEAR) {
+				if (sy + (wy ? 1 : 0) > y)
+					break;
+				// A weight means we are between the previous row and this one
+				p0 = wy ? ps->prev : pixels;
+				for(dx = 0; dx < ps->cx; dx++) {
+					sx = ps->mapx[dx];
+					if (ps->wx[dx])
+						ps->out[dx] = ImageScaleMix(p0[sx], p0[sx+1], pixels[sx], pixels[sx+1], ps->wx[dx], wy);
+					else
+						ps->out[dx] = ImageScaleMix(p0[sx], p0[sx], pixels[sx], pixels[sx], 0, wy);
+				}
+			} else {
+				if (sy > y)
+					break;
+				// No horizontal scaling means we can blit the source row
+				if (ps->cx == ps->sw) {
+					gdispBlitAreaEx(ps->x, ps->y + ps->dy, ps->cx, 1, 0, 0, ps->sw, pixels);
+					continue;
+				}
+				// Rows repeated when enlarging only need to be built once
+				if (!built) {
+					for(dx = 0; dx < ps->cx; dx++)
+						ps->out[dx] = pixels[ps->mapx[dx]];
+					built = TRUE;
+				}
+			}
+			gdispBlitAreaEx(ps->x, ps->y + ps->dy, ps->cx, 1, 0, 0, ps->cx, ps->out);
+		}
+
+		// Keep this row for the next one
+		if (ps->filter == GDISP_IMAGE_FILTER_BILINEAR && ps->dy < ps->cy)
+			memcpy(ps->prev, pixels, ps->sw * sizeof(pixel_t));
+		return TRUE;
+	}
+
+	gdispImageError gdispImageDrawScaled(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, gdispImageFilter filter) {
+		ImageScale		*ps;
+		uint8_t			*need;
+		gdispImageError	err;
+		size_t			psz;
+		coord_t			d, sy;
+		uint8_t			w;
+
+		if (!img->fns) return GDISP_IMAGE_ERR_BADFORMAT;
+		if (cx <= 0 || cy <= 0) return GDISP_IMAGE_ERR_OK;
+
+		/* Nothing to scale - the normal draw can use any cache */
+		if (cx == img->width && cy == img->height)
+			return gdispImageDraw(img, x, y, cx, cy, 0, 0);
+
+		if ((!img->fns->rows && !img->fns->decode) || (img->flags & GDISP_IMAGE_FLG_ANIMATED))
+			return GDISP_IMAGE_ERR_UNSUPPORTED;
+
+		/* Allocate everything in one go. The pixel arrays go first to keep them aligned. */
+		psz = sizeof(ImageScale) + (cx + img->width * 2) * sizeof(pixel_t) + cx * (sizeof(coord_t) + 1) + (img->height + 7) / 8;
+		if (!(ps = (ImageScale *)gdispImageAlloc(img, psz)))
+			return GDISP_IMAGE_ERR_NOMEMORY;
+		ps->out = (pixel_t *)(ps+1);
+		ps->sink.buf = ps->out + cx;
+		ps->prev = ps->sink.buf + img->width;
+		ps->mapx = (coord_t *)(ps->prev + img->width);
+		ps->wx = (uint8_t *)(ps->mapx + cx);
+		need = ps->wx + cx;
+
+		ps->sink.row = ImageScaleRow;
+		ps->sink.need = need;
+		ps->filter = filter;
+		ps->x = x; ps->y = y; ps->cx = cx; ps->cy = cy;
+		ps->sw = img->width; ps->sh = img->height;
+		ps->dy = 0;
+
+		/* Work out which source columns and rows we need */
+		for(d = 0; d < cx; d++)
+			ps->mapx[d] = ImageScalePos(ps, d, cx, ps->sw, ps->wx+d);
+		memset(need, 0, (img->height + 7) / 8);
+		for(ps->sink.last = 0, d = 0; d < cy; d++) {
+			sy = ImageScalePos(ps, d, cy, ps->sh, &w);
+			if (w) sy++;
+			need[sy>>3] |= 1 << (sy & 7);
+			if (w)
+				need[(sy-1)>>3] |= 1 << ((sy-1) & 7);
+			ps->sink.last = sy;
+		}
+
+		err = ImageGetRows(img, &ps->sink);
+		gdispImageFree(img, ps, psz);
+		return err;
+	}
+#endif
+
+#if GDISP_NEED_IMAGE_ASYNC
+	/**
+	 * How many rows are decoded before they are passed back to be drawn, how far apart the rows
+	 * of a progressive preview are and the worker stack size (the decode data is allocated from the heap).
+	 */
+	#define IMAGE_ASYNC_BAND_ROWS		16
+	#define IMAGE_ASYNC_PREVIEW_STEP	8
+	#define IMAGE_ASYNC_STACK_SIZE		1024
+
+	typedef struct ImageAsyncBand {
+		coord_t				sy;					// The first image row in the band
+		coord_t				rows;				// The number of rows (0 when the worker has finished)
+		pixel_t				*pixels;
+	} ImageAsyncBand;
+
+	typedef struct gdispImageAsyncPrivate {
+		gdispImageRowSink	sink;				// Must be first
+		gdispImage			*img;
+		coord_t				x, y, cx, cy, sx, sy;
+		uint8_t				flags;
+		uint8_t				*need;				// The rows wanted by this pass
+		coord_t				step;				// How many rows each decoded row fills
+		bool_t				cancel;
+		gfxThreadHandle		thread;
+		gfxSem				ready;				// Signalled when a band is ready to draw
+		gfxSem				free;				// Signalled when a band has been drawn
+		ImageAsyncBand		band[2];
+		ImageAsyncBand		*fill;				// The band being filled by the worker (if any)
+		uint8_t				nextfill, nextdraw;
+		gdispImageError		result;
+		size_t				size;
+	} gdispImageAsyncPrivate;
+
+	/* Get an empty band to fill. Returns 0 if we have been cancelled. */
+	static ImageAsyncBand *ImageAsyncGetBand(gdispImageAsyncPrivate *priv, coord_t sy) {
+		ImageAsyncBand	*pb;
+
+		gfxSemWait(&priv->free, TIME_INFINITE);
+		if (priv->cancel)
+			return 0;
+		pb = &priv->band[priv->nextfill];
+		priv->nextfill ^= 1;
+		pb->sy = sy;
+		pb->rows = 0;
+		return pb;
+	}
+
+	/* Pass a band back to be drawn */
+	static void ImageAsyncPostBand(gdispImageAsyncPrivate *priv) {
+		if (priv->fill) {
+			priv->fill = 0;
+			gfxSemSignal(&priv->ready);
+		}
+	}
+
+	static bool_t ImageAsyncRow(gdispImageRowSink *sink, coord_t y, const pixel_t *pixels) {
+		gdispImageAsyncPrivate	*priv;
+		coord_t					n;
+
+		priv = (gdispImageAsyncPrivate *)sink;
+		if (priv->cancel)
+			return FALSE;
+
+		// In the preview each row is repeated until the next one
+		for(n = priv->step; n && y < priv->sy + priv->cy; n--, y++) {
+			if (priv->fill && (priv->fill->rows == IMAGE_ASYNC_BAND_ROWS || priv->fill->sy + priv->fill->rows != y))
+				ImageAsyncPostBand(priv);
+			if (!priv->fill && !(priv->fill = ImageAsyncGetBand(priv, y)))
+				return FALSE;
+			memcpy(priv->fill->pixels + priv->fill->rows * priv->cx, pixels + priv->sx, priv->cx * sizeof(pixel_t));
+			priv->fill->rows++;
+		}
+		return TRUE;
+	}
+
+	static DECLARE_THREAD_FUNCTION(ImageAsyncThread, param) {
+		gdispImageAsyncPrivate	*priv;
+		gdispImageError			err;
+		coord_t					y;
+
+		priv = (gdispImageAsyncPrivate *)param;
+		err = GDISP_IMAGE_ERR_OK;
+
+		// A quick look at every few rows first
+		if ((priv->flags & GDISP_IMAGE_ASYNC_PROGRESSIVE) && priv->cy > IMAGE_ASYNC_PREVIEW_STEP) {
+			memset(priv->need, 0, (priv->img->height + 7) / 8);
+			for(y = priv->sy; y < priv->sy + priv->cy; y += IMAGE_ASYNC_PREVIEW_STEP) {
+				priv->need[y>>3] |= 1 << (y & 7);
+				priv->sink.last = y;
+			}
+			priv->step = IMAGE_ASYNC_PREVIEW_STEP;
+			err = ImageGetRows(priv->img, &priv->sink);
+			ImageAsyncPostBand(priv);
+		}
+
+		// Then all of them
+		if (!err && !priv->cancel) {
+			memset(priv->need, 0, (priv->img->height + 7) / 8);
+			for(y = priv->sy; y < priv->sy + priv->cy; y++)
+				priv->need[y>>3] |= 1 << (y & 7);
+			priv->sink.last = priv->sy + priv->cy - 1;
+			priv->step = 1;
+			err = ImageGetRows(priv->img, &priv->sink);
+			ImageAsyncPostBand(priv);
+		}
+
+		// An empty band says we have finished. Once cancelled nobody is waiting for it.
+		priv->result = err;
+		if (!priv->cancel && (priv->fill = ImageAsyncGetBand(priv, 0)))
+			ImageAsyncPostBand(priv);
+		return 0;
+	}
+
+	static void ImageAsyncFree(gdispImageAsync *pa) {
+		gdispImageAsyncPrivate	*priv;
+
+		priv = pa->priv;
+		gfxThreadWait(priv->thread);
+		gfxSemDestroy(&priv->free);
+		gfxSemDestroy(&priv->ready);
+		gdispImageFree(pa->img, priv, priv->size);
+		pa->priv = 0;
+	}
+
+	gdispImageError gdispImageDrawAsync(gdispImageAsync *pa, gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy, uint8_t flags) {
+		gdispImageAsyncPrivate	*priv;
+		size_t					sz;
+
+		pa->img = img;
+		pa->priv = 0;
+		pa->result = GDISP_IMAGE_ERR_OK;
+		if (!img->fns) return pa->result = GDISP_IMAGE_ERR_BADFORMAT;
+		if ((!img->fns->rows && !img->fns->decode) || (img->flags & GDISP_IMAGE_FLG_ANIMATED))
+			return pa->result = GDISP_IMAGE_ERR_UNSUPPORTED;
+
+		/* Check some reasonableness */
+		if (sx < 0) { x -= sx; cx += sx; sx = 0; }
+		if (sy < 0) { y -= sy; cy += sy; sy = 0; }
+		if (sx + cx > img->width) cx = img->width - sx;
+		if (sy + cy > img->height) cy = img->height - sy;
+		if (cx <= 0 || cy <= 0)
+			return GDISP_IMAGE_ERR_OK;
+
+		/* Allocate everything in one go. The pixel arrays go first to keep them aligned. */
+		sz = sizeof(gdispImageAsyncPrivate) + (img->width + 2 * IMAGE_ASYNC_BAND_ROWS * cx) * sizeof(pixel_t) + (img->height + 7) / 8;
+		if (!(priv = (gdispImageAsyncPrivate *)gdispImageAlloc(img, sz)))
+			return pa->result = GDISP_IMAGE_ERR_NOMEMORY;
+		priv->size = sz;
+		priv->sink.row = ImageAsyncRow;
+		priv->sink.buf = (pixel_t *)(priv+1);
+		priv->band[0].pixels = priv->sink.buf + img->width;
+		priv->band[1].pixels = priv->band[0].pixels + IMAGE_ASYNC_BAND_ROWS * cx;
+		priv->need = (uint8_t *)(priv->band[1].pixels + IMAGE_ASYNC_BAND_ROWS * cx);
+		priv->sink.need = priv->need;
+		priv->img = img;
+		priv->x = x; priv->y = y; priv->cx = cx; priv->cy = cy; priv->sx = sx; priv->sy = sy;
+		priv->flags = flags;
+		priv->cancel = FALSE;
+		priv->fill = 0;
+		priv->nextfill = priv->nextdraw = 0;
+		gfxSemInit(&priv->ready, 0, 2);
+		gfxSemInit(&priv->free, 2, 2);
+		if (!(priv->thread = gfxThreadCreate(0, IMAGE_ASYNC_STACK_SIZE, LOW_PRIORITY, ImageAsyncThread, priv))) {
+			gfxSemDestroy(&priv->free);
+			gfxSemDestroy(&priv->ready);
+			gdispImageFree(img, priv, sz);
+			return pa->result = GDISP_IMAGE_ERR_NOMEMORY;
+		}
+		pa->priv = priv;
+		return GDISP_IMAGE_ERR_OK;
+	}
+
+	bool_t gdispImageAsyncPoll(gdispImageAsync *pa, delaytime_t ms) {
+		gdispImageAsyncPrivate	*priv;
+		ImageAsyncBand			*pb;
+
+		if (!(priv = pa->priv))
+			return TRUE;
+
+		while(gfxSemWait(&priv->ready, ms)) {
+			ms = TIME_IMMEDIATE;
+			pb = &priv->band[priv->nextdraw];
+			priv->nextdraw ^= 1;
+			if (!pb->rows) {
+				pa->result = priv->result;
+				ImageAsyncFree(pa);
+				return TRUE;
+			}
+			gdispBlitAreaEx(priv->x, priv->y + pb->sy - priv->sy, priv->cx, pb->rows, 0, 0, priv->cx, pb->pixels);
+			gfxSemSignal(&priv->free);
+		}
+		return FALSE;
+	}
+
+	void gdispImageAsyncCancel(gdispImageAsync *pa) {
+		gdispImageAsyncPrivate	*priv;
+
+		if (!(priv = pa->priv))
+			return;
+		// The worker tests for a cancel before every wait so one signal wakes it whatever it is doing
+		priv->cancel = TRUE;
+		gfxSemSignal(&priv->free);
+		ImageAsyncFree(pa);
+	}
+#endif
+
+#if GDISP_NEED_IMAGE_ATLAS
+	gdispImageError gdispAtlasOpen(gdispAtlas *atlas, gdispImage *img, const gdispAtlasRect *rects, unsigned count) {
+		gdispImageError		err;
+		size_t				sz;
+
+		atlas->pixels = 0;
+		atlas->rects = rects;
+		atlas->count = count;
+		atlas->cellwidth = atlas->cellheight = 0;
+		if (!img->fns) return GDISP_IMAGE_ERR_BADFORMAT;
+		if (!img->fns->decode) return GDISP_IMAGE_ERR_UNSUPPORTED;
+		if (img->width <= 0 || img->height <= 0) return GDISP_IMAGE_ERR_BADDATA;
+
+		atlas->width = img->width;
+		atlas->height = img->height;
+		atlas->bgcolor = img->bgcolor;
+		sz = (size_t)img->width * img->height * sizeof(pixel_t);
+		if (gdispImageHasAlpha(img))
+			sz += (size_t)img->width * img->height;
+
+		// The decoded image comes out of the global cache budget
+		#if GDISP_NEED_IMAGE_GLOBAL_CACHE
+			gfxMutexEnter(&ImageCacheMutex);
+			if (!ImageCacheReserve(sz)) {
+				gfxMutexExit(&ImageCacheMutex);
+				return GDISP_IMAGE_ERR_NOMEMORY;
+			}
+			gfxMutexExit(&ImageCacheMutex);
+		#endif
+
+		if (!(atlas->pixels = (pixel_t *)gfxAlloc(sz)))
+			err = GDISP_IMAGE_ERR_NOMEMORY;
+		else if ((err = img->fns->decode(img, atlas->pixels))) {
+			gfxFree(atlas->pixels);
+			atlas->pixels = 0;
+		}
+		if (err) {
+			#if GDISP_NEED_IMAGE_GLOBAL_CACHE
+				gfxMutexEnter(&ImageCacheMutex);
+				ImageCacheStats.used -= sz;
+				gfxMutexExit(&ImageCacheMutex);
+			#endif
+			return err;
+		}
+		atlas->size = sz;
+		#if GDISP_NEED_IMAGE_ALPHA
+			atlas->alpha = gdispImageHasAlpha(img) ? (const uint8_t *)(atlas->pixels + (size_t)img->width * img->height) : 0;
+		#endif
+		return GDISP_IMAGE_ERR_OK;
+	}
+
+	gdispImageError gdispAtlasOpenGrid(gdispAtlas *atlas, gdispImage *img, coord_t cellwidth, coord_t cellheight) {
+		gdispImageError		err;
+
+		if (cellwidth <= 0 || cellheight <= 0)
+			return GDISP_IMAGE_ERR_BADDATA;
+		if ((err = gdispAtlasOpen(atlas, img, 0, 0)))
+			return err;
+		atlas->cellwidth = cellwidth;
+		atlas->cellheight = cellheight;
+		atlas->count = (unsigned)(atlas->width / cellwidth) * (unsigned)(atlas->height / cellheight);
+		return GDISP_IMAGE_ERR_OK;
+	}
+
+	void gdispAtlasClose(gdispAtlas *atlas) {
+		if (!atlas->pixels)
+			return;
+		gfxFree(atlas->pixels);
+		atlas->pixels = 0;
+		#if GDISP_NEED_IMAGE_GLOBAL_CACHE
+			gfxMutexEnter(&ImageCacheMutex);
+			ImageCacheStats.used -= atlas->size;
+			gfxMutexExit(&ImageCacheMutex);
+		#endif
+	}
+
+	int gdispAtlasFind(gdispAtlas *atlas, const char *name) {
+		unsigned	i;
+
+		if (!atlas->rects)
+			return -1;
+		for(i = 0; i < atlas->count; i++) {
+			if (atlas->rects[i].name && !strcmp(atlas->rects[i].name, name))
+				return (int)i;
+		}
+		return -1;
+	}
+
+	gdispImageError gdispAtlasDraw(gdispAtlas *atlas, unsigned id, coord_t x, coord_t y) {
+		coord_t		sx, sy, cx, cy;
+
+		if (!atlas->pixels || id >= atlas->count)
+			return GDISP_IMAGE_ERR_BADDATA;
+
+		if (atlas->rects) {
+			sx = atlas->rects[id].x;
+			sy = atlas->rects[id].y;
+			cx = atlas->rects[id].width;
+			cy = atlas->rects[id].height;
+		} else {
+			cx = atlas->cellwidth;
+			cy = atlas->cellheight;
+			sx = (coord_t)(id % (unsigned)(atlas->width / cx)) * cx;
+			sy = (coord_t)(id / (unsigned)(atlas->width / cx)) * cy;
+		}
+
+		/* Clip to the image */
+		if (sx < 0) { x -= sx; cx += sx; sx = 0; }
+		if (sy < 0) { y -= sy; cy += sy; sy = 0; }
+		if (sx + cx > atlas->width) cx = atlas->width - sx;
+		if (sy + cy > atlas->height) cy = atlas->height - sy;
+		if (cx <= 0 || cy <= 0)
+			return GDISP_IMAGE_ERR_OK;
+
+		#if GDISP_NEED_IMAGE_ALPHA
+			if (atlas->alpha) {
+				gdispImageBlitAlpha(x, y, cx, cy, sx, sy, atlas->width, atlas->pixels, atlas->alpha, atlas->bgcolor);
+				return GDISP_IMAGE_ERR_OK;
+			}
+		#endif
+		gdispBlitAreaEx(x, y, cx, cy, sx, sy, atlas->width, atlas->pixels);
+		return GDISP_IMAGE_ERR_OK;
+	}
+#endif
+
+#if GDISP_NEED_IMAGE_PRELOAD
+	/**
+	 * The worker stack size (the decode data is allocated from the heap).
+	 */
+	#define IMAGE_PRELOAD_STACK_SIZE	1024
+
+	typedef struct ImagePreload {
+		gdispPreloadAsset	*assets;
+		unsigned			count;
+		unsigned			next;				// The next asset to load
+		size_t				memory;				// The memory used by the assets loaded so far
+		gfxMutex			mutex;
+		gfxSem				loaded;				// Signalled as each asset is loaded
+	} ImagePreload;
+
+	static void ImagePreloadAsset(gdispPreloadAsset *pa) {
+		gdispImage			*img;
+		gdispImageError		err;
+
+		pa->memory = 0;
+
+		// Fonts are compiled in so there is only the name to look up
+		if (!(img = pa->img)) {
+			#if GDISP_NEED_TEXT
+				pa->font = gdispOpenFont(pa->fontname);
+				pa->result = GDISP_IMAGE_ERR_OK;
+			#else
+				pa->result = GDISP_IMAGE_ERR_UNSUPPORTED;
+			#endif
+			return;
+		}
+
+		if (((pa->result = gdispImageOpen(img)) & GDISP_IMAGE_ERR_UNRECOVERABLE))
+			return;
+
+		// Decode the image now. Only a decoding error is fatal - without the memory to cache it the image is still usable.
+		#if GDISP_NEED_IMAGE_GLOBAL_CACHE
+			{
+				ImageCacheEntry	*pe;
+
+				if ((pe = ImageCacheGet(img))) {
+					pa->memory = pe->size;
+					ImageCacheRelease(pe);
+				}
+			}
+		#endif
+		if (!pa->memory) {
+			err = gdispImageCache(img);
+			if ((err & GDISP_IMAGE_ERR_UNRECOVERABLE) && err != GDISP_IMAGE_ERR_NOMEMORY && err != GDISP_IMAGE_ERR_UNSUPPORTED) {
+				gdispImageClose(img);
+				pa->result = err;
+				return;
+			}
+		}
+		pa->memory += img->memused;
+	}
+
+	static DECLARE_THREAD_FUNCTION(ImagePreloadThread, param) {
+		ImagePreload	*pp;
+		unsigned		i;
+
+		pp = (ImagePreload *)param;
+		while(1) {
+			gfxMutexEnter(&pp->mutex);
+			i = pp->next;
+			if (i < pp->count)
+				pp->next++;
+			gfxMutexExit(&pp->mutex);
+			if (i >= pp->count)
+				break;
+
+			ImagePreloadAsset(&pp->assets[i]);
+
+			gfxMutexEnter(&pp->mutex);
+			pp->memory += pp->assets[i].memory;
+			gfxMutexExit(&pp->mutex);
+			gfxSemSignal(&pp->loaded);
+		}
+		return 0;
+	}
+
+	size_t gdispImagePreload(gdispPreloadAsset *assets, unsigned count, gdispPreloadCallback fn, void *param) {
+		ImagePreload		pl;
+		gfxThreadHandle		threads[GDISP_IMAGE_PRELOAD_THREADS];
+		unsigned			i, n;
+		size_t				memory;
+
+		pl.assets = assets;
+		pl.count = count;
+		pl.next = 0;
+		pl.memory = 0;
+		gfxMutexInit(&pl.mutex);
+		gfxSemInit(&pl.loaded, 0, MAX_SEMAPHORE_COUNT);
+
+		// Start the workers. If none can be started the assets are loaded by this thread.
+		for(n = 0; n < GDISP_IMAGE_PRELOAD_THREADS && n < count; n++) {
+			if (!(threads[n] = gfxThreadCreate(0, IMAGE_PRELOAD_STACK_SIZE, NORMAL_PRIORITY, ImagePreloadThread, &pl)))
+				break;
+		}
+		if (!n)
+			ImagePreloadThread(&pl);
+
+		// Report the progress on this thread so the callback can draw
+		for(i = 1; i <= count; i++) {
+			gfxSemWait(&pl.loaded, TIME_INFINITE);
+			if (fn) {
+				gfxMutexEnter(&pl.mutex);
+				memory = pl.memory;
+				gfxMutexExit(&pl.mutex);
+				fn(param, i, count, memory);
+			}
+		}
+
+		while(n)
+			gfxThreadWait(threads[--n]);
+		gfxSemDestroy(&pl.loaded);
+		gfxMutexDestroy(&pl.mutex);
+		return pl.memory;
+	}
+#endif
+
 delaytime_t gdispImageNext(gdispImage *img) {
 	if (!img->fns) return GDISP_IMAGE_ERR_BADFORMAT;
 	return img->fns->next(img);
 }
 
 // Helper Routines
+#if GDISP_NEED_IMAGE_ALPHA
+	/**
+	 * How many partially transparent pixels are blended before they are drawn.
+	 */
+	#define IMAGE_ALPHA_BATCH	32
+
+	/**
+	 * Draw an area of a pixel buffer with its alpha values. Fully transparent rows and pixels are skipped,
+	 * runs of opaque pixels are blitted straight from the buffer and runs of partially transparent pixels
+	 * are blended in batches before being blitted.
+	 */
+	void gdispImageBlitAlpha(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t srcx, coord_t srcy, coord_t srccx, const pixel_t *buffer, const uint8_t *alpha, color_t bgcolor) {
+		const pixel_t	*pb;
+		const uint8_t	*pa;
+		pixel_t			blend[IMAGE_ALPHA_BATCH];
+		coord_t			i, j, n;
+
+		#if GDISP_NEED_PIXELREAD
+			(void) bgcolor;
+		#endif
+
+		for(; cy; cy--, y++, srcy++) {
+			pb = buffer + srcy * srccx + srcx;
+			pa = alpha + srcy * srccx + srcx;
+
+			// Skip transparent rows
+			for(i = 0; i < cx && !pa[i]; i++);
+
+			while(i < cx) {
+				if (pa[i] == 255) {
+					for(j = i+1; j < cx && pa[j] == 255; j++);
+					if (j - i == 1)
+						gdispDrawPixel(x+i, y, pb[i]);
+					else
+						gdispBlitAreaEx(x+i, y, j-i, 1, srcx+i, srcy, srccx, buffer);
+				} else {
+					for(j = i, n = 0; j < cx && pa[j] && pa[j] != 255 && n < IMAGE_ALPHA_BATCH; j++, n++) {
+						#if GDISP_NEED_PIXELREAD
+							blend[n] = gdispBlendColor(pb[j], gdispGetPixelColor(x+j, y), pa[j]);
+						#else
+							blend[n] = gdispBlendColor(pb[j], bgcolor, pa[j]);
+						#endif
+					}
+					if (n == 1)
+						gdispDrawPixel(x+i, y, blend[0]);
+					else
+						gdispBlitAreaEx(x+i, y, n, 1, 0, 0, n, blend);
+				}
+
+				// Skip any transparent pixels
+				for(i = j; i < cx && !pa[i]; i++);
+			}
+		}
+	}
+#endif
+
 void *gdispImageAlloc(gdispImage *img, size_t sz) {
 	#if GDISP_NEED_IMAGE_ACCOUNTING
 		void *ptr;
@@ -16,6 +16,8 @@
 
 #if GFX_USE_GDISP && GDISP_NEED_IMAGE && GDISP_NEED_IMAGE_BMP
 
+#include <string.h>
+
 #ifndef GDISP_NEED_IMAGE_BMP_1
 	#define GDISP_NEED_IMAGE_BMP_1		TRUE
 #endif
@@ -46,6 +48,9 @@
  */
 void *gdispImageAlloc(gdispImage *img, size_t sz);
 void gdispImageFree(gdispImage *img, void *ptr, size_t sz);
+#if GDISP_NEED_IMAGE_ALPHA
+	void gdispImageBlitAlpha(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t srcx, coord_t srcy, coord_t srccx, const pixel_t *buffer, const uint8_t *alpha, color_t bgcolor);
+#endif
 
 /**
  * How big a pixel array to allocate for blitting (in pixels)
@@ -54,6 +59,18 @@ void gdispImageFree(gdispImage *img, void *ptr, size_t sz);
  */
 #define BLIT_BUFFER_SIZE	32
 
+/**
+ * How many rows apart to save the decoder state for RLE images.
+ * Partial redraws start decoding from the nearest saved state.
+ */
+#define RLE_CHECKPOINT_ROWS	8
+
+/**
+ * The size of the palette expansion table used to convert uncompressed palette images a line at a time (in pixels).
+ * 1 bit images expand each nibble to 4 pixels, 4 bit images each byte to 2 pixels and 8 bit images each byte to 1 pixel.
+ */
+#define LUT_PIXELS(bpp)		((bpp) == 1 ? 16*4 : ((bpp) == 4 ? 256*2 : 256))
+
 /*
  * Determining endianness as at compile time is not guaranteed or compiler portable.
  * We use the best test we can. If we can't guarantee little endianness we do things the
@@ -78,10 +95,12 @@ static const uint8_t	dwordOrder[4]	= { 1, 2, 3, 4 };
 	/* These are fast routines for guaranteed little endian machines */
 	#define CONVERT_FROM_WORD_LE(w)
 	#define CONVERT_FROM_DWORD_LE(dw)
+	#define LITTLE_ENDIAN_PIXELS	TRUE		/* For other tests - GUARANTEED_LITTLE_ENDIAN uses defined() */
 #else
 	/* These are slower routines for when little endianness cannot be guaranteed at compile time */
 	#define CONVERT_FROM_WORD_LE(w)		{ if (!isWordLittleEndian()) w = ((((uint16_t)(w))>>8)|(((uint16_t)(w))<<8)); }
 	#define CONVERT_FROM_DWORD_LE(dw)	{ if (!isDWordLittleEndian()) dw = (((uint32_t)(((const uint8_t *)(&dw))[0]))|(((uint32_t)(((const uint8_t *)(&dw))[1]))<<8)|(((uint32_t)(((const uint8_t *)(&dw))[2]))<<16)|(((uint32_t)(((const uint8_t *)(&dw))[3]))<<24)); }
+	#define LITTLE_ENDIAN_PIXELS	FALSE
 #endif
 
 typedef struct gdispImagePrivate {
@@ -99,9 +118,19 @@ typedef struct gdispImagePrivate {
 	uint16_t	palsize;
 	pixel_t		*palette;
 #endif
+#if GDISP_NEED_IMAGE_BMP_1 || GDISP_NEED_IMAGE_BMP_4 || GDISP_NEED_IMAGE_BMP_8
+	pixel_t		*lut;							// The palette expansion table - built on first use
+#endif
 #if GDISP_NEED_IMAGE_BMP_4_RLE || GDISP_NEED_IMAGE_BMP_8_RLE
 	uint16_t	rlerun;
 	uint8_t		rlecode;
+	coord_t		rlechecked;						// The number of valid checkpoints
+	struct bmpcheckpoint {
+		size_t		pos;						// The file position at the start of the row
+		uint16_t	rlerun;
+		uint8_t		rlecode;
+		uint8_t		bmpflags;
+	}			*rlecheck;						// The decoder state every RLE_CHECKPOINT_ROWS rows
 #endif
 #if GDISP_NEED_IMAGE_BMP_16 || GDISP_NEED_IMAGE_BMP_32
 	int8_t		shiftred;
@@ -152,15 +181,23 @@ gdispImageError gdispImageOpen_BMP(gdispImage *img) {
 #if GDISP_NEED_IMAGE_BMP_1 || GDISP_NEED_IMAGE_BMP_4 || GDISP_NEED_IMAGE_BMP_4_RLE || GDISP_NEED_IMAGE_BMP_8 || GDISP_NEED_IMAGE_BMP_8_RLE
 	priv->palette = 0;
 #endif
+#if GDISP_NEED_IMAGE_BMP_1 || GDISP_NEED_IMAGE_BMP_4 || GDISP_NEED_IMAGE_BMP_8
+	priv->lut = 0;
+#endif
+#if GDISP_NEED_IMAGE_BMP_4_RLE || GDISP_NEED_IMAGE_BMP_8_RLE
+	priv->rlecheck = 0;
+	priv->rlechecked = 0;
+#endif
 
 	/* Skip the size field and the 2 reserved fields */
 	if (img->io.fns->read(&img->io, priv->buf, 8) != 8)
 		goto baddatacleanup;
 
 	/* Get the offset to the bitmap data */
-	if (img->io.fns->read(&img->io, &priv->frame0pos, 4) != 4)
+	if (img->io.fns->read(&img->io, &adword, 4) != 4)
 		goto baddatacleanup;
-	CONVERT_FROM_DWORD_LE(priv->frame0pos);
+	CONVERT_FROM_DWORD_LE(adword);
+	priv->frame0pos = adword;
 
 	/* Process the BITMAPCOREHEADER structure */
 
@@ -380,6 +417,7 @@ gdispImageError gdispImageOpen_BMP(gdispImage *img) {
 		priv->shiftred = 0;
 		priv->shiftgreen = 0;
 		priv->shiftblue = 0;
+		priv->shiftalpha = 0;
 		if (priv->maskred) {
 			if (priv->maskred < 256)
 				for(adword = priv->maskred;  adword < 128; priv->shiftred--, adword <<= 1);
@@ -403,6 +441,9 @@ gdispImageError gdispImageOpen_BMP(gdispImage *img) {
 				for(adword = priv->maskalpha;  adword < 128; priv->shiftalpha--, adword <<= 1);
 			else
 				for(adword = priv->maskalpha;  adword > 255; priv->shiftalpha++, adword >>= 1);
+	#if GDISP_NEED_IMAGE_ALPHA
+			img->flags |= GDISP_IMAGE_FLG_TRANSPARENT;
+	#endif
 		}
 	}
 #endif
@@ -424,15 +465,24 @@ void gdispImageClose_BMP(gdispImage *img) {
 #if GDISP_NEED_IMAGE_BMP_1 || GDISP_NEED_IMAGE_BMP_4 || GDISP_NEED_IMAGE_BMP_4_RLE || GDISP_NEED_IMAGE_BMP_8 || GDISP_NEED_IMAGE_BMP_8_RLE
 		if (img->priv->palette)
 			gdispImageFree(img, (void *)img->priv->palette, img->priv->palsize*sizeof(color_t));
+#endif
+#if GDISP_NEED_IMAGE_BMP_1 || GDISP_NEED_IMAGE_BMP_4 || GDISP_NEED_IMAGE_BMP_8
+		if (img->priv->lut)
+			gdispImageFree(img, (void *)img->priv->lut, LUT_PIXELS(img->priv->bitsperpixel)*sizeof(pixel_t));
 #endif
 		if (img->priv->frame0cache)
-			gdispImageFree(img, (void *)img->priv->frame0cache, img->width*img->height*sizeof(pixel_t));
+			gdispImageFree(img, (void *)img->priv->frame0cache, img->width*img->height*(sizeof(pixel_t) + (gdispImageHasAlpha(img) ? 1 : 0)));
+#if GDISP_NEED_IMAGE_BMP_4_RLE || GDISP_NEED_IMAGE_BMP_8_RLE
+		if (img->priv->rlecheck)
+			gdispImageFree(img, (void *)img->priv->rlecheck, ((img->height+RLE_CHECKPOINT_ROWS-1)/RLE_CHECKPOINT_ROWS)*sizeof(struct bmpcheckpoint));
+#endif
 		gdispImageFree(img, (void *)img->priv, sizeof(gdispImagePrivate));
 		img->priv = 0;
 	}
 	img->io.fns->close(&img->io);
 }
 
+/* Any alpha is ignored - images with alpha are always drawn through alphaLine() */
 static coord_t getPixels(gdispImage *img, coord_t x) {
 	gdispImagePrivate *	priv;
 	color_t *			pc;
@@ -691,7 +741,6 @@ static coord_t getPixels(gdispImage *img, coord_t x) {
 					b = (color_t)((w[0] & priv->maskblue) << -priv->shiftblue);
 				else
 					b = (color_t)((w[0] & priv->maskblue) >> priv->shiftblue);
-				/* We don't support alpha yet */
 				*pc++ = RGB2COLOR(r, g, b);
 				if (priv->shiftred < 0)
 					r = (color_t)((w[1] & priv->maskred) << -priv->shiftred);
@@ -705,7 +754,6 @@ static coord_t getPixels(gdispImage *img, coord_t x) {
 					b = (color_t)((w[1] & priv->maskblue) << -priv->shiftblue);
 				else
 					b = (uint8_t)((w[1] & priv->maskblue) >> priv->shiftblue);
-				/* We don't support alpha yet */
 				*pc++ = RGB2COLOR(r, g, b);
 				x += 2;
 				len += 2;
@@ -758,7 +806,6 @@ static coord_t getPixels(gdispImage *img, coord_t x) {
 					b = (color_t)((dw & priv->maskblue) << -priv->shiftblue);
 				else
 					b = (color_t)((dw & priv->maskblue) >> priv->shiftblue);
-				/* We don't support alpha yet */
 				*pc++ = RGB2COLOR(r, g, b);
 				x++;
 				len++;
@@ -772,25 +819,284 @@ static coord_t getPixels(gdispImage *img, coord_t x) {
 	}
 }
 
-gdispImageError gdispImageCache_BMP(gdispImage *img) {
+#if GDISP_NEED_IMAGE_BMP_1 || GDISP_NEED_IMAGE_BMP_4 || GDISP_NEED_IMAGE_BMP_8
+	/**
+	 * Build the palette expansion table for an uncompressed palette image.
+	 * Indexes past the end of the palette expand to black.
+	 */
+	static bool_t buildLUT(gdispImage *img) {
+		gdispImagePrivate *	priv;
+		pixel_t *			pc;
+		unsigned			i, j, bpp;
+
+		priv = img->priv;
+		if (priv->lut)
+			return TRUE;
+
+		bpp = priv->bitsperpixel;
+		if (!(priv->lut = (pixel_t *)gdispImageAlloc(img, LUT_PIXELS(bpp)*sizeof(pixel_t))))
+			return FALSE;
+
+		#define LUTCOLOR(i)		((i) < priv->palsize ? priv->palette[i] : Black)
+		pc = priv->lut;
+		switch(bpp) {
+		case 1:
+			for(i = 0; i < 16; i++)
+				for(j = 0; j < 4; j++)
+					*pc++ = LUTCOLOR((i >> (3-j)) & 1);
+			break;
+		case 4:
+			for(i = 0; i < 256; i++) {
+				*pc++ = LUTCOLOR(i >> 4);
+				*pc++ = LUTCOLOR(i & 0x0F);
+			}
+			break;
+		default:
+			for(i = 0; i < 256; i++)
+				*pc++ = LUTCOLOR(i);
+			break;
+		}
+		#undef LUTCOLOR
+		return TRUE;
+	}
+#endif
+
+/**
+ * Get a pointer to the bytes of an uncompressed line starting at the byte holding pixel x0.
+ * If base is set the image is in memory and no reading is needed, otherwise the bytes are read into buf.
+ * Lines read in file order follow each other so most of the time no seek is needed.
+ */
+static const uint8_t *getLineBytes(gdispImage *img, const uint8_t *base, uint8_t *buf, size_t stride, coord_t r, coord_t x0, size_t len) {
+	size_t		pos;
+
+	pos = stride * r + (((size_t)x0 * img->priv->bitsperpixel) >> 3);
+	if (base)
+		return base + pos;
+	pos += img->priv->frame0pos;
+	if (img->io.pos != pos)
+		img->io.fns->seek(&img->io, pos);
+	if (img->io.fns->read(&img->io, buf, len) != len)
+		return 0;
+	return buf;
+}
+
+/**
+ * Convert cnt pixels of an uncompressed line. The first pixel must be the first pixel in byte p[0].
+ */
+static void convertLine(gdispImage *img, const uint8_t *p, coord_t cnt, pixel_t *pc) {
+	gdispImagePrivate *	priv;
+
+	priv = img->priv;
+	switch(priv->bitsperpixel) {
+#if GDISP_NEED_IMAGE_BMP_1
+	case 1:
+		{
+		const pixel_t *	q;
+		uint8_t			m;
+
+			for(; cnt >= 8; cnt -= 8, p++, pc += 8) {
+				q = priv->lut + (p[0] >> 4)*4;
+				pc[0] = q[0]; pc[1] = q[1]; pc[2] = q[2]; pc[3] = q[3];
+				q = priv->lut + (p[0] & 0x0F)*4;
+				pc[4] = q[0]; pc[5] = q[1]; pc[6] = q[2]; pc[7] = q[3];
+			}
+			for(m = 0x80; cnt; cnt--, m >>= 1)
+				*pc++ = priv->lut[(p[0] & m) ? 15*4 : 0];
+		}
+		break;
+#endif
+
+#if GDISP_NEED_IMAGE_BMP_4
+	case 4:
+		{
+		const pixel_t *	q;
+
+			for(; cnt >= 2; cnt -= 2, p++, pc += 2) {
+				q = priv->lut + p[0]*2;
+				pc[0] = q[0]; pc[1] = q[1];
+			}
+			if (cnt)
+				*pc = priv->lut[p[0]*2];
+		}
+		break;
+#endif
+
+#if GDISP_NEED_IMAGE_BMP_8
+	case 8:
+		for(; cnt; cnt--)
+			*pc++ = priv->lut[*p++];
+		break;
+#endif
+
+#if GDISP_NEED_IMAGE_BMP_16
+	case 16:
+		{
+		uint16_t	w;
+		color_t		r, g, b;
+
+	#if GDISP_PIXELFORMAT == GDISP_PIXELFORMAT_RGB565 && LITTLE_ENDIAN_PIXELS
+			// The file pixels are exactly our pixels
+			if (priv->maskred == 0xF800 && priv->maskgreen == 0x07E0 && priv->maskblue == 0x001F) {
+				memcpy(pc, p, cnt*sizeof(pixel_t));
+				break;
+			}
+	#endif
+			for(; cnt; cnt--, p += 2) {
+				w = (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+				if (priv->shiftred < 0)
+					r = (color_t)((w & priv->maskred) << -priv->shiftred);
+				else
+					r = (color_t)((w & priv->maskred) >> priv->shiftred);
+				if (priv->shiftgreen < 0)
+					g = (color_t)((w & priv->maskgreen) << -priv->shiftgreen);
+				else
+					g = (color_t)((w & priv->maskgreen) >> priv->shiftgreen);
+				if (priv->shiftblue < 0)
+					b = (color_t)((w & priv->maskblue) << -priv->shiftblue);
+				else
+					b = (color_t)((w & priv->maskblue) >> priv->shiftblue);
+				/* Any alpha is read separately by alphaLine() */
+				*pc++ = RGB2COLOR(r, g, b);
+			}
+		}
+		break;
+#endif
+
+#if GDISP_NEED_IMAGE_BMP_24
+	case 24:
+		for(; cnt; cnt--, p += 3)
+			*pc++ = RGB2COLOR(p[2], p[1], p[0]);
+		break;
+#endif
+
+#if GDISP_NEED_IMAGE_BMP_32
+	case 32:
+		{
+		uint32_t	dw;
+		color_t		r, g, b;
+
+			// The standard masks are just the bytes
+			if (priv->maskred == 0x00FF0000 && priv->maskgreen == 0x0000FF00 && priv->maskblue == 0x000000FF) {
+				for(; cnt; cnt--, p += 4)
+					*pc++ = RGB2COLOR(p[2], p[1], p[0]);
+				break;
+			}
+			for(; cnt; cnt--, p += 4) {
+				dw = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+				if (priv->shiftred < 0)
+					r = (color_t)((dw & priv->maskred) << -priv->shiftred);
+				else
+					r = (color_t)((dw & priv->maskred) >> priv->shiftred);
+				if (priv->shiftgreen < 0)
+					g = (color_t)((dw & priv->maskgreen) << -priv->shiftgreen);
+				else
+					g = (color_t)((dw & priv->maskgreen) >> priv->shiftgreen);
+				if (priv->shiftblue < 0)
+					b = (color_t)((dw & priv->maskblue) << -priv->shiftblue);
+				else
+					b = (color_t)((dw & priv->maskblue) >> priv->shiftblue);
+				/* Any alpha is read separately by alphaLine() */
+				*pc++ = RGB2COLOR(r, g, b);
+			}
+		}
+		break;
+#endif
+	}
+}
+
+#if GDISP_NEED_IMAGE_ALPHA && (GDISP_NEED_IMAGE_BMP_16 || GDISP_NEED_IMAGE_BMP_32)
+	/**
+	 * Get the alpha values of cnt pixels of an uncompressed 16 or 32 bit line.
+	 * A pixel with all the alpha mask bits set is fully opaque.
+	 */
+	static void alphaLine(gdispImage *img, const uint8_t *p, coord_t cnt, uint8_t *pa) {
+		gdispImagePrivate *	priv;
+		uint32_t			dw, amax;
+
+		priv = img->priv;
+
+		// The standard mask is just the top byte
+		if (priv->bitsperpixel == 32 && priv->maskalpha == 0xFF000000) {
+			for(p += 3; cnt; cnt--, p += 4)
+				*pa++ = *p;
+			return;
+		}
+
+		amax = priv->shiftalpha < 0 ? priv->maskalpha << -priv->shiftalpha : priv->maskalpha >> priv->shiftalpha;
+		for(; cnt; cnt--) {
+			if (priv->bitsperpixel == 16) {
+				dw = (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+				p += 2;
+			} else {
+				dw = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+				p += 4;
+			}
+			dw &= priv->maskalpha;
+			dw = priv->shiftalpha < 0 ? dw << -priv->shiftalpha : dw >> priv->shiftalpha;
+			*pa++ = dw == amax ? 255 : (uint8_t)dw;
+		}
+	}
+#endif
+
+/**
+ * Get ready to convert uncompressed lines a whole line at a time.
+ * Returns the pointer to the image bytes if they are in memory.
+ * Returns FALSE if the image is RLE compressed or the palette expansion table can't be allocated.
+ */
+static bool_t startLines(gdispImage *img, const uint8_t **pbase, size_t stride) {
+	gdispImagePrivate *	priv;
+
+	priv = img->priv;
+	if ((priv->bmpflags & BMP_COMP_RLE))
+		return FALSE;
+#if GDISP_NEED_IMAGE_BMP_1 || GDISP_NEED_IMAGE_BMP_4 || GDISP_NEED_IMAGE_BMP_8
+	if ((priv->bmpflags & BMP_PALETTE) && !buildLUT(img))
+		return FALSE;
+#endif
+	*pbase = img->io.fns->getptr ? (const uint8_t *)img->io.fns->getptr(&img->io, priv->frame0pos, stride * img->height) : 0;
+	return TRUE;
+}
+
+gdispImageError gdispImageDecode_BMP(gdispImage *img, pixel_t *buf) {
 	gdispImagePrivate *	priv;
 	color_t *			pcs;
 	color_t *			pcd;
 	coord_t				pos, x, y;
-	size_t				len;
+	const uint8_t *		base;
+	const uint8_t *		p;
+	uint8_t *			line;
+	size_t				stride;
 
-	/* If we are already cached - just return OK */
 	priv = img->priv;
-	if (priv->frame0cache)
+	line = 0;
+
+	/* Convert uncompressed images a whole line at a time */
+	stride = ((((size_t)img->width * priv->bitsperpixel) + 31) >> 5) << 2;
+	if (startLines(img, &base, stride) && (base || (line = (uint8_t *)gdispImageAlloc(img, stride)))) {
+		for(y = 0; y < img->height; y++) {
+			if (!(p = getLineBytes(img, base, line, stride, y, 0, (((size_t)img->width * priv->bitsperpixel) + 7) >> 3))) {
+				if (!base)
+					gdispImageFree(img, (void *)line, stride);
+				return GDISP_IMAGE_ERR_BADDATA;
+			}
+			pos = (priv->bmpflags & BMP_TOP_TO_BOTTOM) ? y : img->height-1-y;
+			convertLine(img, p, img->width, buf + img->width * pos);
+	#if GDISP_NEED_IMAGE_ALPHA && (GDISP_NEED_IMAGE_BMP_16 || GDISP_NEED_IMAGE_BMP_32)
+			// The alpha values follow the pixels
+			if (gdispImageHasAlpha(img))
+				alphaLine(img, p, img->width, (uint8_t *)(buf + img->width * img->height) + img->width * pos);
+	#endif
+		}
+		if (!base)
+			gdispImageFree(img, (void *)line, stride);
 		return GDISP_IMAGE_ERR_OK;
+	}
 
-	/* We need to allocate the cache */
-	len = img->width * img->height * sizeof(pixel_t);
-	priv->frame0cache = (pixel_t *)gdispImageAlloc(img, len);
-	if (!priv->frame0cache)
+	/* getPixels() doesn't do alpha */
+	if (gdispImageHasAlpha(img))
 		return GDISP_IMAGE_ERR_NOMEMORY;
 
-	/* Read the entire bitmap into cache */
+	/* Read the entire bitmap into the buffer */
 	img->io.fns->seek(&img->io, priv->frame0pos);
 #if GDISP_NEED_IMAGE_BMP_4_RLE || GDISP_NEED_IMAGE_BMP_8_RLE
 	priv->rlerun = 0;
@@ -798,7 +1104,7 @@ gdispImageError gdispImageCache_BMP(gdispImage *img) {
 #endif
 
 	if (priv->bmpflags & BMP_TOP_TO_BOTTOM) {
-		for(y = 0, pcd = priv->frame0cache; y < img->height; y++) {
+		for(y = 0, pcd = buf; y < img->height; y++) {
 			x = 0; pos = 0;
 			while(x < img->width) {
 				if (!pos) {
@@ -811,7 +1117,7 @@ gdispImageError gdispImageCache_BMP(gdispImage *img) {
 			}
 		}
 	} else {
-		for(y = img->height-1, pcd = priv->frame0cache + img->width*(img->height-1); y >= 0; y--, pcd -= 2*img->width) {
+		for(y = img->height-1, pcd = buf + img->width*(img->height-1); y >= 0; y--, pcd -= 2*img->width) {
 			x = 0; pos = 0;
 			while(x < img->width) {
 				if (!pos) {
@@ -828,10 +1134,117 @@ gdispImageError gdispImageCache_BMP(gdispImage *img) {
 	return GDISP_IMAGE_ERR_OK;
 }
 
+gdispImageError gdispImageCache_BMP(gdispImage *img) {
+	gdispImagePrivate *	priv;
+	gdispImageError		err;
+	size_t				len;
+
+	/* If we are already cached - just return OK */
+	priv = img->priv;
+	if (priv->frame0cache)
+		return GDISP_IMAGE_ERR_OK;
+
+	/* We need to allocate the cache */
+	len = img->width * img->height * (sizeof(pixel_t) + (gdispImageHasAlpha(img) ? 1 : 0));
+	priv->frame0cache = (pixel_t *)gdispImageAlloc(img, len);
+	if (!priv->frame0cache)
+		return GDISP_IMAGE_ERR_NOMEMORY;
+
+	/* Decode the entire bitmap into the cache */
+	if ((err = gdispImageDecode_BMP(img, priv->frame0cache))) {
+		gdispImageFree(img, (void *)priv->frame0cache, len);
+		priv->frame0cache = 0;
+	}
+	return err;
+}
+
+/**
+ * Draw an uncompressed image a whole line at a time.
+ * Only the bytes holding the pixels in the drawing area are read. If the image bytes are
+ * in memory nothing is read at all.
+ * Returns GDISP_IMAGE_ERR_NOMEMORY if the line buffers can't be allocated.
+ */
+static gdispImageError drawLines(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy) {
+	gdispImagePrivate *	priv;
+	const uint8_t *		base;
+	const uint8_t *		p;
+	pixel_t *			pc;
+	uint8_t *			pa;
+	uint8_t *			pb;
+	size_t				stride, len, sz;
+	coord_t				r, rlast, my, x0, cnt;
+
+	priv = img->priv;
+
+	// Each line is padded to a multiple of 4 bytes
+	stride = ((((size_t)img->width * priv->bitsperpixel) + 31) >> 5) << 2;
+	if (!startLines(img, &base, stride))
+		return GDISP_IMAGE_ERR_NOMEMORY;
+
+	// Start at the byte holding sx
+	switch(priv->bitsperpixel) {
+	case 1:		x0 = sx & ~7;	break;
+	case 4:		x0 = sx & ~1;	break;
+	default:	x0 = sx;		break;
+	}
+	cnt = sx+cx-x0;
+	len = (((size_t)cnt * priv->bitsperpixel) + 7) >> 3;
+
+	// One buffer for the pixels followed by the alpha values and the bytes if they are needed
+	sz = cnt * sizeof(pixel_t) + (gdispImageHasAlpha(img) ? cnt : 0) + (base ? 0 : len);
+	if (!(pc = (pixel_t *)gdispImageAlloc(img, sz)))
+		return GDISP_IMAGE_ERR_NOMEMORY;
+	pa = gdispImageHasAlpha(img) ? (uint8_t *)(pc+cnt) : 0;
+	pb = (uint8_t *)(pc+cnt) + (pa ? cnt : 0);
+
+	// Go through the lines in file order
+	if ((priv->bmpflags & BMP_TOP_TO_BOTTOM)) {
+		r = sy;
+		rlast = sy+cy-1;
+	} else {
+		r = img->height-sy-cy;
+		rlast = img->height-1-sy;
+	}
+	for(; r <= rlast; r++) {
+		my = (priv->bmpflags & BMP_TOP_TO_BOTTOM) ? r : img->height-1-r;
+		if (!(p = getLineBytes(img, base, pb, stride, r, x0, len))) {
+			gdispImageFree(img, (void *)pc, sz);
+			return GDISP_IMAGE_ERR_BADDATA;
+		}
+
+#if GDISP_NEED_IMAGE_BMP_16 && GDISP_PIXELFORMAT == GDISP_PIXELFORMAT_RGB565 && LITTLE_ENDIAN_PIXELS
+		// The file pixels are exactly our pixels - blit them without any conversion
+		if (base && priv->bitsperpixel == 16 && priv->maskred == 0xF800 && priv->maskgreen == 0x07E0 && priv->maskblue == 0x001F
+				&& !((size_t)p & (sizeof(pixel_t)-1))) {
+			gdispBlitAreaEx(x, y+my-sy, cx, 1, 0, 0, cnt, (const pixel_t *)p);
+			continue;
+		}
+#endif
+
+		convertLine(img, p, cnt, pc);
+#if GDISP_NEED_IMAGE_ALPHA && (GDISP_NEED_IMAGE_BMP_16 || GDISP_NEED_IMAGE_BMP_32)
+		if (pa) {
+			alphaLine(img, p, cnt, pa);
+			gdispImageBlitAlpha(x, y+my-sy, cx, 1, sx-x0, 0, cnt, pc, pa, img->bgcolor);
+			continue;
+		}
+#endif
+		if (cx == 1)
+			gdispDrawPixel(x, y+my-sy, pc[sx-x0]);
+		else
+			gdispBlitAreaEx(x, y+my-sy, cx, 1, sx-x0, 0, cnt, pc);
+	}
+
+	gdispImageFree(img, (void *)pc, sz);
+	return GDISP_IMAGE_ERR_OK;
+}
+
 gdispImageError gdispImageDraw_BMP(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy) {
 	gdispImagePrivate *	priv;
-	coord_t				mx, my;
+	coord_t				mx, my, x0;
 	coord_t				pos, len, st;
+	coord_t				r, rfirst, rlast;
+	size_t				stride;
 
 	priv = img->priv;
 
@@ -842,42 +1255,77 @@ gdispImageError gdispImageDraw_BMP(gdispImage *img, coord_t x, coord_t y, coord_
 
 	/* Draw from the image cache - if it exists */
 	if (priv->frame0cache) {
+#if GDISP_NEED_IMAGE_ALPHA
+		if (gdispImageHasAlpha(img)) {
+			gdispImageBlitAlpha(x, y, cx, cy, sx, sy, img->width, priv->frame0cache, (const uint8_t *)(priv->frame0cache + img->width * img->height), img->bgcolor);
+			return GDISP_IMAGE_ERR_OK;
+		}
+#endif
 		gdispBlitAreaEx(x, y, cx, cy, sx, sy, img->width, priv->frame0cache);
 		return GDISP_IMAGE_ERR_OK;
 	}
 
-	/* Start decoding from the beginning */
-	img->io.fns->seek(&img->io, priv->frame0pos);
+	/* Draw uncompressed images a whole line at a time - if we can get the memory. getPixels() doesn't do alpha. */
+	if (!(priv->bmpflags & BMP_COMP_RLE)) {
+		gdispImageError		err;
+
+		if ((err = drawLines(img, x, y, cx, cy, sx, sy)) != GDISP_IMAGE_ERR_NOMEMORY || gdispImageHasAlpha(img))
+			return err;
+	}
+
+	/* The rows we need in file order */
+	if ((priv->bmpflags & BMP_TOP_TO_BOTTOM)) {
+		rfirst = sy;
+		rlast = sy+cy-1;
+	} else {
+		rfirst = img->height-sy-cy;
+		rlast = img->height-1-sy;
+	}
+
 #if GDISP_NEED_IMAGE_BMP_4_RLE || GDISP_NEED_IMAGE_BMP_8_RLE
-	priv->rlerun = 0;
-	priv->rlecode = 0;
-#endif
+	if ((priv->bmpflags & BMP_COMP_RLE)) {
+		struct bmpcheckpoint *	pc;
+
+		/* Every row must be decoded but we can start from the nearest saved decoder state */
+		if (!priv->rlecheck && (priv->rlecheck = (struct bmpcheckpoint *)gdispImageAlloc(img, ((img->height+RLE_CHECKPOINT_ROWS-1)/RLE_CHECKPOINT_ROWS)*sizeof(struct bmpcheckpoint)))) {
+			priv->rlecheck[0].pos = priv->frame0pos;
+			priv->rlecheck[0].rlerun = 0;
+			priv->rlecheck[0].rlecode = 0;
+			priv->rlecheck[0].bmpflags = 0;
+			priv->rlechecked = 1;
+		}
+		if (priv->rlecheck) {
+			r = rfirst / RLE_CHECKPOINT_ROWS;
+			if (r >= priv->rlechecked)
+				r = priv->rlechecked - 1;
+			pc = priv->rlecheck + r;
+			img->io.fns->seek(&img->io, pc->pos);
+			priv->rlerun = pc->rlerun;
+			priv->rlecode = pc->rlecode;
+			priv->bmpflags = (priv->bmpflags & ~(BMP_RLE_ENC|BMP_RLE_ABS)) | pc->bmpflags;
+			r *= RLE_CHECKPOINT_ROWS;
+		} else {
+			img->io.fns->seek(&img->io, priv->frame0pos);
+			priv->rlerun = 0;
+			priv->rlecode = 0;
+			priv->bmpflags &= ~(BMP_RLE_ENC|BMP_RLE_ABS);
+			r = 0;
+		}
 
-	if (priv->bmpflags & BMP_TOP_TO_BOTTOM) {
-		for(my = 0; my < img->height; my++) {
-			mx = 0;
-			while(mx < img->width) {
-				if (!(pos = getPixels(img, mx)))
-					return GDISP_IMAGE_ERR_BADDATA;
-				if (my >= sy && my < sy+cy && mx < sx+cx && mx+pos >= sx) {
-					st = mx < sx ? sx - mx : 0;
-					len = pos-st;
-					if (mx+st+len > sx+cx) len = sx+cx-mx-st;
-					if (len == 1)
-						gdispDrawPixel(x+mx+st-sx, y+my-sy, priv->buf[st]);
-					else
-						gdispBlitAreaEx(x+mx+st-sx, y+my-sy, len, 1, st, 0, pos, priv->buf);
-				}
-				mx += pos;
+		for(; r <= rlast; r++) {
+			/* Save the decoder state if this row starts a new checkpoint */
+			if (priv->rlecheck && !(r % RLE_CHECKPOINT_ROWS) && r / RLE_CHECKPOINT_ROWS == priv->rlechecked) {
+				pc = priv->rlecheck + priv->rlechecked++;
+				pc->pos = img->io.pos;
+				pc->rlerun = priv->rlerun;
+				pc->rlecode = priv->rlecode;
+				pc->bmpflags = priv->bmpflags & (BMP_RLE_ENC|BMP_RLE_ABS);
 			}
-		}
-	} else {
-		for(my = img->height-1; my >= 0; my--) {
-			mx = 0;
-			while(mx < img->width) {
+			my = (priv->bmpflags & BMP_TOP_TO_BOTTOM) ? r : img->height-1-r;
+			for(mx = 0; mx < img->width; mx += pos) {
 				if (!(pos = getPixels(img, mx)))
 					return GDISP_IMAGE_ERR_BADDATA;
-				if (my >= sy && my < sy+cy && mx < sx+cx && mx+pos >= sx) {
+				if (r >= rfirst && mx < sx+cx && mx+pos > sx) {
 					st = mx < sx ? sx - mx : 0;
 					len = pos-st;
 					if (mx+st+len > sx+cx) len = sx+cx-mx-st;
@@ -886,14 +1334,116 @@ gdispImageError gdispImageDraw_BMP(gdispImage *img, coord_t x, coord_t y, coord_
 					else
 						gdispBlitAreaEx(x+mx+st-sx, y+my-sy, len, 1, st, 0, pos, priv->buf);
 				}
-				mx += pos;
 			}
 		}
+		return GDISP_IMAGE_ERR_OK;
+	}
+#endif
+
+	/* Without the memory for a line go through getPixels(). Every row is the same size so
+	 * we can still go straight to the rows we need, starting at the pixel group holding sx */
+	stride = ((((size_t)img->width * priv->bitsperpixel) + 31) >> 5) << 2;
+	switch(priv->bitsperpixel) {
+	case 1:		x0 = sx & ~31;	break;
+	case 4:		x0 = sx & ~7;	break;
+	case 8:		x0 = sx & ~3;	break;
+	case 16:	x0 = sx & ~1;	break;
+	default:	x0 = sx;		break;
+	}
+	for(r = rfirst; r <= rlast; r++) {
+		my = (priv->bmpflags & BMP_TOP_TO_BOTTOM) ? r : img->height-1-r;
+		img->io.fns->seek(&img->io, priv->frame0pos + stride * r + (((size_t)x0 * priv->bitsperpixel) >> 3));
+		for(mx = x0; mx < sx+cx; mx += pos) {
+			if (!(pos = getPixels(img, mx)))
+				return GDISP_IMAGE_ERR_BADDATA;
+			st = mx < sx ? sx - mx : 0;
+			len = pos-st;
+			if (mx+st+len > sx+cx) len = sx+cx-mx-st;
+			if (len == 1)
+				gdispDrawPixel(x+mx+st-sx, y+my-sy, priv->buf[st]);
+			else
+				gdispBlitAreaEx(x+mx+st-sx, y+my-sy, len, 1, st, 0, pos, priv->buf);
+		}
 	}
 
 	return GDISP_IMAGE_ERR_OK;
 }
 
+#if GDISP_NEED_IMAGE_SCALING
+	gdispImageError gdispImageRows_BMP(gdispImage *img, gdispImageRowSink *sink) {
+		gdispImagePrivate *	priv;
+		size_t				stride;
+		coord_t				my, mx, len;
+		const uint8_t *		base;
+		const uint8_t *		p;
+		uint8_t *			line;
+		size_t				lsz;
+
+		priv = img->priv;
+
+		/* RLE lines vary in size so the whole image must be decoded */
+		if ((priv->bmpflags & BMP_COMP_RLE))
+			return GDISP_IMAGE_ERR_UNSUPPORTED;
+
+		/* Every other line is the same size so we can go straight to the lines we need */
+		stride = ((((size_t)img->width * priv->bitsperpixel) + 31) >> 5) << 2;
+
+		/* Convert a whole line at a time - if we can get the memory. The alpha values go after the bytes. */
+		line = 0;
+		if (startLines(img, &base, stride)) {
+			lsz = (base ? 0 : stride) + (gdispImageHasAlpha(img) ? img->width : 0);
+			if (!lsz || (line = (uint8_t *)gdispImageAlloc(img, lsz))) {
+				for(my = 0; my <= sink->last; my++) {
+					if (!gdispImageRowNeeded(sink, my))
+						continue;
+					if (!(p = getLineBytes(img, base, line, stride, (priv->bmpflags & BMP_TOP_TO_BOTTOM) ? my : img->height-1-my, 0, (((size_t)img->width * priv->bitsperpixel) + 7) >> 3))) {
+						if (line)
+							gdispImageFree(img, (void *)line, lsz);
+						return GDISP_IMAGE_ERR_BADDATA;
+					}
+					convertLine(img, p, img->width, sink->buf);
+	#if GDISP_NEED_IMAGE_ALPHA && (GDISP_NEED_IMAGE_BMP_16 || GDISP_NEED_IMAGE_BMP_32)
+					// Scaled images are drawn opaque
+					if (gdispImageHasAlpha(img)) {
+						alphaLine(img, p, img->width, line + lsz - img->width);
+						for(mx = 0; mx < img->width; mx++)
+							sink->buf[mx] = gdispBlendColor(sink->buf[mx], img->bgcolor, line[lsz - img->width + mx]);
+					}
+	#endif
+					if (!sink->row(sink, my, sink->buf))
+						break;
+				}
+				if (line)
+					gdispImageFree(img, (void *)line, lsz);
+				return GDISP_IMAGE_ERR_OK;
+			}
+		}
+
+		/* getPixels() doesn't do alpha */
+		if (gdispImageHasAlpha(img))
+			return GDISP_IMAGE_ERR_NOMEMORY;
+
+		for(my = 0; my <= sink->last; my++) {
+			if (!gdispImageRowNeeded(sink, my))
+				continue;
+			if ((priv->bmpflags & BMP_TOP_TO_BOTTOM))
+				img->io.fns->seek(&img->io, priv->frame0pos + stride * my);
+			else
+				img->io.fns->seek(&img->io, priv->frame0pos + stride * (img->height-1-my));
+			for(mx = 0; mx < img->width; mx += len) {
+				if (!(len = getPixels(img, mx)))
+					return GDISP_IMAGE_ERR_BADDATA;
+				if (len > img->width - mx)			// Low bit depths decode whole bytes
+					len = img->width - mx;
+				memcpy(sink->buf + mx, priv->buf, len * sizeof(pixel_t));
+			}
+			if (!sink->row(sink, my, sink->buf))
+				break;
+		}
+		return GDISP_IMAGE_ERR_OK;
+	}
+#endif
+
 delaytime_t gdispImageNext_BMP(gdispImage *img) {
 	(void) img;
 
@@ -28,6 +28,16 @@ void gdispImageFree(gdispImage *img, void *ptr, size_t sz);
  */
 #define BLIT_BUFFER_SIZE	32
 
+/**
+ * How many points to remember where decoding of a frame can be restarted.
+ * Partial redraws start decoding from the nearest one.
+ */
+#define CHECKPOINTS			16
+
+#ifndef GDISP_NEED_IMAGE_GIF_PREDECODE
+	#define GDISP_NEED_IMAGE_GIF_PREDECODE	FALSE
+#endif
+
 /*
  * Determining endianness as at compile time is not guaranteed or compiler portable.
  * We use the best test we can. If we can't guarantee little endianness we do things the
@@ -76,25 +86,53 @@ static const uint16_t BitMask[] = {
 		0x0fff
 		};
 
+// The row order for each pass of an interlaced image. The last entry is for a non-interlaced image.
+static const uint8_t PassStart[5]	= { 0, 4, 2, 1, 0 };
+static const uint8_t PassStep[5]	= { 8, 8, 4, 2, 1 };
+
+// A point where decoding can restart - just after a clear code when the LZW table is empty
+typedef struct imgcheckpoint {
+	uint32_t	pixel;									// The frame pixel that the next code starts at
+	size_t		blockfpos;								// The file position of the data sub-block
+	uint32_t	shiftdata;
+	uint8_t		blockpos;
+	uint8_t		blocksz;
+	uint8_t		shiftbits;
+} imgcheckpoint;
+
+// The restart points for a frame
+typedef struct imgcheckpoints {
+	size_t			posstart;							// The frame these are for
+	uint16_t		count;
+	imgcheckpoint	check[CHECKPOINTS];
+} imgcheckpoints;
+
 // Structure for decoding a single frame
 typedef struct imgdecode {
-	uint8_t		blocksz;								// The size of the block currently being processed
-	uint8_t		maxpixel;								// The maximum allowed pixel value
+	size_t		allocsz;								// The size of this allocation
+	uint8_t		blockpos;								// The position in the current data sub-block
+	uint8_t		blocksz;								// The size of the data sub-block currently being processed
 	uint8_t		bitsperpixel;
 	uint8_t		bitspercode;
 	uint8_t		shiftbits;
-	uint16_t	maxcodesz;
-	uint16_t	stackcnt;								// The number of items on the stack
+	uint16_t	stackpos;								// The position of the first pixel left on the stack
+	uint16_t	stackcnt;								// The number of pixels left on the stack
 	uint16_t	code_clear;
 	uint16_t	code_eof;
-	uint16_t	code_max;
+	uint16_t	code_next;								// The next code to be added to the table
 	uint16_t	code_last;
 	uint32_t	shiftdata;
+	size_t		blockfpos;								// The file position of the current data sub-block
+	uint32_t	linestart;								// The frame pixel at the start of the line being decoded
+	imgcheckpoints *checks;								// Where to save restart points (if wanted)
 	color_t *	palette;
-	uint8_t		buf[BLIT_BUFFER_SIZE];					// Buffer for decoded pixels
+	uint8_t *	line;									// A frame row of decoded pixels
+	pixel_t *	pixels;									// A frame row of colors ready for blitting
+	uint8_t		block[255];								// The current data sub-block
 	uint16_t	prefix[1<<MAX_CODE_BITS];				// The LZW table
+	uint16_t	length[1<<MAX_CODE_BITS];				// The length of the string for each code
     uint8_t		suffix[1<<MAX_CODE_BITS]; 				// So we can trace the codes
-    uint8_t 	stack[1<<MAX_CODE_BITS];				// Decoded pixels might be stacked here
+    uint8_t 	stack[1<<MAX_CODE_BITS];				// Decoded pixels that don't fit in the line are stored here
 } imgdecode;
 
 // The data on a single frame
@@ -131,10 +169,44 @@ typedef struct imgdispose {
 	coord_t				width, height;					// size of dispose area
 } imgdispose;
 
+#if GDISP_NEED_IMAGE_GIF_PREDECODE
+	// An area of the image
+	typedef struct imgrect {
+		coord_t				x, y;
+		coord_t				width, height;
+	} imgrect;
+
+	// The data for composing the next frame of an animation in the background
+	typedef struct imgpredecode {
+		gfxThreadHandle		thread;
+		gfxSem				start;						// Signalled to prepare the next frame
+		gfxSem				header;						// Signalled when the next frame header has been read
+		gfxSem				done;						// Signalled when the next frame is ready
+		uint8_t				flags;						// Only used by the drawing thread
+			#define GIFP_BUSY		0x01					// The worker is preparing the next frame
+			#define GIFP_HEADER		0x02					// The header signal has been used
+			#define GIFP_PENDING	0x04					// The next draw shows the next frame
+			#define GIFP_NEWFRAME	0x08					// Only the changed area needs drawing
+		bool_t				first;						// The current frame must be composed first
+		bool_t				quit;						// The worker must exit
+		gdispImageError		result;						// The result of moving to the next frame
+		uint16_t			delay;						// The delay for the current frame
+		uint16_t			nextdelay;					// The delay for the next frame
+		imgrect				dirty;						// The area changed by the current frame
+		imgrect				nextdirty;					// The area changed by the next frame
+		imgrect				saved;						// The area held in the restore buffer
+		pixel_t *			front;						// The current frame
+		pixel_t *			back;						// The next frame
+		pixel_t *			restore;					// What is under a frame that is disposed by restoring
+		size_t				restoresz;
+	} imgpredecode;
+#endif
+
 typedef struct gdispImagePrivate {
 	uint8_t		flags;							// Flags (global)
 		#define GIF_LOOP			0x01		// Loop back to first frame
 		#define GIF_LOOPFOREVER		0x02		// Looping is forever
+		#define GIF_NOPREDECODE		0x04		// Background decoding could not be started
 	uint8_t		bgcolor;						// Background Color (global)
 	uint16_t	loops;							// Remaining frame loops (if animated)
 	uint16_t	palsize;						// Global palette size (global)
@@ -143,8 +215,12 @@ typedef struct gdispImagePrivate {
 	imgcache *	cache;							// The list of cached frames
 	imgcache *	curcache;						// The cache of the current frame (if created)
 	imgdecode *	decode;							// The decode data for the decode in progress
+	imgcheckpoints *checks;						// Where decoding of the current frame can restart
 	imgframe	frame;
 	imgdispose	dispose;
+	#if GDISP_NEED_IMAGE_GIF_PREDECODE
+		imgpredecode *	pre;					// Background decoding (if started)
+	#endif
 	pixel_t		buf[BLIT_BUFFER_SIZE];			// Buffer for reading and blitting
 	} gdispImagePrivate;
 
@@ -156,31 +232,34 @@ typedef struct gdispImagePrivate {
 static gdispImageError startDecode(gdispImage *img) {
 	gdispImagePrivate *	priv;
 	imgdecode *			decode;
+	size_t				sz;
 	uint16_t			cnt;
 
 	priv = img->priv;
 
-	// We need the decode ram, and possibly a palette
-	if (!(decode = (imgdecode *)gdispImageAlloc(img, sizeof(imgdecode)+priv->frame.palsize*sizeof(color_t))))
+	// We need the decode ram, a row of pixels, and possibly a palette
+	sz = sizeof(imgdecode) + priv->frame.palsize*sizeof(color_t) + priv->frame.width*(sizeof(pixel_t)+1);
+	if (!(decode = (imgdecode *)gdispImageAlloc(img, sz)))
 		return GDISP_IMAGE_ERR_NOMEMORY;
+	decode->allocsz = sz;
+	decode->pixels = (pixel_t *)(decode+1);
+	decode->palette = (color_t *)(decode->pixels + priv->frame.width);
+	decode->line = (uint8_t *)(decode->palette + priv->frame.palsize);
 
 	// We currently have not read any image data block
-	decode->blocksz = 0;
+	decode->blockpos = decode->blocksz = 0;
 
 	// Set the palette
 	if (priv->frame.palsize) {
 		// Local palette
-		decode->maxpixel = priv->frame.palsize-1;
-		decode->palette = (color_t *)(decode+1);
 		img->io.fns->seek(&img->io, priv->frame.pospal);
 		for(cnt = 0; cnt < priv->frame.palsize; cnt++) {
-			if (img->io.fns->read(&img->io, &decode->buf, 3) != 3)
+			if (img->io.fns->read(&img->io, decode->block, 3) != 3)
 				goto baddatacleanup;
-			decode->palette[cnt] = RGB2COLOR(decode->buf[0], decode->buf[1], decode->buf[2]);
+			decode->palette[cnt] = RGB2COLOR(decode->block[0], decode->block[1], decode->block[2]);
 		}
 	} else if (priv->palette) {
 		// Global palette
-		decode->maxpixel = priv->palsize-1;
 		decode->palette = priv->palette;
 	} else {
 		// Oops - we must have a palette
@@ -193,22 +272,26 @@ static gdispImageError startDecode(gdispImage *img) {
 		goto baddatacleanup;
 	decode->code_clear = 1 << decode->bitsperpixel;
 	decode->code_eof = decode->code_clear + 1;
-	decode->code_max = decode->code_clear + 2;
+	decode->code_next = decode->code_clear + 2;
 	decode->code_last = CODE_NONE;
 	decode->bitspercode = decode->bitsperpixel+1;
-	decode->maxcodesz = 1 << decode->bitspercode;
 	decode->shiftbits = 0;
 	decode->shiftdata = 0;
 	decode->stackcnt = 0;
-	for(cnt = 0; cnt <= CODE_MAX; cnt++)
-		decode->prefix[cnt] = CODE_NONE;
+	decode->checks = 0;
+
+	// The root codes are single pixels
+	for(cnt = 0; cnt < decode->code_clear; cnt++) {
+		decode->suffix[cnt] = cnt;
+		decode->length[cnt] = 1;
+	}
 
 	// All ready to go
 	priv->decode = decode;
 	return GDISP_IMAGE_ERR_OK;
 
 baddatacleanup:
-	gdispImageFree(img, decode, sizeof(imgdecode)+priv->frame.palsize*sizeof(color_t));
+	gdispImageFree(img, decode, sz);
 	return GDISP_IMAGE_ERR_BADDATA;
 }
 
@@ -224,158 +307,237 @@ static void stopDecode(gdispImage *img) {
 
 	// Free the decode data
 	if (priv->decode) {
-		gdispImageFree(img, (void *)priv->decode, sizeof(imgdecode)+priv->frame.palsize*sizeof(color_t));
+		gdispImageFree(img, (void *)priv->decode, priv->decode->allocsz);
 		priv->decode = 0;
 	}
 }
 
-static uint16_t getPrefix(imgdecode *decode, uint16_t code) {
-	uint16_t i;
+/**
+ * Skip the rest of the data sub-blocks for a frame.
+ *
+ * Post:	The file position is at the end of the frame.
+ */
+static void skipBlocks(gdispImage *img) {
+	imgdecode *			decode;
 
-	for(i=0; code > decode->code_clear && i <= CODE_MAX; i++, code = decode->prefix[code]) {
-		if (code > CODE_MAX)
-			return CODE_NONE;
-	}
-    return code;
+	decode = img->priv->decode;
+	decode->blockpos = decode->blocksz = 0;
+	while (img->io.fns->read(&img->io, &decode->blocksz, 1) == 1 && decode->blocksz)
+		img->io.fns->seek(&img->io, img->io.pos+decode->blocksz);
+	decode->blocksz = 0;
 }
 
 /**
- * Decode some pixels from a frame.
+ * Remember this point in the frame so decoding can restart here.
  *
- * Pre:		We are ready for decoding.
- *
- * Return:	The number of pixels decoded 0 .. BLIT_BUFFER_SIZE-1. 0 means EOF
- *
- * Note:	The resulting pixels are stored in decode->buf
+ * Pre:		A clear code has just been read.
  */
-static uint16_t getbytes(gdispImage *img) {
+static void saveCheckpoint(gdispImage *img, uint32_t pixel) {
 	gdispImagePrivate *	priv;
 	imgdecode *			decode;
-	uint16_t			cnt;
-	uint16_t			code, prefix;
-	uint8_t				bdata;
+	imgcheckpoints *	checks;
+	imgcheckpoint *		pc;
 
 	priv = img->priv;
 	decode = priv->decode;
+	checks = decode->checks;
+
+	// Only save points past the last one and spread them out across the frame
+	if (!pixel || checks->count >= CHECKPOINTS)
+		return;
+	if (checks->count && pixel < checks->check[checks->count-1].pixel + ((uint32_t)priv->frame.width*priv->frame.height)/CHECKPOINTS)
+		return;
+
+	pc = checks->check + checks->count++;
+	pc->pixel = pixel;
+	pc->blockfpos = decode->blockfpos;
+	pc->blockpos = decode->blockpos;
+	pc->blocksz = decode->blocksz;
+	pc->shiftdata = decode->shiftdata;
+	pc->shiftbits = decode->shiftbits;
+}
+
+/**
+ * Restart decoding at a checkpoint.
+ *
+ * Pre:		We are ready for decoding.
+ */
+static gdispImageError restoreCheckpoint(gdispImage *img, const imgcheckpoint *pc) {
+	imgdecode *			decode;
+
+	decode = img->priv->decode;
+	img->io.fns->seek(&img->io, pc->blockfpos);
+	if (img->io.fns->read(&img->io, decode->block, pc->blocksz) != pc->blocksz)
+		return GDISP_IMAGE_ERR_BADDATA;
+	decode->blockfpos = pc->blockfpos;
+	decode->blockpos = pc->blockpos;
+	decode->blocksz = pc->blocksz;
+	decode->shiftdata = pc->shiftdata;
+	decode->shiftbits = pc->shiftbits;
+	decode->code_next = decode->code_clear + 2;
+	decode->bitspercode = decode->bitsperpixel + 1;
+	decode->code_last = CODE_NONE;
+	decode->stackcnt = 0;
+	return GDISP_IMAGE_ERR_OK;
+}
+
+/**
+ * Decode a row of pixels from a frame.
+ *
+ * Pre:		We are ready for decoding.
+ *
+ * Return:	The number of pixels decoded. Less than width means EOF. -1 means bad data.
+ *
+ * Note:	Each LZW string is decoded backwards straight into the line. Any part that doesn't
+ * 			fit is decoded into the stack and used at the start of the next line.
+ */
+static coord_t getLine(gdispImage *img, uint8_t *line, coord_t width) {
+	imgdecode *			decode;
+	uint8_t *			p;
+	coord_t				cnt;
+	uint16_t			code, c, len;
+
+	decode = img->priv->decode;
 	cnt = 0;
 
-	// At EOF
-	if (decode->code_last == decode->code_eof)
-		return 0;
+	// Use up the stack first
+	while (decode->stackcnt && cnt < width) {
+		line[cnt++] = decode->stack[decode->stackpos++];
+		decode->stackcnt--;
+	}
 
-	while(cnt < sizeof(decode->buf)) {
-		// Use the stack up first
-		if (decode->stackcnt > 0) {
-			decode->buf[cnt++] = decode->stack[--decode->stackcnt];
-			continue;
+	while(cnt < width) {
+		// At EOF
+		if (decode->code_last == decode->code_eof)
+			return cnt;
+
+		// Get another code - a code is made up of decode->bitspercode bits.
+		while (decode->shiftbits < decode->bitspercode) {
+			// Get a byte - we may have to read a new data sub-block
+			if (decode->blockpos >= decode->blocksz) {
+				decode->blockpos = 0;
+				decode->blockfpos = img->io.pos + 1;
+				if (img->io.fns->read(&img->io, &decode->blocksz, 1) != 1 || !decode->blocksz
+						|| img->io.fns->read(&img->io, decode->block, decode->blocksz) != decode->blocksz) {
+					// Pretend we got the EOF code - some encoders seem to just end the file
+					decode->blocksz = 0;
+					decode->code_last = decode->code_eof;
+					return cnt;
+				}
+			}
+			decode->shiftdata |= ((uint32_t)decode->block[decode->blockpos++]) << decode->shiftbits;
+			decode->shiftbits += 8;
 		}
-
-	    // Get another code - a code is made up of decode->bitspercode bits.
-	    while (decode->shiftbits < decode->bitspercode) {
-	    	// Get a byte - we may have to start a new data block
-	    	if ((!decode->blocksz && (img->io.fns->read(&img->io, &decode->blocksz, 1) != 1 || !decode->blocksz))
-	    			|| img->io.fns->read(&img->io, &bdata, 1) != 1) {
-	    		// Pretend we got the EOF code - some encoders seem to just end the file
-	    		decode->code_last = decode->code_eof;
-	    		return cnt;
-	    	}
-   	    	decode->blocksz--;
-
-	        decode->shiftdata |= ((unsigned long)bdata) << decode->shiftbits;
-	        decode->shiftbits += 8;
-	    }
-	    code = decode->shiftdata & BitMask[decode->bitspercode];
-	    decode->shiftdata >>= decode->bitspercode;
-	    decode->shiftbits -= decode->bitspercode;
-	    /**
-	     * If code cannot fit into bitspercode bits we must raise its size.
-	     * Note that codes above CODE_MAX are used for special signaling.
-	     * If we're using MAX_CODE_BITS bits already and we're at the max code, just
-	     * keep using the table as it is, don't increment decode->bitspercode.
-	     */
-	    if (decode->code_max < CODE_MAX + 2 && ++decode->code_max > decode->maxcodesz && decode->bitspercode < MAX_CODE_BITS) {
-	        decode->maxcodesz <<= 1;
-	        decode->bitspercode++;
-	    }
+		code = decode->shiftdata & BitMask[decode->bitspercode];
+		decode->shiftdata >>= decode->bitspercode;
+		decode->shiftbits -= decode->bitspercode;
 
 		// EOF - the appropriate way to stop decoding
 		if (code == decode->code_eof) {
-			// Skip to the end of the data blocks
-			do {
-				img->io.fns->seek(&img->io, img->io.pos+decode->blocksz);
-			} while (img->io.fns->read(&img->io, &decode->blocksz, 1) == 1 && decode->blocksz);
-
-			// Mark the end
+			skipBlocks(img);
 			decode->code_last = decode->code_eof;
-			break;
+			return cnt;
 		}
 
 		if (code == decode->code_clear) {
 			// Start again
-			for(prefix = 0; prefix <= CODE_MAX; prefix++)
-				decode->prefix[prefix] = CODE_NONE;
-			decode->code_max = decode->code_eof + 1;
+			decode->code_next = decode->code_clear + 2;
 			decode->bitspercode = decode->bitsperpixel + 1;
-			decode->maxcodesz = 1 << decode->bitspercode;
 			decode->code_last = CODE_NONE;
+
+			// Nothing before this point is needed to decode what follows
+			if (decode->checks)
+				saveCheckpoint(img, decode->linestart + cnt);
 			continue;
 		}
 
-		if (code < decode->code_clear) {
-			// Simple unencoded pixel - add it
-			decode->buf[cnt++] = code;
-
+		/**
+		 * Work out how long the string is. A code that is not in the table yet is only
+		 * allowed if it is the next code. It is then the last string plus its own first pixel.
+		 */
+		if (code < decode->code_next && code != decode->code_clear+1)
+			len = decode->length[code];
+		else if (code == decode->code_next && decode->code_last != CODE_NONE)
+			len = decode->length[decode->code_last] + 1;
+		else
+			return -1;
+
+		// Decode the string backwards - into the line if it fits, otherwise onto the stack
+		p = len <= width - cnt ? line + cnt : decode->stack;
+		if (code == decode->code_next) {
+			c = decode->code_last;
+			p += len - 2;
 		} else {
-			/**
-			 * Its a LZW code - trace the linked list until the prefix is a
-			 * valid pixel while pushing the suffix pixels on the stack.
-			 * If done, pop the stack in reverse order adding the pixels
-			 */
-			if (decode->prefix[code] != CODE_NONE)
-				prefix = code;
-
-			/**
-			 * Only allowed if the code equals the partial code.
-			 * In that case code = XXXCode, CrntCode or the
-			 * prefix code is last code and the suffix char is
-			 * exactly the prefix of last code!
-			 */
-			else if (code == decode->code_max - 2 && decode->stackcnt < sizeof(decode->stack)) {
-				prefix = decode->code_last;
-				decode->suffix[decode->code_max - 2] = decode->stack[decode->stackcnt++] = getPrefix(decode, decode->code_last);
-			} else
-				return 0;
-
-			/**
-			 * If the image is OK we should not get a CODE_NONE while tracing.
-			 * To prevent looping with a bad image we use StackPtr as loop counter
-			 * and stop before overflowing Stack[].
-			 */
-			while (decode->stackcnt < sizeof(decode->stack) && prefix > decode->code_clear && prefix <= CODE_MAX) {
-				decode->stack[decode->stackcnt++] = decode->suffix[prefix];
-				prefix = decode->prefix[prefix];
-			}
-			if (decode->stackcnt >= sizeof(decode->stack) || prefix > CODE_MAX)
-				return 0;
-
-			/* Push the last character on stack: */
-			decode->stack[decode->stackcnt++] = prefix;
+			c = code;
+			p += len - 1;
+		}
+		while (c >= decode->code_clear) {
+			*p-- = decode->suffix[c];
+			c = decode->prefix[c];
+		}
+		*p = c;
+		if (code == decode->code_next)
+			p[len-1] = c;
+
+		// Add the new string to the table
+		if (decode->code_last != CODE_NONE && decode->code_next <= CODE_MAX) {
+			decode->prefix[decode->code_next] = decode->code_last;
+			decode->suffix[decode->code_next] = c;
+			decode->length[decode->code_next] = decode->length[decode->code_last] + 1;
+			if (++decode->code_next > BitMask[decode->bitspercode] && decode->bitspercode < MAX_CODE_BITS)
+				decode->bitspercode++;
 		}
+		decode->code_last = code;
 
-		if (decode->code_last != CODE_NONE && decode->prefix[decode->code_max - 2] == CODE_NONE) {
-			decode->prefix[decode->code_max - 2] = decode->code_last;
+		// Did it go into the line?
+		if (p != decode->stack) {
+			cnt += len;
+			continue;
+		}
 
-			/* Only allowed if code is exactly the running code:
-			* In that case code = XXXCode, CrntCode or the
-			* prefix code is last code and the suffix char is
-			* exactly the prefix of last code! */
-			decode->suffix[decode->code_max - 2] = getPrefix(decode, code == decode->code_max - 2 ? decode->code_last : code);
+		// Use what we can from the stack
+		decode->stackpos = 0;
+		decode->stackcnt = len;
+		while (decode->stackcnt && cnt < width) {
+			line[cnt++] = decode->stack[decode->stackpos++];
+			decode->stackcnt--;
 		}
-		decode->code_last = code;
 	}
 	return cnt;
 }
 
+/**
+ * Draw a row of pixels as runs of non-transparent pixels.
+ */
+static void blitRow(gdispImage *img, coord_t x, coord_t y, const uint8_t *q, coord_t cx, const color_t *palette, pixel_t *pixels, coord_t maxpixels) {
+	gdispImagePrivate *	priv;
+	coord_t				cnt;
+
+	priv = img->priv;
+	while(cx) {
+		// Skip transparent pixels
+		if ((priv->frame.flags & GIFL_TRANSPARENT)) {
+			while(cx && *q == priv->frame.paltrans) {
+				q++; x++; cx--;
+			}
+			if (!cx)
+				break;
+		}
+
+		// Collect the run
+		for(cnt = 0; cnt < cx && cnt < maxpixels; cnt++) {
+			if ((priv->frame.flags & GIFL_TRANSPARENT) && q[cnt] == priv->frame.paltrans)
+				break;
+			pixels[cnt] = palette[q[cnt]];
+		}
+		if (cnt == 1)
+			gdispDrawPixel(x, y, pixels[0]);
+		else
+			gdispBlitAreaEx(x, y, cnt, 1, 0, 0, cnt, pixels);
+		q += cnt; x += cnt; cx -= cnt;
+	}
+}
+
 /**
  * Read the info on a frame.
  *
@@ -441,6 +603,10 @@ static gdispImageError initFrame(gdispImage *img) {
 			priv->frame.posimg = priv->frame.pospal+priv->frame.palsize*3;
 			priv->frame.posend = 0;
 
+			// A frame that doesn't cover the image leaves the rest transparent
+			if (priv->frame.x || priv->frame.y || priv->frame.x+priv->frame.width < img->width || priv->frame.y+priv->frame.height < img->height)
+				img->flags |= GDISP_IMAGE_FLG_TRANSPARENT;
+
 			// Mark this as an animated image if more than 1 frame.
 			if (priv->frame.posstart != priv->frame0pos)
 				img->flags |= GDISP_IMAGE_FLG_ANIMATED;
@@ -546,6 +712,404 @@ static gdispImageError initFrame(gdispImage *img) {
 	}
 }
 
+/**
+ * Move to the next frame.
+ *
+ * Return:	GDISP_IMAGE_ERR_OK for the next frame, GDISP_IMAGE_LOOP if we have gone back to the first frame,
+ * 			GDISP_IMAGE_EOF if there are no more frames, or an error.
+ */
+static gdispImageError advanceFrame(gdispImage *img) {
+	gdispImagePrivate *	priv;
+	gdispImageError		err;
+	uint8_t				blocksz;
+
+	priv = img->priv;
+
+	// We need to get to the end of this frame
+	if (!priv->frame.posend) {
+		// We don't know where the end of the frame is yet - find it!
+		img->io.fns->seek(&img->io, priv->frame.posimg+1);				// Skip the code size byte too
+		while(1) {
+			if (img->io.fns->read(&img->io, &blocksz, 1) != 1)
+				return GDISP_IMAGE_EOF;
+			if (!blocksz)
+				break;
+			img->io.fns->seek(&img->io, img->io.pos + blocksz);
+		}
+		priv->frame.posend = img->io.pos;
+	}
+
+	// Seek to the end of this frame
+	img->io.fns->seek(&img->io, priv->frame.posend);
+
+	// Read the next frame descriptor
+	if ((err = initFrame(img)) != GDISP_IMAGE_LOOP)
+		return err;
+
+	// Back to the beginning - only once to prevent cycling forever with a bad file
+	return initFrame(img) == GDISP_IMAGE_ERR_OK ? GDISP_IMAGE_LOOP : GDISP_IMAGE_EOF;
+}
+
+#if GDISP_NEED_IMAGE_GIF_PREDECODE
+	/**
+	 * Background decoding of animations.
+	 *
+	 * The first call to gdispImageNext() starts a thread that composes each following frame
+	 * into a full image buffer while the current frame is being displayed. The frame disposal
+	 * (including restoring) is done in the buffers so gdispImageDraw() only has to blit the area
+	 * that has changed. Only the worker thread uses the image io functions once it has started.
+	 */
+
+	static void clipRect(gdispImage *img, imgrect *r) {
+		if (r->x >= img->width || r->y >= img->height) {
+			r->width = r->height = 0;
+			return;
+		}
+		if (r->x + r->width > img->width) r->width = img->width - r->x;
+		if (r->y + r->height > img->height) r->height = img->height - r->y;
+	}
+
+	static void unionRect(imgrect *r, const imgrect *a) {
+		coord_t		x1, y1;
+
+		if (a->width <= 0 || a->height <= 0)
+			return;
+		if (r->width <= 0 || r->height <= 0) {
+			*r = *a;
+			return;
+		}
+		x1 = r->x + r->width > a->x + a->width ? r->x + r->width : a->x + a->width;
+		y1 = r->y + r->height > a->y + a->height ? r->y + r->height : a->y + a->height;
+		if (a->x < r->x) r->x = a->x;
+		if (a->y < r->y) r->y = a->y;
+		r->width = x1 - r->x;
+		r->height = y1 - r->y;
+	}
+
+	static void fillCanvas(gdispImage *img, pixel_t *canvas, const imgrect *r, pixel_t color) {
+		pixel_t *	p;
+		coord_t		mx, my;
+
+		for(my = 0; my < r->height; my++)
+			for(p = canvas + (r->y+my)*img->width + r->x, mx = 0; mx < r->width; mx++)
+				p[mx] = color;
+	}
+
+	// Copy an area between canvases (dstride == 0) or between a canvas and a buffer of the area size
+	static void copyCanvas(gdispImage *img, pixel_t *dst, coord_t dstride, const pixel_t *src, coord_t sstride, const imgrect *r) {
+		coord_t		mx, my;
+
+		if (!dstride) { dst += r->y*img->width + r->x; dstride = img->width; }
+		if (!sstride) { src += r->y*img->width + r->x; sstride = img->width; }
+		for(my = 0; my < r->height; my++, dst += dstride, src += sstride)
+			for(mx = 0; mx < r->width; mx++)
+				dst[mx] = src[mx];
+	}
+
+	// Draw the non-transparent pixels of the current frame into a canvas
+	static void composeFrame(gdispImage *img, pixel_t *canvas) {
+		gdispImagePrivate *	priv;
+		imgdecode *			decode;
+		const uint8_t *		q;
+		const color_t *		palette;
+		pixel_t *			p;
+		imgrect				r;
+		coord_t				mx, my, cnt;
+		uint8_t				pass;
+
+		priv = img->priv;
+		r.x = priv->frame.x; r.y = priv->frame.y; r.width = priv->frame.width; r.height = priv->frame.height;
+		clipRect(img, &r);
+
+		// From the frame cache if we have it
+		if (priv->curcache) {
+			palette = priv->curcache->palette;
+			for(my = 0; my < r.height; my++) {
+				p = canvas + (r.y+my)*img->width + r.x;
+				q = priv->curcache->imagebits + my*priv->frame.width;
+				for(mx = 0; mx < r.width; mx++) {
+					if (!(priv->frame.flags & GIFL_TRANSPARENT) || q[mx] != priv->frame.paltrans)
+						p[mx] = palette[q[mx]];
+				}
+			}
+			return;
+		}
+
+		if (startDecode(img) != GDISP_IMAGE_ERR_OK)
+			return;
+		decode = priv->decode;
+		for(pass = (priv->frame.flags & GIFL_INTERLACE) ? 0 : 4; pass < 5; pass++) {
+			for(my = PassStart[pass]; my < priv->frame.height; my += PassStep[pass]) {
+				if ((cnt = getLine(img, decode->line, priv->frame.width)) < 0)
+					goto done;
+				if (my < r.height) {
+					p = canvas + (r.y+my)*img->width + r.x;
+					for(mx = 0; mx < r.width && mx < cnt; mx++) {
+						if (!(priv->frame.flags & GIFL_TRANSPARENT) || decode->line[mx] != priv->frame.paltrans)
+							p[mx] = decode->palette[decode->line[mx]];
+					}
+				}
+				if (cnt < priv->frame.width)
+					goto done;
+			}
+		}
+		if (decode->code_last != decode->code_eof)
+			skipBlocks(img);
+		priv->frame.posend = img->io.pos;
+	done:
+		stopDecode(img);
+	}
+
+	// Save what is under the current frame if it is going to be disposed by restoring
+	static void saveUnder(gdispImage *img, const pixel_t *canvas) {
+		gdispImagePrivate *	priv;
+		imgpredecode *		pre;
+		size_t				sz;
+
+		priv = img->priv;
+		pre = priv->pre;
+		pre->saved.width = 0;
+		if (!(priv->frame.flags & GIFL_DISPOSEREST))
+			return;
+		pre->saved.x = priv->frame.x; pre->saved.y = priv->frame.y;
+		pre->saved.width = priv->frame.width; pre->saved.height = priv->frame.height;
+		clipRect(img, &pre->saved);
+		sz = pre->saved.width * pre->saved.height * sizeof(pixel_t);
+		if (sz > pre->restoresz) {
+			if (pre->restore)
+				gdispImageFree(img, pre->restore, pre->restoresz);
+			pre->restoresz = 0;
+			if (!(pre->restore = (pixel_t *)gdispImageAlloc(img, sz))) {
+				pre->saved.width = 0;							// We will clear instead
+				return;
+			}
+			pre->restoresz = sz;
+		}
+		copyCanvas(img, pre->restore, pre->saved.width, canvas, 0, &pre->saved);
+	}
+
+	// Compose the next frame into the back buffer
+	static void prepareFrame(gdispImage *img) {
+		gdispImagePrivate *	priv;
+		imgpredecode *		pre;
+		imgrect				r;
+
+		priv = img->priv;
+		pre = priv->pre;
+
+		// The display is already showing the first frame - compose it from the background
+		if (pre->first) {
+			r.x = r.y = 0; r.width = img->width; r.height = img->height;
+			fillCanvas(img, pre->front, &r, img->bgcolor);
+			saveUnder(img, pre->front);
+			composeFrame(img, pre->front);
+			copyCanvas(img, pre->back, 0, pre->front, 0, &r);
+			pre->dirty.width = 0;
+		}
+
+		// Bring the back buffer up to date with the current frame
+		copyCanvas(img, pre->back, 0, pre->front, 0, &pre->dirty);
+
+		// Move to the next frame
+		pre->result = advanceFrame(img);
+		pre->nextdelay = priv->frame.delay;
+		gfxSemSignal(&pre->header);
+
+		pre->nextdirty.width = 0;
+		switch(pre->result) {
+		case GDISP_IMAGE_ERR_OK:
+			// Dispose of the current frame
+			if ((priv->dispose.flags & (GIFL_DISPOSECLEAR|GIFL_DISPOSEREST))) {
+				r.x = priv->dispose.x; r.y = priv->dispose.y; r.width = priv->dispose.width; r.height = priv->dispose.height;
+				clipRect(img, &r);
+				if ((priv->dispose.flags & GIFL_DISPOSEREST) && pre->saved.width && pre->saved.x == r.x && pre->saved.y == r.y
+						&& pre->saved.width == r.width && pre->saved.height == r.height)
+					copyCanvas(img, pre->back, 0, pre->restore, r.width, &r);
+				else if ((priv->dispose.flags & GIFL_TRANSPARENT) || priv->bgcolor >= priv->palsize)
+					fillCanvas(img, pre->back, &r, img->bgcolor);
+				else
+					fillCanvas(img, pre->back, &r, priv->palette[priv->bgcolor]);
+				pre->nextdirty = r;
+			}
+			break;
+		case GDISP_IMAGE_LOOP:
+			// Start again from the background
+			r.x = r.y = 0; r.width = img->width; r.height = img->height;
+			fillCanvas(img, pre->back, &r, img->bgcolor);
+			pre->nextdirty = r;
+			break;
+		default:
+			gfxSemSignal(&pre->done);
+			return;
+		}
+
+		// Draw the new frame
+		saveUnder(img, pre->back);
+		composeFrame(img, pre->back);
+		r.x = priv->frame.x; r.y = priv->frame.y; r.width = priv->frame.width; r.height = priv->frame.height;
+		clipRect(img, &r);
+		unionRect(&pre->nextdirty, &r);
+		gfxSemSignal(&pre->done);
+	}
+
+	static DECLARE_THREAD_FUNCTION(GIFPredecodeThread, param) {
+		gdispImage *		img;
+		imgpredecode *		pre;
+
+		img = (gdispImage *)param;
+		pre = img->priv->pre;
+		while(1) {
+			gfxSemWait(&pre->start, TIME_INFINITE);
+			if (pre->quit)
+				break;
+			prepareFrame(img);
+		}
+		return 0;
+	}
+
+	// Start preparing the next frame
+	static void kickPredecode(imgpredecode *pre) {
+		pre->flags |= GIFP_BUSY;
+		pre->flags &= ~GIFP_HEADER;
+		gfxSemSignal(&pre->start);
+	}
+
+	// Wait for the worker to finish preparing the next frame
+	static void waitPredecode(imgpredecode *pre) {
+		if (!(pre->flags & GIFP_BUSY))
+			return;
+		if (!(pre->flags & GIFP_HEADER))
+			gfxSemWait(&pre->header, TIME_INFINITE);
+		gfxSemWait(&pre->done, TIME_INFINITE);
+		pre->flags &= ~(GIFP_BUSY|GIFP_HEADER);
+		pre->first = FALSE;
+	}
+
+	static void freePredecode(gdispImage *img) {
+		imgpredecode *		pre;
+		size_t				sz;
+
+		pre = img->priv->pre;
+		sz = img->width * img->height * sizeof(pixel_t);
+		if (pre->restore)
+			gdispImageFree(img, pre->restore, pre->restoresz);
+		if (pre->back)
+			gdispImageFree(img, pre->back, sz);
+		if (pre->front)
+			gdispImageFree(img, pre->front, sz);
+		gdispImageFree(img, pre, sizeof(imgpredecode));
+		img->priv->pre = 0;
+	}
+
+	static bool_t startPredecode(gdispImage *img) {
+		gdispImagePrivate *	priv;
+		imgpredecode *		pre;
+		size_t				sz;
+
+		priv = img->priv;
+		if (img->width <= 0 || img->height <= 0 || !(pre = (imgpredecode *)gdispImageAlloc(img, sizeof(imgpredecode))))
+			return FALSE;
+		priv->pre = pre;
+		sz = img->width * img->height * sizeof(pixel_t);
+		pre->restore = 0;
+		pre->restoresz = 0;
+		pre->back = 0;
+		if (!(pre->front = (pixel_t *)gdispImageAlloc(img, sz)) || !(pre->back = (pixel_t *)gdispImageAlloc(img, sz))) {
+			freePredecode(img);
+			return FALSE;
+		}
+		pre->flags = 0;
+		pre->first = TRUE;
+		pre->quit = FALSE;
+		pre->delay = priv->frame.delay;
+		pre->saved.width = 0;
+		gfxSemInit(&pre->start, 0, 1);
+		gfxSemInit(&pre->header, 0, 1);
+		gfxSemInit(&pre->done, 0, 1);
+		if (!(pre->thread = gfxThreadCreate(0, GDISP_IMAGE_GIF_PREDECODE_STACK_SIZE, LOW_PRIORITY, GIFPredecodeThread, img))) {
+			gfxSemDestroy(&pre->done);
+			gfxSemDestroy(&pre->header);
+			gfxSemDestroy(&pre->start);
+			freePredecode(img);
+			return FALSE;
+		}
+		kickPredecode(pre);
+		return TRUE;
+	}
+
+	static void stopPredecode(gdispImage *img) {
+		imgpredecode *		pre;
+
+		pre = img->priv->pre;
+		waitPredecode(pre);
+		pre->quit = TRUE;
+		gfxSemSignal(&pre->start);
+		gfxThreadWait(pre->thread);
+		gfxSemDestroy(&pre->done);
+		gfxSemDestroy(&pre->header);
+		gfxSemDestroy(&pre->start);
+		freePredecode(img);
+	}
+
+	static void drawPredecode(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy) {
+		imgpredecode *		pre;
+		pixel_t *			tmp;
+		coord_t				d;
+
+		pre = img->priv->pre;
+
+		// Show the next frame if it has been asked for
+		if ((pre->flags & GIFP_PENDING)) {
+			waitPredecode(pre);
+			pre->flags &= ~GIFP_PENDING;
+			tmp = pre->front;
+			pre->front = pre->back;
+			pre->back = tmp;
+			pre->dirty = pre->nextdirty;
+			pre->delay = pre->nextdelay;
+			pre->flags |= GIFP_NEWFRAME;
+			kickPredecode(pre);
+		}
+
+		// The first draw of a new frame only needs the area that has changed. Later draws are a full redraw.
+		if ((pre->flags & GIFP_NEWFRAME)) {
+			pre->flags &= ~GIFP_NEWFRAME;
+			if (pre->dirty.x > sx) { d = pre->dirty.x - sx; x += d; cx -= d; sx = pre->dirty.x; }
+			if (pre->dirty.y > sy) { d = pre->dirty.y - sy; y += d; cy -= d; sy = pre->dirty.y; }
+			if (sx + cx > pre->dirty.x + pre->dirty.width) cx = pre->dirty.x + pre->dirty.width - sx;
+			if (sy + cy > pre->dirty.y + pre->dirty.height) cy = pre->dirty.y + pre->dirty.height - sy;
+		}
+		if (sx + cx > img->width) cx = img->width - sx;
+		if (sy + cy > img->height) cy = img->height - sy;
+		if (cx > 0 && cy > 0)
+			gdispBlitAreaEx(x, y, cx, cy, sx, sy, img->width, pre->front);
+	}
+
+	static delaytime_t nextPredecode(gdispImage *img) {
+		imgpredecode *		pre;
+
+		pre = img->priv->pre;
+
+		// Have we already moved on?
+		if ((pre->flags & GIFP_PENDING))
+			return (delaytime_t)pre->delay * 10;
+		if (!(pre->flags & GIFP_BUSY))
+			return TIME_INFINITE;
+
+		// We only need to wait for the worker to read the next frame header
+		if (!(pre->flags & GIFP_HEADER)) {
+			gfxSemWait(&pre->header, TIME_INFINITE);
+			pre->flags |= GIFP_HEADER;
+		}
+		if (pre->result != GDISP_IMAGE_ERR_OK && pre->result != GDISP_IMAGE_LOOP) {
+			waitPredecode(pre);
+			return TIME_INFINITE;
+		}
+		pre->flags |= GIFP_PENDING;
+		return (delaytime_t)pre->delay * 10;
+	}
+#endif
+
 gdispImageError gdispImageOpen_GIF(gdispImage *img) {
 	gdispImagePrivate *priv;
 	uint8_t		hdr[6];
@@ -576,6 +1140,11 @@ gdispImageError gdispImageOpen_GIF(gdispImage *img) {
 	priv->frame.flags = 0;
 	priv->cache = 0;
 	priv->curcache = 0;
+	priv->decode = 0;
+	priv->checks = 0;
+	#if GDISP_NEED_IMAGE_GIF_PREDECODE
+		priv->pre = 0;
+	#endif
 
 	/* Process the Screen Descriptor structure */
 
@@ -635,6 +1204,11 @@ void gdispImageClose_GIF(gdispImage *img) {
 
 	priv = img->priv;
 	if (priv) {
+		#if GDISP_NEED_IMAGE_GIF_PREDECODE
+			if (priv->pre)
+				stopPredecode(img);
+		#endif
+
 		// Free any stored frames
 		cache = priv->cache;
 		while(cache) {
@@ -644,6 +1218,8 @@ void gdispImageClose_GIF(gdispImage *img) {
 		}
 		if (priv->palette)
 			gdispImageFree(img, (void *)priv->palette, priv->palsize*sizeof(color_t));
+		if (priv->checks)
+			gdispImageFree(img, (void *)priv->checks, sizeof(imgcheckpoints));
 		gdispImageFree(img, (void *)img->priv, sizeof(gdispImagePrivate));
 		img->priv = 0;
 	}
@@ -655,15 +1231,20 @@ gdispImageError gdispImageCache_GIF(gdispImage *img) {
 	imgcache *			cache;
 	imgdecode *			decode;
 	uint8_t *			p;
-	uint8_t *			q;
-	coord_t				mx, my;
-	uint16_t			cnt;
+	coord_t				my, cnt;
+	uint8_t				pass;
 
 	/* If we are already cached - just return OK */
 	priv = img->priv;
 	if (priv->curcache)
 		return GDISP_IMAGE_ERR_OK;
 
+	/* Background decoding is already drawing from a full image buffer */
+	#if GDISP_NEED_IMAGE_GIF_PREDECODE
+		if (priv->pre)
+			return GDISP_IMAGE_ERR_OK;
+	#endif
+
 	/* We need to allocate the frame, the palette and bits for the image */
 	if (!(cache = (imgcache *)gdispImageAlloc(img, sizeof(imgcache) + priv->frame.palsize*sizeof(color_t) + priv->frame.width*priv->frame.height)))
 		return GDISP_IMAGE_ERR_NOMEMORY;
@@ -693,99 +1274,21 @@ gdispImageError gdispImageCache_GIF(gdispImage *img) {
 	} else
 		cache->palette = priv->palette;
 
-	// Check for interlacing
-	cnt = 0;
-	if (cache->frame.flags & GIFL_INTERLACE) {
-		// Every 8th row starting at row 0
-		for(p=cache->imagebits, my=0; my < cache->frame.height; my+=8, p += cache->frame.width*7) {
-			for(mx=0; mx < cache->frame.width; mx++) {
-				if (!cnt) {
-					if (!(cnt = getbytes(img))) {
-						// Sometimes the image EOF is a bit early - treat the rest as transparent
-						if (decode->code_last != decode->code_eof)
-							goto baddatacleanup;
-						while(cnt < sizeof(decode->buf))
-							decode->buf[cnt++] = (cache->frame.flags & GIFL_TRANSPARENT) ? cache->frame.paltrans : 0;
-					}
-					q = decode->buf;
-				}
-				*p++ = *q++;
-				cnt--;
-			}
-		}
-		// Every 8th row starting at row 4
-		for(p=cache->imagebits+cache->frame.width*4, my=4; my < cache->frame.height; my+=8, p += cache->frame.width*7) {
-			for(mx=0; mx < cache->frame.width; mx++) {
-				if (!cnt) {
-					if (!(cnt = getbytes(img))) {
-						// Sometimes the image EOF is a bit early - treat the rest as transparent
-						if (decode->code_last != decode->code_eof)
-							goto baddatacleanup;
-						while(cnt < sizeof(decode->buf))
-							decode->buf[cnt++] = (cache->frame.flags & GIFL_TRANSPARENT) ? cache->frame.paltrans : 0;
-					}
-					q = decode->buf;
-				}
-				*p++ = *q++;
-				cnt--;
-			}
-		}
-		// Every 4th row starting at row 2
-		for(p=cache->imagebits+cache->frame.width*2, my=2; my < cache->frame.height; my+=4, p += cache->frame.width*3) {
-			for(mx=0; mx < cache->frame.width; mx++) {
-				if (!cnt) {
-					if (!(cnt = getbytes(img))) {
-						// Sometimes the image EOF is a bit early - treat the rest as transparent
-						if (decode->code_last != decode->code_eof)
-							goto baddatacleanup;
-						while(cnt < sizeof(decode->buf))
-							decode->buf[cnt++] = (cache->frame.flags & GIFL_TRANSPARENT) ? cache->frame.paltrans : 0;
-					}
-					q = decode->buf;
-				}
-				*p++ = *q++;
-				cnt--;
-			}
-		}
-		// Every 2nd row starting at row 1
-		for(p=cache->imagebits+cache->frame.width, my=1; my < cache->frame.height; my+=2, p += cache->frame.width) {
-			for(mx=0; mx < cache->frame.width; mx++) {
-				if (!cnt) {
-					if (!(cnt = getbytes(img))) {
-						// Sometimes the image EOF is a bit early - treat the rest as transparent
-						if (decode->code_last != decode->code_eof)
-							goto baddatacleanup;
-						while(cnt < sizeof(decode->buf))
-							decode->buf[cnt++] = (cache->frame.flags & GIFL_TRANSPARENT) ? cache->frame.paltrans : 0;
-					}
-					q = decode->buf;
-				}
-				*p++ = *q++;
-				cnt--;
-			}
-		}
-	} else {
-		// Every row in sequence
-		p=cache->imagebits;
-		for(my=0; my < cache->frame.height; my++) {
-			for(mx=0; mx < cache->frame.width; mx++) {
-				if (!cnt) {
-					if (!(cnt = getbytes(img))) {
-						// Sometimes the image EOF is a bit early - treat the rest as transparent
-						if (decode->code_last != decode->code_eof)
-							goto baddatacleanup;
-						while(cnt < sizeof(decode->buf))
-							decode->buf[cnt++] = (cache->frame.flags & GIFL_TRANSPARENT) ? cache->frame.paltrans : 0;
-					}
-					q = decode->buf;
-				}
-				*p++ = *q++;
-				cnt--;
-			}
+	// Decode each row straight into the cache in the order they appear in the file
+	for(pass = (cache->frame.flags & GIFL_INTERLACE) ? 0 : 4; pass < 5; pass++) {
+		for(my = PassStart[pass]; my < cache->frame.height; my += PassStep[pass]) {
+			p = cache->imagebits + my*cache->frame.width;
+			if ((cnt = getLine(img, p, cache->frame.width)) < 0)
+				goto baddatacleanup;
+
+			// Sometimes the image EOF is a bit early - treat the rest as transparent
+			for(; cnt < cache->frame.width; cnt++)
+				p[cnt] = (cache->frame.flags & GIFL_TRANSPARENT) ? cache->frame.paltrans : 0;
 		}
 	}
 	// We could be pedantic here but extra bytes won't hurt us
-	while(getbytes(img));
+	if (decode->code_last != decode->code_eof)
+		skipBlocks(img);
 	priv->frame.posend = cache->frame.posend = img->io.pos;
 
 	// Save everything
@@ -820,16 +1323,119 @@ baddatacleanup:
 	return GDISP_IMAGE_ERR_BADDATA;
 }
 
+/**
+ * Convert the non-transparent pixels of a frame row into an image row.
+ */
+static void decodeRow(gdispImage *img, pixel_t *p, uint8_t *pa, const uint8_t *q, coord_t cnt, const color_t *palette) {
+	gdispImagePrivate *	priv;
+	coord_t				mx;
+
+	priv = img->priv;
+	for(mx = 0; mx < cnt; mx++) {
+		if ((priv->frame.flags & GIFL_TRANSPARENT) && q[mx] == priv->frame.paltrans)
+			continue;
+		p[mx] = palette[q[mx]];
+		if (pa)
+			pa[mx] = 255;
+	}
+}
+
+gdispImageError gdispImageDecode_GIF(gdispImage *img, pixel_t *buf) {
+	gdispImagePrivate *	priv;
+	imgdecode *			decode;
+	uint8_t *			pa;
+	size_t				i, n;
+	coord_t				my, cx, cy, cnt;
+	uint8_t				pass;
+
+	priv = img->priv;
+
+	/* Background decoding owns the io */
+	#if GDISP_NEED_IMAGE_GIF_PREDECODE
+		if (priv->pre)
+			return GDISP_IMAGE_ERR_UNSUPPORTED;
+	#endif
+
+	/* Anything the frame doesn't draw is transparent */
+	n = (size_t)img->width * img->height;
+	pa = gdispImageHasAlpha(img) ? (uint8_t *)(buf + n) : 0;
+	for(i = 0; i < n; i++)
+		buf[i] = img->bgcolor;
+	if (pa) {
+		for(i = 0; i < n; i++)
+			pa[i] = 0;
+	}
+
+	/* Clip the frame to the image */
+	if (priv->frame.x >= img->width || priv->frame.y >= img->height)
+		return GDISP_IMAGE_ERR_OK;
+	cx = priv->frame.width;
+	cy = priv->frame.height;
+	if (priv->frame.x + cx > img->width) cx = img->width - priv->frame.x;
+	if (priv->frame.y + cy > img->height) cy = img->height - priv->frame.y;
+	buf += priv->frame.y * img->width + priv->frame.x;
+	if (pa)
+		pa += priv->frame.y * img->width + priv->frame.x;
+
+	/* From the frame cache if we have it */
+	if (priv->curcache) {
+		for(my = 0; my < cy; my++)
+			decodeRow(img, buf + my*img->width, pa ? pa + my*img->width : 0, priv->curcache->imagebits + my*priv->frame.width, cx, priv->curcache->palette);
+		return GDISP_IMAGE_ERR_OK;
+	}
+
+	switch(startDecode(img)) {
+	case GDISP_IMAGE_ERR_OK:			break;
+	case GDISP_IMAGE_ERR_NOMEMORY:		return GDISP_IMAGE_ERR_NOMEMORY;
+	case GDISP_IMAGE_ERR_BADDATA:
+	default:							return GDISP_IMAGE_ERR_BADDATA;
+	}
+	decode = priv->decode;
+
+	for(pass = (priv->frame.flags & GIFL_INTERLACE) ? 0 : 4; pass < 5; pass++) {
+		for(my = PassStart[pass]; my < priv->frame.height; my += PassStep[pass]) {
+			// A non-interlaced image can stop once we are past the image
+			if (pass == 4 && my >= cy)
+				goto done;
+			if ((cnt = getLine(img, decode->line, priv->frame.width)) < 0) {
+				stopDecode(img);
+				return GDISP_IMAGE_ERR_BADDATA;
+			}
+			if (my < cy)
+				decodeRow(img, buf + my*img->width, pa ? pa + my*img->width : 0, decode->line, cnt < cx ? cnt : cx, decode->palette);
+
+			// Sometimes the image EOF is a bit early - treat the rest as transparent
+			if (cnt < priv->frame.width)
+				goto done;
+		}
+	}
+	// We could be pedantic here but extra bytes won't hurt us
+	if (decode->code_last != decode->code_eof)
+		skipBlocks(img);
+	priv->frame.posend = img->io.pos;
+
+done:
+	stopDecode(img);
+	return GDISP_IMAGE_ERR_OK;
+}
+
 gdispImageError gdispImageDraw_GIF(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy) {
 	gdispImagePrivate *	priv;
 	imgdecode *			decode;
-	uint8_t *			q;
-	coord_t				mx, my, fx, fy;
-	uint16_t			cnt, gcnt;
-	uint8_t				col;
+	coord_t				mx, my, fx, fy, cnt;
+	uint32_t			start;
+	uint8_t				pass;
 
 	priv = img->priv;
 
+	/* Draw from the background decoding buffer */
+	#if GDISP_NEED_IMAGE_GIF_PREDECODE
+		if (priv->pre) {
+			drawPredecode(img, x, y, cx, cy, sx, sy);
+			return GDISP_IMAGE_ERR_OK;
+		}
+	#endif
+
 	/* Handle previous frame disposing */
 	if (priv->dispose.flags & (GIFL_DISPOSECLEAR|GIFL_DISPOSEREST)) {
 		// Clip to the disposal area - clip area = mx,my -> fx, fy (sx,sy,cx,cy are unchanged)
@@ -870,37 +1476,18 @@ gdispImageError gdispImageDraw_GIF(gdispImage *img, coord_t x, coord_t y, coord_
 	/* Draw from the image cache - if it exists */
 	if (priv->curcache) {
 		imgcache *	cache;
+		pixel_t *	pixels;
 
+		// Blit whole rows if we can get the ram, otherwise use our small buffer
 		cache = priv->curcache;
-		q = cache->imagebits+priv->frame.width*sy+sx;
-
-		for(my=sy; my < fy; my++, q += priv->frame.width - cx) {
-			for(gcnt=0, mx=sx, cnt=0; mx < fx; mx++) {
-				col = *q++;
-				if ((priv->frame.flags & GIFL_TRANSPARENT) && col == priv->frame.paltrans) {
-					// We have a transparent pixel - dump the buffer to the display
-					switch(gcnt) {
-					case 0:																							break;
-					case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]); gcnt = 0;						break;
-					default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf); gcnt = 0;	break;
-					}
-					continue;
-				}
-				priv->buf[gcnt++] = cache->palette[col];
-				if (gcnt >= BLIT_BUFFER_SIZE) {
-					// We have run out of buffer - dump it to the display
-					gdispBlitAreaEx(x+mx-sx-gcnt+1, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);
-					gcnt = 0;
-				}
-			}
-			// We have finished the line - dump the buffer to the display
-			switch(gcnt) {
-			case 0:																				break;
-			case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]);					break;
-			default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);	break;
-			}
+		if (!(pixels = (pixel_t *)gdispImageAlloc(img, cx*sizeof(pixel_t)))) {
+			for(my = sy; my < fy; my++)
+				blitRow(img, x, y+my-sy, cache->imagebits+priv->frame.width*my+sx, cx, cache->palette, priv->buf, BLIT_BUFFER_SIZE);
+			return GDISP_IMAGE_ERR_OK;
 		}
-
+		for(my = sy; my < fy; my++)
+			blitRow(img, x, y+my-sy, cache->imagebits+priv->frame.width*my+sx, cx, cache->palette, pixels, cx);
+		gdispImageFree(img, pixels, cx*sizeof(pixel_t));
 		return GDISP_IMAGE_ERR_OK;
 	}
 
@@ -913,245 +1500,61 @@ gdispImageError gdispImageDraw_GIF(gdispImage *img, coord_t x, coord_t y, coord_
 	}
 	decode = priv->decode;
 
-	// Check for interlacing
-	cnt = 0;
-	if (priv->frame.flags & GIFL_INTERLACE) {
-		// Every 8th row starting at row 0
-		for(my=0; my < priv->frame.height; my+=8) {
-			for(gcnt=0, mx=0; mx < priv->frame.width; mx++, q++, cnt--) {
-				if (!cnt) {
-					if (!(cnt = getbytes(img))) {
-						// Sometimes the image EOF is a bit early - treat the rest as transparent
-						if (decode->code_last != decode->code_eof)
-							goto baddatacleanup;
-						mx++;
-						break;
-					}
-					q = decode->buf;
-				}
-				if (my >= sy && my < fy && mx >= sx && mx < fx) {
-					col = *q;
-					if ((priv->frame.flags & GIFL_TRANSPARENT) && col == priv->frame.paltrans) {
-						// We have a transparent pixel - dump the buffer to the display
-						switch(gcnt) {
-						case 0:																							break;
-						case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]); gcnt = 0;						break;
-						default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf); gcnt = 0;	break;
-						}
-						continue;
-					}
-					priv->buf[gcnt++] = decode->palette[col];
-					if (gcnt >= BLIT_BUFFER_SIZE) {
-						// We have run out of buffer - dump it to the display
-						gdispBlitAreaEx(x+mx-sx-gcnt+1, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);
-						gcnt = 0;
-					}
-					continue;
-				}
-				// We have finished the visible area - dump the buffer to the display
-				switch(gcnt) {
-				case 0:																							break;
-				case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]); gcnt = 0;						break;
-				default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf); gcnt = 0;	break;
-				}
-			}
-			// We have finished the line - dump the buffer to the display
-			switch(gcnt) {
-			case 0:																				break;
-			case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]);					break;
-			default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);	break;
+	/**
+	 * A non-interlaced image can skip to the last restart point before the area.
+	 * The restart points are saved as we go.
+	 */
+	start = 0;
+	if (!(priv->frame.flags & GIFL_INTERLACE)) {
+		if (!priv->checks && (priv->checks = (imgcheckpoints *)gdispImageAlloc(img, sizeof(imgcheckpoints))))
+			priv->checks->count = 0;
+		if (priv->checks) {
+			imgcheckpoint *		pc;
+
+			if (priv->checks->posstart != priv->frame.posstart) {
+				priv->checks->posstart = priv->frame.posstart;
+				priv->checks->count = 0;
 			}
-		}
-		// Every 8th row starting at row 4
-		for(my=4; my < priv->frame.height; my+=8) {
-			for(gcnt=0, mx=0; mx < priv->frame.width; mx++, q++, cnt--) {
-				if (!cnt) {
-					if (!(cnt = getbytes(img))) {
-						// Sometimes the image EOF is a bit early - treat the rest as transparent
-						if (decode->code_last != decode->code_eof)
-							goto baddatacleanup;
-						mx++;
-						break;
-					}
-					q = decode->buf;
-				}
-				if (my >= sy && my < fy && mx >= sx && mx < fx) {
-					col = *q;
-					if ((priv->frame.flags & GIFL_TRANSPARENT) && col == priv->frame.paltrans) {
-						// We have a transparent pixel - dump the buffer to the display
-						switch(gcnt) {
-						case 0:																							break;
-						case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]); gcnt = 0;						break;
-						default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf); gcnt = 0;	break;
-						}
-						continue;
-					}
-					priv->buf[gcnt++] = decode->palette[col];
-					if (gcnt >= BLIT_BUFFER_SIZE) {
-						// We have run out of buffer - dump it to the display
-						gdispBlitAreaEx(x+mx-sx-gcnt+1, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);
-						gcnt = 0;
-					}
-					continue;
+			for(pc = priv->checks->check+priv->checks->count-1; pc >= priv->checks->check; pc--) {
+				if (pc->pixel <= (uint32_t)sy*priv->frame.width) {
+					if (restoreCheckpoint(img, pc))
+						goto baddatacleanup;
+					start = pc->pixel;
+					break;
 				}
-				// We have finished the visible area - dump the buffer to the display
-				switch(gcnt) {
-				case 0:																							break;
-				case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]); gcnt = 0;						break;
-				default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf); gcnt = 0;	break;
-				}
-			}
-			// We have finished the line - dump the buffer to the display
-			switch(gcnt) {
-			case 0:																				break;
-			case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]);					break;
-			default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);	break;
 			}
+			decode->checks = priv->checks;
 		}
-		// Every 4th row starting at row 2
-		for(my=2; my < priv->frame.height; my+=4) {
-			for(gcnt=0, mx=0; mx < priv->frame.width; mx++, q++, cnt--) {
-				if (!cnt) {
-					if (!(cnt = getbytes(img))) {
-						// Sometimes the image EOF is a bit early - treat the rest as transparent
-						if (decode->code_last != decode->code_eof)
-							goto baddatacleanup;
-						mx++;
-						break;
-					}
-					q = decode->buf;
-				}
-				if (my >= sy && my < fy && mx >= sx && mx < fx) {
-					col = *q;
-					if ((priv->frame.flags & GIFL_TRANSPARENT) && col == priv->frame.paltrans) {
-						// We have a transparent pixel - dump the buffer to the display
-						switch(gcnt) {
-						case 0:																							break;
-						case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]); gcnt = 0;						break;
-						default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf); gcnt = 0;	break;
-						}
-						continue;
-					}
-					priv->buf[gcnt++] = decode->palette[col];
-					if (gcnt >= BLIT_BUFFER_SIZE) {
-						// We have run out of buffer - dump it to the display
-						gdispBlitAreaEx(x+mx-sx-gcnt+1, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);
-						gcnt = 0;
-					}
-					continue;
-				}
-				// We have finished the visible area - dump the buffer to the display
-				switch(gcnt) {
-				case 0:																							break;
-				case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]); gcnt = 0;						break;
-				default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf); gcnt = 0;	break;
-				}
-			}
-			// We have finished the line - dump the buffer to the display
-			switch(gcnt) {
-			case 0:																				break;
-			case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]);					break;
-			default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);	break;
-			}
-		}
-		// Every 2nd row starting at row 1
-		for(my=1; my < priv->frame.height; my+=2) {
-			for(gcnt=0, mx=0; mx < priv->frame.width; mx++, q++, cnt--) {
-				if (!cnt) {
-					if (!(cnt = getbytes(img))) {
-						// Sometimes the image EOF is a bit early - treat the rest as transparent
-						if (decode->code_last != decode->code_eof)
-							goto baddatacleanup;
-						mx++;
-						break;
-					}
-					q = decode->buf;
-				}
-				if (my >= sy && my < fy && mx >= sx && mx < fx) {
-					col = *q;
-					if ((priv->frame.flags & GIFL_TRANSPARENT) && col == priv->frame.paltrans) {
-						// We have a transparent pixel - dump the buffer to the display
-						switch(gcnt) {
-						case 0:																							break;
-						case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]); gcnt = 0;						break;
-						default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf); gcnt = 0;	break;
-						}
-						continue;
-					}
-					priv->buf[gcnt++] = decode->palette[col];
-					if (gcnt >= BLIT_BUFFER_SIZE) {
-						// We have run out of buffer - dump it to the display
-						gdispBlitAreaEx(x+mx-sx-gcnt+1, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);
-						gcnt = 0;
-					}
-					continue;
-				}
-				// We have finished the visible area - dump the buffer to the display
-				switch(gcnt) {
-				case 0:																							break;
-				case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]); gcnt = 0;						break;
-				default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf); gcnt = 0;	break;
-				}
-			}
-			// We have finished the line - dump the buffer to the display
-			switch(gcnt) {
-			case 0:																				break;
-			case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]);					break;
-			default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);	break;
-			}
-		}
-	} else {
-		// Every row in sequence
-		for(my=0; my < priv->frame.height; my++) {
-			for(gcnt=0, mx=0; mx < priv->frame.width; mx++, q++, cnt--) {
-				if (!cnt) {
-					if (!(cnt = getbytes(img))) {
-						// Sometimes the image EOF is a bit early - treat the rest as transparent
-						if (decode->code_last != decode->code_eof)
-							goto baddatacleanup;
-						mx++;
-						break;
-					}
-					q = decode->buf;
-				}
-				if (my >= sy && my < fy && mx >= sx && mx < fx) {
-					col = *q;
-					if ((priv->frame.flags & GIFL_TRANSPARENT) && col == priv->frame.paltrans) {
-						// We have a transparent pixel - dump the buffer to the display
-						switch(gcnt) {
-						case 0:																							break;
-						case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]); gcnt = 0;						break;
-						default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf); gcnt = 0;	break;
-						}
-						continue;
-					}
-					priv->buf[gcnt++] = decode->palette[col];
-					if (gcnt >= BLIT_BUFFER_SIZE) {
-						// We have run out of buffer - dump it to the display
-						gdispBlitAreaEx(x+mx-sx-gcnt+1, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);
-						gcnt = 0;
-					}
-					continue;
-				}
-				// We have finished the visible area - dump the buffer to the display
-				switch(gcnt) {
-				case 0:																							break;
-				case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]); gcnt = 0;						break;
-				default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf); gcnt = 0;	break;
-				}
-			}
-			// We have finished the line - dump the buffer to the display
-			switch(gcnt) {
-			case 0:																				break;
-			case 1:		gdispDrawPixel(x+mx-sx-gcnt, y+my-sy, priv->buf[0]);					break;
-			default:	gdispBlitAreaEx(x+mx-sx-gcnt, y+my-sy, gcnt, 1, 0, 0, gcnt, priv->buf);	break;
-			}
+	}
+
+	// Decode each row and draw the part of it that is visible
+	for(pass = (priv->frame.flags & GIFL_INTERLACE) ? 0 : 4; pass < 5; pass++) {
+		for(my = pass == 4 ? start / priv->frame.width : PassStart[pass]; my < priv->frame.height; my += PassStep[pass]) {
+			// A non-interlaced image can stop once we are past the area
+			if (pass == 4 && my >= fy)
+				goto done;
+
+			// Restarting may be part way through a row but that row is before the area
+			mx = start ? (coord_t)(start - (uint32_t)my*priv->frame.width) : 0;
+			start = 0;
+			decode->linestart = (uint32_t)my*priv->frame.width + mx;
+			if ((cnt = getLine(img, decode->line+mx, priv->frame.width-mx)) < 0)
+				goto baddatacleanup;
+			cnt += mx;
+			if (my >= sy && my < fy && cnt > sx)
+				blitRow(img, x, y+my-sy, decode->line+sx, (cnt < fx ? cnt : fx) - sx, decode->palette, decode->pixels, cx);
+
+			// Sometimes the image EOF is a bit early - treat the rest as transparent
+			if (cnt < priv->frame.width)
+				goto done;
 		}
 	}
 	// We could be pedantic here but extra bytes won't hurt us
-	while (getbytes(img));
+	if (decode->code_last != decode->code_eof)
+		skipBlocks(img);
 	priv->frame.posend = img->io.pos;
 
+done:
 	stopDecode(img);
 	return GDISP_IMAGE_ERR_OK;
 
@@ -1163,46 +1566,32 @@ baddatacleanup:
 delaytime_t gdispImageNext_GIF(gdispImage *img) {
 	gdispImagePrivate *	priv;
 	delaytime_t			delay;
-	uint8_t				blocksz;
 
 	priv = img->priv;
 
+	// Use background decoding if we can
+	#if GDISP_NEED_IMAGE_GIF_PREDECODE
+		if (!priv->pre && !(priv->flags & GIF_NOPREDECODE) && !startPredecode(img))
+			priv->flags |= GIF_NOPREDECODE;
+		if (priv->pre)
+			return nextPredecode(img);
+	#endif
+
 	// Save the delay and convert to millisecs
 	delay = (delaytime_t)priv->frame.delay * 10;
 
-	// We need to get to the end of this frame
-	if (!priv->frame.posend) {
-		// We don't know where the end of the frame is yet - find it!
-		img->io.fns->seek(&img->io, priv->frame.posimg+1);				// Skip the code size byte too
-		while(1) {
-			if (img->io.fns->read(&img->io, &blocksz, 1) != 1)
-				return TIME_INFINITE;
-			if (!blocksz)
-				break;
-			img->io.fns->seek(&img->io, img->io.pos + blocksz);
-		}
-		priv->frame.posend = img->io.pos;
-	}
-
-	// Seek to the end of this frame
-	img->io.fns->seek(&img->io, priv->frame.posend);
-
 	// Read the next frame descriptor
-	for(blocksz=0; blocksz < 2; blocksz++) {		// 2 loops max to prevent cycling forever with a bad file
-		switch(initFrame(img)) {
-		case GDISP_IMAGE_ERR_OK:					// Everything OK
-			return delay;
-		case GDISP_IMAGE_LOOP:						// Back to the beginning
-			break;
-		case GDISP_IMAGE_EOF:						// The real End-Of-File
-		case GDISP_IMAGE_ERR_BADDATA:				// Oops - something wrong with the data
-		case GDISP_IMAGE_ERR_NOMEMORY:				// Out of Memory
-		case GDISP_IMAGE_ERR_UNSUPPORTED:			// Unsupported
-		default:
-			return TIME_INFINITE;
-		}
+	switch(advanceFrame(img)) {
+	case GDISP_IMAGE_ERR_OK:					// Everything OK
+	case GDISP_IMAGE_LOOP:						// Back to the beginning
+		return delay;
+	case GDISP_IMAGE_EOF:						// The real End-Of-File
+	case GDISP_IMAGE_ERR_BADDATA:				// Oops - something wrong with the data
+	case GDISP_IMAGE_ERR_NOMEMORY:				// Out of Memory
+	case GDISP_IMAGE_ERR_UNSUPPORTED:			// Unsupported
+	default:
+		return TIME_INFINITE;
 	}
-	return TIME_INFINITE;
 }
 
 #endif /* GFX_USE_GDISP && GDISP_NEED_IMAGE && GDISP_NEED_IMAGE_GIF */
@@ -8,12 +8,1008 @@
 /**
  * @file    src/gdisp/image_jpg.c
  * @brief   GDISP native image code.
+ *
+ * @defgroup Image Image
+ * @ingroup GDISP
  */
 #include "gfx.h"
 
 #if GFX_USE_GDISP && GDISP_NEED_IMAGE && GDISP_NEED_IMAGE_JPG
 
-#error "JPG support not implemented yet"
+/**
+ * Helper Routines Needed
+ */
+void *gdispImageAlloc(gdispImage *img, size_t sz);
+void gdispImageFree(gdispImage *img, void *ptr, size_t sz);
+
+/**
+ * How many bytes of compressed data to read from the file at a time
+ */
+#define JPG_INPUT_SIZE		64
+
+#define JPG_MAX_COMPONENTS	3
+
+// The position in the block of each coefficient in zigzag order
+static const uint8_t zigzag[64] = {
+		 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+		12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+		35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+		58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+		};
+
+// The AAN scale factors (scaled by 14 bits) that are folded into the quantization tables for the full size IDCT
+static const uint16_t aanScale[64] = {
+		16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+		22725, 31521, 29692, 26722, 22725, 17855, 12299,  6270,
+		21407, 29692, 27969, 25172, 21407, 16819, 11585,  5906,
+		19266, 26722, 25172, 22654, 19266, 15137, 10426,  5315,
+		16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+		12873, 17855, 16819, 15137, 12873, 10114,  6967,  3552,
+		 8867, 12299, 11585, 10426,  8867,  6967,  4799,  2446,
+		 4520,  6270,  5906,  5315,  4520,  3552,  2446,  1247
+		};
+
+// The reduced size IDCT weights (scaled by 13 bits). Entry [j][u] is the full size IDCT basis
+// c(u)/2 * cos((2x+1)u.pi/16) averaged over the samples x that make up output sample j.
+static const int16_t idct4[4][8] = {
+		{ 2896,  3711,  2676,  1303,  0,  -871, -1108,  -738 },
+		{ 2896,  1537, -2676, -3146,  0,  2102,  1108,  -306 },
+		{ 2896, -1537, -2676,  3146,  0, -2102,  1108,   306 },
+		{ 2896, -3711,  2676, -1303,  0,   871, -1108,   738 }
+		};
+static const int16_t idct2[2][8] = {
+		{ 2896,  2624,     0,  -922,  0,   616,     0,  -522 },
+		{ 2896, -2624,     0,   922,  0,  -616,     0,   522 }
+		};
+
+// A huffman table with an 8 bit lookahead
+typedef struct jpghuff {
+	uint8_t		looklen[256];							// The code length for an 8 bit prefix (0 if longer)
+	uint8_t		looksym[256];							// The symbol for an 8 bit prefix
+	int32_t		maxcode[18];							// The largest code of each length (-1 if none)
+	int32_t		valoffset[17];							// The offset from a code to its symbol index
+	uint8_t		vals[256];								// The symbols
+} jpghuff;
+
+// A component of the image
+typedef struct jpgcomponent {
+	uint8_t		id;
+	uint8_t		h, v;									// The sampling factors
+	uint8_t		tq;										// The quantization table
+	uint8_t		td, ta;									// The DC and AC huffman tables
+} jpgcomponent;
+
+// Structure for decoding the image data. It only exists while decoding.
+typedef struct jpgdecode {
+	uint16_t	ipos, ilen;								// Position and length of the data in ibuf
+	uint8_t		ibuf[JPG_INPUT_SIZE];					// Compressed data read from the file
+	uint32_t	bitbuf;									// Bits not yet used (msb first)
+	uint8_t		bitcnt;									// The number of bits in bitbuf
+	uint8_t		marker;									// A marker that has been found in the data
+	uint16_t	restartleft;							// MCUs until the next restart marker
+	int32_t		dcpred[JPG_MAX_COMPONENTS];				// The DC predictors
+	int32_t		qmul[4][64];							// The dequantization multipliers in zigzag order
+	int32_t		coef[64];								// The block coefficients
+	int32_t		ws[64];									// IDCT workspace
+	int32_t		coefmax;								// The limit for a dequantized coefficient (stops IDCT overflow on bad data)
+	uint8_t *	plane[JPG_MAX_COMPONENTS];				// The decoded samples for an MCU row
+	coord_t		stride[JPG_MAX_COMPONENTS];				// The width of each plane
+	size_t		planesize;								// The total size of the planes
+	pixel_t *	pixels;									// The converted pixels for an MCU row
+	size_t		pixelsize;								// The size of pixels
+} jpgdecode;
+
+typedef struct gdispImagePrivate {
+	uint8_t			ncomp;						// The number of components
+	uint8_t			hmax, vmax;					// The maximum sampling factors
+	uint8_t			scale;						// log2 of the scale denominator
+	coord_t			fullwidth, fullheight;		// The unscaled image size
+	uint16_t		restart;					// The restart interval (in MCUs)
+	jpgcomponent	comp[JPG_MAX_COMPONENTS];
+	uint8_t			qtdef;						// Which quantization tables are defined
+	uint16_t		qt[4][64];					// The quantization tables in zigzag order
+	jpghuff *		huff[8];					// The DC (0-3) and AC (4-7) huffman tables
+	size_t			frame0pos;					// The position of the scan data
+	pixel_t *		frame0cache;				// The decoded image (if cached)
+	} gdispImagePrivate;
+
+static uint16_t getBE16(const uint8_t *p) {
+	return ((uint16_t)p[0] << 8) | p[1];
+}
+
+/*-----------------------------------------------------------------
+ * Entropy coded input
+ *---------------------------------------------------------------*/
+
+static int getByte(gdispImage *img, jpgdecode *decode) {
+	size_t		len;
+
+	if (decode->ipos >= decode->ilen) {
+		if (!(len = img->io.fns->read(&img->io, decode->ibuf, JPG_INPUT_SIZE)))
+			return -1;
+		decode->ilen = len;
+		decode->ipos = 0;
+	}
+	return decode->ibuf[decode->ipos++];
+}
+
+// Make sure there are at least 25 bits in the bit buffer. Once a marker is found only zeros are added.
+static void fillBits(gdispImage *img, jpgdecode *decode) {
+	int		b;
+
+	while(decode->bitcnt <= 24) {
+		b = 0;
+		if (!decode->marker) {
+			if ((b = getByte(img, decode)) < 0) {
+				decode->marker = 0xD9;				// Treat the end of the file as an EOI
+				b = 0;
+			} else if (b == 0xFF) {
+				do {
+					b = getByte(img, decode);
+				} while (b == 0xFF);				// Fill bytes
+				if (b) {
+					decode->marker = b < 0 ? 0xD9 : b;
+					b = 0;
+				} else
+					b = 0xFF;						// A stuffed 0xFF
+			}
+		}
+		decode->bitbuf |= (uint32_t)b << (24 - decode->bitcnt);
+		decode->bitcnt += 8;
+	}
+}
+
+static int getBits(gdispImage *img, jpgdecode *decode, uint8_t cnt) {
+	int		val;
+
+	if (!cnt)
+		return 0;
+	if (decode->bitcnt < cnt)
+		fillBits(img, decode);
+	val = decode->bitbuf >> (32 - cnt);
+	decode->bitbuf <<= cnt;
+	decode->bitcnt -= cnt;
+	return val;
+}
+
+// Get cnt bits as a signed value
+static int32_t getSigned(gdispImage *img, jpgdecode *decode, uint8_t cnt) {
+	int32_t	val;
+
+	val = getBits(img, decode, cnt);
+	if (cnt && val < (1L << (cnt-1)))
+		val -= (1L << cnt) - 1;
+	return val;
+}
+
+// Decode a huffman symbol. Returns -1 on error.
+static int getSymbol(gdispImage *img, jpgdecode *decode, const jpghuff *h) {
+	uint32_t	code;
+	uint8_t		len;
+
+	if (decode->bitcnt < 16)
+		fillBits(img, decode);
+
+	// Most codes are no more than 8 bits
+	if ((len = h->looklen[decode->bitbuf >> 24])) {
+		code = h->looksym[decode->bitbuf >> 24];
+		decode->bitbuf <<= len;
+		decode->bitcnt -= len;
+		return code;
+	}
+
+	// The slow way
+	for(len = 9; len <= 16; len++) {
+		code = decode->bitbuf >> (32 - len);
+		if ((int32_t)code <= h->maxcode[len]) {
+			decode->bitbuf <<= len;
+			decode->bitcnt -= len;
+			return h->vals[(code + h->valoffset[len]) & 0xFF];
+		}
+	}
+	return -1;
+}
+
+/*-----------------------------------------------------------------
+ * Blocks
+ *---------------------------------------------------------------*/
+
+static int32_t clampCoef(jpgdecode *decode, int32_t v) {
+	return v > decode->coefmax ? decode->coefmax : (v < -decode->coefmax ? -decode->coefmax : v);
+}
+
+// Decode the coefficients of a block. Returns the number of coefficients decoded (ie the last non-zero + 1) or -1 on error.
+static int getBlock(gdispImage *img, jpgdecode *decode, uint8_t c, bool_t store) {
+	gdispImagePrivate *	priv;
+	const jpghuff *		hac;
+	const int32_t *		qmul;
+	int					s, k, last;
+
+	priv = img->priv;
+	hac = priv->huff[4+priv->comp[c].ta];
+	qmul = decode->qmul[priv->comp[c].tq];
+
+	// DC
+	if ((s = getSymbol(img, decode, priv->huff[priv->comp[c].td])) < 0 || s > 11)
+		return -1;
+	decode->dcpred[c] += getSigned(img, decode, s);
+	if (decode->dcpred[c] > 2047 || decode->dcpred[c] < -2048)
+		return -1;
+	if (store) {
+		for(k = 1; k < 64; k++)
+			decode->coef[k] = 0;
+		decode->coef[0] = clampCoef(decode, decode->dcpred[c] * qmul[0]);
+	}
+
+	// AC
+	for(last = 1, k = 1; k < 64; k++) {
+		if ((s = getSymbol(img, decode, hac)) < 0)
+			return -1;
+		if (!(s & 0x0F)) {
+			if (s != 0xF0)
+				break;							// End of block
+			k += 15;							// 16 zeros
+			continue;
+		}
+		k += s >> 4;
+		if (k > 63)
+			return -1;
+		if (store) {
+			decode->coef[zigzag[k]] = clampCoef(decode, getSigned(img, decode, s & 0x0F) * qmul[k]);
+			last = k+1;
+		} else
+			getBits(img, decode, s & 0x0F);
+	}
+	return last;
+}
+
+static uint8_t clampSample(int32_t v) {
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+#define FIX_1_082392200		277			/* These are scaled by 8 bits */
+#define FIX_1_414213562		362
+#define FIX_1_847759065		473
+#define FIX_2_613125930		669
+#define MULTIPLY(v, c)		(((v) * (c)) >> 8)
+#define IDCT_BITS			4			/* Extra fraction bits kept through the IDCT. More would overflow 32 bits. */
+
+/**
+ * The AAN integer IDCT (as in the IJG fast IDCT). The dequantization multipliers include the
+ * AAN scale factors and IDCT_BITS extra bits of precision.
+ */
+static void idct8(const int32_t *in, int32_t *ws, uint8_t *out, coord_t stride) {
+	int32_t		tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+	int32_t		tmp10, tmp11, tmp12, tmp13;
+	int32_t		z5, z10, z11, z12, z13;
+	int			i;
+
+	// Columns
+	for(i = 0; i < 8; i++, in++, ws++) {
+		if (!(in[8] | in[16] | in[24] | in[32] | in[40] | in[48] | in[56])) {
+			ws[0] = ws[8] = ws[16] = ws[24] = ws[32] = ws[40] = ws[48] = ws[56] = in[0];
+			continue;
+		}
+
+		// Even part
+		tmp10 = in[0] + in[32];
+		tmp11 = in[0] - in[32];
+		tmp13 = in[16] + in[48];
+		tmp12 = MULTIPLY(in[16] - in[48], FIX_1_414213562) - tmp13;
+		tmp0 = tmp10 + tmp13;
+		tmp3 = tmp10 - tmp13;
+		tmp1 = tmp11 + tmp12;
+		tmp2 = tmp11 - tmp12;
+
+		// Odd part
+		z13 = in[40] + in[24];
+		z10 = in[40] - in[24];
+		z11 = in[8] + in[56];
+		z12 = in[8] - in[56];
+		tmp7 = z11 + z13;
+		tmp11 = MULTIPLY(z11 - z13, FIX_1_414213562);
+		z5 = MULTIPLY(z10 + z12, FIX_1_847759065);
+		tmp10 = MULTIPLY(z12, FIX_1_082392200) - z5;
+		tmp12 = MULTIPLY(z10, -FIX_2_613125930) + z5;
+		tmp6 = tmp12 - tmp7;
+		tmp5 = tmp11 - tmp6;
+		tmp4 = tmp10 + tmp5;
+
+		ws[0] = tmp0 + tmp7;
+		ws[56] = tmp0 - tmp7;
+		ws[8] = tmp1 + tmp6;
+		ws[48] = tmp1 - tmp6;
+		ws[16] = tmp2 + tmp5;
+		ws[40] = tmp2 - tmp5;
+		ws[32] = tmp3 + tmp4;
+		ws[24] = tmp3 - tmp4;
+	}
+	ws -= 8;
+
+	// Rows - remove the extra precision and the 8x scaling and add the level shift
+	#define DESCALE(v)		clampSample((((v) + (1 << (IDCT_BITS+2))) >> (IDCT_BITS+3)) + 128)
+	for(i = 0; i < 8; i++, ws += 8, out += stride) {
+		tmp10 = ws[0] + ws[4];
+		tmp11 = ws[0] - ws[4];
+		tmp13 = ws[2] + ws[6];
+		tmp12 = MULTIPLY(ws[2] - ws[6], FIX_1_414213562) - tmp13;
+		tmp0 = tmp10 + tmp13;
+		tmp3 = tmp10 - tmp13;
+		tmp1 = tmp11 + tmp12;
+		tmp2 = tmp11 - tmp12;
+
+		z13 = ws[5] + ws[3];
+		z10 = ws[5] - ws[3];
+		z11 = ws[1] + ws[7];
+		z12 = ws[1] - ws[7];
+		tmp7 = z11 + z13;
+		tmp11 = MULTIPLY(z11 - z13, FIX_1_414213562);
+		z5 = MULTIPLY(z10 + z12, FIX_1_847759065);
+		tmp10 = MULTIPLY(z12, FIX_1_082392200) - z5;
+		tmp12 = MULTIPLY(z10, -FIX_2_613125930) + z5;
+		tmp6 = tmp12 - tmp7;
+		tmp5 = tmp11 - tmp6;
+		tmp4 = tmp10 + tmp5;
+
+		out[0] = DESCALE(tmp0 + tmp7);
+		out[7] = DESCALE(tmp0 - tmp7);
+		out[1] = DESCALE(tmp1 + tmp6);
+		out[6] = DESCALE(tmp1 - tmp6);
+		out[2] = DESCALE(tmp2 + tmp5);
+		out[5] = DESCALE(tmp2 - tmp5);
+		out[4] = DESCALE(tmp3 + tmp4);
+		out[3] = DESCALE(tmp3 - tmp4);
+	}
+	#undef DESCALE
+}
+
+/**
+ * A reduced size IDCT producing n x n samples from all 64 coefficients.
+ * The samples are what the full size IDCT would give averaged over each (8/n x 8/n) area.
+ */
+static void idctReduced(const int32_t *in, int32_t *ws, uint8_t *out, coord_t stride, const int16_t *tbl, int n) {
+	int		x, y, u;
+	int32_t	sum;
+
+	// Columns (the result is scaled by 1 bit)
+	for(u = 0; u < 8; u++) {
+		if (!(in[u] | in[8+u] | in[16+u] | in[24+u] | in[32+u] | in[40+u] | in[48+u] | in[56+u])) {
+			for(y = 0; y < n; y++)
+				ws[y*8+u] = 0;
+			continue;
+		}
+		for(y = 0; y < n; y++) {
+			for(sum = 0, x = 0; x < 8; x++)
+				sum += tbl[y*8+x] * in[x*8+u];
+			ws[y*8+u] = (sum + (1 << 11)) >> 12;
+		}
+	}
+
+	// Rows
+	for(y = 0; y < n; y++, out += stride) {
+		for(x = 0; x < n; x++) {
+			for(sum = 0, u = 0; u < 8; u++)
+				sum += tbl[x*8+u] * ws[y*8+u];
+			out[x] = clampSample(((sum + (1L << 13)) >> 14) + 128);
+		}
+	}
+}
+
+// Turn the coefficients into samples at the current scale
+static void putBlock(gdispImage *img, jpgdecode *decode, int last, uint8_t *out, coord_t stride) {
+	uint8_t		val;
+	int			i, j, bs;
+
+	bs = 8 >> img->priv->scale;
+
+	// A block with only a DC value is a single color
+	if (last <= 1) {
+		val = img->priv->scale ? clampSample(((decode->coef[0] + 4) >> 3) + 128) : clampSample(((decode->coef[0] + (1 << (IDCT_BITS+2))) >> (IDCT_BITS+3)) + 128);
+		for(j = 0; j < bs; j++, out += stride)
+			for(i = 0; i < bs; i++)
+				out[i] = val;
+		return;
+	}
+
+	switch(img->priv->scale) {
+	case 0:		idct8(decode->coef, decode->ws, out, stride);							break;
+	case 1:		idctReduced(decode->coef, decode->ws, out, stride, idct4[0], 4);		break;
+	case 2:		idctReduced(decode->coef, decode->ws, out, stride, idct2[0], 2);		break;
+	default:	*out = clampSample(((decode->coef[0] + 4) >> 3) + 128);					break;
+	}
+}
+
+/*-----------------------------------------------------------------
+ * Decoding
+ *---------------------------------------------------------------*/
+
+static gdispImageError startDecode(gdispImage *img, jpgdecode **pdecode, coord_t cx) {
+	gdispImagePrivate *	priv;
+	jpgdecode *			decode;
+	coord_t				mcusx, mcuh;
+	size_t				sz;
+	int					c, k;
+
+	priv = img->priv;
+	if (!(decode = (jpgdecode *)gdispImageAlloc(img, sizeof(jpgdecode))))
+		return GDISP_IMAGE_ERR_NOMEMORY;
+	decode->ipos = decode->ilen = 0;
+	decode->bitbuf = 0;
+	decode->bitcnt = 0;
+	decode->marker = 0;
+	decode->restartleft = priv->restart;
+	decode->coefmax = priv->scale ? (1L << 12) : (1L << (12+IDCT_BITS));
+	for(c = 0; c < priv->ncomp; c++)
+		decode->dcpred[c] = 0;
+
+	// The dequantization multipliers - the full size IDCT needs the AAN scaling and the extra precision bits
+	for(c = 0; c < 4; c++) {
+		if (!(priv->qtdef & (1 << c)))
+			continue;
+		for(k = 0; k < 64; k++) {
+			if (priv->scale)
+				decode->qmul[c][k] = priv->qt[c][k];
+			else
+				decode->qmul[c][k] = ((int32_t)priv->qt[c][k] * aanScale[zigzag[k]] + (1 << (13-IDCT_BITS))) >> (14-IDCT_BITS);
+		}
+	}
+
+	// The sample planes for one MCU row
+	mcusx = (priv->fullwidth + 8*priv->hmax - 1) / (8*priv->hmax);
+	mcuh = (8 * priv->vmax) >> priv->scale;
+	for(sz = 0, c = 0; c < priv->ncomp; c++) {
+		decode->stride[c] = (mcusx * priv->comp[c].h * 8) >> priv->scale;
+		sz += (size_t)decode->stride[c] * ((priv->comp[c].v * 8) >> priv->scale);
+	}
+	decode->planesize = sz;
+	decode->pixelsize = (size_t)cx * mcuh * sizeof(pixel_t);
+	if (!(decode->plane[0] = (uint8_t *)gdispImageAlloc(img, sz))) {
+		gdispImageFree(img, decode, sizeof(jpgdecode));
+		return GDISP_IMAGE_ERR_NOMEMORY;
+	}
+	for(c = 1; c < priv->ncomp; c++)
+		decode->plane[c] = decode->plane[c-1] + (size_t)decode->stride[c-1] * ((priv->comp[c-1].v * 8) >> priv->scale);
+	decode->pixels = 0;
+	if (decode->pixelsize && !(decode->pixels = (pixel_t *)gdispImageAlloc(img, decode->pixelsize))) {
+		gdispImageFree(img, decode->plane[0], decode->planesize);
+		gdispImageFree(img, decode, sizeof(jpgdecode));
+		return GDISP_IMAGE_ERR_NOMEMORY;
+	}
+
+	img->io.fns->seek(&img->io, priv->frame0pos);
+	*pdecode = decode;
+	return GDISP_IMAGE_ERR_OK;
+}
+
+static void stopDecode(gdispImage *img, jpgdecode *decode) {
+	if (decode->pixels)
+		gdispImageFree(img, decode->pixels, decode->pixelsize);
+	gdispImageFree(img, decode->plane[0], decode->planesize);
+	gdispImageFree(img, decode, sizeof(jpgdecode));
+}
+
+// Process a restart marker
+static bool_t doRestart(gdispImage *img, jpgdecode *decode) {
+	int		b, c;
+
+	decode->bitbuf = 0;
+	decode->bitcnt = 0;
+
+	// Find the marker if we haven't already
+	while (!decode->marker) {
+		if ((b = getByte(img, decode)) < 0)
+			return FALSE;
+		if (b == 0xFF) {
+			do {
+				b = getByte(img, decode);
+			} while (b == 0xFF);
+			if (b > 0)
+				decode->marker = b;
+		}
+	}
+	if (decode->marker < 0xD0 || decode->marker > 0xD7)
+		return FALSE;
+	decode->marker = 0;
+	decode->restartleft = img->priv->restart;
+	for(c = 0; c < img->priv->ncomp; c++)
+		decode->dcpred[c] = 0;
+	return TRUE;
+}
+
+// Convert part of the MCU row in the planes into pixels
+static void convertPixels(gdispImage *img, jpgdecode *decode, pixel_t *pd, coord_t pstride, coord_t sx, coord_t cx, coord_t y0, coord_t cy) {
+	gdispImagePrivate *	priv;
+	const uint8_t		*py, *pcb, *pcr;
+	coord_t				x, y, hy, hc, vc;
+	int32_t				Y, cb, cr;
+
+	priv = img->priv;
+	hy = priv->hmax / priv->comp[0].h;
+	vc = priv->ncomp == 3 ? priv->vmax / priv->comp[1].v : 1;
+	hc = priv->ncomp == 3 ? priv->hmax / priv->comp[1].h : 1;
+
+	for(y = y0; y < y0+cy; y++, pd += pstride) {
+		py = decode->plane[0] + (y / (priv->vmax / priv->comp[0].v)) * decode->stride[0];
+		if (priv->ncomp == 1) {
+			for(x = 0; x < cx; x++) {
+				Y = py[(sx+x) / hy];
+				pd[x] = RGB2COLOR(Y, Y, Y);
+			}
+			continue;
+		}
+		pcb = decode->plane[1] + (y / vc) * decode->stride[1];
+		pcr = decode->plane[2] + (y / vc) * decode->stride[2];
+		for(x = 0; x < cx; x++) {
+			Y = py[(sx+x) / hy];
+			cb = pcb[(sx+x) / hc] - 128;
+			cr = pcr[(sx+x) / hc] - 128;
+			pd[x] = RGB2COLOR(clampSample(Y + ((91881 * cr + 32768) >> 16)),
+							clampSample(Y - ((22554 * cb + 46802 * cr - 32768) >> 16)),
+							clampSample(Y + ((116130 * cb + 32768) >> 16)));
+		}
+	}
+}
+
+/**
+ * Decode the image area sx,sy,cx,cy. It is drawn at x,y or, if cache is set, stored in the cache.
+ * If sink is set the needed rows are passed to it instead.
+ */
+static gdispImageError decodeImage(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy, pixel_t *cache, gdispImageRowSink *sink) {
+	gdispImagePrivate *	priv;
+	jpgdecode *			decode;
+	gdispImageError		err;
+	coord_t				mcusx, mcusy, mcuw, mcuh, mx, my, bs, top, y0, y1;
+	int					c, h, v, last;
+	bool_t				visible, store;
+
+	priv = img->priv;
+	if ((err = startDecode(img, &decode, cache || sink ? 0 : cx)))
+		return err;
+
+	bs = 8 >> priv->scale;
+	mcusx = (priv->fullwidth + 8*priv->hmax - 1) / (8*priv->hmax);
+	mcusy = (priv->fullheight + 8*priv->vmax - 1) / (8*priv->vmax);
+	mcuw = bs * priv->hmax;
+	mcuh = bs * priv->vmax;
+
+	for(my = 0; my < mcusy; my++) {
+		// Stop once we are past the area. Rows above it are entropy decoded only.
+		top = my * mcuh;
+		if (top >= sy+cy)
+			break;
+		visible = top + mcuh > sy;
+		#if GDISP_NEED_IMAGE_SCALING
+			// Only MCU rows containing a needed row must be transformed
+			if (sink) {
+				for(visible = FALSE, y0 = top; y0 < top + mcuh && y0 <= sink->last; y0++) {
+					if (gdispImageRowNeeded(sink, y0)) {
+						visible = TRUE;
+						break;
+					}
+				}
+			}
+		#endif
+
+		for(mx = 0; mx < mcusx; mx++) {
+			if (priv->restart) {
+				if (!decode->restartleft && !doRestart(img, decode)) {
+					err = GDISP_IMAGE_ERR_BADDATA;
+					goto done;
+				}
+				decode->restartleft--;
+			}
+
+			// Only do the IDCT for MCUs that overlap the area
+			store = visible && mx*mcuw < sx+cx && (mx+1)*mcuw > sx;
+			for(c = 0; c < priv->ncomp; c++) {
+				for(v = 0; v < priv->comp[c].v; v++) {
+					for(h = 0; h < priv->comp[c].h; h++) {
+						if ((last = getBlock(img, decode, c, store)) < 0) {
+							err = GDISP_IMAGE_ERR_BADDATA;
+							goto done;
+						}
+						if (store)
+							putBlock(img, decode, last, decode->plane[c] + v*bs*decode->stride[c] + (mx*priv->comp[c].h + h)*bs, decode->stride[c]);
+					}
+				}
+			}
+		}
+
+		if (!visible)
+			continue;
+
+		// Convert and draw the rows of this MCU row that are in the area
+		y0 = top < sy ? sy : top;
+		y1 = top + mcuh > sy+cy ? sy+cy : top + mcuh;
+		#if GDISP_NEED_IMAGE_SCALING
+			if (sink) {
+				for(; y0 < y1; y0++) {
+					if (gdispImageRowNeeded(sink, y0)) {
+						convertPixels(img, decode, sink->buf, img->width, 0, img->width, y0 - top, 1);
+						if (!sink->row(sink, y0, sink->buf))
+							goto done;
+					}
+				}
+				continue;
+			}
+		#endif
+		if (cache)
+			convertPixels(img, decode, cache + y0*img->width, img->width, 0, img->width, y0 - top, y1 - y0);
+		else {
+			convertPixels(img, decode, decode->pixels, cx, sx, cx, y0 - top, y1 - y0);
+			gdispBlitAreaEx(x, y + y0 - sy, cx, y1 - y0, 0, 0, cx, decode->pixels);
+		}
+	}
+
+done:
+	stopDecode(img, decode);
+	return err;
+}
+
+/*-----------------------------------------------------------------
+ * Headers
+ *---------------------------------------------------------------*/
+
+static gdispImageError readDHT(gdispImage *img, uint16_t len) {
+	gdispImagePrivate *	priv;
+	jpghuff *			h;
+	uint8_t				bits[17], tc;
+	uint16_t			total, i, j, p;
+	int32_t				code;
+
+	priv = img->priv;
+	while (len >= 17) {
+		if (img->io.fns->read(&img->io, bits, 17) != 17)
+			return GDISP_IMAGE_ERR_BADDATA;
+		tc = bits[0];
+		if ((tc >> 4) > 1 || (tc & 0x0F) > 3)
+			return GDISP_IMAGE_ERR_BADDATA;
+		tc = (tc >> 4) * 4 + (tc & 0x0F);
+		for(total = 0, i = 1; i <= 16; i++)
+			total += bits[i];
+		if (total > 256 || total + 17 > len)
+			return GDISP_IMAGE_ERR_BADDATA;
+		len -= total + 17;
+
+		if (!(h = priv->huff[tc]) && !(h = priv->huff[tc] = (jpghuff *)gdispImageAlloc(img, sizeof(jpghuff))))
+			return GDISP_IMAGE_ERR_NOMEMORY;
+		if (img->io.fns->read(&img->io, h->vals, total) != total)
+			return GDISP_IMAGE_ERR_BADDATA;
+
+		// The canonical codes
+		for(code = 0, p = 0, i = 1; i <= 16; i++) {
+			h->valoffset[i] = p - code;
+			code += bits[i];
+			p += bits[i];
+			h->maxcode[i] = bits[i] ? code - 1 : -1;
+			code <<= 1;
+		}
+		h->maxcode[17] = 0x7FFFFFFF;
+
+		// The lookahead for codes of 8 bits or less
+		for(i = 0; i < 256; i++)
+			h->looklen[i] = 0;
+		for(code = 0, p = 0, i = 1; i <= 8; i++, code <<= 1) {
+			for(j = 0; j < bits[i]; j++, p++, code++) {
+				int32_t	k, base;
+
+				if (code >= (1L << i))
+					return GDISP_IMAGE_ERR_BADDATA;
+				for(base = code << (8 - i), k = 0; k < (1 << (8 - i)); k++) {
+					h->looklen[base+k] = i;
+					h->looksym[base+k] = h->vals[p];
+				}
+			}
+		}
+	}
+	return len ? GDISP_IMAGE_ERR_BADDATA : GDISP_IMAGE_ERR_OK;
+}
+
+static gdispImageError readDQT(gdispImage *img, uint16_t len) {
+	gdispImagePrivate *	priv;
+	uint8_t				buf[2];
+	uint8_t				t;
+	int					k;
+
+	priv = img->priv;
+	while (len >= 65) {
+		if (img->io.fns->read(&img->io, buf, 1) != 1 || (buf[0] & 0x0F) > 3)
+			return GDISP_IMAGE_ERR_BADDATA;
+		t = buf[0] & 0x0F;
+		if ((buf[0] >> 4)) {
+			// 16 bit values
+			if (len < 129)
+				return GDISP_IMAGE_ERR_BADDATA;
+			for(k = 0; k < 64; k++) {
+				if (img->io.fns->read(&img->io, buf, 2) != 2)
+					return GDISP_IMAGE_ERR_BADDATA;
+				priv->qt[t][k] = getBE16(buf) > 255 ? 255 : getBE16(buf);	// Only 8 bit values are valid for 8 bit samples
+			}
+			len -= 129;
+		} else {
+			for(k = 0; k < 64; k++) {
+				if (img->io.fns->read(&img->io, buf, 1) != 1)
+					return GDISP_IMAGE_ERR_BADDATA;
+				priv->qt[t][k] = buf[0];
+			}
+			len -= 65;
+		}
+		priv->qtdef |= 1 << t;
+	}
+	return len ? GDISP_IMAGE_ERR_BADDATA : GDISP_IMAGE_ERR_OK;
+}
+
+static gdispImageError readSOF(gdispImage *img, uint16_t len) {
+	gdispImagePrivate *	priv;
+	uint8_t				buf[6];
+	int					c;
+
+	priv = img->priv;
+	if (len < 6 || img->io.fns->read(&img->io, buf, 6) != 6)
+		return GDISP_IMAGE_ERR_BADDATA;
+	if (buf[0] != 8)									// Only 8 bit precision
+		return GDISP_IMAGE_ERR_UNSUPPORTED;
+	if (!getBE16(buf+1) || !getBE16(buf+3) || getBE16(buf+1) > 32767 || getBE16(buf+3) > 32767)
+		return GDISP_IMAGE_ERR_UNSUPPORTED;				// No DNL support
+	priv->fullheight = getBE16(buf+1);
+	priv->fullwidth = getBE16(buf+3);
+	priv->ncomp = buf[5];
+	if (priv->ncomp != 1 && priv->ncomp != 3)
+		return GDISP_IMAGE_ERR_UNSUPPORTED;
+	if (len != 6 + 3*priv->ncomp)
+		return GDISP_IMAGE_ERR_BADDATA;
+
+	priv->hmax = priv->vmax = 1;
+	for(c = 0; c < priv->ncomp; c++) {
+		if (img->io.fns->read(&img->io, buf, 3) != 3)
+			return GDISP_IMAGE_ERR_BADDATA;
+		priv->comp[c].id = buf[0];
+		priv->comp[c].h = buf[1] >> 4;
+		priv->comp[c].v = buf[1] & 0x0F;
+		priv->comp[c].tq = buf[2];
+		if (priv->comp[c].h < 1 || priv->comp[c].h > 4 || priv->comp[c].v < 1 || priv->comp[c].v > 4 || priv->comp[c].tq > 3)
+			return GDISP_IMAGE_ERR_BADDATA;
+		if (priv->comp[c].h > priv->hmax) priv->hmax = priv->comp[c].h;
+		if (priv->comp[c].v > priv->vmax) priv->vmax = priv->comp[c].v;
+	}
+
+	// A single component scan is not interleaved so each MCU is a single block
+	if (priv->ncomp == 1)
+		priv->comp[0].h = priv->comp[0].v = priv->hmax = priv->vmax = 1;
+
+	// We only support sampling factors that divide evenly
+	for(c = 0; c < priv->ncomp; c++) {
+		if ((priv->hmax % priv->comp[c].h) || (priv->vmax % priv->comp[c].v))
+			return GDISP_IMAGE_ERR_UNSUPPORTED;
+	}
+	return GDISP_IMAGE_ERR_OK;
+}
+
+static gdispImageError readSOS(gdispImage *img, uint16_t len) {
+	gdispImagePrivate *	priv;
+	uint8_t				buf[4];
+	int					i, c;
+
+	priv = img->priv;
+	if (!priv->ncomp || img->io.fns->read(&img->io, buf, 1) != 1)
+		return GDISP_IMAGE_ERR_BADDATA;
+
+	// The scan must contain all the components - we don't support multiple scans
+	if (buf[0] != priv->ncomp || len != 4 + 2*priv->ncomp)
+		return GDISP_IMAGE_ERR_UNSUPPORTED;
+	for(i = 0; i < priv->ncomp; i++) {
+		if (img->io.fns->read(&img->io, buf, 2) != 2)
+			return GDISP_IMAGE_ERR_BADDATA;
+		for(c = 0; c < priv->ncomp && priv->comp[c].id != buf[0]; c++);
+		if (c != i || (buf[1] >> 4) > 3 || (buf[1] & 0x0F) > 3)
+			return GDISP_IMAGE_ERR_UNSUPPORTED;
+		priv->comp[c].td = buf[1] >> 4;
+		priv->comp[c].ta = buf[1] & 0x0F;
+		if (!priv->huff[priv->comp[c].td] || !priv->huff[4+priv->comp[c].ta] || !(priv->qtdef & (1 << priv->comp[c].tq)))
+			return GDISP_IMAGE_ERR_BADDATA;
+	}
+	if (img->io.fns->read(&img->io, buf, 3) != 3)
+		return GDISP_IMAGE_ERR_BADDATA;
+	if (buf[0] != 0 || buf[1] != 63 || buf[2] != 0)		// Spectral selection and successive approximation
+		return GDISP_IMAGE_ERR_UNSUPPORTED;
+	priv->frame0pos = img->io.pos;
+	return GDISP_IMAGE_ERR_OK;
+}
+
+gdispImageError gdispImageOpen_JPG(gdispImage *img) {
+	gdispImagePrivate *priv;
+	gdispImageError	err;
+	uint8_t			hdr[4];
+	uint16_t		len;
+	size_t			pos;
+	int				i;
+
+	/* Read the file identifier */
+	if (img->io.fns->read(&img->io, hdr, 2) != 2 || hdr[0] != 0xFF || hdr[1] != 0xD8)
+		return GDISP_IMAGE_ERR_BADFORMAT;		// It can't be us
+
+	/* We know we are a JPG format image */
+	img->flags = 0;
+
+	/* Allocate our private area */
+	if (!(img->priv = (gdispImagePrivate *)gdispImageAlloc(img, sizeof(gdispImagePrivate))))
+		return GDISP_IMAGE_ERR_NOMEMORY;
+
+	/* Initialise the essential bits in the private area */
+	priv = img->priv;
+	priv->frame0cache = 0;
+	priv->ncomp = 0;
+	priv->scale = 0;
+	priv->restart = 0;
+	priv->qtdef = 0;
+	for(i = 0; i < 8; i++)
+		priv->huff[i] = 0;
+
+	/* Process the segments up to the start of the scan */
+	while(1) {
+		if (img->io.fns->read(&img->io, hdr, 2) != 2 || hdr[0] != 0xFF)
+			goto baddatacleanup;
+		if (hdr[1] == 0xFF) {						// Fill byte
+			img->io.fns->seek(&img->io, img->io.pos - 1);
+			continue;
+		}
+		if (img->io.fns->read(&img->io, hdr+2, 2) != 2 || (len = getBE16(hdr+2)) < 2)
+			goto baddatacleanup;
+		len -= 2;
+		pos = img->io.pos;
+
+		switch(hdr[1]) {
+		case 0xC0:									// SOF0 - Baseline
+		case 0xC1:									// SOF1 - Extended sequential huffman
+			if ((err = readSOF(img, len)))
+				goto errcleanup;
+			break;
+		case 0xC4:									// DHT
+			if ((err = readDHT(img, len)))
+				goto errcleanup;
+			break;
+		case 0xDB:									// DQT
+			if ((err = readDQT(img, len)))
+				goto errcleanup;
+			break;
+		case 0xDD:									// DRI
+			if (len != 2 || img->io.fns->read(&img->io, hdr, 2) != 2)
+				goto baddatacleanup;
+			priv->restart = getBE16(hdr);
+			break;
+		case 0xDA:									// SOS
+			if ((err = readSOS(img, len)))
+				goto errcleanup;
+			img->width = priv->fullwidth;
+			img->height = priv->fullheight;
+			img->type = GDISP_IMAGE_TYPE_JPG;
+			return GDISP_IMAGE_ERR_OK;
+		case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+		case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+			goto unsupportedcleanup;				// Progressive, lossless, hierarchical or arithmetic coding
+		case 0xD9:									// EOI
+			goto baddatacleanup;
+		default:									// APPn, COM etc
+			break;
+		}
+		img->io.fns->seek(&img->io, pos + len);
+	}
+
+errcleanup:
+	gdispImageClose_JPG(img);				// Clean up the private data area
+	return err;
+
+baddatacleanup:
+	gdispImageClose_JPG(img);				// Clean up the private data area
+	return GDISP_IMAGE_ERR_BADDATA;			// Oops - something wrong
+
+unsupportedcleanup:
+	gdispImageClose_JPG(img);				// Clean up the private data area
+	return GDISP_IMAGE_ERR_UNSUPPORTED;		// Not supported
+}
+
+void gdispImageClose_JPG(gdispImage *img) {
+	int		i;
+
+	if (img->priv) {
+		for(i = 0; i < 8; i++) {
+			if (img->priv->huff[i])
+				gdispImageFree(img, (void *)img->priv->huff[i], sizeof(jpghuff));
+		}
+		if (img->priv->frame0cache)
+			gdispImageFree(img, (void *)img->priv->frame0cache, img->width*img->height*sizeof(pixel_t));
+		gdispImageFree(img, (void *)img->priv, sizeof(gdispImagePrivate));
+		img->priv = 0;
+	}
+	img->io.fns->close(&img->io);
+}
+
+gdispImageError gdispImageSetScale_JPG(gdispImage *img, uint8_t denom) {
+	gdispImagePrivate *	priv;
+	uint8_t				scale;
+
+	if (img->type != GDISP_IMAGE_TYPE_JPG || !img->priv)
+		return GDISP_IMAGE_ERR_BADFORMAT;
+	switch(denom) {
+	case 1:		scale = 0;	break;
+	case 2:		scale = 1;	break;
+	case 4:		scale = 2;	break;
+	case 8:		scale = 3;	break;
+	default:	return GDISP_IMAGE_ERR_UNSUPPORTED;
+	}
+
+	/* Any cache is for the old size */
+	priv = img->priv;
+	if (priv->frame0cache) {
+		gdispImageFree(img, (void *)priv->frame0cache, img->width*img->height*sizeof(pixel_t));
+		priv->frame0cache = 0;
+	}
+	priv->scale = scale;
+	img->width = (priv->fullwidth + denom - 1) >> scale;
+	img->height = (priv->fullheight + denom - 1) >> scale;
+	return GDISP_IMAGE_ERR_OK;
+}
+
+gdispImageError gdispImageDecode_JPG(gdispImage *img, pixel_t *buf) {
+	return decodeImage(img, 0, 0, img->width, img->height, 0, 0, buf, 0);
+}
+
+gdispImageError gdispImageCache_JPG(gdispImage *img) {
+	gdispImagePrivate *	priv;
+	gdispImageError		err;
+	size_t				len;
+
+	/* If we are already cached - just return OK */
+	priv = img->priv;
+	if (priv->frame0cache)
+		return GDISP_IMAGE_ERR_OK;
+
+	/* We need to allocate the cache */
+	len = img->width * img->height * sizeof(pixel_t);
+	priv->frame0cache = (pixel_t *)gdispImageAlloc(img, len);
+	if (!priv->frame0cache)
+		return GDISP_IMAGE_ERR_NOMEMORY;
+
+	/* Decode the entire image into the cache */
+	if ((err = gdispImageDecode_JPG(img, priv->frame0cache))) {
+		gdispImageFree(img, (void *)priv->frame0cache, len);
+		priv->frame0cache = 0;
+	}
+	return err;
+}
+
+gdispImageError gdispImageDraw_JPG(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy) {
+	gdispImagePrivate *	priv;
+
+	priv = img->priv;
+
+	/* Check some reasonableness */
+	if (sx >= img->width || sy >= img->height) return GDISP_IMAGE_ERR_OK;
+	if (sx + cx > img->width) cx = img->width - sx;
+	if (sy + cy > img->height) cy = img->height - sy;
+	if (cx <= 0 || cy <= 0) return GDISP_IMAGE_ERR_OK;
+
+	/* Draw from the image cache - if it exists */
+	if (priv->frame0cache) {
+		gdispBlitAreaEx(x, y, cx, cy, sx, sy, img->width, priv->frame0cache);
+		return GDISP_IMAGE_ERR_OK;
+	}
+
+	return decodeImage(img, x, y, cx, cy, sx, sy, 0, 0);
+}
+
+#if GDISP_NEED_IMAGE_SCALING
+	gdispImageError gdispImageRows_JPG(gdispImage *img, gdispImageRowSink *sink) {
+		return decodeImage(img, 0, 0, img->width, sink->last+1, 0, 0, 0, sink);
+	}
+#endif
+
+delaytime_t gdispImageNext_JPG(gdispImage *img) {
+	(void) img;
+
+	/* No more frames/pages */
+	return TIME_INFINITE;
+}
 
 #endif /* GFX_USE_GDISP && GDISP_NEED_IMAGE && GDISP_NEED_IMAGE_JPG */
 /** @} */
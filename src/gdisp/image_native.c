@@ -13,6 +13,8 @@
 
 #if GFX_USE_GDISP && GDISP_NEED_IMAGE && GDISP_NEED_IMAGE_NATIVE
 
+#include <string.h>
+
 /**
  * How big a pixel array to allocate for blitting
  * Bigger is faster but uses more RAM.
@@ -22,6 +24,34 @@
 #define HEADER_SIZE			8
 #define FRAME0POS			(HEADER_SIZE)
 
+/**
+ * The version 2 (compressed) format.
+ * The header is followed by a row index of height+1 little endian 32 bit entries and then the row data.
+ * Each entry has the offset of the row from the start of the row data and the row compression in the top 2 bits.
+ * The last entry is the length of the row data.
+ */
+#define HEADER_SIZE_V2		12
+#define ORDER_LE			0				// Header byte 9 - the byte order of the pixels
+#define ORDER_BE			1
+#define INDEXPOS_V2			(HEADER_SIZE_V2)
+#define DATAPOS_V2(img)		(HEADER_SIZE_V2 + ((size_t)(img)->height + 1) * 4)
+#define ROW_OFFSET_MASK		0x3FFFFFFF
+#define ROW_METHOD(e)		((e) >> 30)
+	#define ROW_RAW				0
+	#define ROW_RLE				1
+	#define ROW_LZ				2
+
+/**
+ * How many row index entries to read at a time when not memory resident
+ */
+#define INDEX_CHUNK			16
+
+/* Testing through a byte pointer is safe for any alignment and aliasing rules */
+static const uint16_t	byteOrder = 0x0100;
+#define isBigEndian()		(*(const uint8_t *)&byteOrder != 0)
+
+#define LE32(p)				(((uint32_t)(p)[0]) | (((uint32_t)(p)[1])<<8) | (((uint32_t)(p)[2])<<16) | (((uint32_t)(p)[3])<<24))
+
 /**
  * Helper Routines Needed
  */
@@ -31,6 +61,13 @@ void gdispImageFree(gdispImage *img, void *ptr, size_t sz);
 typedef struct gdispImagePrivate {
 	pixel_t		*frame0cache;
 	pixel_t		buf[BLIT_BUFFER_SIZE];
+	uint8_t		version;
+	bool_t		swap;							// Version 2 - The pixels are in the other byte order
+	pixel_t		*row;							// Version 2 - One decoded row
+	uint8_t		*in;							// Version 2 - One compressed row read from the file
+	size_t		datalen;						// Version 2 - The length of the row data
+	coord_t		idxrow, idxcnt;					// Version 2 - The rows in idx
+	uint8_t		idx[(INDEX_CHUNK+1)*4];			// Version 2 - Some of the row index
 	} gdispImagePrivate;
 
 gdispImageError gdispImageOpen_NATIVE(gdispImage *img) {
@@ -40,7 +77,7 @@ gdispImageError gdispImageOpen_NATIVE(gdispImage *img) {
 	if (img->io.fns->read(&img->io, hdr, 8) != 8)
 		return GDISP_IMAGE_ERR_BADFORMAT;		// It can't be us
 
-	if (hdr[0] != 'N' || hdr[1] != 'I')
+	if (hdr[0] != 'N' || (hdr[1] != 'I' && hdr[1] != 'Z'))
 		return GDISP_IMAGE_ERR_BADFORMAT;		// It can't be us
 
 	if (hdr[6] != GDISP_PIXELFORMAT/256 || hdr[7] != (GDISP_PIXELFORMAT & 0xFF))
@@ -55,21 +92,286 @@ gdispImageError gdispImageOpen_NATIVE(gdispImage *img) {
 	if (!(img->priv = (gdispImagePrivate *)gdispImageAlloc(img, sizeof(gdispImagePrivate))))
 		return GDISP_IMAGE_ERR_NOMEMORY;
 	img->priv->frame0cache = 0;
-
+	img->priv->version = 1;
+	img->priv->swap = FALSE;
+	img->priv->row = 0;
+	img->priv->in = 0;
 	img->type = GDISP_IMAGE_TYPE_NATIVE;
+
+	if (hdr[1] == 'Z') {
+		img->priv->version = 2;
+		img->priv->idxcnt = 0;
+
+		/* The rest of the header has the pixel size which must match ours */
+		if (img->io.fns->read(&img->io, hdr, HEADER_SIZE_V2-HEADER_SIZE) != HEADER_SIZE_V2-HEADER_SIZE)
+			goto baddatacleanup;
+		if (hdr[0] != sizeof(pixel_t) || (hdr[1] != ORDER_LE && hdr[1] != ORDER_BE))
+			goto unsupportedcleanup;
+		img->priv->swap = sizeof(pixel_t) > 1 && (hdr[1] == ORDER_BE) != isBigEndian();
+
+		/* The last index entry tells us how big the image is */
+		img->io.fns->seek(&img->io, INDEXPOS_V2 + (size_t)img->height * 4);
+		if (img->io.fns->read(&img->io, hdr, 4) != 4)
+			goto baddatacleanup;
+		img->priv->datalen = LE32(hdr) & ROW_OFFSET_MASK;
+
+		if (!(img->priv->row = (pixel_t *)gdispImageAlloc(img, img->width * sizeof(pixel_t)))) {
+			gdispImageClose_NATIVE(img);
+			return GDISP_IMAGE_ERR_NOMEMORY;
+		}
+	}
+
 	return GDISP_IMAGE_ERR_OK;
+
+baddatacleanup:
+	gdispImageClose_NATIVE(img);			// Clean up the private data area
+	return GDISP_IMAGE_ERR_BADDATA;			// Oops - something wrong
+
+unsupportedcleanup:
+	gdispImageClose_NATIVE(img);			// Clean up the private data area
+	return GDISP_IMAGE_ERR_UNSUPPORTED;		// Not supported
 }
 
 void gdispImageClose_NATIVE(gdispImage *img) {
 	if (img->priv) {
 		if (img->priv->frame0cache)
 			gdispImageFree(img, (void *)img->priv->frame0cache, img->width * img->height * sizeof(pixel_t));
+		if (img->priv->row)
+			gdispImageFree(img, (void *)img->priv->row, img->width * sizeof(pixel_t));
+		if (img->priv->in)
+			gdispImageFree(img, (void *)img->priv->in, img->width * sizeof(pixel_t));
 		gdispImageFree(img, (void *)img->priv, sizeof(gdispImagePrivate));
 		img->priv = 0;
 	}
 	img->io.fns->close(&img->io);
 }
 
+/**
+ * Get a pointer to the pixels if the io layer can give us one we can blit straight from.
+ */
+static const pixel_t *getDirect(gdispImage *img) {
+	const void	*p;
+
+	if (!img->io.fns->getptr)
+		return 0;
+	p = img->io.fns->getptr(&img->io, FRAME0POS, img->width * img->height * sizeof(pixel_t));
+	if (!p || ((size_t)p & (sizeof(pixel_t)-1)))
+		return 0;
+	return (const pixel_t *)p;
+}
+
+/**
+ * Get a pointer to the whole version 2 image if the io layer can give us one.
+ */
+static const uint8_t *getDirectV2(gdispImage *img) {
+	if (!img->io.fns->getptr)
+		return 0;
+	return (const uint8_t *)img->io.fns->getptr(&img->io, 0, DATAPOS_V2(img) + img->priv->datalen);
+}
+
+/**
+ * Decode a run length encoded row.
+ * Each packet is a byte n. If the top bit is set the following pixel is repeated (n & 0x7F) + 1 times,
+ * otherwise n + 1 literal pixels follow.
+ */
+static bool_t decodeRLE(pixel_t *out, coord_t cx, coord_t width, const uint8_t *in, size_t len) {
+	const uint8_t	*end;
+	pixel_t			*p, *pe;
+	pixel_t			c;
+	unsigned		n;
+
+	end = in + len;
+	for(p = out, pe = out + cx; p < pe;) {
+		if (in >= end)
+			return FALSE;
+		n = *in++;
+		if ((n & 0x80)) {
+			n = (n & 0x7F) + 1;
+			if (n > (unsigned)(out + width - p) || sizeof(pixel_t) > (size_t)(end - in))
+				return FALSE;
+			memcpy(&c, in, sizeof(pixel_t));
+			in += sizeof(pixel_t);
+			while(n--)
+				*p++ = c;
+		} else {
+			n++;
+			if (n > (unsigned)(out + width - p) || n * sizeof(pixel_t) > (size_t)(end - in))
+				return FALSE;
+			memcpy(p, in, n * sizeof(pixel_t));
+			in += n * sizeof(pixel_t);
+			p += n;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Decode a LZ compressed row. This is the LZ4 block format but counting in pixels and with matches
+ * only within the row. Each sequence is a token byte with the literal count in the top nibble and the
+ * match length - 2 in the bottom nibble (15 means more length bytes follow until one isn't 255),
+ * the literal pixels, then a 16 bit little endian match offset in pixels. The row ends after the literals
+ * that fill it.
+ */
+static bool_t decodeLZ(pixel_t *out, coord_t cx, coord_t width, const uint8_t *in, size_t len) {
+	const uint8_t	*end;
+	pixel_t			*p, *pe;
+	const pixel_t	*m;
+	unsigned		n, t, off;
+
+	end = in + len;
+	for(p = out, pe = out + cx; p < pe;) {
+		if (in >= end)
+			return FALSE;
+		t = *in++;
+
+		/* The literals */
+		if ((n = t >> 4) == 15) {
+			do {
+				if (in >= end)
+					return FALSE;
+				n += *in;
+			} while(*in++ == 255);
+		}
+		if (n > (unsigned)(out + width - p) || n * sizeof(pixel_t) > (size_t)(end - in))
+			return FALSE;
+		memcpy(p, in, n * sizeof(pixel_t));
+		in += n * sizeof(pixel_t);
+		p += n;
+		if (p >= pe)
+			break;
+
+		/* The match */
+		if (end - in < 2)
+			return FALSE;
+		off = in[0] | (((unsigned)in[1])<<8);
+		in += 2;
+		if ((n = (t & 0x0F)) == 15) {
+			do {
+				if (in >= end)
+					return FALSE;
+				n += *in;
+			} while(*in++ == 255);
+		}
+		n += 2;
+		if (!off || off > (unsigned)(p - out) || n > (unsigned)(out + width - p))
+			return FALSE;
+		m = p - off;
+		if (off >= n) {
+			memcpy(p, m, n * sizeof(pixel_t));
+			p += n;
+		} else {
+			while(n--)
+				*p++ = *m++;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Swap the bytes of each pixel in a row
+ */
+static void swapRow(pixel_t *p, coord_t cx) {
+	for(; cx; cx--, p++) {
+		if (sizeof(pixel_t) == 2)
+			*p = (pixel_t)((*p >> 8) | (*p << 8));
+		else if (sizeof(pixel_t) == 4)
+			*p = (pixel_t)((*p >> 24) | ((*p >> 8) & 0xFF00) | ((*p << 8) & 0xFF0000) | (*p << 24));
+	}
+}
+
+/**
+ * Get the first cx pixels of row y of a version 2 image.
+ * They are either decoded into priv->row or, for a raw row in memory, pointed to where they are.
+ */
+static gdispImageError getRowV2(gdispImage *img, const uint8_t *direct, coord_t y, coord_t cx, const pixel_t **pp) {
+	gdispImagePrivate *	priv;
+	const uint8_t *		p;
+	uint32_t			start, end;
+	unsigned			method;
+	size_t				len;
+	coord_t				n;
+
+	priv = img->priv;
+
+	/* Find the row */
+	if (direct)
+		p = direct + INDEXPOS_V2 + (size_t)y * 4;
+	else {
+		if (y < priv->idxrow || y >= priv->idxrow + priv->idxcnt) {
+			n = img->height - y;
+			if (n > INDEX_CHUNK)
+				n = INDEX_CHUNK;
+			img->io.fns->seek(&img->io, INDEXPOS_V2 + (size_t)y * 4);
+			if (img->io.fns->read(&img->io, priv->idx, (n+1) * 4) != (size_t)(n+1) * 4)
+				return GDISP_IMAGE_ERR_BADDATA;
+			priv->idxrow = y;
+			priv->idxcnt = n;
+		}
+		p = priv->idx + (y - priv->idxrow) * 4;
+	}
+	start = LE32(p);
+	end = LE32(p+4) & ROW_OFFSET_MASK;
+	method = ROW_METHOD(start);
+	start &= ROW_OFFSET_MASK;
+
+	/* The row can never be bigger than uncompressed */
+	if (end < start || end > priv->datalen)
+		return GDISP_IMAGE_ERR_BADDATA;
+	len = end - start;
+	if (method == ROW_RAW) {
+		if (len < img->width * sizeof(pixel_t))
+			return GDISP_IMAGE_ERR_BADDATA;
+		len = cx * sizeof(pixel_t);
+	} else if (len > img->width * sizeof(pixel_t))
+		return GDISP_IMAGE_ERR_BADDATA;
+
+	/* Get the row data */
+	if (direct)
+		p = direct + DATAPOS_V2(img) + start;
+	else {
+		img->io.fns->seek(&img->io, DATAPOS_V2(img) + start);
+		if (method == ROW_RAW) {
+			/* Raw rows from a file can be read straight into the row */
+			if (img->io.fns->read(&img->io, priv->row, len) != len)
+				return GDISP_IMAGE_ERR_BADDATA;
+			if (priv->swap)
+				swapRow(priv->row, cx);
+			*pp = priv->row;
+			return GDISP_IMAGE_ERR_OK;
+		}
+		if (!priv->in && !(priv->in = (uint8_t *)gdispImageAlloc(img, img->width * sizeof(pixel_t))))
+			return GDISP_IMAGE_ERR_NOMEMORY;
+		if (img->io.fns->read(&img->io, priv->in, len) != len)
+			return GDISP_IMAGE_ERR_BADDATA;
+		p = priv->in;
+	}
+
+	/* Decode it */
+	switch(method) {
+	case ROW_RAW:
+		if (!priv->swap && !((size_t)p & (sizeof(pixel_t)-1))) {
+			*pp = (const pixel_t *)p;
+			return GDISP_IMAGE_ERR_OK;
+		}
+		memcpy(priv->row, p, len);
+		break;
+	case ROW_RLE:
+		if (!decodeRLE(priv->row, cx, img->width, p, len))
+			return GDISP_IMAGE_ERR_BADDATA;
+		break;
+	case ROW_LZ:
+		if (!decodeLZ(priv->row, cx, img->width, p, len))
+			return GDISP_IMAGE_ERR_BADDATA;
+		break;
+	default:
+		return GDISP_IMAGE_ERR_UNSUPPORTED;
+	}
+	if (priv->swap)
+		swapRow(priv->row, cx);
+	*pp = priv->row;
+	return GDISP_IMAGE_ERR_OK;
+}
+
 gdispImageError gdispImageCache_NATIVE(gdispImage *img) {
 	size_t		len;
 
@@ -77,12 +379,35 @@ gdispImageError gdispImageCache_NATIVE(gdispImage *img) {
 	if (img->priv->frame0cache)
 		return GDISP_IMAGE_ERR_OK;
 
+	/* There is nothing to gain if we can already draw directly from the image */
+	if (img->priv->version == 1 && getDirect(img))
+		return GDISP_IMAGE_ERR_OK;
+
 	/* We need to allocate the cache */
 	len = img->width * img->height * sizeof(pixel_t);
 	img->priv->frame0cache = (pixel_t *)gdispImageAlloc(img, len);
 	if (!img->priv->frame0cache)
 		return GDISP_IMAGE_ERR_NOMEMORY;
 
+	/* Decompress each row into the cache */
+	if (img->priv->version == 2) {
+		const uint8_t *		direct;
+		const pixel_t *		p;
+		gdispImageError		err;
+		coord_t				y;
+
+		direct = getDirectV2(img);
+		for(y = 0; y < img->height; y++) {
+			if ((err = getRowV2(img, direct, y, img->width, &p))) {
+				gdispImageFree(img, (void *)img->priv->frame0cache, len);
+				img->priv->frame0cache = 0;
+				return err;
+			}
+			memcpy(img->priv->frame0cache + y * img->width, p, img->width * sizeof(pixel_t));
+		}
+		return GDISP_IMAGE_ERR_OK;
+	}
+
 	/* Read the entire bitmap into cache */
 	img->io.fns->seek(&img->io, FRAME0POS);
 	if (img->io.fns->read(&img->io, img->priv->frame0cache, len) != len)
@@ -92,8 +417,9 @@ gdispImageError gdispImageCache_NATIVE(gdispImage *img) {
 }
 
 gdispImageError gdispImageDraw_NATIVE(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy) {
-	coord_t		mx, mcx;
-	size_t		pos, len;
+	const pixel_t	*direct;
+	coord_t			mx, mcx;
+	size_t			pos, len;
 
 	/* Check some reasonableness */
 	if (sx >= img->width || sy >= img->height) return GDISP_IMAGE_ERR_OK;
@@ -106,8 +432,29 @@ gdispImageError gdispImageDraw_NATIVE(gdispImage *img, coord_t x, coord_t y, coo
 		return GDISP_IMAGE_ERR_OK;
 	}
 
+	/* Decompress just the rows we need */
+	if (img->priv->version == 2) {
+		const uint8_t *		direct2;
+		const pixel_t *		p;
+		gdispImageError		err;
+
+		direct2 = getDirectV2(img);
+		for(;cy;cy--, y++, sy++) {
+			if ((err = getRowV2(img, direct2, sy, sx + cx, &p)))
+				return err;
+			gdispBlitAreaEx(x, y, cx, 1, sx, 0, img->width, p);
+		}
+		return GDISP_IMAGE_ERR_OK;
+	}
+
+	/* Draw straight from the image bytes - if they are in memory */
+	if ((direct = getDirect(img))) {
+		gdispBlitAreaEx(x, y, cx, cy, sx, sy, img->width, direct);
+		return GDISP_IMAGE_ERR_OK;
+	}
+
 	/* For this image decoder we cheat and just seek straight to the region we want to display */
-	pos = FRAME0POS + (img->width * sy + cx) * sizeof(pixel_t);
+	pos = FRAME0POS + (img->width * sy + sx) * sizeof(pixel_t);
 
 	/* Cycle through the lines */
 	for(;cy;cy--, y++) {
@@ -119,7 +466,7 @@ gdispImageError gdispImageDraw_NATIVE(gdispImage *img, coord_t x, coord_t y, coo
 			// Read the data
 			len = img->io.fns->read(&img->io,
 						img->priv->buf,
-						mx > BLIT_BUFFER_SIZE ? (BLIT_BUFFER_SIZE*sizeof(pixel_t)) : (mx * sizeof(pixel_t)))
+						mcx > BLIT_BUFFER_SIZE ? (BLIT_BUFFER_SIZE*sizeof(pixel_t)) : (mcx * sizeof(pixel_t)))
 					/ sizeof(pixel_t);
 			if (!len)
 				return GDISP_IMAGE_ERR_BADDATA;
@@ -135,6 +482,51 @@ gdispImageError gdispImageDraw_NATIVE(gdispImage *img, coord_t x, coord_t y, coo
 	return GDISP_IMAGE_ERR_OK;
 }
 
+#if GDISP_NEED_IMAGE_SCALING
+	gdispImageError gdispImageRows_NATIVE(gdispImage *img, gdispImageRowSink *sink) {
+		const pixel_t	*direct;
+		coord_t			my;
+		size_t			len;
+
+		if (img->priv->version == 2) {
+			const uint8_t *		direct2;
+			const pixel_t *		p;
+			gdispImageError		err;
+
+			direct2 = getDirectV2(img);
+			for(my = 0; my <= sink->last; my++) {
+				if (!gdispImageRowNeeded(sink, my))
+					continue;
+				if ((err = getRowV2(img, direct2, my, img->width, &p)))
+					return err;
+				if (!sink->row(sink, my, p))
+					break;
+			}
+			return GDISP_IMAGE_ERR_OK;
+		}
+
+		direct = getDirect(img);
+		len = img->width * sizeof(pixel_t);
+
+		/* Every line is the same size so we can go straight to the lines we need */
+		for(my = 0; my <= sink->last; my++) {
+			if (!gdispImageRowNeeded(sink, my))
+				continue;
+			if (direct) {
+				if (!sink->row(sink, my, direct + my * img->width))
+					break;
+				continue;
+			}
+			img->io.fns->seek(&img->io, FRAME0POS + my * len);
+			if (img->io.fns->read(&img->io, sink->buf, len) != len)
+				return GDISP_IMAGE_ERR_BADDATA;
+			if (!sink->row(sink, my, sink->buf))
+				break;
+		}
+		return GDISP_IMAGE_ERR_OK;
+	}
+#endif
+
 delaytime_t gdispImageNext_NATIVE(gdispImage *img) {
 	(void) img;
 
@@ -8,12 +8,945 @@
 /**
  * @file    src/gdisp/image_png.c
  * @brief   GDISP native image code.
+ *
+ * @defgroup Image Image
+ * @ingroup GDISP
  */
 #include "gfx.h"
 
 #if GFX_USE_GDISP && GDISP_NEED_IMAGE && GDISP_NEED_IMAGE_PNG
 
-#error "PNG support not implemented yet"
+#include <string.h>
+
+#ifndef GDISP_NEED_IMAGE_PNG_INTERLACED
+	#define GDISP_NEED_IMAGE_PNG_INTERLACED	TRUE
+#endif
+
+/**
+ * Helper Routines Needed
+ */
+void *gdispImageAlloc(gdispImage *img, size_t sz);
+void gdispImageFree(gdispImage *img, void *ptr, size_t sz);
+#if GDISP_NEED_IMAGE_ALPHA
+	void gdispImageBlitAlpha(coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t srcx, coord_t srcy, coord_t srccx, const pixel_t *buffer, const uint8_t *alpha, color_t bgcolor);
+#endif
+
+/**
+ * How big a pixel array to allocate for blitting (in pixels)
+ * Bigger is faster but uses more RAM.
+ */
+#define BLIT_BUFFER_SIZE	32
+
+/**
+ * How many bytes of compressed data to read from the file at a time
+ */
+#define PNG_INPUT_SIZE		64
+
+// PNG color types
+#define PNG_COLOR_GREY			0
+#define PNG_COLOR_RGB			2
+#define PNG_COLOR_PALETTE		3
+#define PNG_COLOR_GREYALPHA		4
+#define PNG_COLOR_RGBALPHA		6
+
+// The inflate states
+#define INFLATE_HEADER			0		// Waiting for a block header
+#define INFLATE_STORED			1		// In a stored block
+#define INFLATE_HUFFMAN			2		// In a huffman coded block
+
+// Length and distance codes (RFC1951)
+static const uint16_t lenBase[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+		};
+static const uint8_t lenExtra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+		};
+static const uint16_t distBase[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+		};
+static const uint8_t distExtra[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+		};
+static const uint8_t codeOrder[19] = {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+		};
+
+#if GDISP_NEED_IMAGE_PNG_INTERLACED
+	// The Adam7 interlace passes - x start, y start, x step, y step
+	static const uint8_t adam7[7][4] = {
+			{ 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 },
+			{ 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 }
+			};
+#endif
+
+// Structure for decoding the image data. It only exists while decoding.
+typedef struct pngdecode {
+	// The input
+	uint32_t	chunkleft;								// Bytes left in the current IDAT chunk
+	uint16_t	ipos, ilen;								// Position and length of the data in ibuf
+	uint8_t		ibuf[PNG_INPUT_SIZE];					// Compressed data read from the file
+	uint32_t	bitbuf;									// Bits not yet used
+	uint8_t		bitcnt;									// The number of bits in bitbuf
+	// Inflate
+	uint8_t		state;									// INFLATE_xxx
+	uint8_t		final;									// The current block is the last one
+	uint16_t	storedleft;								// Bytes left in a stored block
+	uint16_t	copylen;								// Bytes left to copy from the window
+	uint16_t	copydist;								// The distance back in the window to copy from
+	uint16_t	wpos;									// The window position
+	uint16_t	wmask;									// The window size - 1
+	uint8_t *	window;									// The sliding window
+	uint16_t	lencnt[16], lensym[288];				// The literal/length huffman table
+	uint16_t	distcnt[16], distsym[30];				// The distance huffman table
+	uint8_t		lens[288+32];							// Code lengths while building the tables
+	// Unfiltering
+	size_t		rowbytes;								// The maximum bytes in a row
+	uint8_t *	row;									// The current row
+	uint8_t *	prev;									// The previous row
+} pngdecode;
+
+typedef struct gdispImagePrivate {
+	uint8_t		bitdepth;						// Bits per sample
+	uint8_t		colortype;						// PNG_COLOR_xxx
+	uint8_t		bpp;							// Bytes per complete pixel (at least 1) for unfiltering
+	uint8_t		flags;
+		#define PNG_INTERLACED		0x01		// Adam7 interlaced
+		#define PNG_TRNS			0x02		// Has a transparent color key (grey and RGB)
+	uint16_t	palsize;						// The number of palette entries
+	uint8_t		*palette;						// Palette as R, G, B, A
+	uint16_t	trns[3];						// The transparent color key
+	size_t		frame0pos;						// The position of the first IDAT chunk
+	pixel_t		*frame0cache;					// The decoded image (if cached)
+	pixel_t		buf[BLIT_BUFFER_SIZE];			// Buffer for blitting
+#if GDISP_NEED_IMAGE_ALPHA
+	uint8_t		alpha[BLIT_BUFFER_SIZE];		// The alpha values for the blitting buffer
+#endif
+	} gdispImagePrivate;
+
+static uint32_t getBE32(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/*-----------------------------------------------------------------
+ * Compressed input - the concatenated data of the IDAT chunks
+ *---------------------------------------------------------------*/
+
+static int getByte(gdispImage *img, pngdecode *decode) {
+	uint8_t		hdr[12];
+	size_t		len;
+
+	if (decode->ipos >= decode->ilen) {
+		// Move to the next IDAT chunk if this one is used up (skipping the CRC)
+		while (!decode->chunkleft) {
+			if (img->io.fns->read(&img->io, hdr, 12) != 12 || hdr[8] != 'I' || hdr[9] != 'D' || hdr[10] != 'A' || hdr[11] != 'T')
+				return -1;
+			decode->chunkleft = getBE32(hdr+4);
+		}
+		len = decode->chunkleft > PNG_INPUT_SIZE ? PNG_INPUT_SIZE : decode->chunkleft;
+		if (img->io.fns->read(&img->io, decode->ibuf, len) != len)
+			return -1;
+		decode->chunkleft -= len;
+		decode->ilen = len;
+		decode->ipos = 0;
+	}
+	return decode->ibuf[decode->ipos++];
+}
+
+static int getBits(gdispImage *img, pngdecode *decode, uint8_t cnt) {
+	int		b;
+	int		val;
+
+	while(decode->bitcnt < cnt) {
+		if ((b = getByte(img, decode)) < 0)
+			return -1;
+		decode->bitbuf |= (uint32_t)b << decode->bitcnt;
+		decode->bitcnt += 8;
+	}
+	val = decode->bitbuf & ((1UL << cnt) - 1);
+	decode->bitbuf >>= cnt;
+	decode->bitcnt -= cnt;
+	return val;
+}
+
+/*-----------------------------------------------------------------
+ * Inflate (RFC1950 & RFC1951)
+ *---------------------------------------------------------------*/
+
+// Build a canonical huffman table from the code lengths. Returns FALSE for an over-subscribed code.
+static bool_t buildHuffman(uint16_t *cnt, uint16_t *sym, const uint8_t *lens, unsigned n) {
+	uint16_t	offs[16];
+	unsigned	len, s;
+	int			left;
+
+	for(len = 0; len < 16; len++)
+		cnt[len] = 0;
+	for(s = 0; s < n; s++)
+		cnt[lens[s]]++;
+	for(left = 1, len = 1; len < 16; len++) {
+		left = (left << 1) - cnt[len];
+		if (left < 0)
+			return FALSE;
+	}
+	for(offs[1] = 0, len = 1; len < 15; len++)
+		offs[len+1] = offs[len] + cnt[len];
+	for(s = 0; s < n; s++) {
+		if (lens[s])
+			sym[offs[lens[s]]++] = s;
+	}
+	return TRUE;
+}
+
+// Decode one huffman symbol. Returns -1 on error.
+static int getSymbol(gdispImage *img, pngdecode *decode, const uint16_t *cnt, const uint16_t *sym) {
+	int		code, first, index, count, b;
+	uint8_t	len;
+
+	code = first = index = 0;
+	for(len = 1; len < 16; len++) {
+		if (!decode->bitcnt) {
+			if ((b = getByte(img, decode)) < 0)
+				return -1;
+			decode->bitbuf = b;
+			decode->bitcnt = 8;
+		}
+		code |= decode->bitbuf & 1;
+		decode->bitbuf >>= 1;
+		decode->bitcnt--;
+		count = cnt[len];
+		if (code - count < first)
+			return sym[index + (code - first)];
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+static bool_t startBlock(gdispImage *img, pngdecode *decode) {
+	int			nlen, ndist, ncode, i, sym, rep;
+	uint8_t		val;
+
+	if (decode->final)
+		return FALSE;						// We need more data but there is no more
+	if ((i = getBits(img, decode, 3)) < 0)
+		return FALSE;
+	decode->final = i & 1;
+
+	switch(i >> 1) {
+	case 0:									// Stored
+		decode->bitbuf = 0;
+		decode->bitcnt = 0;
+		if ((i = getBits(img, decode, 16)) < 0 || (nlen = getBits(img, decode, 16)) < 0 || (i ^ 0xFFFF) != nlen)
+			return FALSE;
+		decode->storedleft = i;
+		decode->state = INFLATE_STORED;
+		return TRUE;
+
+	case 1:									// Fixed huffman codes
+		for(i = 0; i < 144; i++)	decode->lens[i] = 8;
+		for(; i < 256; i++)			decode->lens[i] = 9;
+		for(; i < 280; i++)			decode->lens[i] = 7;
+		for(; i < 288; i++)			decode->lens[i] = 8;
+		for(i = 0; i < 30; i++)		decode->lens[288+i] = 5;
+		buildHuffman(decode->lencnt, decode->lensym, decode->lens, 288);
+		buildHuffman(decode->distcnt, decode->distsym, decode->lens+288, 30);
+		decode->state = INFLATE_HUFFMAN;
+		return TRUE;
+
+	case 2:									// Dynamic huffman codes
+		if ((nlen = getBits(img, decode, 5)) < 0 || (ndist = getBits(img, decode, 5)) < 0 || (ncode = getBits(img, decode, 4)) < 0)
+			return FALSE;
+		nlen += 257;
+		ndist += 1;
+		ncode += 4;
+		if (nlen > 286 || ndist > 30)
+			return FALSE;
+
+		// The code length code lengths - temporarily use the literal table to decode them
+		for(i = 0; i < 19; i++)
+			decode->lens[codeOrder[i]] = 0;
+		for(i = 0; i < ncode; i++) {
+			if ((sym = getBits(img, decode, 3)) < 0)
+				return FALSE;
+			decode->lens[codeOrder[i]] = sym;
+		}
+		if (!buildHuffman(decode->lencnt, decode->lensym, decode->lens, 19))
+			return FALSE;
+
+		// The literal/length and distance code lengths
+		for(i = 0; i < nlen + ndist; ) {
+			if ((sym = getSymbol(img, decode, decode->lencnt, decode->lensym)) < 0)
+				return FALSE;
+			if (sym < 16) {
+				decode->lens[i++] = sym;
+				continue;
+			}
+			val = 0;
+			if (sym == 16) {
+				if (!i || (rep = getBits(img, decode, 2)) < 0)
+					return FALSE;
+				val = decode->lens[i-1];
+				rep += 3;
+			} else if (sym == 17) {
+				if ((rep = getBits(img, decode, 3)) < 0)
+					return FALSE;
+				rep += 3;
+			} else {
+				if ((rep = getBits(img, decode, 7)) < 0)
+					return FALSE;
+				rep += 11;
+			}
+			if (i + rep > nlen + ndist)
+				return FALSE;
+			while(rep--)
+				decode->lens[i++] = val;
+		}
+		if (!decode->lens[256])				// There must be an end of block code
+			return FALSE;
+		if (!buildHuffman(decode->lencnt, decode->lensym, decode->lens, nlen)
+				|| !buildHuffman(decode->distcnt, decode->distsym, decode->lens+nlen, ndist))
+			return FALSE;
+		decode->state = INFLATE_HUFFMAN;
+		return TRUE;
+
+	default:
+		return FALSE;
+	}
+}
+
+// Get the next len bytes of decompressed data
+static bool_t inflate(gdispImage *img, pngdecode *decode, uint8_t *pd, size_t len) {
+	int			sym, b;
+	uint8_t		c;
+
+	while(len) {
+		// Copy any match that is still in progress
+		if (decode->copylen) {
+			do {
+				c = decode->window[(decode->wpos - decode->copydist) & decode->wmask];
+				decode->window[decode->wpos] = c;
+				decode->wpos = (decode->wpos + 1) & decode->wmask;
+				*pd++ = c;
+				decode->copylen--;
+			} while(--len && decode->copylen);
+			continue;
+		}
+
+		switch(decode->state) {
+		case INFLATE_HEADER:
+			if (!startBlock(img, decode))
+				return FALSE;
+			break;
+
+		case INFLATE_STORED:
+			if (!decode->storedleft) {
+				decode->state = INFLATE_HEADER;
+				break;
+			}
+			if ((b = getByte(img, decode)) < 0)
+				return FALSE;
+			decode->storedleft--;
+			decode->window[decode->wpos] = b;
+			decode->wpos = (decode->wpos + 1) & decode->wmask;
+			*pd++ = b;
+			len--;
+			break;
+
+		case INFLATE_HUFFMAN:
+			if ((sym = getSymbol(img, decode, decode->lencnt, decode->lensym)) < 0)
+				return FALSE;
+			if (sym < 256) {
+				decode->window[decode->wpos] = sym;
+				decode->wpos = (decode->wpos + 1) & decode->wmask;
+				*pd++ = sym;
+				len--;
+				break;
+			}
+			if (sym == 256) {
+				decode->state = INFLATE_HEADER;
+				break;
+			}
+			sym -= 257;
+			if (sym >= 29 || (b = getBits(img, decode, lenExtra[sym])) < 0)
+				return FALSE;
+			decode->copylen = lenBase[sym] + b;
+			if ((sym = getSymbol(img, decode, decode->distcnt, decode->distsym)) < 0 || sym >= 30
+					|| (b = getBits(img, decode, distExtra[sym])) < 0)
+				return FALSE;
+			decode->copydist = distBase[sym] + b;
+			if (decode->copydist > (uint32_t)decode->wmask + 1)
+				return FALSE;
+			break;
+		}
+	}
+	return TRUE;
+}
+
+// The number of bytes in a row of w pixels
+static size_t rowBytes(gdispImagePrivate *priv, coord_t w) {
+	unsigned	samples;
+
+	switch(priv->colortype) {
+	case PNG_COLOR_RGB:			samples = 3;	break;
+	case PNG_COLOR_GREYALPHA:	samples = 2;	break;
+	case PNG_COLOR_RGBALPHA:	samples = 4;	break;
+	default:					samples = 1;	break;
+	}
+	return ((size_t)w * samples * priv->bitdepth + 7) / 8;
+}
+
+/**
+ * Get ready for decoding the image data.
+ */
+static gdispImageError startDecode(gdispImage *img, pngdecode **pdecode) {
+	gdispImagePrivate *	priv;
+	pngdecode *			decode;
+	int					cmf, flg;
+	size_t				wsize;
+
+	priv = img->priv;
+	if (!(decode = (pngdecode *)gdispImageAlloc(img, sizeof(pngdecode))))
+		return GDISP_IMAGE_ERR_NOMEMORY;
+	decode->window = 0;
+	decode->chunkleft = 0;
+	decode->ipos = decode->ilen = 0;
+	decode->bitbuf = 0;
+	decode->bitcnt = 0;
+	decode->state = INFLATE_HEADER;
+	decode->final = 0;
+	decode->copylen = 0;
+	decode->wpos = 0;
+
+	decode->rowbytes = rowBytes(priv, img->width);
+
+	// The zlib header tells us how big a window we need
+	img->io.fns->seek(&img->io, priv->frame0pos);
+	if ((cmf = getByte(img, decode)) < 0 || (flg = getByte(img, decode)) < 0
+			|| (cmf & 0x0F) != 8 || (cmf >> 4) > 7 || ((cmf << 8) | flg) % 31 || (flg & 0x20)) {
+		gdispImageFree(img, decode, sizeof(pngdecode));
+		return GDISP_IMAGE_ERR_BADDATA;
+	}
+	wsize = (size_t)1 << ((cmf >> 4) + 8);
+	decode->wmask = wsize - 1;
+
+	// The window and the two rows
+	if (!(decode->window = (uint8_t *)gdispImageAlloc(img, wsize + 2*decode->rowbytes))) {
+		gdispImageFree(img, decode, sizeof(pngdecode));
+		return GDISP_IMAGE_ERR_NOMEMORY;
+	}
+	decode->row = decode->window + wsize;
+	decode->prev = decode->row + decode->rowbytes;
+
+	*pdecode = decode;
+	return GDISP_IMAGE_ERR_OK;
+}
+
+static void stopDecode(gdispImage *img, pngdecode *decode) {
+	gdispImageFree(img, decode->window, decode->wmask + 1 + 2*decode->rowbytes);
+	gdispImageFree(img, decode, sizeof(pngdecode));
+}
+
+/*-----------------------------------------------------------------
+ * Rows
+ *---------------------------------------------------------------*/
+
+// Inflate and unfilter the next row. The previous row must be zero at the start of a pass.
+static bool_t getRow(gdispImage *img, pngdecode *decode, size_t len) {
+	uint8_t		*row, *prev, *tmp;
+	uint8_t		filter;
+	size_t		i;
+	unsigned	bpp;
+	int			p, pa, pb, pc;
+
+	// Swap the rows so the last one becomes the previous
+	tmp = decode->prev;
+	decode->prev = decode->row;
+	decode->row = tmp;
+	row = decode->row;
+	prev = decode->prev;
+	bpp = img->priv->bpp;
+
+	if (!inflate(img, decode, &filter, 1) || !inflate(img, decode, row, len))
+		return FALSE;
+
+	switch(filter) {
+	case 0:		// None
+		break;
+	case 1:		// Sub
+		for(i = bpp; i < len; i++)
+			row[i] += row[i-bpp];
+		break;
+	case 2:		// Up
+		for(i = 0; i < len; i++)
+			row[i] += prev[i];
+		break;
+	case 3:		// Average
+		for(i = 0; i < bpp; i++)
+			row[i] += prev[i] >> 1;
+		for(; i < len; i++)
+			row[i] += (row[i-bpp] + prev[i]) >> 1;
+		break;
+	case 4:		// Paeth
+		for(i = 0; i < bpp; i++)
+			row[i] += prev[i];
+		for(; i < len; i++) {
+			p = row[i-bpp] + prev[i] - prev[i-bpp];
+			pa = p > row[i-bpp] ? p - row[i-bpp] : row[i-bpp] - p;
+			pb = p > prev[i] ? p - prev[i] : prev[i] - p;
+			pc = p > prev[i-bpp] ? p - prev[i-bpp] : prev[i-bpp] - p;
+			if (pa <= pb && pa <= pc)
+				row[i] += row[i-bpp];
+			else if (pb <= pc)
+				row[i] += prev[i];
+			else
+				row[i] += prev[i-bpp];
+		}
+		break;
+	default:
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Get the color of a pixel. If pa is set the alpha is returned there,
+ * otherwise the pixel is blended with the image background color.
+ */
+static color_t blendPixel(gdispImage *img, uint8_t r, uint8_t g, uint8_t b, uint8_t a, uint8_t *pa) {
+	if (pa) {
+		*pa = a;
+		return RGB2COLOR(r, g, b);
+	}
+	if (a == 255)
+		return RGB2COLOR(r, g, b);
+	if (!a)
+		return img->bgcolor;
+	return gdispBlendColor(RGB2COLOR(r, g, b), img->bgcolor, a);
+}
+
+// Convert pixel i of the current row
+static color_t getPixel(gdispImage *img, const uint8_t *row, coord_t i, uint8_t *pa) {
+	gdispImagePrivate *	priv;
+	const uint8_t *		p;
+	unsigned			v, bits;
+
+	priv = img->priv;
+	switch(priv->colortype) {
+	case PNG_COLOR_GREY:
+		if (priv->bitdepth == 16) {
+			p = row + 2*i;
+			return blendPixel(img, p[0], p[0], p[0], (priv->flags & PNG_TRNS) && ((p[0] << 8) | p[1]) == priv->trns[0] ? 0 : 255, pa);
+		}
+		bits = (unsigned)i * priv->bitdepth;
+		v = (row[bits >> 3] >> (8 - priv->bitdepth - (bits & 7))) & ((1 << priv->bitdepth) - 1);
+		if ((priv->flags & PNG_TRNS) && v == priv->trns[0])
+			return blendPixel(img, 0, 0, 0, 0, pa);
+		v = v * 255 / ((1 << priv->bitdepth) - 1);
+		return blendPixel(img, v, v, v, 255, pa);
+
+	case PNG_COLOR_RGB:
+		if (priv->bitdepth == 16) {
+			p = row + 6*i;
+			return blendPixel(img, p[0], p[2], p[4], (priv->flags & PNG_TRNS) && ((p[0] << 8) | p[1]) == priv->trns[0]
+					&& ((p[2] << 8) | p[3]) == priv->trns[1] && ((p[4] << 8) | p[5]) == priv->trns[2] ? 0 : 255, pa);
+		}
+		p = row + 3*i;
+		return blendPixel(img, p[0], p[1], p[2], (priv->flags & PNG_TRNS) && p[0] == priv->trns[0] && p[1] == priv->trns[1] && p[2] == priv->trns[2] ? 0 : 255, pa);
+
+	case PNG_COLOR_PALETTE:
+		bits = (unsigned)i * priv->bitdepth;
+		v = (row[bits >> 3] >> (8 - priv->bitdepth - (bits & 7))) & ((1 << priv->bitdepth) - 1);
+		if (v >= priv->palsize)
+			v = 0;
+		p = priv->palette + 4*v;
+		return blendPixel(img, p[0], p[1], p[2], p[3], pa);
+
+	case PNG_COLOR_GREYALPHA:
+		if (priv->bitdepth == 16) {
+			p = row + 4*i;
+			return blendPixel(img, p[0], p[0], p[0], p[2], pa);
+		}
+		p = row + 2*i;
+		return blendPixel(img, p[0], p[0], p[0], p[1], pa);
+
+	case PNG_COLOR_RGBALPHA:
+	default:
+		if (priv->bitdepth == 16) {
+			p = row + 8*i;
+			return blendPixel(img, p[0], p[2], p[4], p[6], pa);
+		}
+		p = row + 4*i;
+		return blendPixel(img, p[0], p[1], p[2], p[3], pa);
+	}
+}
+
+/**
+ * Decode the image area sx,sy,cx,cy. It is drawn at x,y or, if cache is set, stored in the cache.
+ * If sink is set the needed rows are passed to it instead.
+ */
+static gdispImageError decodeImage(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy, pixel_t *cache, gdispImageRowSink *sink) {
+	gdispImagePrivate *	priv;
+	pngdecode *			decode;
+	gdispImageError		err;
+	coord_t				my, mx, len, i;
+	size_t				rb;
+	uint8_t *			pa;
+	uint8_t *			calpha;
+
+	priv = img->priv;
+
+	// Where the alpha values go (if we are keeping them)
+	pa = 0;
+	calpha = 0;
+	#if GDISP_NEED_IMAGE_ALPHA
+		if (gdispImageHasAlpha(img)) {
+			pa = priv->alpha;
+			if (cache)
+				calpha = (uint8_t *)(cache + img->width * img->height);
+		}
+	#endif
+
+	// Interlaced rows arrive in pieces so they can't be passed on one at a time
+	if (sink && (priv->flags & PNG_INTERLACED))
+		return GDISP_IMAGE_ERR_UNSUPPORTED;
+
+	if ((err = startDecode(img, &decode)))
+		return err;
+	err = GDISP_IMAGE_ERR_OK;
+
+	#if GDISP_NEED_IMAGE_PNG_INTERLACED
+		if ((priv->flags & PNG_INTERLACED)) {
+			coord_t		pass, pw, ph, px, py, dx, dy, j;
+
+			// Each pass is a reduced image - draw its pixels where they belong
+			for(pass = 0; pass < 7; pass++) {
+				px = adam7[pass][0]; py = adam7[pass][1];
+				dx = adam7[pass][2]; dy = adam7[pass][3];
+				pw = (img->width - px + dx - 1) / dx;
+				ph = (img->height - py + dy - 1) / dy;
+				if (pw <= 0 || ph <= 0)
+					continue;
+				rb = rowBytes(priv, pw);
+				memset(decode->row, 0, rb);
+				for(j = 0; j < ph; j++) {
+					if (!getRow(img, decode, rb)) {
+						err = GDISP_IMAGE_ERR_BADDATA;
+						goto done;
+					}
+					my = py + j*dy;
+					if (my < sy || my >= sy+cy)
+						continue;
+					for(i = 0, mx = px; i < pw; i++, mx += dx) {
+						if (mx < sx || mx >= sx+cx)
+							continue;
+						if (cache) {
+							cache[my*img->width + mx] = getPixel(img, decode->row, i, calpha ? calpha + my*img->width + mx : 0);
+							continue;
+						}
+						priv->buf[0] = getPixel(img, decode->row, i, pa);
+						#if GDISP_NEED_IMAGE_ALPHA
+							if (pa) {
+								gdispImageBlitAlpha(x+mx-sx, y+my-sy, 1, 1, 0, 0, 1, priv->buf, pa, img->bgcolor);
+								continue;
+							}
+						#endif
+						gdispDrawPixel(x+mx-sx, y+my-sy, priv->buf[0]);
+					}
+				}
+			}
+			goto done;
+		}
+	#endif
+
+	// Rows above the area must still be inflated and unfiltered but we stop after the last row
+	rb = rowBytes(priv, img->width);
+	memset(decode->row, 0, rb);
+	for(my = 0; my < sy+cy; my++) {
+		if (!getRow(img, decode, rb)) {
+			err = GDISP_IMAGE_ERR_BADDATA;
+			break;
+		}
+		if (my < sy)
+			continue;
+		#if GDISP_NEED_IMAGE_SCALING
+			if (sink) {
+				if (gdispImageRowNeeded(sink, my)) {
+					for(mx = 0; mx < img->width; mx++)
+						sink->buf[mx] = getPixel(img, decode->row, mx, 0);
+					if (!sink->row(sink, my, sink->buf))
+						break;
+				}
+				continue;
+			}
+		#endif
+		if (cache) {
+			for(mx = 0; mx < img->width; mx++)
+				*cache++ = getPixel(img, decode->row, mx, calpha ? calpha++ : 0);
+			continue;
+		}
+		for(mx = sx; mx < sx+cx; mx += len) {
+			len = sx+cx-mx > BLIT_BUFFER_SIZE ? BLIT_BUFFER_SIZE : sx+cx-mx;
+			for(i = 0; i < len; i++)
+				priv->buf[i] = getPixel(img, decode->row, mx+i, pa ? pa+i : 0);
+			#if GDISP_NEED_IMAGE_ALPHA
+				if (pa) {
+					gdispImageBlitAlpha(x+mx-sx, y+my-sy, len, 1, 0, 0, len, priv->buf, pa, img->bgcolor);
+					continue;
+				}
+			#endif
+			if (len == 1)
+				gdispDrawPixel(x+mx-sx, y+my-sy, priv->buf[0]);
+			else
+				gdispBlitAreaEx(x+mx-sx, y+my-sy, len, 1, 0, 0, len, priv->buf);
+		}
+	}
+
+#if GDISP_NEED_IMAGE_PNG_INTERLACED
+done:
+#endif
+	stopDecode(img, decode);
+	return err;
+}
+
+gdispImageError gdispImageOpen_PNG(gdispImage *img) {
+	gdispImagePrivate *priv;
+	uint8_t		buf[13];
+	uint32_t	len, i;
+	size_t		pos;
+
+	/* Read the file identifier */
+	if (img->io.fns->read(&img->io, buf, 8) != 8)
+		return GDISP_IMAGE_ERR_BADFORMAT;		// It can't be us
+	if (buf[0] != 0x89 || buf[1] != 'P' || buf[2] != 'N' || buf[3] != 'G' || buf[4] != 0x0D || buf[5] != 0x0A || buf[6] != 0x1A || buf[7] != 0x0A)
+		return GDISP_IMAGE_ERR_BADFORMAT;		// It can't be us
+
+	/* The IHDR chunk must be first */
+	if (img->io.fns->read(&img->io, buf, 8) != 8 || getBE32(buf) != 13 || buf[4] != 'I' || buf[5] != 'H' || buf[6] != 'D' || buf[7] != 'R')
+		return GDISP_IMAGE_ERR_BADFORMAT;
+	if (img->io.fns->read(&img->io, buf, 13) != 13)
+		return GDISP_IMAGE_ERR_BADDATA;
+
+	/* We know we are a PNG format image */
+	img->flags = 0;
+
+	/* Allocate our private area */
+	if (!(img->priv = (gdispImagePrivate *)gdispImageAlloc(img, sizeof(gdispImagePrivate))))
+		return GDISP_IMAGE_ERR_NOMEMORY;
+
+	/* Initialise the essential bits in the private area */
+	priv = img->priv;
+	priv->frame0cache = 0;
+	priv->palette = 0;
+	priv->palsize = 0;
+	priv->flags = 0;
+
+	/* Process the header */
+	if (getBE32(buf) > 32767 || getBE32(buf+4) > 32767 || !getBE32(buf) || !getBE32(buf+4))
+		goto unsupportedcleanup;
+	img->width = getBE32(buf);
+	img->height = getBE32(buf+4);
+	priv->bitdepth = buf[8];
+	priv->colortype = buf[9];
+	if (buf[10] || buf[11])						// Compression and filter method
+		goto unsupportedcleanup;
+	switch(buf[12]) {
+	case 0:
+		break;
+	#if GDISP_NEED_IMAGE_PNG_INTERLACED
+		case 1:
+			priv->flags |= PNG_INTERLACED;
+			break;
+	#endif
+	default:
+		goto unsupportedcleanup;
+	}
+	switch(priv->colortype) {
+	case PNG_COLOR_GREY:
+		if (priv->bitdepth != 1 && priv->bitdepth != 2 && priv->bitdepth != 4 && priv->bitdepth != 8 && priv->bitdepth != 16)
+			goto unsupportedcleanup;
+		priv->bpp = priv->bitdepth == 16 ? 2 : 1;
+		break;
+	case PNG_COLOR_PALETTE:
+		if (priv->bitdepth != 1 && priv->bitdepth != 2 && priv->bitdepth != 4 && priv->bitdepth != 8)
+			goto unsupportedcleanup;
+		priv->bpp = 1;
+		break;
+	case PNG_COLOR_RGB:
+	case PNG_COLOR_GREYALPHA:
+	case PNG_COLOR_RGBALPHA:
+		if (priv->bitdepth != 8 && priv->bitdepth != 16)
+			goto unsupportedcleanup;
+		priv->bpp = rowBytes(priv, 1);
+		if (priv->colortype != PNG_COLOR_RGB)
+			img->flags |= GDISP_IMAGE_FLG_TRANSPARENT;
+		break;
+	default:
+		goto unsupportedcleanup;
+	}
+	img->io.fns->seek(&img->io, img->io.pos + 4);		// Skip the CRC
+
+	/* Process the chunks up to the image data */
+	while(1) {
+		if (img->io.fns->read(&img->io, buf, 8) != 8)
+			goto baddatacleanup;
+		len = getBE32(buf);
+		pos = img->io.pos;
+
+		if (buf[4] == 'I' && buf[5] == 'D' && buf[6] == 'A' && buf[7] == 'T') {
+			// Point at the CRC of the previous chunk so every IDAT chunk is read the same way
+			priv->frame0pos = pos - 12;
+			break;
+		}
+
+		if (buf[4] == 'I' && buf[5] == 'E' && buf[6] == 'N' && buf[7] == 'D')
+			goto baddatacleanup;
+
+		if (buf[4] == 'P' && buf[5] == 'L' && buf[6] == 'T' && buf[7] == 'E') {
+			// A palette is only needed for a palette image. Others may have a suggested palette we don't need.
+			if (priv->colortype == PNG_COLOR_PALETTE && !priv->palette) {
+				if (len % 3 || len > 3*256 || !len)
+					goto baddatacleanup;
+				priv->palsize = len / 3;
+				if (!(priv->palette = (uint8_t *)gdispImageAlloc(img, 4*priv->palsize)))
+					goto nomemcleanup;
+				for(i = 0; i < priv->palsize; i++) {
+					if (img->io.fns->read(&img->io, priv->palette+4*i, 3) != 3)
+						goto baddatacleanup;
+					priv->palette[4*i+3] = 255;
+				}
+			}
+
+		} else if (buf[4] == 't' && buf[5] == 'R' && buf[6] == 'N' && buf[7] == 'S') {
+			switch(priv->colortype) {
+			case PNG_COLOR_PALETTE:
+				// Alpha values for the first palette entries
+				if (!priv->palette || len > priv->palsize)
+					goto baddatacleanup;
+				for(i = 0; i < len; i++) {
+					if (img->io.fns->read(&img->io, priv->palette+4*i+3, 1) != 1)
+						goto baddatacleanup;
+				}
+				img->flags |= GDISP_IMAGE_FLG_TRANSPARENT;
+				break;
+			case PNG_COLOR_GREY:
+			case PNG_COLOR_RGB:
+				// A single transparent color
+				if (len != (priv->colortype == PNG_COLOR_GREY ? 2U : 6U) || img->io.fns->read(&img->io, buf, len) != len)
+					goto baddatacleanup;
+				for(i = 0; i < len/2; i++)
+					priv->trns[i] = (buf[2*i] << 8) | buf[2*i+1];
+				priv->flags |= PNG_TRNS;
+				img->flags |= GDISP_IMAGE_FLG_TRANSPARENT;
+				break;
+			default:
+				break;
+			}
+		}
+
+		// Move to the next chunk (skipping the CRC)
+		img->io.fns->seek(&img->io, pos + len + 4);
+	}
+
+	if (priv->colortype == PNG_COLOR_PALETTE && !priv->palette)
+		goto baddatacleanup;
+
+	img->type = GDISP_IMAGE_TYPE_PNG;
+	return GDISP_IMAGE_ERR_OK;
+
+nomemcleanup:
+	gdispImageClose_PNG(img);				// Clean up the private data area
+	return GDISP_IMAGE_ERR_NOMEMORY;		// Out of memory
+
+baddatacleanup:
+	gdispImageClose_PNG(img);				// Clean up the private data area
+	return GDISP_IMAGE_ERR_BADDATA;			// Oops - something wrong
+
+unsupportedcleanup:
+	gdispImageClose_PNG(img);				// Clean up the private data area
+	return GDISP_IMAGE_ERR_UNSUPPORTED;		// Not supported
+}
+
+void gdispImageClose_PNG(gdispImage *img) {
+	if (img->priv) {
+		if (img->priv->palette)
+			gdispImageFree(img, (void *)img->priv->palette, 4*img->priv->palsize);
+		if (img->priv->frame0cache)
+			gdispImageFree(img, (void *)img->priv->frame0cache, img->width*img->height*(sizeof(pixel_t) + (gdispImageHasAlpha(img) ? 1 : 0)));
+		gdispImageFree(img, (void *)img->priv, sizeof(gdispImagePrivate));
+		img->priv = 0;
+	}
+	img->io.fns->close(&img->io);
+}
+
+gdispImageError gdispImageDecode_PNG(gdispImage *img, pixel_t *buf) {
+	return decodeImage(img, 0, 0, img->width, img->height, 0, 0, buf, 0);
+}
+
+gdispImageError gdispImageCache_PNG(gdispImage *img) {
+	gdispImagePrivate *	priv;
+	gdispImageError		err;
+	size_t				len;
+
+	/* If we are already cached - just return OK */
+	priv = img->priv;
+	if (priv->frame0cache)
+		return GDISP_IMAGE_ERR_OK;
+
+	/* We need to allocate the cache */
+	len = img->width * img->height * (sizeof(pixel_t) + (gdispImageHasAlpha(img) ? 1 : 0));
+	priv->frame0cache = (pixel_t *)gdispImageAlloc(img, len);
+	if (!priv->frame0cache)
+		return GDISP_IMAGE_ERR_NOMEMORY;
+
+	/* Decode the entire image into the cache */
+	if ((err = gdispImageDecode_PNG(img, priv->frame0cache))) {
+		gdispImageFree(img, (void *)priv->frame0cache, len);
+		priv->frame0cache = 0;
+	}
+	return err;
+}
+
+gdispImageError gdispImageDraw_PNG(gdispImage *img, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy) {
+	gdispImagePrivate *	priv;
+
+	priv = img->priv;
+
+	/* Check some reasonableness */
+	if (sx >= img->width || sy >= img->height) return GDISP_IMAGE_ERR_OK;
+	if (sx + cx > img->width) cx = img->width - sx;
+	if (sy + cy > img->height) cy = img->height - sy;
+
+	/* Draw from the image cache - if it exists */
+	if (priv->frame0cache) {
+		#if GDISP_NEED_IMAGE_ALPHA
+			if (gdispImageHasAlpha(img)) {
+				gdispImageBlitAlpha(x, y, cx, cy, sx, sy, img->width, priv->frame0cache, (const uint8_t *)(priv->frame0cache + img->width * img->height), img->bgcolor);
+				return GDISP_IMAGE_ERR_OK;
+			}
+		#endif
+		gdispBlitAreaEx(x, y, cx, cy, sx, sy, img->width, priv->frame0cache);
+		return GDISP_IMAGE_ERR_OK;
+	}
+
+	return decodeImage(img, x, y, cx, cy, sx, sy, 0, 0);
+}
+
+#if GDISP_NEED_IMAGE_SCALING
+	gdispImageError gdispImageRows_PNG(gdispImage *img, gdispImageRowSink *sink) {
+		return decodeImage(img, 0, 0, img->width, sink->last+1, 0, 0, 0, sink);
+	}
+#endif
+
+delaytime_t gdispImageNext_PNG(gdispImage *img) {
+	(void) img;
+
+	/* No more frames/pages */
+	return TIME_INFINITE;
+}
 
 #endif /* GFX_USE_GDISP && GDISP_NEED_IMAGE && GDISP_NEED_IMAGE_PNG */
 /** @} */
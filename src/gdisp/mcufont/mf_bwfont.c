@@ -12,17 +12,35 @@
 static const struct mf_bwfont_char_range_s *find_char_range(
     const struct mf_bwfont_s *font, uint16_t character, uint16_t *index_ret)
 {
-    unsigned i, index;
+    unsigned lo, hi, mid, index;
     const struct mf_bwfont_char_range_s *range;
-    for (i = 0; i < font->char_range_count; i++)
+    
+    /* The ranges are sorted by first_char. Try the first range on its own
+     * as it normally holds ASCII, then binary search the rest. */
+    lo = 0;
+    hi = font->char_range_count;
+    if (hi && character < font->char_ranges[0].first_char + font->char_ranges[0].char_count)
+        hi = 1;
+    
+    while (lo < hi)
     {
-        range = &font->char_ranges[i];
+        mid = (lo + hi) / 2;
+        range = &font->char_ranges[mid];
+        if (character < range->first_char)
+        {
+            hi = mid;
+            continue;
+        }
+        
         index = character - range->first_char;
-        if (character >= range->first_char && index < range->char_count)
+        if (index >= range->char_count)
         {
-            *index_ret = index;
-            return range;
+            lo = mid + 1;
+            continue;
         }
+        
+        *index_ret = index;
+        return range;
     }
     
     return 0;
@@ -23,6 +23,9 @@
 #endif
 
 #define MF_USE_KERNING GDISP_NEED_TEXT_KERNING
+#define MF_KERNING_CACHE_SIZE GDISP_TEXT_KERNING_CACHE_SIZE
+#define MF_KERNING_LOCK() gfxSystemLock()
+#define MF_KERNING_UNLOCK() gfxSystemUnlock()
 #define MF_FONT_FILE_NAME "../src/gdisp/fonts/fonts.h"
 
 /* These are not used for now */
@@ -146,6 +149,22 @@
 #define MF_KERNING_ZONES 16
 #endif
 
+/* Number of glyph edge profiles the kerning module keeps, so that the
+ * glyphs don't have to be rendered again for every character pair. Each
+ * entry takes 2 * MF_KERNING_ZONES bytes plus the key. Set to 0 to disable.
+ */
+#ifndef MF_KERNING_CACHE_SIZE
+#define MF_KERNING_CACHE_SIZE 32
+#endif
+
+/* Lock protecting the kerning profile cache when text is rendered from
+ * several threads. The lock is only held while an entry is copied.
+ */
+#ifndef MF_KERNING_LOCK
+#define MF_KERNING_LOCK()
+#define MF_KERNING_UNLOCK()
+#endif
+
 
 
 /* Add extern "C" when used from C++. */
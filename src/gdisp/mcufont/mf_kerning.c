@@ -10,41 +10,106 @@
 
 #if MF_USE_KERNING
 
-/* Structure for keeping track of the edge of the glyph as it is rendered. */
-struct kerning_state_s
+/* Structure holding the left and right edges of a glyph in each kerning
+ * zone, measured by rendering it once. */
+struct kerning_profile_s
 {
-    uint8_t edgepos[MF_KERNING_ZONES];
+    const struct mf_font_s *font;
+    mf_char character;
+    uint8_t width;
     uint8_t zoneheight;
+    uint8_t left[MF_KERNING_ZONES];
+    uint8_t right[MF_KERNING_ZONES];
 };
 
-/* Pixel callback for analyzing the left edge of a glyph. */
-static void fit_leftedge(int16_t x, int16_t y, uint8_t count, uint8_t alpha,
-                         void *state)
+/* Pixel callback for analyzing both edges of a glyph. */
+static void fit_edges(int16_t x, int16_t y, uint8_t count, uint8_t alpha,
+                      void *state)
 {
-    struct kerning_state_s *s = state;
+    struct kerning_profile_s *s = state;
     
     if (alpha > 7)
     {
         uint8_t zone = y / s->zoneheight;
-        if (x < s->edgepos[zone])
-            s->edgepos[zone] = x;
+        if (x < s->left[zone])
+            s->left[zone] = x;
+        x += count - 1;
+        if (x > s->right[zone])
+            s->right[zone] = x;
     }
 }
 
-/* Pixel callback for analyzing the right edge of a glyph. */
-static void fit_rightedge(int16_t x, int16_t y, uint8_t count, uint8_t alpha,
-                         void *state)
+/* Render a glyph to find its edges. */
+static void compute_profile(const struct mf_font_s *font, mf_char c,
+                            struct kerning_profile_s *p)
 {
-    struct kerning_state_s *s = state;
+    uint8_t i;
     
-    if (alpha > 7)
+    /* Compute the height of one kerning zone in pixels */
+    i = (font->height + MF_KERNING_ZONES - 1) / MF_KERNING_ZONES;
+    if (i < 1) i = 1;
+    
+    p->font = font;
+    p->character = c;
+    p->zoneheight = i;
+    for (i = 0; i < MF_KERNING_ZONES; i++)
     {
-        uint8_t zone = y / s->zoneheight;
-        x += count - 1;
-        if (x > s->edgepos[zone])
-            s->edgepos[zone] = x;
+        p->left[i] = 255;
+        p->right[i] = 0;
+    }
+    
+    p->width = mf_render_character(font, 0, 0, c, fit_edges, p);
+}
+
+#if MF_KERNING_CACHE_SIZE
+/* Direct mapped cache of recently used glyph profiles. */
+static struct kerning_profile_s kerning_cache[MF_KERNING_CACHE_SIZE];
+
+/* Get the profile of a glyph from the cache, measuring it on a miss. The
+ * lock is only held while copying so glyphs are never rendered under it. */
+static void get_profile(const struct mf_font_s *font, mf_char c,
+                        struct kerning_profile_s *p)
+{
+    struct kerning_profile_s *slot;
+    
+    slot = &kerning_cache[((size_t)font / sizeof(void*) + c) % MF_KERNING_CACHE_SIZE];
+    
+    MF_KERNING_LOCK();
+    if (slot->font == font && slot->character == c)
+    {
+        *p = *slot;
+        MF_KERNING_UNLOCK();
+        return;
+    }
+    MF_KERNING_UNLOCK();
+    
+    compute_profile(font, c, p);
+    
+    MF_KERNING_LOCK();
+    *slot = *p;
+    MF_KERNING_UNLOCK();
+}
+
+void mf_kerning_flush(const struct mf_font_s *font)
+{
+    unsigned i;
+    
+    MF_KERNING_LOCK();
+    for (i = 0; i < MF_KERNING_CACHE_SIZE; i++)
+    {
+        if (kerning_cache[i].font == font)
+            kerning_cache[i].font = 0;
     }
+    MF_KERNING_UNLOCK();
 }
+#else
+#define get_profile compute_profile
+
+void mf_kerning_flush(const struct mf_font_s *font)
+{
+    (void)font;
+}
+#endif
 
 /* Should kerning be done against this character? */
 static bool do_kerning(mf_char c)
@@ -68,7 +133,7 @@ static int16_t avg16(int16_t a, int16_t b) { return (a + b) / 2; }
 int8_t mf_compute_kerning(const struct mf_font_s *font,
                           mf_char c1, mf_char c2)
 {
-    struct kerning_state_s leftedge, rightedge;
+    struct kerning_profile_s leftedge, rightedge;
     uint8_t w1, w2, i, min_space;
     int16_t normal_space, adjust, max_adjust;
     
@@ -78,31 +143,21 @@ int8_t mf_compute_kerning(const struct mf_font_s *font,
     if (!do_kerning(c1) || !do_kerning(c2))
         return 0;
     
-    /* Compute the height of one kerning zone in pixels */
-    i = (font->height + MF_KERNING_ZONES - 1) / MF_KERNING_ZONES;
-    if (i < 1) i = 1;
-    
-    /* Initialize structures */
-    leftedge.zoneheight = rightedge.zoneheight = i;
-    for (i = 0; i < MF_KERNING_ZONES; i++)
-    {
-        leftedge.edgepos[i] = 255;
-        rightedge.edgepos[i] = 0;
-    }
-    
-    /* Analyze the edges of both glyphs. */
-    w1 = mf_render_character(font, 0, 0, c1, fit_rightedge, &rightedge);
-    w2 = mf_render_character(font, 0, 0, c2, fit_leftedge, &leftedge);
+    /* Get the edges of both glyphs. */
+    get_profile(font, c1, &rightedge);
+    get_profile(font, c2, &leftedge);
+    w1 = rightedge.width;
+    w2 = leftedge.width;
     
     /* Find the minimum horizontal space between the glyphs. */
     min_space = 255;
     for (i = 0; i < MF_KERNING_ZONES; i++)
     {
         uint8_t space;
-        if (leftedge.edgepos[i] == 255 || rightedge.edgepos[i] == 0)
+        if (leftedge.left[i] == 255 || rightedge.right[i] == 0)
             continue; /* Outside glyph area. */
         
-        space = w1 - rightedge.edgepos[i] + leftedge.edgepos[i];
+        space = w1 - rightedge.right[i] + leftedge.left[i];
         if (space < min_space)
             min_space = space;
     }
@@ -31,4 +31,15 @@ MF_EXTERN int8_t mf_compute_kerning(const struct mf_font_s *font,
 #define mf_compute_kerning(font, c1, c2)		0
 #endif
 
+/* Forget the glyph edges remembered for a font. Must be called before the
+ * memory of a font is released, as another font may later reuse it.
+ *
+ * font: Pointer to the font definition.
+ */
+#if MF_USE_KERNING
+MF_EXTERN void mf_kerning_flush(const struct mf_font_s *font);
+#else
+#define mf_kerning_flush(font)
+#endif
+
 #endif
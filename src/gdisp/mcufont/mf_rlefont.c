@@ -32,21 +32,40 @@
 /* Find a pointer to the glyph matching a given character by searching
  * through the character ranges. If the character is not found, return
  * pointer to the default glyph.
+ *
+ * The ranges are sorted by first_char, so they are binary searched. The
+ * first range is tried on its own first as it normally holds the ASCII
+ * characters that make up most text.
  */
 static const uint8_t *find_glyph(const struct mf_rlefont_s *font,
                                  uint16_t character)
 {
-   unsigned i, index;
+   unsigned lo, hi, mid, index;
    const struct mf_rlefont_char_range_s *range;
-   for (i = 0; i < font->char_range_count; i++)
+   
+   lo = 0;
+   hi = font->char_range_count;
+   if (hi && character < font->char_ranges[0].first_char + font->char_ranges[0].char_count)
+       hi = 1;
+   
+   while (lo < hi)
    {
-       range = &font->char_ranges[i];
+       mid = (lo + hi) / 2;
+       range = &font->char_ranges[mid];
+       if (character < range->first_char)
+       {
+           hi = mid;
+           continue;
+       }
+       
        index = character - range->first_char;
-       if (character >= range->first_char && index < range->char_count)
+       if (index >= range->char_count)
        {
-           uint16_t offset = range->glyph_offsets[index];
-           return &range->glyph_data[offset];
+           lo = mid + 1;
+           continue;
        }
+       
+       return &range->glyph_data[range->glyph_offsets[index]];
    }
 
    return 0;
@@ -19,6 +19,9 @@
 extern void _gosInit(void);
 #if GFX_USE_GDISP
 	extern void _gdispInit(void);
+	#if GDISP_NEED_IMAGE && GDISP_NEED_IMAGE_GLOBAL_CACHE
+		extern void _gdispImageInit(void);
+	#endif
 #endif
 #if GFX_USE_TDISP
 	extern void _tdispInit(void);
@@ -69,6 +72,9 @@ void gfxInit(void) {
 	#endif
 	#if GFX_USE_GDISP
 		_gdispInit();
+		#if GDISP_NEED_IMAGE && GDISP_NEED_IMAGE_GLOBAL_CACHE
+			_gdispImageInit();
+		#endif
 		gdispClear(Black);
 	#endif
 	#if GFX_USE_GWIN
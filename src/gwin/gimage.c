@@ -18,7 +18,115 @@
 
 #define widget(gh)	((GImageObject *)gh)
 
+#if GWIN_NEED_IMAGE_ASYNC
+	// How often (in milliseconds) the decoded parts of background draws are put on the display
+	#define GIMAGE_ASYNC_PERIOD		20
+
+	// The image windows with a background draw in progress. One timer draws them all and only touches
+	//	windows on this list (with the mutex held) so a window can be destroyed part way through a draw.
+	//	The timer thread draws on the display alongside the application (hence GDISP_NEED_MULTITHREAD).
+	static gfxMutex			asyncMutex;
+	static GTimer			asyncTimer;
+	static GImageObject *	asyncHead;
+
+	void _gimageInit(void) {
+		gfxMutexInit(&asyncMutex);
+		gtimerInit(&asyncTimer);
+	}
+
+	// Draw the rows that are ready. The drawing is clipped to the parts of the window that can be
+	//	seen and the application's clip is put back afterwards.
+	static bool_t _asyncPoll(GImageObject *gi) {
+		bool_t		done;
+		#if GDISP_NEED_CLIP
+			coord_t		x0, y0, x1, y1;
+		#endif
+		#if GWIN_NEED_WINDOWMANAGER && GDISP_NEED_CLIPREGION
+			bool_t		clipped;
+		#endif
+
+		#if GDISP_NEED_CLIP
+			x0 = GDISP.clipx0; y0 = GDISP.clipy0;
+			x1 = GDISP.clipx1; y1 = GDISP.clipy1;
+			gdispSetClip(gi->g.x, gi->g.y, gi->g.width, gi->g.height);
+		#endif
+		#if GWIN_NEED_WINDOWMANAGER && GDISP_NEED_CLIPREGION
+			clipped = _gwmPushVisible(&gi->g);
+		#endif
+		done = gdispImageAsyncPoll(&gi->async, TIME_IMMEDIATE);
+		#if GWIN_NEED_WINDOWMANAGER && GDISP_NEED_CLIPREGION
+			if (clipped)
+				gdispPopClip();
+		#endif
+		#if GDISP_NEED_CLIP
+			gdispSetClip(x0, y0, x1-x0, y1-y0);
+		#endif
+		return done;
+	}
+
+	static void _asyncTimer(void *param) {
+		GImageObject	**pp, *gi;
+		(void) param;
+
+		gfxMutexEnter(&asyncMutex);
+		for(pp = &asyncHead; (gi = *pp); ) {
+			// Stop drawing windows that have been made invisible
+			if (!(gi->g.flags & GWIN_FLG_VISIBLE))
+				gdispImageAsyncCancel(&gi->async);
+			else if (!_asyncPoll(gi)) {
+				pp = &gi->asyncNext;
+				continue;
+			}
+			*pp = gi->asyncNext;
+		}
+		if (!asyncHead)
+			gtimerStop(&asyncTimer);
+		gfxMutexExit(&asyncMutex);
+	}
+
+	// Start a background draw. Returns FALSE if the image must be drawn normally.
+	static bool_t _asyncStart(GHandle gh, coord_t x, coord_t y, coord_t cx, coord_t cy, coord_t sx, coord_t sy) {
+		// Images cached with gwinImageCache() are drawn quicker directly
+		if ((widget(gh)->image.flags & GDISP_IMAGE_FLG_CACHED))
+			return FALSE;
+		if (gdispImageDrawAsync(&widget(gh)->async, &widget(gh)->image, x, y, cx, cy, sx, sy, GDISP_IMAGE_ASYNC_PROGRESSIVE) != GDISP_IMAGE_ERR_OK)
+			return FALSE;
+
+		// Nothing to draw
+		if (!widget(gh)->async.priv)
+			return TRUE;
+
+		gfxMutexEnter(&asyncMutex);
+		widget(gh)->asyncNext = asyncHead;
+		asyncHead = widget(gh);
+		if (!gtimerIsActive(&asyncTimer))
+			gtimerStart(&asyncTimer, _asyncTimer, 0, TRUE, GIMAGE_ASYNC_PERIOD);
+		gfxMutexExit(&asyncMutex);
+		return TRUE;
+	}
+
+	// Cancel any background draw. Returns TRUE if there was one.
+	static bool_t _asyncCancel(GHandle gh) {
+		GImageObject	**pp;
+
+		gfxMutexEnter(&asyncMutex);
+		for(pp = &asyncHead; *pp; pp = &(*pp)->asyncNext) {
+			if (*pp == widget(gh)) {
+				*pp = widget(gh)->asyncNext;
+				gdispImageAsyncCancel(&widget(gh)->async);
+				gfxMutexExit(&asyncMutex);
+				return TRUE;
+			}
+		}
+		gfxMutexExit(&asyncMutex);
+		return FALSE;
+	}
+#else
+	#define _asyncCancel(gh)
+#endif
+
 static void _destroy(GWindowObject *gh) {
+	_asyncCancel(gh);
 	if (gdispImageIsOpen(&widget(gh)->image))
 		gdispImageClose(&widget(gh)->image);
 }
@@ -88,7 +196,12 @@ static void _redraw(GHandle gh) {
 	// Reset the background color in case it has changed
 	gdispImageSetBgColor(&widget(gh)->image, bg);
 
-	// Display the image
+	// Display the image. Still images can be decoded in the background and drawn as they arrive.
+	#if GWIN_NEED_IMAGE_ASYNC
+		_asyncCancel(gh);
+		if (_asyncStart(gh, x, y, w, h, dx, dy))
+			return;
+	#endif
 	gdispImageDraw(&widget(gh)->image, x, y, w, h, dx, dy);
 
 	#if GWIN_NEED_IMAGE_ANIMATION
@@ -138,6 +251,7 @@ GHandle gwinImageCreate(GImageObject *gobj, GWindowInit *pInit) {
 }
 
 bool_t gwinImageOpenMemory(GHandle gh, const void* memory) {
+	_asyncCancel(gh);
 	if (gdispImageIsOpen(&widget(gh)->image))
 		gdispImageClose(&widget(gh)->image);
 
@@ -161,6 +275,7 @@ bool_t gwinImageOpenMemory(GHandle gh, const void* memory) {
 
 #if defined(WIN32) || GFX_USE_OS_WIN32 || GFX_USE_OS_LINUX || GFX_USE_OS_OSX || defined(__DOXYGEN__)
 bool_t gwinImageOpenFile(GHandle gh, const char* filename) {
+	_asyncCancel(gh);
 	if (gdispImageIsOpen(&widget(gh)->image))
 		gdispImageClose(&widget(gh)->image);
 
@@ -185,6 +300,7 @@ bool_t gwinImageOpenFile(GHandle gh, const char* filename) {
 
 #if GFX_USE_OS_CHIBIOS || defined(__DOXYGEN__)
 bool_t gwinImageOpenStream(GHandle gh, void *streamPtr) {
+	_asyncCancel(gh);
 	if (gdispImageIsOpen(&widget(gh)->image))
 		gdispImageClose(&widget(gh)->image);
 
@@ -208,7 +324,23 @@ bool_t gwinImageOpenStream(GHandle gh, void *streamPtr) {
 #endif
 
 gdispImageError gwinImageCache(GHandle gh) {
-	return gdispImageCache(&widget(gh)->image);
+	#if GWIN_NEED_IMAGE_ASYNC
+		gdispImageError	err;
+
+		// The image can't be decoded twice at once. A cancelled background draw is finished from the cache.
+		if (!_asyncCancel(gh))
+			return gdispImageCache(&widget(gh)->image);
+		err = gdispImageCache(&widget(gh)->image);
+		if ((gh->flags & GWIN_FLG_VISIBLE)) {
+			#if GDISP_NEED_CLIP
+				gdispSetClip(gh->x, gh->y, gh->width, gh->height);
+			#endif
+			_redraw(gh);
+		}
+		return err;
+	#else
+		return gdispImageCache(&widget(gh)->image);
+	#endif
 }
 
 #endif // GFX_USE_GWIN && GWIN_NEED_IMAGE
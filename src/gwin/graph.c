@@ -19,6 +19,10 @@
 #define GGRAPH_FLG_CONNECTPOINTS			(GWIN_FIRST_CONTROL_FLAG<<0)
 #define GGRAPH_ARROW_SIZE					5
 
+// The ends and corners of thick lines. Round ends make consecutive segments drawn by lineto() join neatly.
+#define GGRAPH_THICK_CAP					capRound
+#define GGRAPH_THICK_JOIN					joinRound
+
 static const GGraphStyle GGraphDefaultStyle = {
 	{ GGRAPH_POINT_DOT, 0, White },			// point
 	{ GGRAPH_LINE_DOT, 2, Gray },			// line
@@ -98,6 +102,16 @@ static void lineto(GGraphObject *gg, coord_t x0, coord_t y0, coord_t x1, coord_t
 		run_off = -style->size;
 		break;
 
+	case GGRAPH_LINE_THICK:
+		#if GDISP_NEED_CONVEX_POLYGON
+			// Draw a thick line as a polygon
+			if (style->size > 1) {
+				gdispDrawThickLine(x0, y0, x1, y1, style->color, style->size, GGRAPH_THICK_CAP);
+				return;
+			}
+		#endif
+		// Fall through
+
 	case GGRAPH_LINE_SOLID:
 	default:
 		// Use the driver to draw a solid line
@@ -165,6 +179,40 @@ static void lineto(GGraphObject *gg, coord_t x0, coord_t y0, coord_t x1, coord_t
 	}
 }
 
+#if GDISP_NEED_CONVEX_POLYGON
+	#define GGRAPH_STROKE_POINTS				16
+
+	/*
+	 * Draw the connecting lines for a thick line style as a polyline so each corner is joined
+	 * rather than overdrawn. The points are converted to device space in chunks. Successive chunks
+	 * overlap by one segment so the join at the end of each chunk is still drawn correctly.
+	 */
+	static void strokepoints(GGraphObject *gg, const point *points, unsigned count) {
+		point		buf[GGRAPH_STROKE_POINTS];
+		unsigned	n;
+
+		n = 0;
+		if ((gg->g.flags & GGRAPH_FLG_CONNECTPOINTS)) {
+			buf[0].x = gg->g.x + gg->xorigin + gg->lastx;
+			buf[0].y = gg->g.y + gg->g.height - 1 - gg->yorigin - gg->lasty;
+			n = 1;
+		}
+		for(; count; count--, points++) {
+			if (n >= GGRAPH_STROKE_POINTS) {
+				gdispDrawThickPolyline(0, 0, buf, n, gg->style.line.color, gg->style.line.size, GGRAPH_THICK_JOIN, GGRAPH_THICK_CAP);
+				buf[0] = buf[n-2];
+				buf[1] = buf[n-1];
+				n = 2;
+			}
+			buf[n].x = gg->g.x + gg->xorigin + points->x;
+			buf[n].y = gg->g.y + gg->g.height - 1 - gg->yorigin - points->y;
+			n++;
+		}
+		if (n >= 2)
+			gdispDrawThickPolyline(0, 0, buf, n, gg->style.line.color, gg->style.line.size, GGRAPH_THICK_JOIN, GGRAPH_THICK_CAP);
+	}
+#endif
+
 GHandle gwinGraphCreate(GGraphObject *gg, const GWindowInit *pInit) {
 	if (!(gg = (GGraphObject *)_gwindowCreate(&gg->g, pInit, &graphVMT, 0)))
 		return 0;
@@ -306,25 +354,42 @@ void gwinGraphDrawPoints(GHandle gh, const point *points, unsigned count) {
 	if (gh->vmt != &graphVMT)
 		return;
 
-	// Draw the connecting lines
-	for(p = points, i = 0; i < count; p++, i++) {
-		if ((gh->flags & GGRAPH_FLG_CONNECTPOINTS)) {
-			// Draw the line
-			lineto(gg, gg->lastx, gg->lasty, p->x, p->y, &gg->style.line);
+	#if GDISP_NEED_CONVEX_POLYGON
+		// Draw thick connecting lines as a single joined polyline
+		if (gg->style.line.type == GGRAPH_LINE_THICK && gg->style.line.size > 1 && count) {
+			strokepoints(gg, points, count);
 
 			// Redraw the previous point because the line may have overwritten it
-			if (i == 0)
+			if ((gh->flags & GGRAPH_FLG_CONNECTPOINTS))
 				pointto(gg, gg->lastx, gg->lasty, &gg->style.point);
+			else
+				gh->flags |= GGRAPH_FLG_CONNECTPOINTS;
 
+			// Save the last point for next time.
+			gg->lastx = points[count-1].x;
+			gg->lasty = points[count-1].y;
 		} else
-			gh->flags |= GGRAPH_FLG_CONNECTPOINTS;
-
-		// Save this point for next time.
-		gg->lastx = p->x;
-		gg->lasty = p->y;
+	#endif
+	{
+		// Draw the connecting lines
+		for(p = points, i = 0; i < count; p++, i++) {
+			if ((gh->flags & GGRAPH_FLG_CONNECTPOINTS)) {
+				// Draw the line
+				lineto(gg, gg->lastx, gg->lasty, p->x, p->y, &gg->style.line);
+
+				// Redraw the previous point because the line may have overwritten it
+				if (i == 0)
+					pointto(gg, gg->lastx, gg->lasty, &gg->style.point);
+
+			} else
+				gh->flags |= GGRAPH_FLG_CONNECTPOINTS;
+
+			// Save this point for next time.
+			gg->lastx = p->x;
+			gg->lasty = p->y;
+		}
 	}
 
-
 	// Draw the points.
 	for(p = points, i = 0; i < count; p++, i++)
 		pointto(gg, p->x, p->y, &gg->style.point);
@@ -86,6 +86,11 @@ void _gwinInit(void) {
 
 		_gwmInit();
 	#endif
+	#if GWIN_NEED_IMAGE && GWIN_NEED_IMAGE_ASYNC
+		extern void _gimageInit(void);
+
+		_gimageInit();
+	#endif
 }
 
 // Internal routine for use by GWIN components only
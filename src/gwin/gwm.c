@@ -90,6 +90,33 @@ GWindowMinMax gwinGetMinMax(GHandle gh) {
  * Window Manager Routines
  *-----------------------------------------------*/
 
+#if GDISP_NEED_CLIPREGION
+	// Clip drawing to the parts of the window that are not covered by windows above it.
+	// Returns FALSE if that can't be done in which case the whole window should be drawn.
+	static bool_t WM_PushVisible(GHandle gh) {
+		const gfxQueueASyncItem *	qi;
+		GHandle						gx;
+		gdispRegion					rgn;
+
+		gdispRegionSet(&rgn, gh->x, gh->y, gh->width, gh->height);
+
+		// Windows later in the list are higher in the z-order
+		for(qi = gfxQueueASyncNext(&gh->wmq); qi; qi = gfxQueueASyncNext(qi)) {
+			gx = QItem2GWindow(qi);
+			if ((gx->flags & GWIN_FLG_VISIBLE) && !gdispRegionSubtract(&rgn, gx->x, gx->y, gx->width, gx->height))
+				return FALSE;
+		}
+		return gdispPushClip(&rgn);
+	}
+
+	bool_t _gwmPushVisible(GHandle gh) {
+		// Only this window manager keeps _GWINList in z-order
+		if (_GWINwm != (GWindowManager *)&GNullWindowManager)
+			return FALSE;
+		return WM_PushVisible(gh);
+	}
+#endif
+
 static void WM_Init(void) {
 	// We don't need to do anything here.
 	// A full window manager would move the windows around, add borders etc
@@ -131,11 +158,18 @@ static void WM_Visible(GHandle gh) {
 		gdispSetClip(gh->x, gh->y, gh->width, gh->height);
 	#endif
 	if ((gh->flags & GWIN_FLG_VISIBLE)) {
+		#if GDISP_NEED_CLIPREGION
+			bool_t	clipped = WM_PushVisible(gh);
+		#endif
 		if (gh->vmt->Redraw)
 			gh->vmt->Redraw(gh);
 		else
 			gdispFillArea(gh->x, gh->y, gh->width, gh->height, gh->bgcolor);
 		// A real window manager would also redraw the borders here
+		#if GDISP_NEED_CLIPREGION
+			if (clipped)
+				gdispPopClip();
+		#endif
 	} else
 		gdispFillArea(gh->x, gh->y, gh->width, gh->height, gwinGetDefaultBgColor());
 }
@@ -170,6 +204,13 @@ static void WM_Redim(GHandle gh, coord_t x, coord_t y, coord_t w, coord_t h) {
 			#if GDISP_NEED_CLIP
 				gdispSetClip(gh->x, gh->y, gh->width, gh->height);
 			#endif
+			#if GDISP_NEED_CLIPREGION
+				if (WM_PushVisible(gh)) {
+					gh->vmt->Redraw(gh);
+					gdispPopClip();
+					return;
+				}
+			#endif
 			gh->vmt->Redraw(gh);
 		}
 	}
@@ -192,6 +233,14 @@ static void WM_Raise(GHandle gh) {
 			#if GDISP_NEED_CLIP
 				gdispSetClip(gh->x, gh->y, gh->width, gh->height);
 			#endif
+			#if GDISP_NEED_CLIPREGION
+				// Recalculate what is visible now that the window is on top
+				if (WM_PushVisible(gh)) {
+					gh->vmt->Redraw(gh);
+					gdispPopClip();
+					return;
+				}
+			#endif
 			gh->vmt->Redraw(gh);
 		}
 	}
@@ -6,6 +6,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <string.h>
 #ifdef WIN32
@@ -14,6 +15,336 @@
 
 static unsigned char buf[1024];
 
+/* A converted native image */
+static unsigned char *	native;
+static size_t			nativelen;
+static size_t			nativepos;
+
+#define ROW_RAW		0
+#define ROW_RLE		1
+#define ROW_LZ		2
+
+static void put32le(unsigned char *p, unsigned long v) {
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+static unsigned long get16le(const unsigned char *p) {
+	return p[0] | ((unsigned long)p[1] << 8);
+}
+
+static unsigned long get32le(const unsigned char *p) {
+	return p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/* Convert a 0xRRGGBB color to a pixel format. These must match RGB2COLOR() in gdisp.h */
+static int pixelsize(int fmt) {
+	switch(fmt) {
+	case 1:		case 332:	return 1;
+	case 565:	case 444:	return 2;
+	case 888:	case 666:	return 4;
+	}
+	return 0;
+}
+
+static unsigned long rgb2pixel(unsigned long c, int fmt) {
+	unsigned long	r, g, b;
+
+	r = (c >> 16) & 0xFF;
+	g = (c >> 8) & 0xFF;
+	b = c & 0xFF;
+	switch(fmt) {
+	case 1:		return (r|g|b) ? 1 : 0;
+	case 332:	return (r & 0xE0) | ((g & 0xE0)>>3) | ((b & 0xC0)>>6);
+	case 565:	return ((r & 0xF8)<<8) | ((g & 0xFC)<<3) | ((b & 0xF8)>>3);
+	case 444:	return ((r & 0xF0)<<4) | (g & 0xF0) | ((b & 0xF0)>>4);
+	case 888:	return c & 0xFFFFFF;
+	case 666:	return ((r & 0xFC)<<10) | ((g & 0xFC)<<4) | ((b & 0xFC)>>2);
+	}
+	return 0;
+}
+
+/* Read an uncompressed BMP into 0xRRGGBB colors */
+static unsigned long *readbmp(FILE *f, unsigned *pw, unsigned *ph) {
+	unsigned char	hdr[54];
+	unsigned char	pal[256*4];
+	unsigned char *	row;
+	unsigned long *	rgb;
+	unsigned long	off, hsize, comp, ncolors, stride, v;
+	long			w, h;
+	unsigned		bpp, x, y, i;
+	int				topdown;
+
+	if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || hdr[0] != 'B' || hdr[1] != 'M')
+		return 0;
+	off = get32le(hdr+10);
+	hsize = get32le(hdr+14);
+	if (hsize < 40)
+		return 0;
+	w = (long)get32le(hdr+18);
+	h = (long)get32le(hdr+22);
+	if (h & 0x80000000L) h -= 0x100000000L;
+	topdown = h < 0;
+	if (topdown) h = -h;
+	bpp = (unsigned)get16le(hdr+28);
+	comp = get32le(hdr+30);
+	ncolors = get32le(hdr+46);
+	if (w < 1 || w > 32767 || h < 1 || h > 32767 || comp != 0 || (bpp != 1 && bpp != 4 && bpp != 8 && bpp != 24 && bpp != 32))
+		return 0;
+	if (bpp <= 8) {
+		if (!ncolors || ncolors > (1UL << bpp))
+			ncolors = 1UL << bpp;
+		if (fseek(f, 14 + hsize, SEEK_SET) || fread(pal, 4, ncolors, f) != ncolors)
+			return 0;
+	}
+	stride = ((w * bpp + 31) >> 5) << 2;
+	row = (unsigned char *)malloc(stride);
+	rgb = (unsigned long *)malloc(w * h * sizeof(unsigned long));
+	if (!row || !rgb || fseek(f, off, SEEK_SET))
+		goto bad;
+	for(y = 0; y < (unsigned)h; y++) {
+		if (fread(row, 1, stride, f) != stride)
+			goto bad;
+		for(x = 0; x < (unsigned)w; x++) {
+			switch(bpp) {
+			case 24:	v = get32le(row+x*3) & 0xFFFFFF;		break;
+			case 32:	v = get32le(row+x*4) & 0xFFFFFF;		break;
+			default:
+				i = (row[x*bpp/8] >> (8 - bpp - (x*bpp & 7))) & ((1 << bpp) - 1);
+				v = i < ncolors ? get32le(pal+i*4) & 0xFFFFFF : 0;
+				break;
+			}
+			rgb[(topdown ? y : h-1-y) * w + x] = v;
+		}
+	}
+	free(row);
+	*pw = (unsigned)w;
+	*ph = (unsigned)h;
+	return rgb;
+
+bad:
+	free(row);
+	free(rgb);
+	return 0;
+}
+
+/* Put a pixel in little endian order */
+static unsigned char *putpixel(unsigned char *p, unsigned long c, int psize) {
+	while(psize--) {
+		*p++ = (unsigned char)c;
+		c >>= 8;
+	}
+	return p;
+}
+
+/* Put a LZ length extension */
+static unsigned char *putlen(unsigned char *p, unsigned long n) {
+	for(; n >= 255; n -= 255)
+		*p++ = 255;
+	*p++ = (unsigned char)n;
+	return p;
+}
+
+/* Run length encode a row. See decodeRLE() in image_native.c */
+static size_t rlerow(unsigned char *out, const unsigned long *px, unsigned w, int psize) {
+	unsigned char *	p;
+	unsigned		x, n, lit;
+
+	p = out;
+	for(x = 0; x < w;) {
+		/* Count the repeats */
+		for(n = 1; x+n < w && n < 128 && px[x+n] == px[x]; n++);
+		if (n >= (psize == 1 ? 3U : 2U)) {
+			*p++ = (unsigned char)(0x80 | (n-1));
+			p = putpixel(p, px[x], psize);
+			x += n;
+			continue;
+		}
+
+		/* Count the literals - until the next worthwhile repeat */
+		for(lit = 1; x+lit < w && lit < 128; lit++) {
+			if (x+lit+1 < w && px[x+lit] == px[x+lit+1] && (psize > 1 || (x+lit+2 < w && px[x+lit] == px[x+lit+2])))
+				break;
+		}
+		*p++ = (unsigned char)(lit-1);
+		for(; lit; lit--)
+			p = putpixel(p, px[x++], psize);
+	}
+	return p - out;
+}
+
+/* LZ compress a row. See decodeLZ() in image_native.c */
+#define LZ_HASH_BITS	12
+#define LZ_MAX_TRIES	64
+static size_t lzrow(unsigned char *out, const unsigned long *px, unsigned w, int psize) {
+	static long		head[1<<LZ_HASH_BITS];
+	static long *	chain;
+	static unsigned	chainlen;
+	unsigned char *	p;
+	unsigned long	h;
+	unsigned		x, lit, n, best, bestoff, tries;
+	long			c;
+
+	if (chainlen < w) {
+		free(chain);
+		chainlen = w;
+		chain = (long *)malloc(w * sizeof(long));
+	}
+	for(x = 0; x < (1<<LZ_HASH_BITS); x++)
+		head[x] = -1;
+
+	p = out;
+	for(x = lit = 0; x < w;) {
+		/* Find the longest match of at least 2 pixels */
+		best = bestoff = 0;
+		if (x+1 < w) {
+			h = ((px[x] * 2654435761UL) ^ (px[x+1] * 40503UL)) & ((1<<LZ_HASH_BITS)-1);
+			for(c = head[h], tries = 0; c >= 0 && tries < LZ_MAX_TRIES && x - c <= 0xFFFF; c = chain[c], tries++) {
+				for(n = 0; x+n < w && px[c+n] == px[x+n]; n++);
+				if (n > best) {
+					best = n;
+					bestoff = x - c;
+				}
+			}
+			chain[x] = head[h];
+			head[h] = x;
+		}
+
+		/* Only take matches that save space */
+		if (best < 2 || best * psize < 4) {
+			x++;
+			lit++;
+			continue;
+		}
+
+		/* Output the sequence */
+		*p++ = (unsigned char)(((lit >= 15 ? 15 : lit) << 4) | (best-2 >= 15 ? 15 : best-2));
+		if (lit >= 15)
+			p = putlen(p, lit-15);
+		for(n = x - lit; n < x; n++)
+			p = putpixel(p, px[n], psize);
+		*p++ = (unsigned char)bestoff;
+		*p++ = (unsigned char)(bestoff >> 8);
+		if (best-2 >= 15)
+			p = putlen(p, best-2-15);
+
+		/* Add the matched pixels to the hash */
+		for(n = 1; n < best; n++) {
+			if (x+n+1 < w) {
+				h = ((px[x+n] * 2654435761UL) ^ (px[x+n+1] * 40503UL)) & ((1<<LZ_HASH_BITS)-1);
+				chain[x+n] = head[h];
+				head[h] = x+n;
+			}
+		}
+		x += best;
+		lit = 0;
+	}
+
+	/* The last literals end the row */
+	if (lit) {
+		*p++ = (unsigned char)((lit >= 15 ? 15 : lit) << 4);
+		if (lit >= 15)
+			p = putlen(p, lit-15);
+		for(n = w - lit; n < w; n++)
+			p = putpixel(p, px[n], psize);
+	}
+	return p - out;
+}
+
+/*
+ * Convert a BMP into a compressed (version 2) native image. See image.h for the format.
+ * Each row uses whichever of raw, run length or LZ encoding is smallest.
+ */
+static int tonative(FILE *f, int fmt) {
+	unsigned long *	rgb;
+	unsigned char *	rle;
+	unsigned char *	lz;
+	unsigned char *	p;
+	unsigned		w, h, x, y;
+	int				psize, method;
+	size_t			datapos, pos, rowlen, rlelen, lzlen, len;
+
+	if (!(psize = pixelsize(fmt))) {
+		fprintf(stderr, "Unknown pixel format %d\n", fmt);
+		return 0;
+	}
+	if (!(rgb = readbmp(f, &w, &h))) {
+		fprintf(stderr, "The input file must be an uncompressed 1, 4, 8, 24 or 32 bit BMP\n");
+		return 0;
+	}
+	for(x = 0; x < w * h; x++)
+		rgb[x] = rgb2pixel(rgb[x], fmt);
+
+	/* The worst case is every row raw with padding */
+	rowlen = w * psize;
+	datapos = 12 + (h+1) * 4;
+	native = (unsigned char *)malloc(datapos + h * (rowlen + psize));
+	rle = (unsigned char *)malloc(rowlen + rowlen/128 + 16);
+	lz = (unsigned char *)malloc(rowlen + rowlen/8 + 16);
+	if (!native || !rle || !lz) {
+		fprintf(stderr, "Out of memory\n");
+		return 0;
+	}
+
+	/* The header */
+	native[0] = 'N';
+	native[1] = 'Z';
+	native[2] = (unsigned char)(w >> 8);
+	native[3] = (unsigned char)w;
+	native[4] = (unsigned char)(h >> 8);
+	native[5] = (unsigned char)h;
+	native[6] = (unsigned char)(fmt >> 8);
+	native[7] = (unsigned char)fmt;
+	native[8] = (unsigned char)psize;
+	native[9] = 0;						/* The pixels are little endian - see putpixel() */
+	native[10] = native[11] = 0;
+
+	/* The rows */
+	for(pos = 0, y = 0; y < h; y++) {
+		rlelen = rlerow(rle, rgb + y * w, w, psize);
+		lzlen = lzrow(lz, rgb + y * w, w, psize);
+		if (rlelen < rowlen && rlelen <= lzlen) {
+			method = ROW_RLE;
+			memcpy(native + datapos + pos, rle, len = rlelen);
+		} else if (lzlen < rowlen) {
+			method = ROW_LZ;
+			memcpy(native + datapos + pos, lz, len = lzlen);
+		} else {
+			/* Raw rows are aligned so they can be drawn in place */
+			while((pos % psize))
+				native[datapos + pos++] = 0;
+			method = ROW_RAW;
+			p = native + datapos + pos;
+			for(x = 0; x < w; x++)
+				p = putpixel(p, rgb[y * w + x], psize);
+			len = rowlen;
+		}
+		put32le(native + 12 + y * 4, pos | ((unsigned long)method << 30));
+		pos += len;
+	}
+	put32le(native + 12 + h * 4, pos);
+	nativelen = datapos + pos;
+	nativepos = 0;
+
+	fprintf(stderr, "Native image %ux%u: %lu bytes (%lu uncompressed)\n", w, h, (unsigned long)nativelen, (unsigned long)(8 + w * h * psize));
+	free(rgb);
+	free(rle);
+	free(lz);
+	return 1;
+}
+
+static size_t readinput(FILE *f, unsigned char *p, size_t len) {
+	if (!native)
+		return fread(p, 1, len, f);
+	if (len > nativelen - nativepos)
+		len = nativelen - nativepos;
+	memcpy(p, native + nativepos, len);
+	nativepos += len;
+	return len;
+}
+
 static char *filenameof(char *fname) {
 	char *p;
 
@@ -44,6 +375,8 @@ char *		opt_inputfile;
 char *		opt_outputfile;
 char *		opt_arrayname;
 int			opt_breakblocks;
+int			opt_native;
+int			opt_raw;
 char *		opt_static;
 char *		opt_const;
 FILE *		f_input;
@@ -58,6 +391,8 @@ size_t		i;
 	opt_outputfile = 0;
 	opt_arrayname = 0;
 	opt_breakblocks = 0;
+	opt_native = 0;
+	opt_raw = 0;
 	opt_static = "";
 	opt_const = "";
 
@@ -71,6 +406,9 @@ size_t		i;
 				case 'c':		opt_const = "const ";		break;
 				case 's':		opt_static = "static ";		break;
 				case 'n':		opt_arrayname = *++argv;	goto nextarg;
+				case 'i':		if (!*++argv) goto usage;
+								opt_native = atoi(*argv);	goto nextarg;
+				case 'r':		opt_raw = 1;				break;
 				default:
 					fprintf(stderr, "Unknown flag -%c\n", argv[0][0]);
 					goto usage;
@@ -83,13 +421,16 @@ size_t		i;
 		else {
 			usage:
 			fprintf(stderr, "Usage:\n\t%s -?\n"
-							"\t%s [-bs] [-n name] [inputfile] [outputfile]\n"
+							"\t%s [-bcsr] [-n name] [-i format] [inputfile] [outputfile]\n"
 							"\t\t-?\tThis help\n"
 							"\t\t-h\tThis help\n"
 							"\t\t-b\tBreak the arrays for compilers that won't handle large arrays\n"
 							"\t\t-c\tDeclare the arrays as const (useful to ensure they end up in Flash)\n"
 							"\t\t-s\tDeclare the arrays as static\n"
 							"\t\t-n name\tUse \"name\" as the name of the array\n"
+							"\t\t-i format\tConvert a BMP to a compressed native image for the pixel format\n"
+							"\t\t\t\t(1, 332, 444, 565, 666 or 888 - the GDISP_PIXELFORMAT number)\n"
+							"\t\t-r\tWrite the raw bytes rather than a c array\n"
 					, opt_progname, opt_progname);
 			return 1;
 		}
@@ -115,15 +456,31 @@ size_t		i;
 #endif
 	}
 
+	/* Convert the image */
+	if (opt_native && !tonative(f_input, opt_native))
+		return 1;
+
 	/* Open the output file */
 	if (opt_outputfile) {
-		f_output = fopen(opt_outputfile, "w");
+		f_output = fopen(opt_outputfile, opt_raw ? "wb" : "w");
 		if (!f_output) {
 			fprintf(stderr, "Could not open output file '%s'\n", opt_outputfile);
 			goto usage;
 		}
-	} else
+	} else {
 		f_output = stdout;
+#ifdef WIN32
+		if (opt_raw)
+			_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	}
+
+	/* Just copy the bytes */
+	if (opt_raw) {
+		while((len = readinput(f_input, buf, sizeof(buf))))
+			fwrite(buf, 1, len, f_output);
+		goto cleanup;
+	}
 
 	/* Print the comment header */
 	fprintf(f_output, "/**\n * This file was generated ");
@@ -136,6 +493,7 @@ size_t		i;
 		if (opt_static[0]) fprintf(f_output, "s");
 		if (opt_arrayname) fprintf(f_output, "n %s", opt_arrayname);
 	}
+	if (opt_native) fprintf(f_output, " -i %d", opt_native);
 	if (opt_inputfile) fprintf(f_output, " %s", opt_inputfile);
 	if (opt_outputfile) fprintf(f_output, " %s", opt_outputfile);
 	fprintf(f_output, "\n *\n */\n");
@@ -155,7 +513,7 @@ size_t		i;
 
 	/* Read the file processing 1K at a time */
 	blocknum = 0;
-	while((len = fread(buf, 1, sizeof(buf), f_input))) {
+	while((len = readinput(f_input, buf, sizeof(buf)))) {
 		if (!blocknum++)
 			fprintf(f_output, "%s%sunsigned char %s[] = {", opt_static, opt_const, opt_arrayname);
 		else if (opt_breakblocks)
@@ -167,6 +525,7 @@ size_t		i;
 	fprintf(f_output, "\n};\n");
 
 	/* Clean up */
+cleanup:
 	if (ferror(f_input))
 		fprintf(stderr, "Input file read error\n");
 	if (ferror(f_output))
@@ -0,0 +1,44 @@
+/*
+ * This file is subject to the terms of the GFX License. If a copy of
+ * the license was not distributed with this file, you can obtain one at:
+ *
+ *              http://ugfx.org/license.html
+ */
+
+#ifndef _GFXCONF_H
+#define _GFXCONF_H
+
+/* The operating system to use - one of these must be defined */
+#define GFX_USE_OS_CHIBIOS		FALSE
+#define GFX_USE_OS_WIN32		FALSE
+#define GFX_USE_OS_LINUX		TRUE
+#define GFX_USE_OS_OSX			FALSE
+
+/* GFX sub-systems to turn on */
+#define GFX_USE_GDISP			TRUE
+
+/* Features for the GDISP sub-system. Turn on everything the trace might use. */
+#define GDISP_NEED_VALIDATION	TRUE
+#define GDISP_NEED_CLIP			TRUE
+#define GDISP_NEED_CLIPREGION	TRUE
+#define GDISP_NEED_TEXT			TRUE
+#define GDISP_NEED_CIRCLE		TRUE
+#define GDISP_NEED_ELLIPSE		TRUE
+#define GDISP_NEED_ARC			TRUE
+#define GDISP_NEED_SCROLL		FALSE
+#define GDISP_NEED_PIXELREAD	FALSE
+#define GDISP_NEED_CONTROL		TRUE
+#define GDISP_NEED_MULTITHREAD	FALSE
+#define GDISP_NEED_ASYNC		FALSE
+#define GDISP_NEED_MSGAPI		FALSE
+#define GDISP_NEED_STATISTICS	TRUE
+#define GDISP_NEED_TRACE		TRUE
+
+/* Text is replayed as drawing calls but the makefile builds the font code so it needs one font */
+#define GDISP_INCLUDE_FONT_UI2	TRUE
+
+/* Time each operation with the processor clock (in microseconds on Linux) */
+#include <time.h>
+#define GDISP_STATISTICS_COUNTER()	((uint32_t)clock())
+
+#endif /* _GFXCONF_H */
@@ -0,0 +1,61 @@
+/*
+ * This file is subject to the terms of the GFX License. If a copy of
+ * the license was not distributed with this file, you can obtain one at:
+ *
+ *              http://ugfx.org/license.html
+ */
+
+/*
+ * Replay a GDISP trace captured with gdispTraceStart() on the display
+ * this program is built with and report how long it took.
+ *
+ *	Usage: gdisp_replay tracefile [repeat]
+ */
+
+#include "gfx.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static size_t readfile(void *param, void *buf, size_t len) {
+	return fread(buf, 1, len, (FILE *)param);
+}
+
+int main(int argc, char *argv[]) {
+	gdispTraceResult	res;
+	FILE *				f;
+	int					i, repeat;
+	uint32_t			total;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s tracefile [repeat]\n", argv[0]);
+		return 1;
+	}
+	repeat = argc > 2 ? atoi(argv[2]) : 1;
+	if (repeat < 1)
+		repeat = 1;
+	if (!(f = fopen(argv[1], "rb"))) {
+		fprintf(stderr, "Can't open %s\n", argv[1]);
+		return 1;
+	}
+
+	gfxInit();
+
+	for(total = 0, i = 0; i < repeat; i++) {
+		rewind(f);
+		gdispClear(Black);
+		if (!gdispTraceReplay(readfile, f, &res)) {
+			fprintf(stderr, "Replay failed after %lu records - the trace is invalid or uses an operation not built in\n", (unsigned long)res.records);
+			return 1;
+		}
+		total += res.replayMs;
+		printf("Run %d: %lu records, captured %lums, replayed %lums\n", i+1,
+			(unsigned long)res.records, (unsigned long)res.captureMs, (unsigned long)res.replayMs);
+	}
+	fclose(f);
+	printf("Average replay %lums\n", (unsigned long)(total / repeat));
+
+	#if GDISP_NEED_STATISTICS
+		gdispDumpStats();
+	#endif
+	return 0;
+}